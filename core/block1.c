@@ -0,0 +1,230 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Reassembly of request payloads received with the Block1 option (RFC 7959).
+ *
+ * A transfer is identified by the peer session, the request method and the
+ * URI path. Blocks must be received in order. The buffer grows geometrically
+ * so that a transfer costs linear copies.
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+struct _lwm2m_block1_data_
+{
+    lwm2m_block1_data_t *   next;
+    void *                  sessionH;
+    uint8_t                 code;
+    char *                  uriPath;
+    uint8_t *               buffer;
+    size_t                  length;
+    size_t                  capacity;
+    time_t                  lastTime;
+};
+
+static void prv_free(lwm2m_block1_data_t * block1P)
+{
+    if (block1P->uriPath != NULL) lwm2m_free(block1P->uriPath);
+    if (block1P->buffer != NULL) lwm2m_free(block1P->buffer);
+    lwm2m_free(block1P);
+}
+
+static void prv_remove(lwm2m_context_t * contextP,
+                       lwm2m_block1_data_t * block1P)
+{
+    if (contextP->block1List == block1P)
+    {
+        contextP->block1List = block1P->next;
+    }
+    else
+    {
+        lwm2m_block1_data_t * previousP;
+
+        previousP = contextP->block1List;
+        while (previousP != NULL && previousP->next != block1P)
+        {
+            previousP = previousP->next;
+        }
+        if (previousP != NULL) previousP->next = block1P->next;
+    }
+    prv_free(block1P);
+}
+
+static lwm2m_block1_data_t * prv_find(lwm2m_context_t * contextP,
+                                      void * sessionH,
+                                      coap_packet_t * message)
+{
+    lwm2m_block1_data_t * block1P;
+
+    for (block1P = contextP->block1List ; block1P != NULL ; block1P = block1P->next)
+    {
+        if (block1P->sessionH == sessionH
+         && block1P->code == message->code
+         && uri_matchPath(block1P->uriPath, message->uri_path))
+        {
+            return block1P;
+        }
+    }
+
+    return NULL;
+}
+
+static bool prv_append(lwm2m_block1_data_t * block1P,
+                       uint8_t * buffer,
+                       size_t length)
+{
+    if (block1P->length + length > block1P->capacity)
+    {
+        uint8_t * newBuffer;
+        size_t capacity;
+
+        capacity = block1P->capacity * 2;
+        if (capacity < block1P->length + length) capacity = block1P->length + length;
+        if (capacity > LWM2M_BLOCK1_MAX_SIZE) capacity = LWM2M_BLOCK1_MAX_SIZE;
+
+        newBuffer = (uint8_t *)lwm2m_malloc(capacity);
+        if (newBuffer == NULL) return false;
+        if (block1P->length > 0) memcpy(newBuffer, block1P->buffer, block1P->length);
+        if (block1P->buffer != NULL) lwm2m_free(block1P->buffer);
+        block1P->buffer = newBuffer;
+        block1P->capacity = capacity;
+    }
+
+    memcpy(block1P->buffer + block1P->length, buffer, length);
+    block1P->length += length;
+
+    return true;
+}
+
+coap_status_t block1_handle_request(lwm2m_context_t * contextP,
+                                    void * fromSessionH,
+                                    coap_packet_t * message,
+                                    uint8_t ** bufferP,
+                                    size_t * lengthP)
+{
+    lwm2m_block1_data_t * block1P;
+    uint32_t blockNum;
+    uint8_t blockMore;
+    uint16_t blockSize;
+    uint32_t blockOffset;
+    struct timeval tv;
+
+    *bufferP = NULL;
+    *lengthP = 0;
+
+    coap_get_header_block1(message, &blockNum, &blockMore, &blockSize, &blockOffset);
+    if (0 != utils_gettimeofday(contextP, &tv)) return COAP_500_INTERNAL_SERVER_ERROR;
+
+    block1P = prv_find(contextP, fromSessionH, message);
+
+    if (blockNum == 0)
+    {
+        // (re)start of a transfer
+        if (block1P != NULL) prv_remove(contextP, block1P);
+
+        block1P = (lwm2m_block1_data_t *)lwm2m_malloc(sizeof(lwm2m_block1_data_t));
+        if (block1P == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+        memset(block1P, 0, sizeof(lwm2m_block1_data_t));
+        block1P->sessionH = fromSessionH;
+        block1P->code = message->code;
+        block1P->uriPath = coap_get_multi_option_as_string(message->uri_path);
+        if (block1P->uriPath == NULL)
+        {
+            lwm2m_free(block1P);
+            return COAP_500_INTERNAL_SERVER_ERROR;
+        }
+        block1P->next = contextP->block1List;
+        contextP->block1List = block1P;
+    }
+    else
+    {
+        if (block1P == NULL) return COAP_408_REQUEST_ENTITY_INCOMPLETE;
+
+        if (blockOffset < block1P->length
+         && blockOffset + message->payload_len == block1P->length)
+        {
+            // retransmission of the last block
+            block1P->lastTime = tv.tv_sec;
+            return blockMore ? COAP_231_CONTINUE : COAP_408_REQUEST_ENTITY_INCOMPLETE;
+        }
+        if (blockOffset != block1P->length)
+        {
+            prv_remove(contextP, block1P);
+            return COAP_408_REQUEST_ENTITY_INCOMPLETE;
+        }
+    }
+
+    // only the last block may be smaller than the block size
+    if ((blockMore && message->payload_len != blockSize)
+     || block1P->length + message->payload_len > LWM2M_BLOCK1_MAX_SIZE)
+    {
+        prv_remove(contextP, block1P);
+        return blockMore && message->payload_len != blockSize ? COAP_400_BAD_REQUEST : COAP_413_ENTITY_TOO_LARGE;
+    }
+
+    if (!prv_append(block1P, message->payload, message->payload_len))
+    {
+        prv_remove(contextP, block1P);
+        return COAP_500_INTERNAL_SERVER_ERROR;
+    }
+    block1P->lastTime = tv.tv_sec;
+
+    if (blockMore) return COAP_231_CONTINUE;
+
+    // hand over the reassembled payload
+    *bufferP = block1P->buffer;
+    *lengthP = block1P->length;
+    block1P->buffer = NULL;
+    prv_remove(contextP, block1P);
+
+    return COAP_NO_ERROR;
+}
+
+void block1_step(lwm2m_context_t * contextP,
+                 time_t currentTime)
+{
+    lwm2m_block1_data_t * block1P;
+
+    block1P = contextP->block1List;
+    while (block1P != NULL)
+    {
+        lwm2m_block1_data_t * nextP = block1P->next;
+
+        // the peer gave up the transfer
+        if (block1P->lastTime + COAP_EXCHANGE_LIFETIME <= currentTime)
+        {
+            prv_remove(contextP, block1P);
+        }
+        block1P = nextP;
+    }
+}
+
+void block1_close(lwm2m_context_t * contextP)
+{
+    while (contextP->block1List != NULL)
+    {
+        lwm2m_block1_data_t * block1P;
+
+        block1P = contextP->block1List;
+        contextP->block1List = block1P->next;
+        prv_free(block1P);
+    }
+}
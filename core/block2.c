@@ -0,0 +1,535 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Reassembly of responses received with the Block2 option (RFC 7959).
+ *
+ * When the response to a GET holds the first block of a larger
+ * representation, the original transaction is taken out of the transaction
+ * list and the next blocks are requested by child transactions, up to
+ * lwm2m_context_t::block2Window at a time. Blocks are stored at their offset
+ * so they may arrive in any order. Once all of them are received, the
+ * callback of the original transaction gets a single response holding the
+ * whole payload.
+ *
+ * On the other side, a GET response larger than a block is kept when its
+ * first block is sent. The next blocks are sliced from it instead of reading
+ * the resource again for each block, so that a transfer costs linear work.
+ * Separate responses and notifications larger than a block are kept the
+ * same way. A response is identified by the peer session, the URI path and
+ * the requested format. It is released after its last block is sent or after
+ * COAP_EXCHANGE_LIFETIME.
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+
+#define PRV_UNKNOWN_NUM     0xFFFFFFFF
+
+struct _lwm2m_block2_data_
+{
+    lwm2m_block2_data_t *   next;
+    void *                  sessionH;
+    char *                  uriPath;
+    lwm2m_media_type_t      format;         // requested format
+    uint8_t                 hasContentType;
+    uint16_t                contentType;
+    uint8_t                 etag[COAP_ETAG_LEN];
+    uint8_t                 etagLen;
+    uint8_t *               buffer;
+    size_t                  length;
+    time_t                  lastTime;
+};
+
+typedef struct
+{
+    lwm2m_context_t *       contextP;
+    lwm2m_transaction_t *   parentP;    // original request, not in the transaction list
+    uint8_t *               buffer;
+    size_t                  length;
+    size_t                  capacity;
+    uint16_t                size;
+    uint32_t                nextNum;    // next block to request
+    uint32_t                lastNum;    // last block of the representation
+    uint32_t                received;
+    uint8_t                 pending;    // child transactions in flight
+    bool                    isOver;     // delivered or failed, waiting for the pending children
+} prv_block2_data_t;
+
+static void prv_free(prv_block2_data_t * dataP)
+{
+    if (dataP->parentP != NULL) transaction_free(dataP->parentP);
+    if (dataP->buffer != NULL) lwm2m_free(dataP->buffer);
+    lwm2m_free(dataP);
+}
+
+// Store a block at its offset.
+static coap_status_t prv_store(prv_block2_data_t * dataP,
+                               uint32_t num,
+                               uint8_t * payload,
+                               size_t length)
+{
+    size_t offset;
+
+    offset = (size_t)num * dataP->size;
+    // the callback gets the payload in a coap_packet_t
+    if (offset + length > 0xFFFF) return COAP_413_ENTITY_TOO_LARGE;
+
+    if (offset + length > dataP->capacity)
+    {
+        uint8_t * newBuffer;
+        size_t capacity;
+
+        capacity = dataP->capacity * 2;
+        if (capacity < offset + length) capacity = offset + length;
+
+        newBuffer = (uint8_t *)lwm2m_malloc(capacity);
+        if (newBuffer == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+        if (dataP->length > 0) memcpy(newBuffer, dataP->buffer, dataP->length);
+        if (dataP->buffer != NULL) lwm2m_free(dataP->buffer);
+        dataP->buffer = newBuffer;
+        dataP->capacity = capacity;
+    }
+
+    memcpy(dataP->buffer + offset, payload, length);
+    if (offset + length > dataP->length) dataP->length = offset + length;
+    dataP->received++;
+
+    return COAP_NO_ERROR;
+}
+
+// Report an error to the original callback. A NULL message means a timeout.
+static void prv_fail(prv_block2_data_t * dataP,
+                     coap_packet_t * message,
+                     coap_status_t code)
+{
+    coap_packet_t packet;
+
+    if (message == NULL && code != COAP_NO_ERROR)
+    {
+        coap_init_message(&packet, COAP_TYPE_ACK, code, 0);
+        message = &packet;
+    }
+
+    if (dataP->parentP->callback != NULL)
+    {
+        dataP->parentP->callback(dataP->parentP, message);
+    }
+    dataP->isOver = true;
+}
+
+static void prv_deliver(prv_block2_data_t * dataP,
+                        coap_packet_t * lastBlockP)
+{
+    coap_packet_t packet;
+
+    // a response holding the whole representation
+    memcpy(&packet, lastBlockP, sizeof(coap_packet_t));
+    packet.options[COAP_OPTION_BLOCK2 / OPTION_MAP_SIZE] &= ~(1 << (COAP_OPTION_BLOCK2 % OPTION_MAP_SIZE));
+    packet.payload = dataP->buffer;
+    packet.payload_len = (uint16_t)dataP->length;
+
+    if (dataP->parentP->callback != NULL)
+    {
+        dataP->parentP->callback(dataP->parentP, &packet);
+    }
+    dataP->isOver = true;
+}
+
+static void prv_childCallback(lwm2m_transaction_t * transacP, void * message);
+
+static bool prv_request(prv_block2_data_t * dataP,
+                        uint32_t num)
+{
+    lwm2m_transaction_t * childP;
+    coap_packet_t * requestP;
+
+    childP = transaction_new(COAP_GET, NULL, dataP->contextP->nextMID++, dataP->parentP->peerType, dataP->parentP->peerP);
+    if (childP == NULL) return false;
+
+    // same request as the original one, options point inside its datagram until serialized
+    requestP = (coap_packet_t *)childP->message;
+    if (NO_ERROR != coap_parse_message(requestP, dataP->parentP->buffer, dataP->parentP->buffer_len))
+    {
+        transaction_free(childP);
+        return false;
+    }
+    requestP->mid = childP->mID;
+    transaction_set_token(childP, childP->mID);
+    requestP->options[COAP_OPTION_OBSERVE / OPTION_MAP_SIZE] &= ~(1 << (COAP_OPTION_OBSERVE % OPTION_MAP_SIZE));
+    coap_set_header_block2(requestP, num, 0, dataP->size);
+    coap_set_payload(requestP, NULL, 0);
+
+    childP->callback = prv_childCallback;
+    childP->userData = (void *)dataP;
+
+    dataP->contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(dataP->contextP->transactionList, childP);
+    dataP->pending++;
+
+    transaction_send(dataP->contextP, childP);
+
+    return true;
+}
+
+// Request the next blocks up to the window.
+static void prv_fill_window(prv_block2_data_t * dataP)
+{
+    uint8_t window;
+
+    window = dataP->contextP->block2Window;
+    if (window == 0) window = 1;
+
+    while (dataP->pending < window
+        && (dataP->lastNum == PRV_UNKNOWN_NUM || dataP->nextNum <= dataP->lastNum))
+    {
+        if (!prv_request(dataP, dataP->nextNum)) break;
+        dataP->nextNum++;
+    }
+}
+
+static void prv_childCallback(lwm2m_transaction_t * transacP,
+                              void * message)
+{
+    prv_block2_data_t * dataP = (prv_block2_data_t *)transacP->userData;
+    coap_packet_t * packet = (coap_packet_t *)message;
+    uint32_t num;
+
+    num = ((coap_packet_t *)transacP->message)->block2_num;
+    dataP->pending--;
+
+    if (!dataP->isOver)
+    {
+        if (packet == NULL)
+        {
+            prv_fail(dataP, NULL, COAP_NO_ERROR);
+        }
+        else if (packet->code == BAD_OPTION_4_02 && num > 0)
+        {
+            // speculative request past the end of the representation
+            if (dataP->lastNum == PRV_UNKNOWN_NUM || dataP->lastNum >= num)
+            {
+                dataP->lastNum = num - 1;
+            }
+        }
+        else if (packet->code != COAP_205_CONTENT)
+        {
+            prv_fail(dataP, packet, COAP_NO_ERROR);
+        }
+        else if (!IS_OPTION(packet, COAP_OPTION_BLOCK2)
+              || packet->block2_num != num
+              || packet->block2_size != dataP->size
+              || (packet->block2_more && packet->payload_len != dataP->size))
+        {
+            prv_fail(dataP, NULL, COAP_500_INTERNAL_SERVER_ERROR);
+        }
+        else
+        {
+            coap_status_t result;
+
+            if (!packet->block2_more) dataP->lastNum = num;
+
+            result = prv_store(dataP, num, packet->payload, packet->payload_len);
+            if (result != COAP_NO_ERROR)
+            {
+                prv_fail(dataP, NULL, result);
+            }
+            else if (dataP->lastNum != PRV_UNKNOWN_NUM && dataP->received == dataP->lastNum + 1)
+            {
+                prv_deliver(dataP, packet);
+            }
+        }
+
+        if (!dataP->isOver)
+        {
+            prv_fill_window(dataP);
+            // the peer stopped answering with the expected blocks
+            if (dataP->pending == 0) prv_fail(dataP, NULL, COAP_500_INTERNAL_SERVER_ERROR);
+        }
+    }
+
+    if (dataP->isOver && dataP->pending == 0) prv_free(dataP);
+}
+
+int block2_handle_response(lwm2m_context_t * contextP,
+                           lwm2m_transaction_t * transacP,
+                           coap_packet_t * message)
+{
+    prv_block2_data_t * dataP;
+    uint32_t totalSize;
+
+    if (transacP->callback == prv_childCallback
+     || transacP->buffer == NULL
+     || ((coap_packet_t *)transacP->message)->code != COAP_GET
+     || message->code != COAP_205_CONTENT
+     || !IS_OPTION(message, COAP_OPTION_BLOCK2)
+     || message->block2_num != 0
+     || !message->block2_more
+     || message->payload_len != message->block2_size)
+    {
+        return 0;
+    }
+
+    dataP = (prv_block2_data_t *)lwm2m_malloc(sizeof(prv_block2_data_t));
+    if (dataP == NULL) return 0;
+    memset(dataP, 0, sizeof(prv_block2_data_t));
+    dataP->contextP = contextP;
+    dataP->size = message->block2_size;
+    dataP->nextNum = 1;
+    dataP->lastNum = PRV_UNKNOWN_NUM;
+
+    // Size2 gives the number of blocks and avoids requests past the end
+    if (coap_get_header_size(message, &totalSize) && totalSize > dataP->size)
+    {
+        dataP->lastNum = (totalSize - 1) / dataP->size;
+    }
+
+    if (COAP_NO_ERROR != prv_store(dataP, 0, message->payload, message->payload_len))
+    {
+        lwm2m_free(dataP);
+        return 0;
+    }
+
+    // the original transaction is answered once all the blocks are received
+    transaction_unlink(contextP, transacP);
+    dataP->parentP = transacP;
+
+    prv_fill_window(dataP);
+    if (dataP->pending == 0)
+    {
+        prv_fail(dataP, NULL, COAP_500_INTERNAL_SERVER_ERROR);
+        prv_free(dataP);
+    }
+
+    return 1;
+}
+
+static void prv_responseFree(lwm2m_block2_data_t * block2P)
+{
+    if (block2P->uriPath != NULL) lwm2m_free(block2P->uriPath);
+    if (block2P->buffer != NULL) lwm2m_free(block2P->buffer);
+    lwm2m_free(block2P);
+}
+
+static lwm2m_block2_data_t * prv_responseFind(lwm2m_context_t * contextP,
+                                              void * sessionH,
+                                              coap_packet_t * message)
+{
+    lwm2m_block2_data_t * block2P;
+    lwm2m_media_type_t format;
+
+    format = data_getFormat(message, true);
+    for (block2P = contextP->block2List ; block2P != NULL ; block2P = block2P->next)
+    {
+        if (block2P->sessionH == sessionH
+         && block2P->format == format
+         && uri_matchPath(block2P->uriPath, message->uri_path))
+        {
+            return block2P;
+        }
+    }
+
+    return NULL;
+}
+
+lwm2m_block2_data_t * block2_keep_response(lwm2m_context_t * contextP,
+                                           void * fromSessionH,
+                                           coap_packet_t * message,
+                                           coap_packet_t * response)
+{
+    lwm2m_block2_data_t * block2P;
+    struct timeval tv;
+
+    if (0 != utils_gettimeofday(contextP, &tv)) return NULL;
+
+    // a new read of the same resource replaces the previous one
+    block2P = prv_responseFind(contextP, fromSessionH, message);
+    if (block2P != NULL) block2_remove_response(contextP, block2P);
+
+    block2P = (lwm2m_block2_data_t *)lwm2m_malloc(sizeof(lwm2m_block2_data_t));
+    if (block2P == NULL) return NULL;
+    memset(block2P, 0, sizeof(lwm2m_block2_data_t));
+    block2P->uriPath = coap_get_multi_option_as_string(message->uri_path);
+    if (block2P->uriPath == NULL)
+    {
+        lwm2m_free(block2P);
+        return NULL;
+    }
+    block2P->sessionH = fromSessionH;
+    block2P->format = data_getFormat(message, true);
+    if (IS_OPTION(response, COAP_OPTION_CONTENT_TYPE))
+    {
+        block2P->hasContentType = 1;
+        block2P->contentType = response->content_type;
+    }
+    if (IS_OPTION(response, COAP_OPTION_ETAG))
+    {
+        block2P->etagLen = response->etag_len;
+        memcpy(block2P->etag, response->etag, response->etag_len);
+    }
+    // the payload is now owned by the kept response
+    block2P->buffer = response->payload;
+    block2P->length = response->payload_len;
+    block2P->lastTime = tv.tv_sec;
+
+    block2P->next = contextP->block2List;
+    contextP->block2List = block2P;
+
+    return block2P;
+}
+
+bool block2_keep_blocks(lwm2m_context_t * contextP,
+                        void * sessionH,
+                        lwm2m_uri_t * uriP,
+                        lwm2m_media_type_t format,
+                        coap_packet_t * messageP,
+                        uint8_t * buffer,
+                        size_t length,
+                        uint16_t blockSize)
+{
+    coap_packet_t request[1];
+    char objStringID[LWM2M_STRING_ID_MAX_LEN];
+    char instanceStringID[LWM2M_STRING_ID_MAX_LEN];
+    char resourceStringID[LWM2M_STRING_ID_MAX_LEN];
+    lwm2m_block2_data_t * block2P;
+
+    // the next blocks are requested with the path and format of the original read
+    coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+    snprintf(objStringID, LWM2M_STRING_ID_MAX_LEN, "%hu", uriP->objectId);
+    coap_set_header_uri_path_segment(request, objStringID);
+    if (LWM2M_URI_IS_SET_INSTANCE(uriP))
+    {
+        snprintf(instanceStringID, LWM2M_STRING_ID_MAX_LEN, "%hu", uriP->instanceId);
+        coap_set_header_uri_path_segment(request, instanceStringID);
+    }
+    if (LWM2M_URI_IS_SET_RESOURCE(uriP))
+    {
+        snprintf(resourceStringID, LWM2M_STRING_ID_MAX_LEN, "%hu", uriP->resourceId);
+        coap_set_header_uri_path_segment(request, resourceStringID);
+    }
+    coap_set_header_accept(request, format);
+
+    messageP->payload = buffer;
+    messageP->payload_len = (uint16_t)length;
+    block2P = block2_keep_response(contextP, sessionH, request, messageP);
+    coap_free_header(request);
+    if (block2P == NULL) return false;
+
+    coap_set_header_size(messageP, (uint32_t)length);
+    coap_set_header_block2(messageP, 0, 1, blockSize);
+    coap_set_payload(messageP, buffer, blockSize);
+
+    return true;
+}
+
+lwm2m_block2_data_t * block2_read_response(lwm2m_context_t * contextP,
+                                           void * fromSessionH,
+                                           coap_packet_t * message,
+                                           coap_packet_t * response)
+{
+    lwm2m_block2_data_t * block2P;
+    struct timeval tv;
+
+    block2P = prv_responseFind(contextP, fromSessionH, message);
+    if (block2P == NULL) return NULL;
+
+    if (0 == utils_gettimeofday(contextP, &tv)) block2P->lastTime = tv.tv_sec;
+
+    coap_set_status_code(response, COAP_205_CONTENT);
+    if (block2P->hasContentType)
+    {
+        coap_set_header_content_type(response, block2P->contentType);
+    }
+    if (block2P->etagLen > 0)
+    {
+        coap_set_header_etag(response, block2P->etag, block2P->etagLen);
+    }
+    // the caller slices the requested block and does not free the payload
+    response->payload = block2P->buffer;
+    response->payload_len = (uint16_t)block2P->length;
+
+    return block2P;
+}
+
+void block2_remove_response(lwm2m_context_t * contextP,
+                            lwm2m_block2_data_t * block2P)
+{
+    if (contextP->block2List == block2P)
+    {
+        contextP->block2List = block2P->next;
+    }
+    else
+    {
+        lwm2m_block2_data_t * previousP;
+
+        previousP = contextP->block2List;
+        while (previousP != NULL && previousP->next != block2P)
+        {
+            previousP = previousP->next;
+        }
+        if (previousP != NULL) previousP->next = block2P->next;
+    }
+    prv_responseFree(block2P);
+}
+
+void block2_step(lwm2m_context_t * contextP,
+                 time_t currentTime)
+{
+    lwm2m_block2_data_t * block2P;
+
+    block2P = contextP->block2List;
+    while (block2P != NULL)
+    {
+        lwm2m_block2_data_t * nextP = block2P->next;
+
+        // the peer gave up the transfer
+        if (block2P->lastTime + COAP_EXCHANGE_LIFETIME <= currentTime)
+        {
+            block2_remove_response(contextP, block2P);
+        }
+        block2P = nextP;
+    }
+}
+
+void block2_close(lwm2m_context_t * contextP)
+{
+    lwm2m_transaction_t * transacP;
+
+    // the pending children are freed with the transaction list, without callbacks
+    for (transacP = contextP->transactionList ; transacP != NULL ; transacP = transacP->next)
+    {
+        if (transacP->callback == prv_childCallback)
+        {
+            prv_block2_data_t * dataP = (prv_block2_data_t *)transacP->userData;
+
+            transacP->callback = NULL;
+            dataP->pending--;
+            if (dataP->pending == 0) prv_free(dataP);
+        }
+    }
+
+    while (contextP->block2List != NULL)
+    {
+        lwm2m_block2_data_t * block2P;
+
+        block2P = contextP->block2List;
+        contextP->block2List = block2P->next;
+        prv_responseFree(block2P);
+    }
+}
@@ -0,0 +1,583 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Last known resource values of the registered clients.
+ *
+ * Responses to reads and notifications are decoded and stored per resource,
+ * with the time they were received. lwm2m_cache_read() returns a copy of a
+ * value received less than lwm2m_context_t::cacheMaxAge seconds ago.
+ *
+ * The last response to a read carrying an ETag is also kept. The ETag is
+ * sent with the next read of the same URI and a 2.03 Valid answer is
+ * replaced by the kept response before reaching the read callbacks. Kept
+ * responses are dropped lwm2m_context_t::etagMaxAge seconds after they were
+ * received, independently of the value cache.
+ *
+ * Successful writes and deletes drop the values they may have changed.
+ * cache_step() only walks the lists once the earliest expiry is due.
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LWM2M_SERVER_MODE
+
+struct _lwm2m_cache_entry_
+{
+    lwm2m_cache_entry_t *   next;
+    lwm2m_uri_t             uri;    // always a resource
+    lwm2m_tlv_t *           tlvP;   // a single resource, owns its values
+    time_t                  time;
+};
+
+struct _lwm2m_cache_response_
+{
+    lwm2m_cache_response_t *    next;
+    lwm2m_uri_t                 uri;
+    uint8_t                     etag[COAP_ETAG_LEN];
+    uint8_t                     etagLen;
+    lwm2m_media_type_t          format;
+    uint8_t *                   buffer;
+    size_t                      length;
+    time_t                      time;
+};
+
+// let cache_step() walk the lists at expiry
+static void prv_scheduleExpiry(lwm2m_context_t * contextP,
+                               time_t expiry)
+{
+    if (contextP->cacheExpiry == 0 || expiry < contextP->cacheExpiry)
+    {
+        contextP->cacheExpiry = expiry;
+    }
+}
+
+static bool prv_copy(lwm2m_tlv_t * srcP,
+                     lwm2m_tlv_t * dstP)
+{
+    memcpy(dstP, srcP, sizeof(lwm2m_tlv_t));
+    dstP->flags &= ~LWM2M_TLV_FLAG_STATIC_DATA;
+
+    if (srcP->type == LWM2M_TYPE_MULTIPLE_RESSOURCE
+     || srcP->type == LWM2M_TYPE_OBJECT_INSTANCE)
+    {
+        lwm2m_tlv_t * childrenP;
+        size_t i;
+
+        dstP->value = NULL;
+        dstP->length = 0;
+        if (srcP->length == 0) return true;
+
+        childrenP = lwm2m_tlv_new(srcP->length);
+        if (childrenP == NULL) return false;
+        for (i = 0 ; i < srcP->length ; i++)
+        {
+            if (!prv_copy((lwm2m_tlv_t *)srcP->value + i, childrenP + i))
+            {
+                lwm2m_tlv_free(i, childrenP);
+                return false;
+            }
+        }
+        dstP->value = (uint8_t *)childrenP;
+        dstP->length = srcP->length;
+    }
+    else
+    {
+        dstP->value = (uint8_t *)lwm2m_malloc(srcP->length > 0 ? srcP->length : 1);
+        if (dstP->value == NULL) return false;
+        memcpy(dstP->value, srcP->value, srcP->length);
+    }
+
+    return true;
+}
+
+static lwm2m_tlv_t * prv_duplicate(lwm2m_tlv_t * tlvP)
+{
+    lwm2m_tlv_t * copyP;
+
+    copyP = lwm2m_tlv_new(1);
+    if (copyP == NULL) return NULL;
+    if (!prv_copy(tlvP, copyP))
+    {
+        lwm2m_free(copyP);
+        return NULL;
+    }
+
+    return copyP;
+}
+
+static void prv_free(lwm2m_cache_entry_t * entryP)
+{
+    lwm2m_tlv_free(1, entryP->tlvP);
+    lwm2m_free(entryP);
+}
+
+static void prv_responseFree(lwm2m_cache_response_t * responseP)
+{
+    if (responseP->buffer != NULL) lwm2m_free(responseP->buffer);
+    lwm2m_free(responseP);
+}
+
+static lwm2m_cache_response_t * prv_responseFind(lwm2m_client_t * clientP,
+                                                 lwm2m_uri_t * uriP)
+{
+    lwm2m_cache_response_t * responseP;
+
+    for (responseP = clientP->responseList ; responseP != NULL ; responseP = responseP->next)
+    {
+        if (uri_isSame(&responseP->uri, uriP)) return responseP;
+    }
+
+    return NULL;
+}
+
+// true if one of the URIs designates a part of the other
+static bool prv_isOverlapping(lwm2m_uri_t * uri1P,
+                              lwm2m_uri_t * uri2P)
+{
+    if (uri1P->objectId != uri2P->objectId) return false;
+    if (!LWM2M_URI_IS_SET_INSTANCE(uri1P) || !LWM2M_URI_IS_SET_INSTANCE(uri2P)) return true;
+    if (uri1P->instanceId != uri2P->instanceId) return false;
+    if (!LWM2M_URI_IS_SET_RESOURCE(uri1P) || !LWM2M_URI_IS_SET_RESOURCE(uri2P)) return true;
+
+    return uri1P->resourceId == uri2P->resourceId;
+}
+
+static lwm2m_cache_entry_t * prv_find(lwm2m_client_t * clientP,
+                                      lwm2m_uri_t * uriP)
+{
+    lwm2m_cache_entry_t * entryP;
+
+    for (entryP = clientP->cacheList ; entryP != NULL ; entryP = entryP->next)
+    {
+        if (entryP->uri.objectId == uriP->objectId
+         && entryP->uri.instanceId == uriP->instanceId
+         && entryP->uri.resourceId == uriP->resourceId)
+        {
+            return entryP;
+        }
+    }
+
+    return NULL;
+}
+
+static void prv_store(lwm2m_client_t * clientP,
+                      uint16_t objectId,
+                      uint16_t instanceId,
+                      lwm2m_tlv_t * tlvP,
+                      time_t currentTime)
+{
+    lwm2m_cache_entry_t * entryP;
+    lwm2m_tlv_t * copyP;
+    lwm2m_uri_t uri;
+
+    if (tlvP->type != LWM2M_TYPE_RESSOURCE
+     && tlvP->type != LWM2M_TYPE_MULTIPLE_RESSOURCE)
+    {
+        return;
+    }
+
+    uri.flag = LWM2M_URI_FLAG_OBJECT_ID | LWM2M_URI_FLAG_INSTANCE_ID | LWM2M_URI_FLAG_RESOURCE_ID;
+    uri.objectId = objectId;
+    uri.instanceId = instanceId;
+    uri.resourceId = tlvP->id;
+
+    copyP = prv_duplicate(tlvP);
+    if (copyP == NULL) return;
+
+    entryP = prv_find(clientP, &uri);
+    if (entryP == NULL)
+    {
+        entryP = (lwm2m_cache_entry_t *)lwm2m_malloc(sizeof(lwm2m_cache_entry_t));
+        if (entryP == NULL)
+        {
+            lwm2m_tlv_free(1, copyP);
+            return;
+        }
+        memcpy(&entryP->uri, &uri, sizeof(lwm2m_uri_t));
+        entryP->next = clientP->cacheList;
+        clientP->cacheList = entryP;
+    }
+    else
+    {
+        lwm2m_tlv_free(1, entryP->tlvP);
+    }
+    entryP->tlvP = copyP;
+    entryP->time = currentTime;
+}
+
+void cache_update(lwm2m_context_t * contextP,
+                  lwm2m_client_t * clientP,
+                  lwm2m_uri_t * uriP,
+                  lwm2m_media_type_t format,
+                  uint8_t * payload,
+                  size_t payloadLength)
+{
+    lwm2m_tlv_t * tlvP;
+    uint8_t * copyP = NULL;
+    struct timeval tv;
+    int size;
+    int i;
+
+    if (contextP->cacheMaxAge == 0) return;
+    if (0 != utils_gettimeofday(contextP, &tv)) return;
+
+    if (format == LWM2M_CONTENT_SENML_JSON)
+    {
+        // decoded in place but the callbacks get the payload after us
+        copyP = (uint8_t *)lwm2m_malloc(payloadLength > 0 ? payloadLength : 1);
+        if (copyP == NULL) return;
+        memcpy(copyP, payload, payloadLength);
+        payload = copyP;
+    }
+
+    size = lwm2m_data_parse(uriP, (char *)payload, payloadLength, format, &tlvP);
+    if (size <= 0)
+    {
+        if (copyP != NULL) lwm2m_free(copyP);
+        return;
+    }
+
+    if (LWM2M_URI_IS_SET_RESOURCE(uriP))
+    {
+        if (tlvP[0].type == LWM2M_TYPE_RESSOURCE_INSTANCE)
+        {
+            lwm2m_tlv_t multiple;
+
+            // instances of a multiple resource sent without their container
+            memset(&multiple, 0, sizeof(lwm2m_tlv_t));
+            multiple.type = LWM2M_TYPE_MULTIPLE_RESSOURCE;
+            multiple.id = uriP->resourceId;
+            multiple.flags = LWM2M_TLV_FLAG_STATIC_DATA;
+            multiple.length = size;
+            multiple.value = (uint8_t *)tlvP;
+            prv_store(clientP, uriP->objectId, uriP->instanceId, &multiple, tv.tv_sec);
+        }
+        else
+        {
+            for (i = 0 ; i < size ; i++)
+            {
+                if (tlvP[i].id == uriP->resourceId)
+                {
+                    prv_store(clientP, uriP->objectId, uriP->instanceId, tlvP + i, tv.tv_sec);
+                }
+            }
+        }
+    }
+    else if (LWM2M_URI_IS_SET_INSTANCE(uriP))
+    {
+        for (i = 0 ; i < size ; i++)
+        {
+            prv_store(clientP, uriP->objectId, uriP->instanceId, tlvP + i, tv.tv_sec);
+        }
+    }
+    else
+    {
+        for (i = 0 ; i < size ; i++)
+        {
+            lwm2m_tlv_t * resourceP = (lwm2m_tlv_t *)tlvP[i].value;
+            size_t j;
+
+            if (tlvP[i].type != LWM2M_TYPE_OBJECT_INSTANCE) continue;
+            for (j = 0 ; j < tlvP[i].length ; j++)
+            {
+                prv_store(clientP, uriP->objectId, tlvP[i].id, resourceP + j, tv.tv_sec);
+            }
+        }
+    }
+
+    prv_scheduleExpiry(contextP, tv.tv_sec + (time_t)contextP->cacheMaxAge);
+
+    lwm2m_tlv_free(size, tlvP);
+    if (copyP != NULL) lwm2m_free(copyP);
+}
+
+void cache_set_etag(lwm2m_client_t * clientP,
+                    lwm2m_uri_t * uriP,
+                    coap_packet_t * requestP)
+{
+    lwm2m_cache_response_t * responseP;
+
+    responseP = prv_responseFind(clientP, uriP);
+    if (responseP != NULL)
+    {
+        coap_set_header_etag(requestP, responseP->etag, responseP->etagLen);
+    }
+}
+
+void cache_keep_response(lwm2m_context_t * contextP,
+                         lwm2m_client_t * clientP,
+                         lwm2m_uri_t * uriP,
+                         coap_packet_t * packet)
+{
+    lwm2m_cache_response_t * responseP;
+    struct timeval tv;
+    uint8_t * buffer;
+
+    if (contextP->etagMaxAge == 0) return;
+    if (0 != utils_gettimeofday(contextP, &tv)) return;
+
+    responseP = prv_responseFind(clientP, uriP);
+    if (responseP != NULL && responseP->buffer == packet->payload) return;
+
+    if (!IS_OPTION(packet, COAP_OPTION_ETAG) || packet->etag_len == 0)
+    {
+        // the next read cannot be validated
+        if (responseP != NULL) cache_invalidate(clientP, uriP);
+        return;
+    }
+
+    buffer = (uint8_t *)lwm2m_malloc(packet->payload_len > 0 ? packet->payload_len : 1);
+    if (buffer == NULL) return;
+    memcpy(buffer, packet->payload, packet->payload_len);
+
+    if (responseP == NULL)
+    {
+        responseP = (lwm2m_cache_response_t *)lwm2m_malloc(sizeof(lwm2m_cache_response_t));
+        if (responseP == NULL)
+        {
+            lwm2m_free(buffer);
+            return;
+        }
+        memset(responseP, 0, sizeof(lwm2m_cache_response_t));
+        memcpy(&responseP->uri, uriP, sizeof(lwm2m_uri_t));
+        responseP->next = clientP->responseList;
+        clientP->responseList = responseP;
+    }
+    else
+    {
+        lwm2m_free(responseP->buffer);
+    }
+    responseP->etagLen = packet->etag_len;
+    memcpy(responseP->etag, packet->etag, packet->etag_len);
+    responseP->format = data_getFormat(packet, false);
+    responseP->buffer = buffer;
+    responseP->length = packet->payload_len;
+    responseP->time = tv.tv_sec;
+    prv_scheduleExpiry(contextP, tv.tv_sec + (time_t)contextP->etagMaxAge);
+}
+
+bool cache_validate_response(lwm2m_client_t * clientP,
+                             lwm2m_uri_t * uriP,
+                             coap_packet_t * packet)
+{
+    lwm2m_cache_response_t * responseP;
+
+    responseP = prv_responseFind(clientP, uriP);
+    if (responseP == NULL) return false;
+    if (IS_OPTION(packet, COAP_OPTION_ETAG)
+     && (packet->etag_len != responseP->etagLen
+      || 0 != memcmp(packet->etag, responseP->etag, responseP->etagLen)))
+    {
+        return false;
+    }
+
+    // the packet now points to the kept payload
+    packet->code = COAP_205_CONTENT;
+    if (responseP->format != LWM2M_CONTENT_TEXT)
+    {
+        coap_set_header_content_type(packet, responseP->format);
+    }
+    packet->payload = responseP->buffer;
+    packet->payload_len = (uint16_t)responseP->length;
+
+    return true;
+}
+
+void cache_invalidate(lwm2m_client_t * clientP,
+                      lwm2m_uri_t * uriP)
+{
+    lwm2m_cache_entry_t ** entryP;
+    lwm2m_cache_response_t ** responseP;
+
+    responseP = &clientP->responseList;
+    while (*responseP != NULL)
+    {
+        if (prv_isOverlapping(&(*responseP)->uri, uriP))
+        {
+            lwm2m_cache_response_t * targetP = *responseP;
+
+            *responseP = targetP->next;
+            prv_responseFree(targetP);
+        }
+        else
+        {
+            responseP = &(*responseP)->next;
+        }
+    }
+
+    entryP = &clientP->cacheList;
+    while (*entryP != NULL)
+    {
+        if (prv_isOverlapping(&(*entryP)->uri, uriP))
+        {
+            lwm2m_cache_entry_t * targetP = *entryP;
+
+            *entryP = targetP->next;
+            prv_free(targetP);
+        }
+        else
+        {
+            entryP = &(*entryP)->next;
+        }
+    }
+}
+
+void cache_step(lwm2m_context_t * contextP,
+                time_t currentTime)
+{
+    lwm2m_client_t * clientP;
+
+    if (contextP->cacheExpiry == 0 || currentTime < contextP->cacheExpiry) return;
+    contextP->cacheExpiry = 0;
+
+    for (clientP = contextP->clientList ; clientP != NULL ; clientP = clientP->next)
+    {
+        lwm2m_cache_entry_t ** entryP;
+        lwm2m_cache_response_t ** responseP;
+
+        responseP = &clientP->responseList;
+        while (*responseP != NULL)
+        {
+            if ((*responseP)->time + (time_t)contextP->etagMaxAge <= currentTime)
+            {
+                lwm2m_cache_response_t * targetP = *responseP;
+
+                *responseP = targetP->next;
+                prv_responseFree(targetP);
+            }
+            else
+            {
+                prv_scheduleExpiry(contextP, (*responseP)->time + (time_t)contextP->etagMaxAge);
+                responseP = &(*responseP)->next;
+            }
+        }
+
+        entryP = &clientP->cacheList;
+        while (*entryP != NULL)
+        {
+            if ((*entryP)->time + (time_t)contextP->cacheMaxAge <= currentTime)
+            {
+                lwm2m_cache_entry_t * targetP = *entryP;
+
+                *entryP = targetP->next;
+                prv_free(targetP);
+            }
+            else
+            {
+                prv_scheduleExpiry(contextP, (*entryP)->time + (time_t)contextP->cacheMaxAge);
+                entryP = &(*entryP)->next;
+            }
+        }
+    }
+}
+
+static void prv_freeEntries(lwm2m_client_t * clientP)
+{
+    while (clientP->cacheList != NULL)
+    {
+        lwm2m_cache_entry_t * entryP;
+
+        entryP = clientP->cacheList;
+        clientP->cacheList = entryP->next;
+        prv_free(entryP);
+    }
+}
+
+static void prv_freeResponses(lwm2m_client_t * clientP)
+{
+    while (clientP->responseList != NULL)
+    {
+        lwm2m_cache_response_t * responseP;
+
+        responseP = clientP->responseList;
+        clientP->responseList = responseP->next;
+        prv_responseFree(responseP);
+    }
+}
+
+void cache_free(lwm2m_client_t * clientP)
+{
+    prv_freeEntries(clientP);
+    prv_freeResponses(clientP);
+}
+
+void lwm2m_set_cache_max_age(lwm2m_context_t * contextP,
+                             uint32_t maxAge)
+{
+    lwm2m_client_t * clientP;
+
+    contextP->cacheMaxAge = maxAge;
+    // the expiry dates changed, walk the lists at the next step
+    if (contextP->cacheExpiry != 0) contextP->cacheExpiry = 1;
+    if (maxAge != 0) return;
+
+    for (clientP = contextP->clientList ; clientP != NULL ; clientP = clientP->next)
+    {
+        prv_freeEntries(clientP);
+    }
+}
+
+void lwm2m_set_etag_max_age(lwm2m_context_t * contextP,
+                            uint32_t maxAge)
+{
+    lwm2m_client_t * clientP;
+
+    contextP->etagMaxAge = maxAge;
+    // the expiry dates changed, walk the lists at the next step
+    if (contextP->cacheExpiry != 0) contextP->cacheExpiry = 1;
+    if (maxAge != 0) return;
+
+    for (clientP = contextP->clientList ; clientP != NULL ; clientP = clientP->next)
+    {
+        prv_freeResponses(clientP);
+    }
+}
+
+int lwm2m_cache_read(lwm2m_context_t * contextP,
+                     uint16_t clientID,
+                     lwm2m_uri_t * uriP,
+                     lwm2m_tlv_t ** dataP,
+                     time_t * timeP)
+{
+    lwm2m_client_t * clientP;
+    lwm2m_cache_entry_t * entryP;
+    struct timeval tv;
+
+    *dataP = NULL;
+
+    if (!LWM2M_URI_IS_SET_INSTANCE(uriP) || !LWM2M_URI_IS_SET_RESOURCE(uriP)) return COAP_400_BAD_REQUEST;
+
+    clientP = clients_find(contextP, clientID);
+    if (clientP == NULL) return COAP_404_NOT_FOUND;
+
+    entryP = prv_find(clientP, uriP);
+    if (entryP == NULL) return COAP_404_NOT_FOUND;
+
+    if (0 != utils_gettimeofday(contextP, &tv)) return COAP_500_INTERNAL_SERVER_ERROR;
+    if (entryP->time + (time_t)contextP->cacheMaxAge <= tv.tv_sec) return COAP_404_NOT_FOUND;
+
+    *dataP = prv_duplicate(entryP->tlvP);
+    if (*dataP == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+    if (timeP != NULL) *timeP = entryP->time;
+
+    return COAP_205_CONTENT;
+}
+
+#endif
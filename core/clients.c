@@ -0,0 +1,409 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Table of the registered clients.
+ *
+ * The fields read when scanning all the clients, end of life, session and
+ * endpoint name hash, are kept in arrays indexed by internal ID. The
+ * lwm2m_client_t records only hold the data of a single client and are
+ * reached from the table when needed. Expiring clients is thus a linear scan
+ * of contiguous memory.
+ *
+ * The clients are also chained in two hash indexes, by session and by
+ * endpoint name. Finding the client of a datagram or of a registration only
+ * walks the few clients of a bucket. Buckets and chains hold internal IDs,
+ * PRV_NO_ID ending a chain.
+ *
+ * Internal IDs are the lowest free slots. The records stay linked in
+ * lwm2m_context_t::clientList sorted by ID for the application, the previous
+ * client being found in the table instead of walking the list.
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LWM2M_SERVER_MODE
+
+#define PRV_FIRST_SIZE  16
+// end of life of the free slots, never reached
+#define PRV_NEVER       ((time_t)0x7FFFFFFF)
+// end of a hash chain, LWM2M_MAX_ID is never given to a client
+#define PRV_NO_ID       LWM2M_MAX_ID
+
+struct _lwm2m_client_table_
+{
+    uint32_t            size;       // number of slots
+    uint32_t            end;        // slots from end are free
+    uint32_t            firstFree;  // slots before firstFree are used
+    uint32_t            bucketMask; // number of buckets minus one, a power of two minus one
+    time_t *            endOfLife;
+    void **             sessions;
+    lwm2m_client_t **   clients;    // NULL for free slots
+    uint32_t *          nameHashes;
+    uint16_t *          sessionNext;
+    uint16_t *          nameNext;
+    uint16_t *          sessionBuckets;
+    uint16_t *          nameBuckets;
+};
+
+static uint32_t prv_hashName(const char * name)
+{
+    uint32_t hash;
+
+    // 32-bit FNV-1a
+    hash = 2166136261u;
+    while (*name != 0)
+    {
+        hash ^= (uint8_t)*name;
+        hash *= 16777619u;
+        name++;
+    }
+
+    return hash;
+}
+
+static uint32_t prv_hashSession(void * sessionH)
+{
+    uint32_t hash;
+
+    // sessions are usually aligned pointers, mix all their bits
+    hash = (uint32_t)((uintptr_t)sessionH ^ ((uint64_t)(uintptr_t)sessionH >> 32));
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3Bu;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+static void prv_link(uint16_t * bucketP,
+                     uint16_t * next,
+                     uint16_t id)
+{
+    next[id] = *bucketP;
+    *bucketP = id;
+}
+
+static void prv_unlink(uint16_t * bucketP,
+                       uint16_t * next,
+                       uint16_t id)
+{
+    while (*bucketP != PRV_NO_ID && *bucketP != id) bucketP = next + *bucketP;
+    if (*bucketP == id) *bucketP = next[id];
+}
+
+// move the table to arrays of size slots and rebuild the hash indexes
+static int prv_resize(lwm2m_client_table_t * tableP,
+                      uint32_t size)
+{
+    uint8_t * memoryP;
+    time_t * endOfLife;
+    void ** sessions;
+    lwm2m_client_t ** clients;
+    uint32_t * nameHashes;
+    uint16_t * sessionNext;
+    uint16_t * nameNext;
+    uint16_t * sessionBuckets;
+    uint16_t * nameBuckets;
+    uint32_t buckets;
+    uint32_t i;
+
+    buckets = 1;
+    while (buckets < size) buckets *= 2;
+
+    // a single block, arrays ordered by decreasing alignment
+    memoryP = (uint8_t *)lwm2m_malloc(size * (sizeof(time_t) + sizeof(void *) + sizeof(lwm2m_client_t *) + sizeof(uint32_t) + 2 * sizeof(uint16_t))
+                                      + buckets * 2 * sizeof(uint16_t));
+    if (memoryP == NULL) return -1;
+    endOfLife = (time_t *)memoryP;
+    sessions = (void **)(endOfLife + size);
+    clients = (lwm2m_client_t **)(sessions + size);
+    nameHashes = (uint32_t *)(clients + size);
+    sessionNext = (uint16_t *)(nameHashes + size);
+    nameNext = sessionNext + size;
+    sessionBuckets = nameNext + size;
+    nameBuckets = sessionBuckets + buckets;
+
+    if (tableP->size != 0)
+    {
+        memcpy(endOfLife, tableP->endOfLife, tableP->size * sizeof(time_t));
+        memcpy(sessions, tableP->sessions, tableP->size * sizeof(void *));
+        memcpy(clients, tableP->clients, tableP->size * sizeof(lwm2m_client_t *));
+        memcpy(nameHashes, tableP->nameHashes, tableP->size * sizeof(uint32_t));
+        lwm2m_free(tableP->endOfLife);
+    }
+    for (i = tableP->size ; i < size ; i++)
+    {
+        endOfLife[i] = PRV_NEVER;
+        sessions[i] = NULL;
+        clients[i] = NULL;
+        nameHashes[i] = 0;
+    }
+    for (i = 0 ; i < buckets ; i++)
+    {
+        sessionBuckets[i] = PRV_NO_ID;
+        nameBuckets[i] = PRV_NO_ID;
+    }
+
+    tableP->size = size;
+    tableP->bucketMask = buckets - 1;
+    tableP->endOfLife = endOfLife;
+    tableP->sessions = sessions;
+    tableP->clients = clients;
+    tableP->nameHashes = nameHashes;
+    tableP->sessionNext = sessionNext;
+    tableP->nameNext = nameNext;
+    tableP->sessionBuckets = sessionBuckets;
+    tableP->nameBuckets = nameBuckets;
+
+    for (i = 0 ; i < tableP->end ; i++)
+    {
+        if (clients[i] == NULL) continue;
+        prv_link(sessionBuckets + (prv_hashSession(sessions[i]) & tableP->bucketMask), sessionNext, (uint16_t)i);
+        prv_link(nameBuckets + (nameHashes[i] & tableP->bucketMask), nameNext, (uint16_t)i);
+    }
+
+    return 0;
+}
+
+int clients_add(lwm2m_context_t * contextP,
+                lwm2m_client_t * clientP)
+{
+    lwm2m_client_table_t * tableP;
+    uint32_t id;
+    uint32_t previous;
+
+    tableP = contextP->clientTable;
+    if (tableP == NULL)
+    {
+        tableP = (lwm2m_client_table_t *)lwm2m_malloc(sizeof(lwm2m_client_table_t));
+        if (tableP == NULL) return -1;
+        memset(tableP, 0, sizeof(lwm2m_client_table_t));
+        contextP->clientTable = tableP;
+    }
+
+    id = tableP->firstFree;
+    if (id >= LWM2M_MAX_ID) return -1;
+    if (id == tableP->size)
+    {
+        uint32_t size;
+
+        size = tableP->size == 0 ? PRV_FIRST_SIZE : tableP->size * 2;
+        if (size > LWM2M_MAX_ID) size = LWM2M_MAX_ID;
+        if (prv_resize(tableP, size) != 0) return -1;
+    }
+
+    clientP->internalID = (uint16_t)id;
+    tableP->clients[id] = clientP;
+    tableP->nameHashes[id] = clientP->name != NULL ? prv_hashName(clientP->name) : 0;
+    // no expiry until the registration sets it
+    tableP->endOfLife[id] = PRV_NEVER;
+    tableP->sessions[id] = NULL;
+    prv_link(tableP->sessionBuckets + (prv_hashSession(NULL) & tableP->bucketMask), tableP->sessionNext, (uint16_t)id);
+    prv_link(tableP->nameBuckets + (tableP->nameHashes[id] & tableP->bucketMask), tableP->nameNext, (uint16_t)id);
+    if (id >= tableP->end) tableP->end = id + 1;
+    do
+    {
+        tableP->firstFree++;
+    } while (tableP->firstFree < tableP->size && tableP->clients[tableP->firstFree] != NULL);
+
+    // insert after the client with the previous ID
+    previous = id;
+    while (previous > 0 && tableP->clients[previous - 1] == NULL) previous--;
+    if (previous == 0)
+    {
+        clientP->next = contextP->clientList;
+        contextP->clientList = clientP;
+    }
+    else
+    {
+        clientP->next = tableP->clients[previous - 1]->next;
+        tableP->clients[previous - 1]->next = clientP;
+    }
+
+    return 0;
+}
+
+void clients_remove(lwm2m_context_t * contextP,
+                    lwm2m_client_t * clientP)
+{
+    lwm2m_client_table_t * tableP = contextP->clientTable;
+    uint32_t id = clientP->internalID;
+    uint32_t previous;
+
+    if (tableP == NULL || id >= tableP->size || tableP->clients[id] != clientP) return;
+
+    previous = id;
+    while (previous > 0 && tableP->clients[previous - 1] == NULL) previous--;
+    if (previous == 0)
+    {
+        contextP->clientList = clientP->next;
+    }
+    else
+    {
+        tableP->clients[previous - 1]->next = clientP->next;
+    }
+    clientP->next = NULL;
+
+    prv_unlink(tableP->sessionBuckets + (prv_hashSession(tableP->sessions[id]) & tableP->bucketMask), tableP->sessionNext, (uint16_t)id);
+    prv_unlink(tableP->nameBuckets + (tableP->nameHashes[id] & tableP->bucketMask), tableP->nameNext, (uint16_t)id);
+    tableP->clients[id] = NULL;
+    tableP->endOfLife[id] = PRV_NEVER;
+    tableP->sessions[id] = NULL;
+    if (id < tableP->firstFree) tableP->firstFree = id;
+    while (tableP->end > 0 && tableP->clients[tableP->end - 1] == NULL) tableP->end--;
+}
+
+lwm2m_client_t * clients_find(lwm2m_context_t * contextP,
+                              uint16_t id)
+{
+    lwm2m_client_table_t * tableP = contextP->clientTable;
+
+    if (tableP == NULL || id >= tableP->end) return NULL;
+
+    return tableP->clients[id];
+}
+
+lwm2m_client_t * clients_findByName(lwm2m_context_t * contextP,
+                                    const char * name)
+{
+    lwm2m_client_table_t * tableP = contextP->clientTable;
+    uint32_t hash;
+    uint16_t id;
+
+    if (tableP == NULL || tableP->size == 0) return NULL;
+
+    hash = prv_hashName(name);
+    for (id = tableP->nameBuckets[hash & tableP->bucketMask] ; id != PRV_NO_ID ; id = tableP->nameNext[id])
+    {
+        if (tableP->nameHashes[id] == hash
+         && strcmp(tableP->clients[id]->name, name) == 0)
+        {
+            return tableP->clients[id];
+        }
+    }
+
+    return NULL;
+}
+
+lwm2m_client_t * clients_findBySession(lwm2m_context_t * contextP,
+                                       void * sessionH,
+                                       lwm2m_client_t * previousP)
+{
+    lwm2m_client_table_t * tableP = contextP->clientTable;
+    uint16_t id;
+
+    if (tableP == NULL || tableP->size == 0) return NULL;
+
+    if (previousP == NULL)
+    {
+        id = tableP->sessionBuckets[prv_hashSession(sessionH) & tableP->bucketMask];
+    }
+    else
+    {
+        id = tableP->sessionNext[previousP->internalID];
+    }
+    for ( ; id != PRV_NO_ID ; id = tableP->sessionNext[id])
+    {
+        if (tableP->sessions[id] == sessionH) return tableP->clients[id];
+    }
+
+    return NULL;
+}
+
+void * clients_getSession(lwm2m_context_t * contextP,
+                          lwm2m_client_t * clientP)
+{
+    return contextP->clientTable->sessions[clientP->internalID];
+}
+
+void clients_setSession(lwm2m_context_t * contextP,
+                        lwm2m_client_t * clientP,
+                        void * sessionH)
+{
+    lwm2m_client_table_t * tableP = contextP->clientTable;
+    uint16_t id = clientP->internalID;
+
+    if (tableP->sessions[id] == sessionH) return;
+
+    prv_unlink(tableP->sessionBuckets + (prv_hashSession(tableP->sessions[id]) & tableP->bucketMask), tableP->sessionNext, id);
+    tableP->sessions[id] = sessionH;
+    prv_link(tableP->sessionBuckets + (prv_hashSession(sessionH) & tableP->bucketMask), tableP->sessionNext, id);
+}
+
+void clients_setEndOfLife(lwm2m_context_t * contextP,
+                          lwm2m_client_t * clientP,
+                          time_t endOfLife)
+{
+    contextP->clientTable->endOfLife[clientP->internalID] = endOfLife;
+}
+
+int clients_step(lwm2m_context_t * contextP,
+                 time_t currentTime)
+{
+    lwm2m_client_table_t * tableP = contextP->clientTable;
+    time_t next;
+    uint32_t i;
+
+    if (tableP == NULL) return -1;
+
+    next = PRV_NEVER;
+    for (i = 0 ; i < tableP->end ; i++)
+    {
+        if (tableP->endOfLife[i] <= currentTime)
+        {
+            lwm2m_client_t * clientP = tableP->clients[i];
+
+            clients_remove(contextP, clientP);
+            TRACE(contextP, LWM2M_TRACE_EXPIRED, 0, 0, 0, clientP->internalID);
+            if (contextP->monitorCallback != NULL)
+            {
+                contextP->monitorCallback(clientP->internalID, NULL, DELETED_2_02, LWM2M_CONTENT_TEXT, NULL, 0, contextP->monitorUserData);
+            }
+            prv_freeClient(contextP, clientP);
+        }
+        else if (tableP->endOfLife[i] < next)
+        {
+            next = tableP->endOfLife[i];
+        }
+    }
+
+    if (next == PRV_NEVER) return -1;
+    return (int)(next - currentTime);
+}
+
+void clients_close(lwm2m_context_t * contextP)
+{
+    while (contextP->clientList != NULL)
+    {
+        lwm2m_client_t * clientP = contextP->clientList;
+
+        clients_remove(contextP, clientP);
+        prv_freeClient(contextP, clientP);
+    }
+    layout_close(contextP);
+
+    if (contextP->clientTable != NULL)
+    {
+        if (contextP->clientTable->size != 0) lwm2m_free(contextP->clientTable->endOfLife);
+        lwm2m_free(contextP->clientTable);
+        contextP->clientTable = NULL;
+    }
+}
+
+#endif
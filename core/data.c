@@ -0,0 +1,275 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PRV_TEXT_BUFFER_SIZE 32
+
+
+bool data_isFormatSupported(lwm2m_media_type_t format)
+{
+    switch (format)
+    {
+    case LWM2M_CONTENT_TEXT:
+    case LWM2M_CONTENT_OPAQUE:
+    case LWM2M_CONTENT_TLV:
+    case LWM2M_CONTENT_SENML_JSON:
+    case LWM2M_CONTENT_SENML_CBOR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+lwm2m_media_type_t data_getFormat(coap_packet_t * message,
+                                  bool fromAccept)
+{
+    if (fromAccept)
+    {
+        int i;
+
+        if (!IS_OPTION(message, COAP_OPTION_ACCEPT)) return LWM2M_CONTENT_TEXT;
+
+        for (i = 0 ; i < message->accept_num ; i++)
+        {
+            if (data_isFormatSupported((lwm2m_media_type_t)message->accept[i]))
+            {
+                return (lwm2m_media_type_t)message->accept[i];
+            }
+        }
+        // let the caller answer 4.06
+        return (lwm2m_media_type_t)message->accept[0];
+    }
+
+    if (!IS_OPTION(message, COAP_OPTION_CONTENT_TYPE)) return LWM2M_CONTENT_TEXT;
+
+    return (lwm2m_media_type_t)message->content_type;
+}
+
+void data_getETag(lwm2m_media_type_t format,
+                  uint8_t * buffer,
+                  size_t length,
+                  uint8_t * etag)
+{
+    uint32_t hash;
+    size_t i;
+
+    // 32-bit FNV-1a, seeded with the format so that each format has its own ETag
+    hash = 2166136261u ^ (uint32_t)format;
+    for (i = 0 ; i < length ; i++)
+    {
+        hash ^= buffer[i];
+        hash *= 16777619u;
+    }
+
+    etag[0] = (hash >> 24) & 0xFF;
+    etag[1] = (hash >> 16) & 0xFF;
+    etag[2] = (hash >> 8) & 0xFF;
+    etag[3] = hash & 0xFF;
+}
+
+int lwm2m_data_parse(lwm2m_uri_t * uriP,
+                     char * buffer,
+                     size_t bufferLen,
+                     lwm2m_media_type_t format,
+                     lwm2m_tlv_t ** dataP)
+{
+    *dataP = NULL;
+
+    switch (format)
+    {
+    case LWM2M_CONTENT_TEXT:
+    case LWM2M_CONTENT_OPAQUE:
+        if (!LWM2M_URI_IS_SET_RESOURCE(uriP)) return 0;
+        *dataP = lwm2m_tlv_new(1);
+        if (*dataP == NULL) return 0;
+        (*dataP)->flags = LWM2M_TLV_FLAG_STATIC_DATA;
+        if (format == LWM2M_CONTENT_TEXT)
+        {
+            (*dataP)->flags |= LWM2M_TLV_FLAG_TEXT_FORMAT;
+        }
+        else
+        {
+            (*dataP)->dataType = LWM2M_DATA_OPAQUE;
+        }
+        (*dataP)->type = LWM2M_TYPE_RESSOURCE;
+        (*dataP)->id = uriP->resourceId;
+        (*dataP)->length = bufferLen;
+        (*dataP)->value = (uint8_t *)buffer;
+        return 1;
+
+    case LWM2M_CONTENT_TLV:
+        return lwm2m_tlv_parse(buffer, bufferLen, dataP);
+
+    case LWM2M_CONTENT_SENML_JSON:
+    case LWM2M_CONTENT_SENML_CBOR:
+        {
+            senml_tlv_builder_t builder;
+            int result;
+
+            builder.uriP = uriP;
+            builder.tlvP = NULL;
+            builder.size = 0;
+
+            if (format == LWM2M_CONTENT_SENML_JSON)
+            {
+                result = lwm2m_senml_json_parse((uint8_t *)buffer, bufferLen, senml_tlvBuilderCallback, &builder);
+            }
+            else
+            {
+                result = lwm2m_senml_cbor_parse((uint8_t *)buffer, bufferLen, senml_tlvBuilderCallback, &builder);
+            }
+            if (0 >= result)
+            {
+                lwm2m_tlv_free(builder.size, builder.tlvP);
+                return 0;
+            }
+            *dataP = builder.tlvP;
+            return builder.size;
+        }
+
+    default:
+        return 0;
+    }
+}
+
+static int prv_textSerialize(lwm2m_tlv_t * tlvP,
+                             char ** bufferP)
+{
+    char string[PRV_TEXT_BUFFER_SIZE];
+    int length;
+
+    if ((tlvP->flags & LWM2M_TLV_FLAG_TEXT_FORMAT) != 0)
+    {
+        // already in plain text
+        length = -1;
+    }
+    else
+    {
+        switch (tlvP->dataType)
+        {
+        case LWM2M_DATA_INTEGER:
+            {
+                int64_t value;
+
+                if (0 == lwm2m_tlv_decode_int(tlvP, &value)) return -1;
+                length = lwm2m_int64ToPlainTextBuffer(value, string, PRV_TEXT_BUFFER_SIZE);
+            }
+            break;
+
+        case LWM2M_DATA_FLOAT:
+            {
+                double value;
+
+                if (0 == lwm2m_tlv_decode_float(tlvP, &value)) return -1;
+                length = lwm2m_float64ToPlainTextBuffer(value, string, PRV_TEXT_BUFFER_SIZE);
+            }
+            break;
+
+        case LWM2M_DATA_BOOLEAN:
+            {
+                bool value;
+
+                if (0 == lwm2m_tlv_decode_bool(tlvP, &value)) return -1;
+                length = lwm2m_boolToPlainTextBuffer(value, string, PRV_TEXT_BUFFER_SIZE);
+            }
+            break;
+
+        default:
+            length = -1;
+            break;
+        }
+        if (length == 0) return -1;
+    }
+
+    if (length < 0)
+    {
+        // copy the raw value
+        *bufferP = (char *)lwm2m_malloc(tlvP->length > 0 ? tlvP->length : 1);
+        if (*bufferP == NULL) return -1;
+        memcpy(*bufferP, tlvP->value, tlvP->length);
+
+        return tlvP->length;
+    }
+
+    *bufferP = (char *)lwm2m_malloc(length);
+    if (*bufferP == NULL) return -1;
+    memcpy(*bufferP, string, length);
+
+    return length;
+}
+
+int lwm2m_data_serialize(lwm2m_uri_t * uriP,
+                         int size,
+                         lwm2m_tlv_t * tlvP,
+                         lwm2m_media_type_t format,
+                         char ** bufferP)
+{
+    *bufferP = NULL;
+
+    switch (format)
+    {
+    case LWM2M_CONTENT_TEXT:
+    case LWM2M_CONTENT_OPAQUE:
+        if (size != 1 || tlvP->type != LWM2M_TYPE_RESSOURCE) return -1;
+        if (format == LWM2M_CONTENT_TEXT)
+        {
+            return prv_textSerialize(tlvP, bufferP);
+        }
+        *bufferP = (char *)lwm2m_malloc(tlvP->length > 0 ? tlvP->length : 1);
+        if (*bufferP == NULL) return -1;
+        memcpy(*bufferP, tlvP->value, tlvP->length);
+        return tlvP->length;
+
+    case LWM2M_CONTENT_TLV:
+        {
+            int length;
+
+            length = lwm2m_tlv_serialize(size, tlvP, bufferP);
+            if (length <= 0) return -1;
+            return length;
+        }
+
+    case LWM2M_CONTENT_SENML_JSON:
+    case LWM2M_CONTENT_SENML_CBOR:
+        {
+            lwm2m_senml_record_t * recordArray;
+            int count;
+            int length;
+
+            count = senml_recordsFromTlv(uriP, size, tlvP, &recordArray);
+            if (count < 0) return -1;
+
+            if (format == LWM2M_CONTENT_SENML_JSON)
+            {
+                length = lwm2m_senml_json_serialize(count, recordArray, (uint8_t **)bufferP);
+            }
+            else
+            {
+                length = lwm2m_senml_cbor_serialize(count, recordArray, (uint8_t **)bufferP);
+            }
+            if (recordArray != NULL) lwm2m_free(recordArray);
+
+            return length;
+        }
+
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,216 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Deduplication of confirmable requests (RFC 7252 4.5).
+ *
+ * The piggybacked response to a confirmable request is kept for
+ * COAP_EXCHANGE_LIFETIME, identified by the peer session and the Message ID.
+ * When the peer retransmits the request because the acknowledgement was lost,
+ * the same datagram is sent again instead of handling the request twice.
+ *
+ * The responses are chained in a hash table on (session, Message ID), grown
+ * with the number of responses kept, and in a list from the oldest to the
+ * newest so that dedup_step() only visits the expired ones.
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PRV_FIRST_BUCKETS   16
+
+typedef struct _dedup_entry_
+{
+    struct _dedup_entry_ *  next;       // next newer response
+    struct _dedup_entry_ *  hashNext;   // next response in the same bucket
+    void *                  sessionH;
+    uint16_t                mid;
+    time_t                  time;
+    size_t                  length;
+    uint8_t                 buffer[];
+} dedup_entry_t;
+
+struct _lwm2m_dedup_table_
+{
+    dedup_entry_t *     oldest;
+    dedup_entry_t *     newest;
+    dedup_entry_t **    buckets;
+    uint32_t            bucketMask; // number of buckets minus one
+    uint32_t            count;
+};
+
+static uint32_t prv_hash(void * sessionH,
+                         uint16_t mid)
+{
+    uint32_t hash;
+
+    hash = (uint32_t)((uintptr_t)sessionH ^ ((uint64_t)(uintptr_t)sessionH >> 32));
+    hash ^= (uint32_t)mid * 0x9E3779B1u;
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3Bu;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+// double the buckets, the table is kept as it is if memory is short
+static void prv_grow(lwm2m_dedup_table_t * tableP)
+{
+    dedup_entry_t ** buckets;
+    dedup_entry_t * entryP;
+    uint32_t mask;
+
+    mask = tableP->bucketMask * 2 + 1;
+    buckets = (dedup_entry_t **)lwm2m_malloc((mask + 1) * sizeof(dedup_entry_t *));
+    if (buckets == NULL) return;
+    memset(buckets, 0, (mask + 1) * sizeof(dedup_entry_t *));
+
+    for (entryP = tableP->oldest ; entryP != NULL ; entryP = entryP->next)
+    {
+        dedup_entry_t ** bucketP = buckets + (prv_hash(entryP->sessionH, entryP->mid) & mask);
+
+        entryP->hashNext = *bucketP;
+        *bucketP = entryP;
+    }
+
+    lwm2m_free(tableP->buckets);
+    tableP->buckets = buckets;
+    tableP->bucketMask = mask;
+}
+
+bool dedup_replay(lwm2m_context_t * contextP,
+                  void * fromSessionH,
+                  uint16_t mid)
+{
+    lwm2m_dedup_table_t * tableP = contextP->dedupTable;
+    dedup_entry_t * entryP;
+
+    if (tableP == NULL) return false;
+
+    for (entryP = tableP->buckets[prv_hash(fromSessionH, mid) & tableP->bucketMask] ; entryP != NULL ; entryP = entryP->hashNext)
+    {
+        if (entryP->sessionH == fromSessionH && entryP->mid == mid)
+        {
+            LOG("Duplicate of message %u, sending the same response\r\n", mid);
+            packet_send(contextP, fromSessionH, entryP->buffer, entryP->length);
+            TRACE(contextP, LWM2M_TRACE_DUPLICATE, (entryP->buffer[0] >> 4) & 0x03, entryP->buffer[1], mid, 0);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void dedup_store(lwm2m_context_t * contextP,
+                 void * sessionH,
+                 uint16_t mid,
+                 uint8_t * buffer,
+                 size_t length)
+{
+    lwm2m_dedup_table_t * tableP;
+    dedup_entry_t * entryP;
+    dedup_entry_t ** bucketP;
+    struct timeval tv;
+
+    if (0 != utils_gettimeofday(contextP, &tv)) return;
+
+    tableP = contextP->dedupTable;
+    if (tableP == NULL)
+    {
+        tableP = (lwm2m_dedup_table_t *)lwm2m_malloc(sizeof(lwm2m_dedup_table_t));
+        if (tableP == NULL) return;
+        memset(tableP, 0, sizeof(lwm2m_dedup_table_t));
+        tableP->buckets = (dedup_entry_t **)lwm2m_malloc(PRV_FIRST_BUCKETS * sizeof(dedup_entry_t *));
+        if (tableP->buckets == NULL)
+        {
+            lwm2m_free(tableP);
+            return;
+        }
+        memset(tableP->buckets, 0, PRV_FIRST_BUCKETS * sizeof(dedup_entry_t *));
+        tableP->bucketMask = PRV_FIRST_BUCKETS - 1;
+        contextP->dedupTable = tableP;
+    }
+
+    entryP = (dedup_entry_t *)lwm2m_malloc(sizeof(dedup_entry_t) + length);
+    if (entryP == NULL) return;
+    memcpy(entryP->buffer, buffer, length);
+    entryP->length = length;
+    entryP->sessionH = sessionH;
+    entryP->mid = mid;
+    entryP->time = tv.tv_sec;
+
+    // the list stays sorted by increasing time
+    entryP->next = NULL;
+    if (tableP->newest == NULL)
+    {
+        tableP->oldest = entryP;
+    }
+    else
+    {
+        tableP->newest->next = entryP;
+    }
+    tableP->newest = entryP;
+
+    bucketP = tableP->buckets + (prv_hash(sessionH, mid) & tableP->bucketMask);
+    entryP->hashNext = *bucketP;
+    *bucketP = entryP;
+
+    tableP->count++;
+    if (tableP->count > 2 * (tableP->bucketMask + 1)) prv_grow(tableP);
+}
+
+void dedup_step(lwm2m_context_t * contextP,
+                time_t currentTime)
+{
+    lwm2m_dedup_table_t * tableP = contextP->dedupTable;
+
+    if (tableP == NULL) return;
+
+    while (tableP->oldest != NULL && tableP->oldest->time + COAP_EXCHANGE_LIFETIME <= currentTime)
+    {
+        dedup_entry_t * entryP = tableP->oldest;
+        dedup_entry_t ** bucketP;
+
+        bucketP = tableP->buckets + (prv_hash(entryP->sessionH, entryP->mid) & tableP->bucketMask);
+        while (*bucketP != entryP) bucketP = &(*bucketP)->hashNext;
+        *bucketP = entryP->hashNext;
+
+        tableP->oldest = entryP->next;
+        if (tableP->oldest == NULL) tableP->newest = NULL;
+        tableP->count--;
+        lwm2m_free(entryP);
+    }
+}
+
+void dedup_close(lwm2m_context_t * contextP)
+{
+    lwm2m_dedup_table_t * tableP = contextP->dedupTable;
+
+    if (tableP == NULL) return;
+
+    while (tableP->oldest != NULL)
+    {
+        dedup_entry_t * entryP = tableP->oldest;
+
+        tableP->oldest = entryP->next;
+        lwm2m_free(entryP);
+    }
+    lwm2m_free(tableP->buckets);
+    lwm2m_free(tableP);
+    contextP->dedupTable = NULL;
+}
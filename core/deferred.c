@@ -0,0 +1,293 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Separate responses (RFC 7252 5.2.2) to requests whose object callback
+ * returned COAP_PENDING.
+ *
+ * lwm2m_handle_packet() acknowledges such a request with an empty ACK. The
+ * request is kept here until the application calls lwm2m_complete_request()
+ * on its URI, then the response is sent with the token of the request: in a
+ * confirmable transaction if the request was confirmable, in a NON message
+ * otherwise. A read response larger than a block is kept by block2.c and
+ * only its first block is sent, as for an immediate response. Confirmable
+ * responses never acknowledged are counted in lwm2m_stats_t::lostResponses.
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef LWM2M_CLIENT_MODE
+
+struct _lwm2m_deferred_
+{
+    lwm2m_deferred_t *  next;
+    void *              sessionH;
+    lwm2m_uri_t         uri;
+    uint8_t             code;       // method of the request
+    coap_message_type_t type;
+    uint16_t            mid;        // of the request, to recognize its retransmissions
+    uint8_t             token[COAP_TOKEN_LEN];
+    uint8_t             tokenLen;
+    lwm2m_media_type_t  format;     // requested format of reads
+    uint16_t            blockSize;  // requested with Block2, 0 if none
+    time_t              time;
+};
+
+coap_status_t deferred_add(lwm2m_context_t * contextP,
+                           lwm2m_uri_t * uriP,
+                           void * fromSessionH,
+                           coap_packet_t * message)
+{
+    lwm2m_deferred_t * deferredP;
+    struct timeval tv;
+
+    if (0 != utils_gettimeofday(contextP, &tv)) return COAP_500_INTERNAL_SERVER_ERROR;
+
+    deferredP = (lwm2m_deferred_t *)lwm2m_malloc(sizeof(lwm2m_deferred_t));
+    if (deferredP == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+    memset(deferredP, 0, sizeof(lwm2m_deferred_t));
+
+    deferredP->sessionH = fromSessionH;
+    memcpy(&deferredP->uri, uriP, sizeof(lwm2m_uri_t));
+    deferredP->code = message->code;
+    deferredP->type = message->type;
+    deferredP->mid = message->mid;
+    deferredP->tokenLen = message->token_len;
+    memcpy(deferredP->token, message->token, message->token_len);
+    deferredP->format = data_getFormat(message, true);
+    if (IS_OPTION(message, COAP_OPTION_BLOCK2)) deferredP->blockSize = message->block2_size;
+    deferredP->time = tv.tv_sec;
+
+    deferredP->next = contextP->deferredList;
+    contextP->deferredList = deferredP;
+
+    return COAP_PENDING;
+}
+
+static lwm2m_server_t * prv_findServer(lwm2m_context_t * contextP,
+                                       void * sessionH)
+{
+    lwm2m_server_t * serverP;
+
+    for (serverP = contextP->serverList ; serverP != NULL ; serverP = serverP->next)
+    {
+        if (serverP->sessionH == sessionH) return serverP;
+    }
+    for (serverP = contextP->bootstrapServerList ; serverP != NULL ; serverP = serverP->next)
+    {
+        if (serverP->sessionH == sessionH) return serverP;
+    }
+
+    return NULL;
+}
+
+static void prv_responseCallback(lwm2m_transaction_t * transacP,
+                                 void * message)
+{
+    lwm2m_context_t * contextP = (lwm2m_context_t *)transacP->userData;
+
+    if (message == NULL)
+    {
+        LOG("Separate response %d.%02d was not acknowledged\n",
+            ((coap_packet_t *)transacP->message)->code >> 5, ((coap_packet_t *)transacP->message)->code & 0x1F);
+        contextP->stats.lostResponses++;
+    }
+}
+
+static void prv_send(lwm2m_context_t * contextP,
+                     lwm2m_deferred_t * deferredP,
+                     uint8_t code,
+                     int size,
+                     lwm2m_tlv_t * dataArray)
+{
+    lwm2m_transaction_t * transacP = NULL;
+    lwm2m_server_t * serverP;
+    coap_packet_t message[1];
+    coap_packet_t * messageP;
+    char * buffer = NULL;
+    int length = 0;
+    char location[13];
+
+    if (deferredP->type == COAP_TYPE_CON)
+    {
+        serverP = prv_findServer(contextP, deferredP->sessionH);
+        if (serverP == NULL) return;
+
+        // retransmitted until the server acknowledges it
+        transacP = transaction_new_response(code, contextP->nextMID++, ENDPOINT_SERVER, (void *)serverP);
+        if (transacP == NULL) return;
+        transacP->callback = prv_responseCallback;
+        transacP->userData = (void *)contextP;
+        messageP = (coap_packet_t *)transacP->message;
+    }
+    else
+    {
+        coap_init_message(message, COAP_TYPE_NON, code, contextP->nextMID++);
+        messageP = message;
+    }
+    coap_set_header_token(messageP, deferredP->token, deferredP->tokenLen);
+
+    if (code == COAP_205_CONTENT && deferredP->code == COAP_GET)
+    {
+        lwm2m_media_type_t format = deferredP->format;
+
+        if (format == LWM2M_CONTENT_TEXT
+         && (size != 1 || dataArray->type != LWM2M_TYPE_RESSOURCE))
+        {
+            format = LWM2M_CONTENT_TLV;
+        }
+        length = lwm2m_data_serialize(&deferredP->uri, size, dataArray, format, &buffer);
+        if (length < 0)
+        {
+            messageP->code = COAP_500_INTERNAL_SERVER_ERROR;
+        }
+        else
+        {
+            uint16_t blockSize;
+
+            if (format != LWM2M_CONTENT_TEXT)
+            {
+                coap_set_header_content_type(messageP, format);
+            }
+            packet_get_sizes(contextP, deferredP->sessionH, NULL, &blockSize);
+            if (deferredP->blockSize != 0 && deferredP->blockSize < blockSize) blockSize = deferredP->blockSize;
+            if (length <= blockSize)
+            {
+                coap_set_payload(messageP, buffer, length);
+            }
+            else if (block2_keep_blocks(contextP, deferredP->sessionH, &deferredP->uri, deferredP->format, messageP, (uint8_t *)buffer, length, blockSize))
+            {
+                // now owned by block2.c
+                buffer = NULL;
+            }
+            else
+            {
+                messageP->code = COAP_500_INTERNAL_SERVER_ERROR;
+                coap_set_payload(messageP, NULL, 0);
+            }
+        }
+    }
+    else if (code == COAP_201_CREATED && LWM2M_URI_IS_SET_INSTANCE((&deferredP->uri)))
+    {
+        if (0 < snprintf(location, sizeof(location), "/%hu/%hu", deferredP->uri.objectId, deferredP->uri.instanceId))
+        {
+            coap_set_header_location_path(messageP, location);
+        }
+    }
+
+    if (transacP != NULL)
+    {
+        contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transacP);
+        transaction_send(contextP, transacP);
+    }
+    else
+    {
+        message_send(contextP, messageP, deferredP->sessionH);
+    }
+
+    if (buffer != NULL) lwm2m_free(buffer);
+}
+
+bool deferred_isPending(lwm2m_context_t * contextP,
+                        void * fromSessionH,
+                        uint16_t mid)
+{
+    lwm2m_deferred_t * deferredP;
+
+    for (deferredP = contextP->deferredList ; deferredP != NULL ; deferredP = deferredP->next)
+    {
+        if (deferredP->sessionH == fromSessionH && deferredP->mid == mid) return true;
+    }
+
+    return false;
+}
+
+int lwm2m_complete_request(lwm2m_context_t * contextP,
+                           lwm2m_uri_t * uriP,
+                           uint8_t code,
+                           int size,
+                           lwm2m_tlv_t * dataArray)
+{
+    lwm2m_deferred_t ** deferredP;
+    int count;
+
+    count = 0;
+    deferredP = &contextP->deferredList;
+    while (*deferredP != NULL)
+    {
+        if (uri_isSame(&(*deferredP)->uri, uriP))
+        {
+            lwm2m_deferred_t * targetP = *deferredP;
+
+            *deferredP = targetP->next;
+            prv_send(contextP, targetP, code, size, dataArray);
+            lwm2m_free(targetP);
+            count++;
+        }
+        else
+        {
+            deferredP = &(*deferredP)->next;
+        }
+    }
+
+    if (count != 0 && (code == COAP_201_CREATED || code == COAP_202_DELETED))
+    {
+        lwm2m_object_instances_changed(contextP, uriP->objectId);
+    }
+
+    return count;
+}
+
+void deferred_step(lwm2m_context_t * contextP,
+                   time_t currentTime)
+{
+    lwm2m_deferred_t ** deferredP;
+
+    deferredP = &contextP->deferredList;
+    while (*deferredP != NULL)
+    {
+        // the server gave up waiting for the response
+        if ((*deferredP)->time + COAP_EXCHANGE_LIFETIME <= currentTime)
+        {
+            lwm2m_deferred_t * targetP = *deferredP;
+
+            *deferredP = targetP->next;
+            lwm2m_free(targetP);
+        }
+        else
+        {
+            deferredP = &(*deferredP)->next;
+        }
+    }
+}
+
+void deferred_close(lwm2m_context_t * contextP)
+{
+    while (contextP->deferredList != NULL)
+    {
+        lwm2m_deferred_t * deferredP;
+
+        deferredP = contextP->deferredList;
+        contextP->deferredList = deferredP->next;
+        lwm2m_free(deferredP);
+    }
+}
+
+#endif
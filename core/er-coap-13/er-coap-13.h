@@ -51,9 +51,10 @@
 /*
  * The maximum buffer size that is provided for resource responses and must be respected due to the limited IP buffer.
  * Larger data must be handled by the resource and will be sent chunk-wise through a TCP stream or CoAP blocks.
+ * liblwm2m chooses the block size at run time, this is only its upper bound (the largest CoAP block).
  */
 #ifndef REST_MAX_CHUNK_SIZE
-#define REST_MAX_CHUNK_SIZE     128
+#define REST_MAX_CHUNK_SIZE     1024
 #endif
 
 #define COAP_DEFAULT_MAX_AGE                 60
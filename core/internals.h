@@ -66,9 +66,46 @@
 #define LOG(...)
 #endif
 
+// record an event if lwm2m_trace_start() was called
+#define TRACE(C, E, T, K, M, I) do { if ((C)->trace != NULL) trace_add((C), (E), (T), (K), (M), (I)); } while (0)
+
 #define LWM2M_DEFAULT_LIFETIME  86400
+// registrations are updated this many seconds before they expire, at half their lifetime if shorter
+#define LWM2M_UPDATE_MARGIN     60
 
-#define LWM2M_MAX_PACKET_SIZE 198
+// Defaults of lwm2m_context_t::packetSize and lwm2m_context_t::blockSize
+#ifndef LWM2M_DEFAULT_PACKET_SIZE
+#define LWM2M_DEFAULT_PACKET_SIZE   198
+#endif
+#ifndef LWM2M_DEFAULT_BLOCK_SIZE
+#define LWM2M_DEFAULT_BLOCK_SIZE    128
+#endif
+#define LWM2M_MIN_BLOCK_SIZE        16
+
+// Largest request payload accepted in Block1 transfers, bounded by coap_packet_t::payload_len
+#ifndef LWM2M_BLOCK1_MAX_SIZE
+#define LWM2M_BLOCK1_MAX_SIZE   0xFFFF
+#endif
+
+// Block2 requests in flight when following a response sent in several blocks
+#ifndef LWM2M_DEFAULT_BLOCK2_WINDOW
+#define LWM2M_DEFAULT_BLOCK2_WINDOW 4
+#endif
+
+#define LWM2M_ETAG_LEN 4
+
+// Default of lwm2m_context_t::etagMaxAge in seconds
+#ifndef LWM2M_DEFAULT_ETAG_MAX_AGE
+#define LWM2M_DEFAULT_ETAG_MAX_AGE  60
+#endif
+
+// MAX_TRANSMIT_WAIT: time a client in queue mode keeps listening after sending a message
+#define LWM2M_QUEUE_AWAKE_TIME 93
+// longest time a client in queue mode holds a notification by default
+#define LWM2M_DEFAULT_QUEUE_DELAY 30
+
+// RFC 7252 EXCHANGE_LIFETIME in seconds
+#define COAP_EXCHANGE_LIFETIME  247
 
 #define URI_REGISTRATION_SEGMENT        "rd"
 #define URI_REGISTRATION_SEGMENT_LEN    2
@@ -82,8 +119,10 @@
 #define LWM2M_URI_MASK_TYPE (uint8_t)0x70
 #define LWM2M_URI_MASK_ID   (uint8_t)0x07
 
-typedef struct
+typedef struct _dm_data_
 {
+    struct _dm_data_ * next;    // other callers waiting for the same response
+    lwm2m_context_t * contextP;
     lwm2m_uri_t uri;
     lwm2m_result_callback_t callback;
     void * userData;
@@ -95,26 +134,55 @@ typedef struct _obs_list_
     lwm2m_observed_t * item;
 } obs_list_t;
 
+// Longest SenML record name is "/65535/65535/65535/65535"
+#define SENML_NAME_MAX_LEN  24
+
+// Used to build a lwm2m_tlv_t tree from SenML records
+typedef struct
+{
+    lwm2m_uri_t *   uriP;
+    lwm2m_tlv_t *   tlvP;
+    size_t          size;
+} senml_tlv_builder_t;
+
+// Base fields carried from one SenML record to the next ones while decoding
+typedef struct
+{
+    uint8_t *           name;
+    size_t              nameLength;
+    double              time;
+    lwm2m_data_type_t   valueType;
+    int64_t             integerValue;
+    double              floatValue;
+} senml_base_t;
+
 // defined in uri.c
 int prv_get_number(const char * uriString, size_t uriLength);
 lwm2m_uri_t * lwm2m_decode_uri(multi_option_t *uriPath);
 
 // defined in objects.c
-coap_status_t object_read(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, char ** bufferP, int * lengthP);
-coap_status_t object_write(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, char * buffer, int length);
-coap_status_t object_create(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, char * buffer, int length);
-coap_status_t object_execute(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, char * buffer, int length);
+coap_status_t object_read(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, lwm2m_media_type_t * formatP, char ** bufferP, int * lengthP);
+coap_status_t object_write(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, lwm2m_media_type_t format, uint8_t * buffer, size_t length);
+coap_status_t object_create(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, lwm2m_media_type_t format, uint8_t * buffer, size_t length);
+coap_status_t object_execute(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, uint8_t * buffer, size_t length);
 coap_status_t object_delete(lwm2m_context_t * contextP, lwm2m_uri_t * uriP);
 bool object_isInstanceNew(lwm2m_context_t * contextP, uint16_t objectId, uint16_t instanceId);
 int prv_getRegisterPayload(lwm2m_context_t * contextP, char * buffer, size_t length);
 int object_getServers(lwm2m_context_t * contextP);
+// Sort objectList by ID and build the instance maps of the objects
+int object_buildIndex(lwm2m_context_t * contextP);
+void object_freeIndex(lwm2m_context_t * contextP);
 
 // defined in transaction.c
 lwm2m_transaction_t * transaction_new(coap_method_t method, lwm2m_uri_t * uriP, uint16_t mID, lwm2m_endpoint_type_t peerType, void * peerP);
+lwm2m_transaction_t * transaction_new_response(coap_status_t code, uint16_t mID, lwm2m_endpoint_type_t peerType, void * peerP);
 int transaction_send(lwm2m_context_t * contextP, lwm2m_transaction_t * transacP);
+void transaction_set_token(lwm2m_transaction_t * transacP, uint16_t value);
 void transaction_free(lwm2m_transaction_t * transacP);
+void transaction_unlink(lwm2m_context_t * contextP, lwm2m_transaction_t * transacP);
 void transaction_remove(lwm2m_context_t * contextP, lwm2m_transaction_t * transacP);
 void transaction_handle_response(lwm2m_context_t * contextP, void * fromSessionH, coap_packet_t * message);
+int transaction_set_payload(lwm2m_context_t * contextP, lwm2m_transaction_t * transacP, uint8_t * buffer, int length);
 
 // defined in management.c
 coap_status_t handle_dm_request(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, void * fromSessionH, coap_packet_t * message, coap_packet_t * response);
@@ -122,20 +190,132 @@ coap_status_t handle_dm_request(lwm2m_context_t * contextP, lwm2m_uri_t * uriP,
 // defined in observe.c
 coap_status_t handle_observe_request(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, void * fromSessionH, coap_packet_t * message, coap_packet_t * response);
 void cancel_observe(lwm2m_context_t * contextP, uint16_t mid, void * fromSessionH);
+void observe_flush(lwm2m_context_t * contextP);
 
 // defined in registration.c
 coap_status_t handle_registration_request(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, void * fromSessionH, coap_packet_t * message, coap_packet_t * response);
 void registration_deregister(lwm2m_context_t * contextP, lwm2m_server_t * serverP);
-void prv_freeClient(lwm2m_client_t * clientP);
+int registration_update(lwm2m_context_t * contextP, lwm2m_server_t * serverP);
+time_t registration_updateTime(lwm2m_server_t * serverP, uint32_t margin);
+void prv_freeClient(lwm2m_context_t * contextP, lwm2m_client_t * clientP);
+
+// defined in clients.c
+int clients_add(lwm2m_context_t * contextP, lwm2m_client_t * clientP);
+void clients_remove(lwm2m_context_t * contextP, lwm2m_client_t * clientP);
+lwm2m_client_t * clients_find(lwm2m_context_t * contextP, uint16_t id);
+lwm2m_client_t * clients_findByName(lwm2m_context_t * contextP, const char * name);
+// Return the next client after previousP using sessionH, from the first one if previousP is NULL
+lwm2m_client_t * clients_findBySession(lwm2m_context_t * contextP, void * sessionH, lwm2m_client_t * previousP);
+void * clients_getSession(lwm2m_context_t * contextP, lwm2m_client_t * clientP);
+void clients_setSession(lwm2m_context_t * contextP, lwm2m_client_t * clientP, void * sessionH);
+void clients_setEndOfLife(lwm2m_context_t * contextP, lwm2m_client_t * clientP, time_t endOfLife);
+// Remove the expired clients and return the seconds until the next expiry or -1
+int clients_step(lwm2m_context_t * contextP, time_t currentTime);
+void clients_close(lwm2m_context_t * contextP);
+
+// defined in layout.c
+lwm2m_client_layout_t * layout_acquire(lwm2m_context_t * contextP, uint8_t * payload, uint16_t length);
+void layout_release(lwm2m_context_t * contextP, lwm2m_client_layout_t * layoutP);
+void layout_close(lwm2m_context_t * contextP);
+// Check if payload is the one the layout was built from
+bool layout_isSame(lwm2m_client_layout_t * layoutP, uint8_t * payload, uint16_t length);
+lwm2m_client_object_t * layout_getObjects(lwm2m_client_layout_t * layoutP);
+// Check if the instances of objectId differ between two layouts
+bool layout_hasChanged(lwm2m_client_layout_t * oldP, lwm2m_client_layout_t * newP, uint16_t objectId);
+// Check if the object and instance of uriP are in the layout
+bool layout_contains(lwm2m_client_layout_t * layoutP, lwm2m_uri_t * uriP);
+
+// defined in block1.c
+coap_status_t block1_handle_request(lwm2m_context_t * contextP, void * fromSessionH, coap_packet_t * message, uint8_t ** bufferP, size_t * lengthP);
+void block1_step(lwm2m_context_t * contextP, time_t currentTime);
+void block1_close(lwm2m_context_t * contextP);
+
+// defined in block2.c
+int block2_handle_response(lwm2m_context_t * contextP, lwm2m_transaction_t * transacP, coap_packet_t * message);
+lwm2m_block2_data_t * block2_keep_response(lwm2m_context_t * contextP, void * fromSessionH, coap_packet_t * message, coap_packet_t * response);
+// Keep buffer, a read result of uriP in format, and put its first block in messageP.
+// Return false if it could not be kept, buffer is not freed then.
+bool block2_keep_blocks(lwm2m_context_t * contextP, void * sessionH, lwm2m_uri_t * uriP, lwm2m_media_type_t format, coap_packet_t * messageP, uint8_t * buffer, size_t length, uint16_t blockSize);
+lwm2m_block2_data_t * block2_read_response(lwm2m_context_t * contextP, void * fromSessionH, coap_packet_t * message, coap_packet_t * response);
+void block2_remove_response(lwm2m_context_t * contextP, lwm2m_block2_data_t * block2P);
+void block2_step(lwm2m_context_t * contextP, time_t currentTime);
+void block2_close(lwm2m_context_t * contextP);
+
+// defined in deferred.c
+coap_status_t deferred_add(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, void * fromSessionH, coap_packet_t * message);
+// Check if the request fromSessionH sent with mid waits for its separate response
+bool deferred_isPending(lwm2m_context_t * contextP, void * fromSessionH, uint16_t mid);
+void deferred_step(lwm2m_context_t * contextP, time_t currentTime);
+void deferred_close(lwm2m_context_t * contextP);
+
+// defined in dedup.c
+bool dedup_replay(lwm2m_context_t * contextP, void * fromSessionH, uint16_t mid);
+void dedup_store(lwm2m_context_t * contextP, void * sessionH, uint16_t mid, uint8_t * buffer, size_t length);
+void dedup_step(lwm2m_context_t * contextP, time_t currentTime);
+void dedup_close(lwm2m_context_t * contextP);
 
 // defined in packet.c
 coap_status_t message_send(lwm2m_context_t * contextP, coap_packet_t * message, void * sessionH);
+// send a datagram through lwm2m_context_t::bufferSendCallback
+uint8_t packet_send(lwm2m_context_t * contextP, void * sessionH, uint8_t * buffer, size_t length);
+void packet_get_sizes(lwm2m_context_t * contextP, void * sessionH, uint16_t * packetSizeP, uint16_t * blockSizeP);
+
+// defined in cache.c
+void cache_update(lwm2m_context_t * contextP, lwm2m_client_t * clientP, lwm2m_uri_t * uriP, lwm2m_media_type_t format, uint8_t * payload, size_t payloadLength);
+void cache_invalidate(lwm2m_client_t * clientP, lwm2m_uri_t * uriP);
+void cache_set_etag(lwm2m_client_t * clientP, lwm2m_uri_t * uriP, coap_packet_t * requestP);
+void cache_keep_response(lwm2m_context_t * contextP, lwm2m_client_t * clientP, lwm2m_uri_t * uriP, coap_packet_t * packet);
+bool cache_validate_response(lwm2m_client_t * clientP, lwm2m_uri_t * uriP, coap_packet_t * packet);
+void cache_step(lwm2m_context_t * contextP, time_t currentTime);
+void cache_free(lwm2m_client_t * clientP);
+
+// defined in stats.c
+void stats_received(lwm2m_context_t * contextP, coap_packet_t * message);
+void stats_sent(lwm2m_context_t * contextP, uint8_t * buffer, size_t length);
+void stats_rtt(lwm2m_context_t * contextP, lwm2m_transaction_t * transacP);
+
+// defined in trace.c
+void trace_add(lwm2m_context_t * contextP, lwm2m_trace_event_t event, uint8_t type, uint8_t code, uint16_t mid, uint16_t id);
+
+// defined in queue.c
+bool queue_isQueueMode(lwm2m_binding_t binding);
+bool queue_isSleeping(lwm2m_context_t * contextP, lwm2m_server_t * serverP);
+void queue_holdNotification(lwm2m_context_t * contextP);
+void queue_listen(lwm2m_context_t * contextP);
+int queue_step(lwm2m_context_t * contextP, time_t currentTime);
+int queue_send(lwm2m_context_t * contextP, lwm2m_transaction_t * transacP);
+void queue_wakeup(lwm2m_context_t * contextP, void * fromSessionH);
+void queue_free(lwm2m_client_t * clientP);
 
 // defined in observe.c
 void handle_observe_notify(lwm2m_context_t * contextP, void * fromSessionH, coap_packet_t * message);
 void observation_remove(lwm2m_client_t * clientP, lwm2m_observation_t * observationP);
 
+// defined in uri.c
+// Compare a path string as returned by coap_get_multi_option_as_string() with Uri-Path options
+bool uri_matchPath(char * path, multi_option_t * optionP);
+// Check that two URIs designate the same object, instance or resource
+bool uri_isSame(lwm2m_uri_t * uri1P, lwm2m_uri_t * uri2P);
+
 // defined in utils.c
 lwm2m_binding_t lwm2m_stringToBinding(uint8_t *buffer, size_t length);
+// Time of the context, from its clock callback if set
+int utils_gettimeofday(lwm2m_context_t * contextP, struct timeval * tv);
+uint64_t utils_gettime_ms(lwm2m_context_t * contextP);
+
+// defined in data.c
+bool data_isFormatSupported(lwm2m_media_type_t format);
+lwm2m_media_type_t data_getFormat(coap_packet_t * message, bool fromAccept);
+// Compute the LWM2M_ETAG_LEN bytes ETag of a read result
+void data_getETag(lwm2m_media_type_t format, uint8_t * buffer, size_t length, uint8_t * etag);
+
+// defined in senml.c
+int senml_nameToRecord(uint8_t * name, size_t length, lwm2m_senml_record_t * recordP);
+int senml_recordName(lwm2m_senml_record_t * recordP, char * buffer);
+int senml_baseName(int count, lwm2m_senml_record_t * recordArray, char * buffer);
+void senml_applyBaseValue(senml_base_t * baseP, lwm2m_senml_record_t * recordP);
+int senml_resolveRecord(senml_base_t * baseP, uint8_t * name, size_t nameLength, double time, lwm2m_senml_record_t * recordP);
+int senml_recordsFromTlv(lwm2m_uri_t * uriP, int size, lwm2m_tlv_t * tlvP, lwm2m_senml_record_t ** recordArrayP);
+int senml_tlvBuilderCallback(lwm2m_senml_record_t * recordP, void * userData);
 
 #endif
@@ -0,0 +1,502 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Object layouts of the registered clients.
+ *
+ * The list of objects and instances sent by a client in its registration
+ * payload is decoded once per distinct payload. The layout keeps the payload
+ * and the decoded lwm2m_client_object_t list, and is shared by all the
+ * clients which sent the same payload. A fleet of identical devices thus
+ * stores a single copy of its layout.
+ *
+ * Layouts are immutable and reference counted. They are found by comparing
+ * the payload as received: a registration update carrying the same payload
+ * as the current layout is detected without decoding it. They are chained
+ * in a hash table on the FNV-1a hash of the payload, grown with the number
+ * of layouts.
+ *
+ * A new payload is parsed in a single pass into a sorted array of links,
+ * (object ID << 16) | instance ID, and the lwm2m_client_object_t list is
+ * built from it. Both live in the same allocation as the layout. Comparing
+ * the links of an object in two layouts is a binary search and a memcmp().
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LWM2M_SERVER_MODE
+
+// link without instance, sorted after the instances of its object
+#define PRV_NO_INSTANCE     LWM2M_MAX_ID
+#define PRV_LINK(O, I)      (((uint32_t)(O) << 16) | (I))
+#define PRV_OBJECT(L)       ((uint16_t)((L) >> 16))
+#define PRV_INSTANCE(L)     ((uint16_t)((L) & 0xFFFF))
+
+#define PRV_FIRST_BUCKETS   16
+
+struct _lwm2m_client_layout_
+{
+    struct _lwm2m_client_layout_ *  next;       // next layout in the same bucket
+    uint32_t                        refCount;
+    uint32_t                        hash;
+    lwm2m_client_object_t *         objectList;
+    uint32_t *                      links;      // sorted, without duplicates
+    uint16_t                        count;      // number of links
+    uint16_t                        length;
+    uint8_t *                       payload;
+};
+
+struct _lwm2m_layout_table_
+{
+    lwm2m_client_layout_t **    buckets;
+    uint32_t                    bucketMask; // number of buckets minus one
+    uint32_t                    count;
+};
+
+static uint32_t prv_hash(uint8_t * payload,
+                         uint16_t length)
+{
+    uint32_t hash;
+    uint16_t i;
+
+    // 32-bit FNV-1a
+    hash = 2166136261u;
+    for (i = 0 ; i < length ; i++)
+    {
+        hash ^= payload[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// double the buckets, the table is kept as it is if memory is short
+static void prv_grow(lwm2m_layout_table_t * tableP)
+{
+    lwm2m_client_layout_t ** buckets;
+    uint32_t mask;
+    uint32_t i;
+
+    mask = tableP->bucketMask * 2 + 1;
+    buckets = (lwm2m_client_layout_t **)lwm2m_malloc((mask + 1) * sizeof(lwm2m_client_layout_t *));
+    if (buckets == NULL) return;
+    memset(buckets, 0, (mask + 1) * sizeof(lwm2m_client_layout_t *));
+
+    for (i = 0 ; i <= tableP->bucketMask ; i++)
+    {
+        while (tableP->buckets[i] != NULL)
+        {
+            lwm2m_client_layout_t * layoutP = tableP->buckets[i];
+
+            tableP->buckets[i] = layoutP->next;
+            layoutP->next = buckets[layoutP->hash & mask];
+            buckets[layoutP->hash & mask] = layoutP;
+        }
+    }
+
+    lwm2m_free(tableP->buckets);
+    tableP->buckets = buckets;
+    tableP->bucketMask = mask;
+}
+
+// parse a decimal ID, returns the index following it or 0
+static uint16_t prv_parseId(uint8_t * payload,
+                            uint16_t index,
+                            uint16_t length,
+                            uint16_t * idP)
+{
+    uint32_t value;
+    uint16_t start;
+
+    value = 0;
+    start = index;
+    while (index < length && payload[index] >= '0' && payload[index] <= '9')
+    {
+        value = value * 10 + (payload[index] - '0');
+        if (value >= LWM2M_MAX_ID) return 0;
+        index++;
+    }
+    if (index == start) return 0;
+
+    *idP = (uint16_t)value;
+    return index;
+}
+
+// index of the comma ending the link starting at index, or length
+static uint16_t prv_skipLink(uint8_t * payload,
+                             uint16_t index,
+                             uint16_t length)
+{
+    bool quoted = false;
+
+    while (index < length && (quoted || payload[index] != ','))
+    {
+        if (payload[index] == '"') quoted = !quoted;
+        index++;
+    }
+
+    return index;
+}
+
+static int prv_compareLinks(const void * left,
+                            const void * right)
+{
+    uint32_t l = *(const uint32_t *)left;
+    uint32_t r = *(const uint32_t *)right;
+
+    return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+// Parse an application/link-format (RFC6690) list of objects and instances in a single pass,
+// without allocation. linkArray holds at least one link per comma plus one.
+static uint16_t prv_parseLinks(uint8_t * payload,
+                               uint16_t length,
+                               uint32_t * linkArray)
+{
+    uint16_t count;
+    uint16_t index;
+    bool sorted;
+    uint16_t kept;
+    uint16_t i;
+
+    count = 0;
+    sorted = true;
+    index = 0;
+    while (index < length)
+    {
+        uint16_t objectId;
+        uint16_t instanceId;
+        uint16_t next;
+
+        while (index < length && payload[index] == ' ') index++;
+        if (index == length) break;
+
+        // </OBJECT> or </OBJECT/INSTANCE> followed by optional attributes, anything else is ignored
+        next = 0;
+        if (payload[index] == '<')
+        {
+            index++;
+            if (index < length && payload[index] == '/') index++;
+            next = prv_parseId(payload, index, length, &objectId);
+        }
+        if (next != 0)
+        {
+            instanceId = PRV_NO_INSTANCE;
+            index = next;
+            if (index < length && payload[index] == '/')
+            {
+                next = prv_parseId(payload, index + 1, length, &instanceId);
+                if (next != 0 && next < length && payload[next] == '>')
+                {
+                    index = next;
+                }
+                else
+                {
+                    // deeper paths only declare the object
+                    instanceId = PRV_NO_INSTANCE;
+                    while (index < length && payload[index] != '>' && payload[index] != ',') index++;
+                }
+            }
+            if (index < length && payload[index] == '>')
+            {
+                linkArray[count] = PRV_LINK(objectId, instanceId);
+                if (count > 0 && linkArray[count] < linkArray[count - 1]) sorted = false;
+                count++;
+            }
+        }
+
+        index = prv_skipLink(payload, index, length) + 1;
+    }
+
+    if (!sorted) qsort(linkArray, count, sizeof(uint32_t), prv_compareLinks);
+
+    // remove duplicates and objects also declared with instances
+    kept = 0;
+    for (i = 0 ; i < count ; i++)
+    {
+        if (kept > 0
+         && (linkArray[i] == linkArray[kept - 1]
+          || (PRV_INSTANCE(linkArray[i]) == PRV_NO_INSTANCE
+           && PRV_OBJECT(linkArray[i]) == PRV_OBJECT(linkArray[kept - 1]))))
+        {
+            continue;
+        }
+        linkArray[kept++] = linkArray[i];
+    }
+
+    return kept;
+}
+
+// index of the first link of objectId, sets countP to the number of links of the object
+static uint16_t prv_findObject(lwm2m_client_layout_t * layoutP,
+                               uint16_t objectId,
+                               uint16_t * countP)
+{
+    uint16_t low;
+    uint16_t high;
+    uint16_t end;
+
+    low = 0;
+    high = layoutP->count;
+    while (low < high)
+    {
+        uint16_t middle = low + (high - low) / 2;
+
+        if (PRV_OBJECT(layoutP->links[middle]) < objectId)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    end = low;
+    while (end < layoutP->count && PRV_OBJECT(layoutP->links[end]) == objectId) end++;
+    *countP = end - low;
+
+    return low;
+}
+
+// build the lwm2m_client_object_t list of the links in the memory of the layout
+static void prv_buildObjects(lwm2m_client_layout_t * layoutP,
+                             lwm2m_client_object_t * objectArray,
+                             lwm2m_list_t * instanceArray)
+{
+    lwm2m_client_object_t * lastObjectP = NULL;
+    lwm2m_list_t * lastInstanceP = NULL;
+    uint16_t i;
+
+    layoutP->objectList = NULL;
+    for (i = 0 ; i < layoutP->count ; i++)
+    {
+        uint16_t objectId = PRV_OBJECT(layoutP->links[i]);
+        uint16_t instanceId = PRV_INSTANCE(layoutP->links[i]);
+
+        if (lastObjectP == NULL || lastObjectP->id != objectId)
+        {
+            lwm2m_client_object_t * objectP = objectArray++;
+
+            objectP->next = NULL;
+            objectP->id = objectId;
+            objectP->instanceList = NULL;
+            if (lastObjectP == NULL)
+            {
+                layoutP->objectList = objectP;
+            }
+            else
+            {
+                lastObjectP->next = objectP;
+            }
+            lastObjectP = objectP;
+            lastInstanceP = NULL;
+        }
+        if (instanceId != PRV_NO_INSTANCE)
+        {
+            lwm2m_list_t * instanceP = instanceArray++;
+
+            instanceP->next = NULL;
+            instanceP->id = instanceId;
+            if (lastInstanceP == NULL)
+            {
+                lastObjectP->instanceList = instanceP;
+            }
+            else
+            {
+                lastInstanceP->next = instanceP;
+            }
+            lastInstanceP = instanceP;
+        }
+    }
+}
+
+bool layout_isSame(lwm2m_client_layout_t * layoutP,
+                   uint8_t * payload,
+                   uint16_t length)
+{
+    return layoutP->length == length
+        && layoutP->hash == prv_hash(payload, length)
+        && memcmp(layoutP->payload, payload, length) == 0;
+}
+
+lwm2m_client_layout_t * layout_acquire(lwm2m_context_t * contextP,
+                                       uint8_t * payload,
+                                       uint16_t length)
+{
+    lwm2m_layout_table_t * tableP;
+    lwm2m_client_layout_t * layoutP;
+    lwm2m_client_layout_t ** bucketP;
+    uint32_t hash;
+    size_t maxCount;
+    uint16_t i;
+    uint8_t * memoryP;
+
+    tableP = contextP->layoutTable;
+    if (tableP == NULL)
+    {
+        tableP = (lwm2m_layout_table_t *)lwm2m_malloc(sizeof(lwm2m_layout_table_t));
+        if (tableP == NULL) return NULL;
+        memset(tableP, 0, sizeof(lwm2m_layout_table_t));
+        tableP->buckets = (lwm2m_client_layout_t **)lwm2m_malloc(PRV_FIRST_BUCKETS * sizeof(lwm2m_client_layout_t *));
+        if (tableP->buckets == NULL)
+        {
+            lwm2m_free(tableP);
+            return NULL;
+        }
+        memset(tableP->buckets, 0, PRV_FIRST_BUCKETS * sizeof(lwm2m_client_layout_t *));
+        tableP->bucketMask = PRV_FIRST_BUCKETS - 1;
+        contextP->layoutTable = tableP;
+    }
+
+    hash = prv_hash(payload, length);
+    for (layoutP = tableP->buckets[hash & tableP->bucketMask] ; layoutP != NULL ; layoutP = layoutP->next)
+    {
+        if (layoutP->hash == hash
+         && layoutP->length == length
+         && memcmp(layoutP->payload, payload, length) == 0)
+        {
+            layoutP->refCount++;
+            return layoutP;
+        }
+    }
+
+    // a single block holds the layout, its objects, instances, links and payload
+    maxCount = 1;
+    for (i = 0 ; i < length ; i++)
+    {
+        if (payload[i] == ',') maxCount++;
+    }
+    memoryP = (uint8_t *)lwm2m_malloc(sizeof(lwm2m_client_layout_t)
+                                      + maxCount * (sizeof(lwm2m_client_object_t) + sizeof(lwm2m_list_t) + sizeof(uint32_t))
+                                      + length);
+    if (memoryP == NULL) return NULL;
+
+    layoutP = (lwm2m_client_layout_t *)memoryP;
+    layoutP->links = (uint32_t *)(memoryP + sizeof(lwm2m_client_layout_t)
+                                  + maxCount * (sizeof(lwm2m_client_object_t) + sizeof(lwm2m_list_t)));
+    layoutP->count = prv_parseLinks(payload, length, layoutP->links);
+    if (layoutP->count == 0)
+    {
+        lwm2m_free(memoryP);
+        return NULL;
+    }
+    prv_buildObjects(layoutP,
+                     (lwm2m_client_object_t *)(memoryP + sizeof(lwm2m_client_layout_t)),
+                     (lwm2m_list_t *)(memoryP + sizeof(lwm2m_client_layout_t) + maxCount * sizeof(lwm2m_client_object_t)));
+    layoutP->refCount = 1;
+    layoutP->hash = hash;
+    layoutP->length = length;
+    layoutP->payload = (uint8_t *)(layoutP->links + maxCount);
+    memcpy(layoutP->payload, payload, length);
+
+    bucketP = tableP->buckets + (hash & tableP->bucketMask);
+    layoutP->next = *bucketP;
+    *bucketP = layoutP;
+
+    tableP->count++;
+    if (tableP->count > 2 * (tableP->bucketMask + 1)) prv_grow(tableP);
+
+    return layoutP;
+}
+
+lwm2m_client_object_t * layout_getObjects(lwm2m_client_layout_t * layoutP)
+{
+    return layoutP->objectList;
+}
+
+bool layout_hasChanged(lwm2m_client_layout_t * oldP,
+                       lwm2m_client_layout_t * newP,
+                       uint16_t objectId)
+{
+    uint16_t oldStart;
+    uint16_t oldCount;
+    uint16_t newStart;
+    uint16_t newCount;
+
+    if (oldP == newP) return false;
+
+    oldStart = prv_findObject(oldP, objectId, &oldCount);
+    newStart = prv_findObject(newP, objectId, &newCount);
+
+    return oldCount != newCount
+        || memcmp(oldP->links + oldStart, newP->links + newStart, oldCount * sizeof(uint32_t)) != 0;
+}
+
+bool layout_contains(lwm2m_client_layout_t * layoutP,
+                     lwm2m_uri_t * uriP)
+{
+    uint16_t start;
+    uint16_t count;
+    uint16_t i;
+
+    start = prv_findObject(layoutP, uriP->objectId, &count);
+    if (count == 0) return false;
+    if ((uriP->flag & LWM2M_URI_FLAG_INSTANCE_ID) == 0) return true;
+
+    for (i = start ; i < start + count ; i++)
+    {
+        if (PRV_INSTANCE(layoutP->links[i]) == uriP->instanceId) return true;
+    }
+
+    return false;
+}
+
+void layout_release(lwm2m_context_t * contextP,
+                    lwm2m_client_layout_t * layoutP)
+{
+    lwm2m_layout_table_t * tableP = contextP->layoutTable;
+    lwm2m_client_layout_t ** bucketP;
+
+    if (layoutP == NULL) return;
+
+    layoutP->refCount--;
+    if (layoutP->refCount > 0) return;
+
+    bucketP = tableP->buckets + (layoutP->hash & tableP->bucketMask);
+    while (*bucketP != NULL && *bucketP != layoutP) bucketP = &(*bucketP)->next;
+    if (*bucketP != NULL) *bucketP = layoutP->next;
+    tableP->count--;
+
+    lwm2m_free(layoutP);
+}
+
+void layout_close(lwm2m_context_t * contextP)
+{
+    lwm2m_layout_table_t * tableP = contextP->layoutTable;
+    uint32_t i;
+
+    if (tableP == NULL) return;
+
+    for (i = 0 ; i <= tableP->bucketMask ; i++)
+    {
+        while (tableP->buckets[i] != NULL)
+        {
+            lwm2m_client_layout_t * layoutP = tableP->buckets[i];
+
+            tableP->buckets[i] = layoutP->next;
+            lwm2m_free(layoutP);
+        }
+    }
+    lwm2m_free(tableP->buckets);
+    lwm2m_free(tableP);
+    contextP->layoutTable = NULL;
+}
+
+#endif
@@ -79,6 +79,16 @@ lwm2m_context_t * lwm2m_init(lwm2m_connect_server_callback_t connectCallback,
         contextP->userData = userData;
         srand(time(NULL));
         contextP->nextMID = rand();
+        contextP->block2Window = LWM2M_DEFAULT_BLOCK2_WINDOW;
+        contextP->packetSize = LWM2M_DEFAULT_PACKET_SIZE;
+        contextP->blockSize = LWM2M_DEFAULT_BLOCK_SIZE;
+#ifdef LWM2M_CLIENT_MODE
+        contextP->queueListenTime = LWM2M_QUEUE_AWAKE_TIME;
+        contextP->queueMaxDelay = LWM2M_DEFAULT_QUEUE_DELAY;
+#endif
+#ifdef LWM2M_SERVER_MODE
+        contextP->etagMaxAge = LWM2M_DEFAULT_ETAG_MAX_AGE;
+#endif
     }
 
     return contextP;
@@ -139,26 +149,24 @@ void lwm2m_close(lwm2m_context_t * contextP)
         lwm2m_free(targetP);
     }
 
-   if (NULL != contextP->objectList)
+    object_freeIndex(contextP);
+    if (NULL != contextP->objectList)
     {
         lwm2m_free(contextP->objectList);
     }
 
     lwm2m_free(contextP->endpointName);
+    if (contextP->msisdn != NULL) lwm2m_free(contextP->msisdn);
+
+    deferred_close(contextP);
 #endif
 
 #ifdef LWM2M_SERVER_MODE
-    while (NULL != contextP->clientList)
-    {
-        lwm2m_client_t * clientP;
-
-        clientP = contextP->clientList;
-        contextP->clientList = contextP->clientList->next;
-
-        prv_freeClient(clientP);
-    }
+    clients_close(contextP);
 #endif
 
+    block2_close(contextP);
+
     while (NULL != contextP->transactionList)
     {
         lwm2m_transaction_t * transacP;
@@ -169,10 +177,27 @@ void lwm2m_close(lwm2m_context_t * contextP)
         transaction_free(transacP);
     }
 
+    block1_close(contextP);
+    dedup_close(contextP);
+    lwm2m_trace_stop(contextP);
+
     lwm2m_free(contextP);
 }
 
 #ifdef LWM2M_CLIENT_MODE
+// freed with lwm2m_free(), unlike strdup()
+static char * prv_strdup(const char * str)
+{
+    char * copy;
+    size_t length;
+
+    length = strlen(str) + 1;
+    copy = (char *)lwm2m_malloc(length);
+    if (copy != NULL) memcpy(copy, str, length);
+
+    return copy;
+}
+
 int lwm2m_configure(lwm2m_context_t * contextP,
                     char * endpointName,
                     char * msisdn,
@@ -197,7 +222,7 @@ int lwm2m_configure(lwm2m_context_t * contextP,
     }
     if (found != 0x07) return COAP_400_BAD_REQUEST;
 
-    contextP->endpointName = strdup(endpointName);
+    contextP->endpointName = prv_strdup(endpointName);
     if (contextP->endpointName == NULL)
     {
         return COAP_500_INTERNAL_SERVER_ERROR;
@@ -205,7 +230,7 @@ int lwm2m_configure(lwm2m_context_t * contextP,
 
     if (msisdn != NULL)
     {
-        contextP->msisdn = strdup(msisdn);
+        contextP->msisdn = prv_strdup(msisdn);
         if (contextP->msisdn == NULL)
         {
             return COAP_500_INTERNAL_SERVER_ERROR;
@@ -218,10 +243,22 @@ int lwm2m_configure(lwm2m_context_t * contextP,
         memcpy(contextP->objectList, objectList, numObject * sizeof(lwm2m_object_t *));
         contextP->numObject = numObject;
     }
-    else
+    if (NULL == contextP->objectList
+     || 0 != object_buildIndex(contextP))
     {
+        if (NULL != contextP->objectList)
+        {
+            lwm2m_free(contextP->objectList);
+            contextP->objectList = NULL;
+            contextP->numObject = 0;
+        }
         lwm2m_free(contextP->endpointName);
         contextP->endpointName = NULL;
+        if (contextP->msisdn != NULL)
+        {
+            lwm2m_free(contextP->msisdn);
+            contextP->msisdn = NULL;
+        }
         return COAP_500_INTERNAL_SERVER_ERROR;
     }
 
@@ -229,17 +266,66 @@ int lwm2m_configure(lwm2m_context_t * contextP,
 }
 #endif
 
+int lwm2m_set_packet_size(lwm2m_context_t * contextP,
+                          uint16_t packetSize,
+                          uint16_t blockSize)
+{
+    // block sizes are powers of two from 16 to 1024 (RFC 7959)
+    if (blockSize < LWM2M_MIN_BLOCK_SIZE
+     || blockSize > REST_MAX_CHUNK_SIZE
+     || (blockSize & (blockSize - 1)) != 0)
+    {
+        return COAP_400_BAD_REQUEST;
+    }
+    // a full block must fit in a datagram
+    if (packetSize < COAP_MAX_HEADER_SIZE + blockSize) return COAP_400_BAD_REQUEST;
+
+    contextP->packetSize = packetSize;
+    contextP->blockSize = blockSize;
+
+    return COAP_NO_ERROR;
+}
+
+void lwm2m_set_capture_callback(lwm2m_context_t * contextP,
+                                lwm2m_capture_callback_t callback,
+                                void * userData)
+{
+    contextP->captureCallback = callback;
+    contextP->captureUserData = userData;
+}
+
+void lwm2m_set_clock_callback(lwm2m_context_t * contextP,
+                              lwm2m_clock_callback_t callback,
+                              void * userData)
+{
+    contextP->clockCallback = callback;
+    contextP->clockUserData = userData;
+}
+
+
+// lower timeoutP to interval milliseconds
+static void prv_setTimeout(struct timeval * timeoutP,
+                           uint64_t interval)
+{
+    if ((uint64_t)timeoutP->tv_sec * 1000 + timeoutP->tv_usec / 1000 > interval)
+    {
+        timeoutP->tv_sec = interval / 1000;
+        timeoutP->tv_usec = (interval % 1000) * 1000;
+    }
+}
 
 int lwm2m_step(lwm2m_context_t * contextP,
                struct timeval * timeoutP)
 {
     lwm2m_transaction_t * transacP;
     struct timeval tv;
-#ifdef LWM2M_SERVER_MODE
-    lwm2m_client_t * clientP;
+    uint64_t now;
+#if defined(LWM2M_CLIENT_MODE) || defined(LWM2M_SERVER_MODE)
+    int interval;
 #endif
 
-    if (0 != lwm2m_gettimeofday(&tv, NULL)) return COAP_500_INTERNAL_SERVER_ERROR;
+    if (0 != utils_gettimeofday(contextP, &tv)) return COAP_500_INTERNAL_SERVER_ERROR;
+    now = utils_gettime_ms(contextP);
 
     transacP = contextP->transactionList;
     while (transacP != NULL)
@@ -248,65 +334,46 @@ int lwm2m_step(lwm2m_context_t * contextP,
         lwm2m_transaction_t * nextP = transacP->next;
         int removed = 0;
 
-        if (transacP->retrans_time <= tv.tv_sec)
+        if (transacP->retrans_time <= now)
         {
             removed = transaction_send(contextP, transacP);
         }
 
         if (0 == removed)
         {
-            time_t interval;
+            uint64_t interval;
 
-            if (transacP->retrans_time > tv.tv_sec)
+            if (transacP->retrans_time > now)
             {
-                interval = transacP->retrans_time - tv.tv_sec;
+                interval = transacP->retrans_time - now;
             }
             else
             {
                 interval = 1;
             }
 
-            if (timeoutP->tv_sec > interval)
-            {
-                timeoutP->tv_sec = interval;
-            }
+            prv_setTimeout(timeoutP, interval);
         }
 
         transacP = nextP;
     }
 #ifdef LWM2M_CLIENT_MODE
     lwm2m_update_registrations(contextP, tv.tv_sec, timeoutP);
+    deferred_step(contextP, tv.tv_sec);
+    interval = queue_step(contextP, tv.tv_sec);
+    if (interval >= 0) prv_setTimeout(timeoutP, (uint64_t)interval * 1000);
 #endif
 
-#ifdef LWM2M_SERVER_MODE
-    // monitor clients lifetime
-    clientP = contextP->clientList;
-    while (clientP != NULL)
-    {
-        lwm2m_client_t * nextP = clientP->next;
-
-        if (clientP->endOfLife <= tv.tv_sec)
-        {
-            contextP->clientList = (lwm2m_client_t *)LWM2M_LIST_RM(contextP->clientList, clientP->internalID, NULL);
-            if (contextP->monitorCallback != NULL)
-            {
-                contextP->monitorCallback(clientP->internalID, NULL, DELETED_2_02, NULL, 0, contextP->monitorUserData);
-            }
-            prv_freeClient(clientP);
-        }
-        else
-        {
-            time_t interval;
+    block1_step(contextP, tv.tv_sec);
+    block2_step(contextP, tv.tv_sec);
+    dedup_step(contextP, tv.tv_sec);
 
-            interval = clientP->endOfLife - tv.tv_sec;
+#ifdef LWM2M_SERVER_MODE
+    cache_step(contextP, tv.tv_sec);
 
-            if (timeoutP->tv_sec > interval)
-            {
-                timeoutP->tv_sec = interval;
-            }
-        }
-        clientP = nextP;
-    }
+    // monitor clients lifetime
+    interval = clients_step(contextP, tv.tv_sec);
+    if (interval >= 0) prv_setTimeout(timeoutP, (uint64_t)interval * 1000);
 #endif
 
     return 0;
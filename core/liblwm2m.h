@@ -66,6 +66,9 @@ void *lwm2m_malloc(size_t s);
 void lwm2m_free(void *p);
 #endif
 
+// monotonic time in milliseconds, used for retransmissions. Provided by the platform in LWM2M_EMBEDDED_MODE.
+uint64_t lwm2m_gettime_ms(void);
+
 /*
  * Error code
  */
@@ -74,17 +77,25 @@ void lwm2m_free(void *p);
 
 #define COAP_201_CREATED                (uint8_t)0x41
 #define COAP_202_DELETED                (uint8_t)0x42
+#define COAP_203_VALID                  (uint8_t)0x43
 #define COAP_204_CHANGED                (uint8_t)0x44
 #define COAP_205_CONTENT                (uint8_t)0x45
+#define COAP_231_CONTINUE               (uint8_t)0x5F
 #define COAP_400_BAD_REQUEST            (uint8_t)0x80
 #define COAP_401_UNAUTHORIZED           (uint8_t)0x81
 #define COAP_404_NOT_FOUND              (uint8_t)0x84
 #define COAP_405_METHOD_NOT_ALLOWED     (uint8_t)0x85
 #define COAP_406_NOT_ACCEPTABLE         (uint8_t)0x86
+#define COAP_408_REQUEST_ENTITY_INCOMPLETE (uint8_t)0x88
+#define COAP_413_ENTITY_TOO_LARGE       (uint8_t)0x8D
+#define COAP_415_UNSUPPORTED_MEDIA_TYPE (uint8_t)0x8F
 #define COAP_500_INTERNAL_SERVER_ERROR  (uint8_t)0xA0
 #define COAP_501_NOT_IMPLEMENTED        (uint8_t)0xA1
 #define COAP_503_SERVICE_UNAVAILABLE    (uint8_t)0xA3
 
+// Not a CoAP code: returned by object callbacks answering later with lwm2m_complete_request()
+#define COAP_PENDING                    (uint8_t)0xFF
+
 /*
  * Standard Object IDs
  */
@@ -161,7 +172,22 @@ uint16_t lwm2m_list_newId(lwm2m_list_t * head);
  */
 
 // defined in utils.c
+// These functions parse the plain text representation of a value. They return 1 on success,
+// 0 if the buffer is not a valid representation or if the value overflows.
 int lwm2m_PlainTextToInt64(char * buffer, int length, int64_t * dataP);
+int lwm2m_PlainTextToFloat64(char * buffer, int length, double * dataP);
+
+/*
+ * These utility functions write the plain text representation of data in
+ * the provided buffer. They return the size in bytes of the representation
+ * or 0 if the buffer is too small. They do not allocate any memory.
+ * Floats are written with the shortest representation parsing back to the
+ * same value.
+ * There is no trailing '\0' character in the buffer.
+ */
+int lwm2m_int64ToPlainTextBuffer(int64_t data, char * buffer, size_t length);
+int lwm2m_float64ToPlainTextBuffer(double data, char * buffer, size_t length);
+int lwm2m_boolToPlainTextBuffer(bool data, char * buffer, size_t length);
 
 /*
  * These utility functions allocate a new buffer storing the plain text
@@ -178,11 +204,30 @@ int lwm2m_float64ToPlainText(double data, char ** bufferP);
 int lwm2m_boolToPlainText(bool data, char ** bufferP);
 
 
+/*
+ * Content formats
+ *
+ * Values of the CoAP Content-Format and Accept options.
+ * LWM2M_CONTENT_TEXT is also used when no option is present.
+ */
+typedef enum
+{
+    LWM2M_CONTENT_TEXT       = 0,
+    LWM2M_CONTENT_LINK       = 40,
+    LWM2M_CONTENT_OPAQUE     = 42,
+    LWM2M_CONTENT_SENML_JSON = 110,
+    LWM2M_CONTENT_SENML_CBOR = 112,
+    LWM2M_CONTENT_TLV        = 1542
+} lwm2m_media_type_t;
+
+
 /*
  * TLV
  */
 
 #define LWM2M_TLV_HEADER_MAX_LENGTH 6
+// longest value written by lwm2m_tlv_encode_int() and lwm2m_tlv_encode_float()
+#define LWM2M_TLV_NUMBER_MAX_LENGTH 32
 
 #define LWM2M_TYPE_RESSOURCE            0x00
 #define LWM2M_TYPE_MULTIPLE_RESSOURCE   0x01
@@ -199,6 +244,22 @@ int lwm2m_boolToPlainText(bool data, char ** bufferP);
 #define LWM2M_TLV_FLAG_STATIC_DATA  0x01
 #define LWM2M_TLV_FLAG_TEXT_FORMAT  0x02
 
+/*
+ * Type of the data stored in lwm2m_tlv_t::value.
+ * TLV carries no type information so this is only a hint used by the
+ * content formats which do (SenML). It is set by the lwm2m_tlv_encode_*()
+ * functions. LWM2M_DATA_UNDEFINED values are handled as strings.
+ */
+typedef enum
+{
+    LWM2M_DATA_UNDEFINED = 0,
+    LWM2M_DATA_STRING,
+    LWM2M_DATA_OPAQUE,
+    LWM2M_DATA_INTEGER,
+    LWM2M_DATA_FLOAT,
+    LWM2M_DATA_BOOLEAN
+} lwm2m_data_type_t;
+
 typedef enum
 {
     TLV_OBJECT_INSTANCE = LWM2M_TYPE_OBJECT_INSTANCE,
@@ -211,6 +272,7 @@ typedef struct
 {
     uint8_t     flags;
     uint8_t     type;
+    uint8_t     dataType;   // a lwm2m_data_type_t
     uint16_t    id;
     size_t      length;
     uint8_t *   value;
@@ -225,6 +287,14 @@ void lwm2m_tlv_encode_int(int64_t data, lwm2m_tlv_t * tlvP);
 int lwm2m_tlv_decode_int(lwm2m_tlv_t * tlvP, int64_t * dataP);
 void lwm2m_tlv_encode_bool(bool data, lwm2m_tlv_t * tlvP);
 int lwm2m_tlv_decode_bool(lwm2m_tlv_t * tlvP, bool * dataP);
+void lwm2m_tlv_encode_float(double data, lwm2m_tlv_t * tlvP);
+int lwm2m_tlv_decode_float(lwm2m_tlv_t * tlvP, double * dataP);
+
+// Same as lwm2m_tlv_encode_int() and lwm2m_tlv_encode_float() without allocation: the value is
+// written in buffer, which must outlive tlvP, and LWM2M_TLV_FLAG_STATIC_DATA is set.
+// A buffer of LWM2M_TLV_NUMBER_MAX_LENGTH bytes is always large enough.
+void lwm2m_tlv_encode_int_buffer(int64_t data, lwm2m_tlv_t * tlvP, uint8_t * buffer, size_t bufferLen);
+void lwm2m_tlv_encode_float_buffer(double data, lwm2m_tlv_t * tlvP, uint8_t * buffer, size_t bufferLen);
 
 
 /*
@@ -273,6 +343,74 @@ typedef struct
 int lwm2m_stringToUri(char * buffer, size_t buffer_len, lwm2m_uri_t * uriP);
 
 
+/*
+ * Content format independent payload handling
+ *
+ * lwm2m_data_parse() returns the number of lwm2m_tlv_t in *dataP or 0 in case
+ * of error. Depending on the format, the lwm2m_tlv_t values may point inside
+ * buffer. The SenML-JSON decoder unescapes strings and decodes base64 values
+ * in place, so buffer is modified. When uriP has no instance ID, SenML records are grouped in
+ * LWM2M_TYPE_OBJECT_INSTANCE lwm2m_tlv_t.
+ * lwm2m_data_serialize() returns the length of the allocated *bufferP or -1
+ * in case of error. LWM2M_CONTENT_TEXT and LWM2M_CONTENT_OPAQUE are only
+ * valid for a single resource.
+ */
+
+// defined in data.c
+int lwm2m_data_parse(lwm2m_uri_t * uriP, char * buffer, size_t bufferLen, lwm2m_media_type_t format, lwm2m_tlv_t ** dataP);
+int lwm2m_data_serialize(lwm2m_uri_t * uriP, int size, lwm2m_tlv_t * tlvP, lwm2m_media_type_t format, char ** bufferP);
+
+
+/*
+ * SenML
+ *
+ * A record holds the resolved name (base name and name) of a SenML record
+ * and its value. resourceInstanceId is LWM2M_MAX_ID if the name does not
+ * target a resource instance. time is the resolved time (base time and time)
+ * or 0 if absent.
+ * String and opaque values point inside the parsed payload.
+ */
+
+typedef struct
+{
+    lwm2m_uri_t         uri;
+    uint16_t            resourceInstanceId;
+    double              time;
+    lwm2m_data_type_t   type;
+    union
+    {
+        bool        asBoolean;
+        int64_t     asInteger;
+        double      asFloat;
+        struct
+        {
+            size_t      length;
+            uint8_t *   buffer;
+        } asBuffer;
+    } value;
+} lwm2m_senml_record_t;
+
+// Called for each decoded record. Return 0 to continue the parsing.
+typedef int (*lwm2m_senml_callback_t) (lwm2m_senml_record_t * recordP, void * userData);
+
+// defined in senml_cbor.c
+// Stream the records of a SenML-CBOR payload to the callback without allocating memory.
+// Return the number of records read or -1 in case of error.
+int lwm2m_senml_cbor_parse(uint8_t * buffer, size_t length, lwm2m_senml_callback_t callback, void * userData);
+// Encode the records, using base name and base time compression.
+// Return the length of the allocated *bufferP or -1 in case of error.
+int lwm2m_senml_cbor_serialize(int count, lwm2m_senml_record_t * recordArray, uint8_t ** bufferP);
+
+// defined in senml_json.c
+// Stream the records of a SenML-JSON payload to the callback. Unescaped strings point
+// inside the payload, escaped strings and opaque values are decoded in place in buffer.
+// Return the number of records read or -1 in case of error.
+int lwm2m_senml_json_parse(uint8_t * buffer, size_t length, lwm2m_senml_callback_t callback, void * userData);
+// Encode the records in a single pass, using base name and base time compression.
+// Return the length of the allocated *bufferP or -1 in case of error.
+int lwm2m_senml_json_serialize(int count, lwm2m_senml_record_t * recordArray, uint8_t ** bufferP);
+
+
 /*
  * LWM2M Objects
  *
@@ -294,7 +432,7 @@ typedef void (*lwm2m_close_callback_t) (lwm2m_object_t * objectP);
 struct _lwm2m_object_t
 {
     uint16_t                 objID;
-    lwm2m_list_t *           instanceList;
+    lwm2m_list_t *           instanceList;  // sorted by ID, see lwm2m_object_instances_changed() when changing it
     lwm2m_read_callback_t    readFunc;
     lwm2m_write_callback_t   writeFunc;
     lwm2m_execute_callback_t executeFunc;
@@ -304,6 +442,9 @@ struct _lwm2m_object_t
     void *                   userData;
 };
 
+// existing instances of an object, kept by the core
+typedef struct _lwm2m_instance_map_ lwm2m_instance_map_t;
+
 /*
  * LWM2M Servers
  *
@@ -343,6 +484,8 @@ typedef struct _lwm2m_server_
     lwm2m_status_t    status;
     char *            location;
     uint16_t          mid;
+    uint16_t          packetSize;   // largest datagram sent to this server or 0 to use lwm2m_context_t::packetSize
+    uint16_t          blockSize;    // preferred block size with this server or 0 to use lwm2m_context_t::blockSize
 } lwm2m_server_t;
 
 
@@ -350,8 +493,9 @@ typedef struct _lwm2m_server_
  * LWM2M result callback
  *
  * When used with an observe, if 'data' is not nil, 'status' holds the observe counter.
+ * 'format' is the Content-Format of 'data'.
  */
-typedef void (*lwm2m_result_callback_t) (uint16_t clientID, lwm2m_uri_t * uriP, int status, uint8_t * data, int dataLength, void * userData);
+typedef void (*lwm2m_result_callback_t) (uint16_t clientID, lwm2m_uri_t * uriP, int status, lwm2m_media_type_t format, uint8_t * data, int dataLength, void * userData);
 
 /*
  * LWM2M Observations
@@ -386,6 +530,19 @@ typedef struct _lwm2m_client_object_
     lwm2m_list_t *           instanceList;
 } lwm2m_client_object_t;
 
+// objects of a client, shared by the clients which registered the same list
+typedef struct _lwm2m_client_layout_ lwm2m_client_layout_t;
+typedef struct _lwm2m_layout_table_ lwm2m_layout_table_t;
+
+// end of life and session of the clients, indexed by internal ID
+typedef struct _lwm2m_client_table_ lwm2m_client_table_t;
+
+/*
+ * Last known resource values of a client
+ */
+typedef struct _lwm2m_cache_entry_ lwm2m_cache_entry_t;
+typedef struct _lwm2m_cache_response_ lwm2m_cache_response_t;
+
 typedef struct _lwm2m_client_
 {
     struct _lwm2m_client_ * next;       // matches lwm2m_list_t::next
@@ -394,10 +551,16 @@ typedef struct _lwm2m_client_
     lwm2m_binding_t         binding;
     char *                  msisdn;
     uint32_t                lifetime;
-    time_t                  endOfLife;
-    void *                  sessionH;
-    lwm2m_client_object_t * objectList;
+    lwm2m_client_layout_t * layout;
+    lwm2m_client_object_t * objectList; // from layout, read only
     lwm2m_observation_t *   observationList;
+    lwm2m_media_type_t      format;     // requested in reads and observations, LWM2M_CONTENT_TEXT lets the client choose
+    uint16_t                packetSize; // largest datagram sent to this client or 0 to use lwm2m_context_t::packetSize
+    uint16_t                blockSize;  // preferred block size with this client or 0 to use lwm2m_context_t::blockSize
+    lwm2m_cache_entry_t *   cacheList;
+    lwm2m_cache_response_t * responseList;  // last responses with an ETag
+    time_t                  lastSeen;   // last message received from the client
+    struct _lwm2m_transaction_ * queueList; // requests waiting for a client in queue mode to wake up
 } lwm2m_client_t;
 
 
@@ -425,7 +588,10 @@ struct _lwm2m_transaction_
     lwm2m_endpoint_type_t peerType;
     void *                peerP;
     uint8_t  retrans_counter;
-    time_t   retrans_time;
+    uint64_t retrans_time;      // next (re)transmission, in milliseconds of the context clock
+    uint32_t retrans_timeout;   // current timeout in ms
+    bool     ack_received;      // empty ACK received, waiting for a separate response
+    uint64_t send_time;         // first transmission, in milliseconds of the context clock
     char objStringID[LWM2M_STRING_ID_MAX_LEN];
     char instanceStringID[LWM2M_STRING_ID_MAX_LEN];
     char resourceStringID[LWM2M_STRING_ID_MAX_LEN];
@@ -434,8 +600,30 @@ struct _lwm2m_transaction_
     uint8_t * buffer;
     lwm2m_transaction_callback_t callback;
     void * userData;
+    uint8_t * payload;      // whole request payload when sent in several blocks
+    size_t payload_len;
 };
 
+/*
+ * Block1 transfers being received
+ */
+typedef struct _lwm2m_block1_data_ lwm2m_block1_data_t;
+
+/*
+ * Responses being sent in several Block2 blocks
+ */
+typedef struct _lwm2m_block2_data_ lwm2m_block2_data_t;
+
+/*
+ * Responses kept to answer duplicated requests
+ */
+typedef struct _lwm2m_dedup_table_ lwm2m_dedup_table_t;
+
+/*
+ * Requests answered later with a separate response
+ */
+typedef struct _lwm2m_deferred_ lwm2m_deferred_t;
+
 /*
  * LWM2M observed resources
  */
@@ -448,6 +636,8 @@ typedef struct _lwm2m_watcher_
     size_t tokenLen;
     uint32_t counter;
     uint16_t lastMid;
+    lwm2m_media_type_t format;
+    bool pending;       // held until the next wake-up in queue mode
 } lwm2m_watcher_t;
 
 typedef struct _lwm2m_observed_
@@ -460,6 +650,71 @@ typedef struct _lwm2m_observed_
 } lwm2m_observed_t;
 
 
+/*
+ * LWM2M engine statistics
+ *
+ * Packets are counted by CoAP type (CON, NON, ACK, RST) and by code class:
+ * 0 for requests and empty messages, 2, 4 and 5 for responses.
+ * Round-trip times of requests are counted by method (GET, POST, PUT, DELETE)
+ * in LWM2M_STATS_RTT_BUCKETS buckets: bucket 0 holds times below 2 ms,
+ * bucket i times from 2^i to 2^(i+1) - 1 ms and the last one all longer times.
+ */
+#define LWM2M_STATS_RTT_BUCKETS 16
+
+typedef struct
+{
+    uint32_t packetsReceived[4];    // by CoAP type
+    uint32_t packetsSent[4];
+    uint32_t codesReceived[8];      // by code class
+    uint32_t codesSent[8];
+    uint32_t parseFailures;
+    uint32_t retransmissions;
+    uint32_t timeouts;              // requests not answered
+    uint32_t lostResponses;         // separate responses not acknowledged, also counted in timeouts
+    uint32_t registrations;         // handled by a server or sent by a client
+    uint32_t updates;
+    uint32_t deregistrations;
+    uint32_t transactions;          // current numbers, only set by lwm2m_get_stats()
+    uint32_t observations;
+    uint32_t clients;
+    uint32_t rtt[4][LWM2M_STATS_RTT_BUCKETS];   // by method, from COAP_GET
+} lwm2m_stats_t;
+
+
+/*
+ * LWM2M trace
+ *
+ * Fixed-size records of the engine events, kept in a ring buffer.
+ */
+typedef enum
+{
+    LWM2M_TRACE_RECEIVED = 1,       // packet received
+    LWM2M_TRACE_SENT,               // packet sent, including the first transmission of a request
+    LWM2M_TRACE_RETRANSMITTED,      // request sent again
+    LWM2M_TRACE_PARSE_FAILED,       // packet received but not parsed
+    LWM2M_TRACE_DUPLICATE,          // duplicated request answered with the same response
+    LWM2M_TRACE_RESPONSE,           // response to a request
+    LWM2M_TRACE_TIMEOUT,            // request not answered
+    LWM2M_TRACE_REGISTERED,
+    LWM2M_TRACE_UPDATED,
+    LWM2M_TRACE_DEREGISTERED,
+    LWM2M_TRACE_EXPIRED             // lifetime of a client registration elapsed
+} lwm2m_trace_event_t;
+
+typedef struct
+{
+    uint64_t time;      // in milliseconds of the context clock
+    uint8_t  event;     // lwm2m_trace_event_t
+    uint8_t  type;      // CoAP type
+    uint8_t  code;      // CoAP code
+    uint8_t  reserved;
+    uint16_t mid;
+    uint16_t id;        // client internal ID or server short ID, 0 if unknown
+} lwm2m_trace_record_t;
+
+typedef struct _lwm2m_trace_ lwm2m_trace_t;
+
+
 /*
  * LWM2M Context
  */
@@ -468,6 +723,10 @@ typedef struct _lwm2m_observed_
 typedef void * (*lwm2m_connect_server_callback_t)(uint16_t serverID, void * userData);
 // The session handle MUST uniquely identify a peer.
 typedef uint8_t (*lwm2m_buffer_send_callback_t)(void * sessionH, uint8_t * buffer, size_t length, void * userData);
+// Called with every datagram given to lwm2m_handle_packet() (sent is false) or to the lwm2m_buffer_send_callback_t (sent is true).
+typedef void (*lwm2m_capture_callback_t)(void * sessionH, bool sent, uint8_t * buffer, size_t length, void * userData);
+// Returns the current time in milliseconds. Replaces lwm2m_gettimeofday() and lwm2m_gettime_ms() for a context.
+typedef uint64_t (*lwm2m_clock_callback_t)(void * userData);
 
 
 typedef struct
@@ -478,21 +737,44 @@ typedef struct
     char *              msisdn;
     lwm2m_server_t *    bootstrapServerList;
     lwm2m_server_t *    serverList;
-    lwm2m_object_t **   objectList;
+    lwm2m_object_t **   objectList;     // sorted by ID
+    lwm2m_instance_map_t * instanceMaps;    // instances of the objects of objectList
     uint16_t            numObject;
     lwm2m_observed_t *  observedList;
+    lwm2m_deferred_t *  deferredList;
+    uint32_t            queueListenTime;    // seconds listening after a wake-up in queue mode
+    uint32_t            queueMaxDelay;      // longest time a notification is held in queue mode
+    time_t              queueAwakeUntil;
+    time_t              queueNotifyTime;    // wake-up date for held notifications or 0
 #endif
 #ifdef LWM2M_SERVER_MODE
-    lwm2m_client_t *        clientList;
+    lwm2m_client_t *        clientList;     // sorted by internal ID
+    lwm2m_client_table_t *  clientTable;
+    lwm2m_layout_table_t *  layoutTable;    // object layouts of the clients
     lwm2m_result_callback_t monitorCallback;
     void *                  monitorUserData;
+    uint32_t                cacheMaxAge;    // in seconds, 0 disables the resource cache
+    uint32_t                etagMaxAge;     // in seconds, 0 disables the ETag validation of reads
+    time_t                  cacheExpiry;    // nothing cached expires before this date, 0 if nothing is cached
 #endif
     uint16_t                nextMID;
     lwm2m_transaction_t *   transactionList;
+    lwm2m_block1_data_t *   block1List;
+    lwm2m_block2_data_t *   block2List;
+    lwm2m_dedup_table_t *   dedupTable;
+    uint8_t                 block2Window;   // Block2 requests sent at once when reading a large response
+    uint16_t                packetSize;     // largest datagram sent
+    uint16_t                blockSize;      // preferred Block1 and Block2 size, a power of two from 16 to 1024
+    lwm2m_stats_t           stats;
+    lwm2m_trace_t *         trace;          // NULL unless lwm2m_trace_start() was called
     // communication layer callbacks
     lwm2m_connect_server_callback_t connectCallback;
     lwm2m_buffer_send_callback_t    bufferSendCallback;
     void *                          userData;
+    lwm2m_capture_callback_t        captureCallback;
+    void *                          captureUserData;
+    lwm2m_clock_callback_t          clockCallback;
+    void *                          clockUserData;
 } lwm2m_context_t;
 
 
@@ -501,11 +783,30 @@ lwm2m_context_t * lwm2m_init(lwm2m_connect_server_callback_t connectCallback, lw
 // close a liblwm2m context.
 void lwm2m_close(lwm2m_context_t * contextP);
 
+// set the largest datagram sent and the preferred block size. Peers with non-zero packetSize or blockSize override them.
+int lwm2m_set_packet_size(lwm2m_context_t * contextP, uint16_t packetSize, uint16_t blockSize);
+
 // perform any required pending operation and adjust timeoutP to the maximal time interval to wait.
 int lwm2m_step(lwm2m_context_t * contextP, struct timeval * timeoutP);
 // dispatch received data to liblwm2m
 void lwm2m_handle_packet(lwm2m_context_t * contextP, uint8_t * buffer, int length, void * fromSessionH);
 
+// copy the statistics of the engine since its initialization or the last reset
+void lwm2m_get_stats(lwm2m_context_t * contextP, lwm2m_stats_t * statsP);
+void lwm2m_reset_stats(lwm2m_context_t * contextP);
+
+// keep the last count events in the trace, 0 stops tracing.
+int lwm2m_trace_start(lwm2m_context_t * contextP, uint32_t count);
+void lwm2m_trace_stop(lwm2m_context_t * contextP);
+// copy at most count events of the last duration seconds (0 for all of them) to bufferP, oldest first.
+// Return the number of events copied.
+uint32_t lwm2m_trace_dump(lwm2m_context_t * contextP, uint32_t duration, lwm2m_trace_record_t * bufferP, uint32_t count);
+
+// set a callback to capture the datagrams received and sent, NULL to stop capturing.
+void lwm2m_set_capture_callback(lwm2m_context_t * contextP, lwm2m_capture_callback_t callback, void * userData);
+// set the clock of the context, NULL to use the platform clocks. Set it before lwm2m_start() or registering clients.
+void lwm2m_set_clock_callback(lwm2m_context_t * contextP, lwm2m_clock_callback_t callback, void * userData);
+
 #ifdef LWM2M_CLIENT_MODE
 // configure the client side with the Endpoint Name, binding, MSISDN (if any) and a list of objects.
 // LWM2M Security Object (ID 0) must be present with either a bootstrap server or a LWM2M server and
@@ -522,6 +823,20 @@ int lwm2m_update_registrations(lwm2m_context_t * contextP, uint32_t currentTime,
 int lwm2m_update_registration(lwm2m_context_t * contextP, uint16_t shortServerID);
 
 void lwm2m_resource_value_changed(lwm2m_context_t * contextP, lwm2m_uri_t * uriP);
+
+// tell the core that the application added or removed instances of an object outside of the object callbacks.
+// The core keeps a map of the instances of each object, built in lwm2m_configure() and updated after the
+// createFunc and deleteFunc callbacks and lwm2m_complete_request(). It also notices changes of the head of
+// instanceList, but other changes made after lwm2m_configure() must be reported with this function.
+void lwm2m_object_instances_changed(lwm2m_context_t * contextP, uint16_t objectId);
+
+// send the responses to the requests on uriP whose object callback returned COAP_PENDING.
+// For reads, dataArray holds size values as readFunc would have returned them. Returns the number of responses sent.
+int lwm2m_complete_request(lwm2m_context_t * contextP, lwm2m_uri_t * uriP, uint8_t code, int size, lwm2m_tlv_t * dataArray);
+
+// set how long the client listens after waking up for servers in queue mode, and how long it may hold
+// a notification before waking up. lwm2m_step() lowers its timeout to the next wake-up or end of listening.
+void lwm2m_set_queue_times(lwm2m_context_t * contextP, uint32_t listenTime, uint32_t maxDelay);
 #endif
 
 #ifdef LWM2M_SERVER_MODE
@@ -534,15 +849,26 @@ void lwm2m_resource_value_changed(lwm2m_context_t * contextP, lwm2m_uri_t * uriP
 void lwm2m_set_monitoring_callback(lwm2m_context_t * contextP, lwm2m_result_callback_t callback, void * userData);
 
 // Device Management APIs
+// Reads and observations request the content format set in lwm2m_client_t::format.
 int lwm2m_dm_read(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_result_callback_t callback, void * userData);
-int lwm2m_dm_write(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, char * buffer, int length, lwm2m_result_callback_t callback, void * userData);
+int lwm2m_dm_write(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_media_type_t format, char * buffer, int length, lwm2m_result_callback_t callback, void * userData);
 int lwm2m_dm_execute(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, char * buffer, int length, lwm2m_result_callback_t callback, void * userData);
-int lwm2m_dm_create(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, char * buffer, int length, lwm2m_result_callback_t callback, void * userData);
+int lwm2m_dm_create(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_media_type_t format, char * buffer, int length, lwm2m_result_callback_t callback, void * userData);
 int lwm2m_dm_delete(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_result_callback_t callback, void * userData);
 
 // Information Reporting APIs
 int lwm2m_observe(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_result_callback_t callback, void * userData);
 int lwm2m_observe_cancel(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_result_callback_t callback, void * userData);
+
+// Resource cache APIs
+// Values read or notified are kept for maxAge seconds. 0 (the default) disables the cache.
+void lwm2m_set_cache_max_age(lwm2m_context_t * contextP, uint32_t maxAge);
+// The last response to a read carrying an ETag is kept for maxAge seconds and the ETag is sent with
+// the next read of the same URI. This does not depend on the cache above. 0 disables it, the default is 60.
+void lwm2m_set_etag_max_age(lwm2m_context_t * contextP, uint32_t maxAge);
+// Return COAP_205_CONTENT and a copy of the resource value to free with lwm2m_tlv_free(1, *dataP),
+// or COAP_404_NOT_FOUND if no fresh value is known. timeP, if not NULL, receives the time the value was received.
+int lwm2m_cache_read(lwm2m_context_t * contextP, uint16_t clientID, lwm2m_uri_t * uriP, lwm2m_tlv_t ** dataP, time_t * timeP);
 #endif
 
 #endif
@@ -65,8 +65,10 @@ coap_status_t handle_dm_request(lwm2m_context_t * contextP,
         {
             char * buffer = NULL;
             int length = 0;
+            lwm2m_media_type_t format;
 
-            result = object_read(contextP, uriP, &buffer, &length);
+            format = data_getFormat(message, true);
+            result = object_read(contextP, uriP, &format, &buffer, &length);
             if (result == COAP_205_CONTENT)
             {
                 if (IS_OPTION(message, COAP_OPTION_OBSERVE))
@@ -75,8 +77,30 @@ coap_status_t handle_dm_request(lwm2m_context_t * contextP,
                 }
                 if (result == COAP_205_CONTENT)
                 {
-                    coap_set_payload(response, buffer, length);
-                    // lwm2m_handle_packet will free buffer
+                    uint8_t etag[LWM2M_ETAG_LEN];
+
+                    data_getETag(format, (uint8_t *)buffer, length, etag);
+                    coap_set_header_etag(response, etag, LWM2M_ETAG_LEN);
+                    if (!IS_OPTION(message, COAP_OPTION_OBSERVE)
+                     && IS_OPTION(message, COAP_OPTION_ETAG)
+                     && message->etag_len == LWM2M_ETAG_LEN
+                     && 0 == memcmp(message->etag, etag, LWM2M_ETAG_LEN))
+                    {
+                        // the server still has this result
+                        lwm2m_free(buffer);
+                        result = COAP_203_VALID;
+                    }
+                    else
+                    {
+                        if (format != LWM2M_CONTENT_TEXT)
+                        {
+                            coap_set_header_content_type(response, format);
+                        }
+                        // coap_set_payload() would truncate it to REST_MAX_CHUNK_SIZE,
+                        // lwm2m_handle_packet will send it blockwise and free buffer
+                        response->payload = (uint8_t *)buffer;
+                        response->payload_len = (uint16_t)length;
+                    }
                 }
             }
         }
@@ -85,7 +109,7 @@ coap_status_t handle_dm_request(lwm2m_context_t * contextP,
         {
             if (!LWM2M_URI_IS_SET_INSTANCE(uriP))
             {
-                result = object_create(contextP, uriP, message->payload, message->payload_len);
+                result = object_create(contextP, uriP, data_getFormat(message, false), message->payload, message->payload_len);
                 if (result == COAP_201_CREATED)
                 {
                     //longest uri is /65535/65535 = 12 + 1 (null) chars
@@ -109,11 +133,11 @@ coap_status_t handle_dm_request(lwm2m_context_t * contextP,
             {
                 if (object_isInstanceNew(contextP, uriP->objectId, uriP->instanceId))
                 {
-                    result = object_create(contextP, uriP, message->payload, message->payload_len);
+                    result = object_create(contextP, uriP, data_getFormat(message, false), message->payload, message->payload_len);
                 }
                 else
                 {
-                    result = object_write(contextP, uriP, message->payload, message->payload_len);
+                    result = object_write(contextP, uriP, data_getFormat(message, false), message->payload, message->payload_len);
                 }
             }
             else
@@ -126,7 +150,7 @@ coap_status_t handle_dm_request(lwm2m_context_t * contextP,
         {
             if (LWM2M_URI_IS_SET_INSTANCE(uriP))
             {
-                result = object_write(contextP, uriP, message->payload, message->payload_len);
+                result = object_write(contextP, uriP, data_getFormat(message, false), message->payload, message->payload_len);
             }
             else
             {
@@ -151,6 +175,12 @@ coap_status_t handle_dm_request(lwm2m_context_t * contextP,
         break;
     }
 
+    if (result == COAP_PENDING)
+    {
+        // the object will answer with lwm2m_complete_request()
+        result = deferred_add(contextP, uriP, fromSessionH, message);
+    }
+
     return result;
 }
 #endif
@@ -159,18 +189,65 @@ coap_status_t handle_dm_request(lwm2m_context_t * contextP,
 
 #define ID_AS_STRING_MAX_LEN 8
 
-static void dm_result_callback(lwm2m_transaction_t * transacP,
-                               void * message)
+static void prv_notifyWaiters(lwm2m_transaction_t * transacP,
+                              coap_packet_t * packet)
 {
     dm_data_t * dataP = (dm_data_t *)transacP->userData;
 
+    while (dataP != NULL)
+    {
+        dm_data_t * nextP = dataP->next;
+
+        if (packet == NULL)
+        {
+            dataP->callback(((lwm2m_client_t*)transacP->peerP)->internalID,
+                            &dataP->uri,
+                            COAP_503_SERVICE_UNAVAILABLE,
+                            LWM2M_CONTENT_TEXT, NULL, 0,
+                            dataP->userData);
+        }
+        else
+        {
+            dataP->callback(((lwm2m_client_t*)transacP->peerP)->internalID,
+                            &dataP->uri,
+                            packet->code,
+                            data_getFormat(packet, false),
+                            packet->payload,
+                            packet->payload_len,
+                            dataP->userData);
+        }
+        lwm2m_free(dataP);
+        dataP = nextP;
+    }
+}
+
+// read again without ETag, the waiters of transacP move to the new transaction
+static int prv_readAgain(lwm2m_context_t * contextP,
+                         lwm2m_transaction_t * transacP)
+{
+    lwm2m_client_t * clientP = (lwm2m_client_t *)transacP->peerP;
+    dm_data_t * dataP = (dm_data_t *)transacP->userData;
+    lwm2m_transaction_t * transaction;
+
+    transaction = transaction_new(COAP_GET, &dataP->uri, contextP->nextMID++, ENDPOINT_CLIENT, (void *)clientP);
+    if (transaction == NULL) return -1;
+    if (clientP->format != LWM2M_CONTENT_TEXT)
+    {
+        coap_set_header_accept(transaction->message, clientP->format);
+    }
+    transaction->callback = transacP->callback;
+    transaction->userData = transacP->userData;
+    transacP->userData = NULL;
+
+    return queue_send(contextP, transaction);
+}
+
+static void dm_result_callback(lwm2m_transaction_t * transacP,
+                               void * message)
+{
     if (message == NULL)
     {
-        dataP->callback(((lwm2m_client_t*)transacP->peerP)->internalID,
-                        &dataP->uri,
-                        COAP_503_SERVICE_UNAVAILABLE,
-                        NULL, 0,
-                        dataP->userData);
+        prv_notifyWaiters(transacP, NULL);
     }
     else
     {
@@ -204,21 +281,78 @@ static void dm_result_callback(lwm2m_transaction_t * transacP,
 
             lwm2m_free(locationString);
         }
+        else
+        {
+            dm_data_t * dataP = (dm_data_t *)transacP->userData;
+            lwm2m_client_t * clientP = (lwm2m_client_t *)transacP->peerP;
+
+            if (packet->code == COAP_203_VALID
+             && ((coap_packet_t *)transacP->message)->code == COAP_GET)
+            {
+                // the response kept with this ETag is still current
+                if (!cache_validate_response(clientP, &dataP->uri, packet))
+                {
+                    // but it was dropped since, the callers did not ask for a validation
+                    if (IS_OPTION((coap_packet_t *)transacP->message, COAP_OPTION_ETAG))
+                    {
+                        prv_readAgain(dataP->contextP, transacP);
+                        // once moved, the waiters are answered by the new transaction
+                        if (transacP->userData == NULL) return;
+                    }
+                    packet->code = COAP_500_INTERNAL_SERVER_ERROR;
+                }
+            }
+            if (packet->code == COAP_205_CONTENT
+             && ((coap_packet_t *)transacP->message)->code == COAP_GET)
+            {
+                cache_update(dataP->contextP, clientP, &dataP->uri, data_getFormat(packet, false), packet->payload, packet->payload_len);
+                cache_keep_response(dataP->contextP, clientP, &dataP->uri, packet);
+            }
+            else if (packet->code == COAP_204_CHANGED || packet->code == COAP_202_DELETED)
+            {
+                // the cached values may not be current anymore
+                cache_invalidate(clientP, &dataP->uri);
+            }
+        }
 
-        dataP->callback(((lwm2m_client_t*)transacP->peerP)->internalID,
-                        &dataP->uri,
-                        packet->code,
-                        packet->payload,
-                        packet->payload_len,
-                        dataP->userData);
+        prv_notifyWaiters(transacP, packet);
     }
-    lwm2m_free(dataP);
+}
+
+static bool prv_isPendingRead(lwm2m_transaction_t * transacP,
+                              lwm2m_client_t * clientP,
+                              lwm2m_uri_t * uriP)
+{
+    return transacP->peerP == (void *)clientP
+        && transacP->callback == dm_result_callback
+        && ((coap_packet_t *)transacP->message)->code == COAP_GET
+        && uri_isSame(&((dm_data_t *)transacP->userData)->uri, uriP);
+}
+
+static lwm2m_transaction_t * prv_findPendingRead(lwm2m_context_t * contextP,
+                                                 lwm2m_client_t * clientP,
+                                                 lwm2m_uri_t * uriP)
+{
+    lwm2m_transaction_t * transacP;
+
+    for (transacP = contextP->transactionList ; transacP != NULL ; transacP = transacP->next)
+    {
+        if (prv_isPendingRead(transacP, clientP, uriP)) return transacP;
+    }
+    // reads queued for a sleeping client
+    for (transacP = clientP->queueList ; transacP != NULL ; transacP = transacP->next)
+    {
+        if (prv_isPendingRead(transacP, clientP, uriP)) return transacP;
+    }
+
+    return NULL;
 }
 
 static int prv_make_operation(lwm2m_context_t * contextP,
                               uint16_t clientID,
                               lwm2m_uri_t * uriP,
                               coap_method_t method,
+                              lwm2m_media_type_t format,
                               char * buffer,
                               int length,
                               lwm2m_result_callback_t callback,
@@ -228,16 +362,60 @@ static int prv_make_operation(lwm2m_context_t * contextP,
     lwm2m_transaction_t * transaction;
     dm_data_t * dataP;
 
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = clients_find(contextP, clientID);
     if (clientP == NULL) return COAP_404_NOT_FOUND;
 
+    if (method == COAP_GET)
+    {
+        // the response to a read in progress is shared with this caller
+        transaction = prv_findPendingRead(contextP, clientP, uriP);
+        if (transaction != NULL)
+        {
+            if (callback != NULL)
+            {
+                dm_data_t * lastP;
+
+                dataP = (dm_data_t *)lwm2m_malloc(sizeof(dm_data_t));
+                if (dataP == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+                memset(dataP, 0, sizeof(dm_data_t));
+                memcpy(&dataP->uri, uriP, sizeof(lwm2m_uri_t));
+                dataP->contextP = contextP;
+                dataP->callback = callback;
+                dataP->userData = userData;
+
+                lastP = (dm_data_t *)transaction->userData;
+                while (lastP->next != NULL) lastP = lastP->next;
+                lastP->next = dataP;
+            }
+            return 0;
+        }
+    }
+
     transaction = transaction_new(method, uriP, contextP->nextMID++, ENDPOINT_CLIENT, (void *)clientP);
     if (transaction == NULL) return INTERNAL_SERVER_ERROR_5_00;
 
+    if (method == COAP_GET)
+    {
+        if (clientP->format != LWM2M_CONTENT_TEXT)
+        {
+            coap_set_header_accept(transaction->message, clientP->format);
+        }
+        // let the client answer 2.03 if the last response is still current
+        cache_set_etag(clientP, uriP, transaction->message);
+    }
+    else if (format != LWM2M_CONTENT_TEXT)
+    {
+        coap_set_header_content_type(transaction->message, format);
+    }
+
     if (buffer != NULL)
     {
-        // TODO: Take care of fragmentation
-        coap_set_payload(transaction->message, buffer, length);
+        // payloads larger than the block size are sent with Block1
+        if (!transaction_set_payload(contextP, transaction, (uint8_t *)buffer, length))
+        {
+            transaction_free(transaction);
+            return COAP_500_INTERNAL_SERVER_ERROR;
+        }
     }
 
     if (callback != NULL)
@@ -248,7 +426,9 @@ static int prv_make_operation(lwm2m_context_t * contextP,
             transaction_free(transaction);
             return COAP_500_INTERNAL_SERVER_ERROR;
         }
+        memset(dataP, 0, sizeof(dm_data_t));
         memcpy(&dataP->uri, uriP, sizeof(lwm2m_uri_t));
+        dataP->contextP = contextP;
         dataP->callback = callback;
         dataP->userData = userData;
 
@@ -256,9 +436,7 @@ static int prv_make_operation(lwm2m_context_t * contextP,
         transaction->userData = (void *)dataP;
     }
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
-
-    return transaction_send(contextP, transaction);
+    return queue_send(contextP, transaction);
 }
 
 int lwm2m_dm_read(lwm2m_context_t * contextP,
@@ -268,13 +446,14 @@ int lwm2m_dm_read(lwm2m_context_t * contextP,
                   void * userData)
 {
     return prv_make_operation(contextP, clientID, uriP,
-                              COAP_GET, NULL, 0,
+                              COAP_GET, LWM2M_CONTENT_TEXT, NULL, 0,
                               callback, userData);
 }
 
 int lwm2m_dm_write(lwm2m_context_t * contextP,
                    uint16_t clientID,
                    lwm2m_uri_t * uriP,
+                   lwm2m_media_type_t format,
                    char * buffer,
                    int length,
                    lwm2m_result_callback_t callback,
@@ -289,13 +468,13 @@ int lwm2m_dm_write(lwm2m_context_t * contextP,
     if (LWM2M_URI_IS_SET_RESOURCE(uriP))
     {
         return prv_make_operation(contextP, clientID, uriP,
-                                  COAP_PUT, buffer, length,
+                                  COAP_PUT, format, buffer, length,
                                   callback, userData);
     }
     else
     {
         return prv_make_operation(contextP, clientID, uriP,
-                                  COAP_POST, buffer, length,
+                                  COAP_POST, format, buffer, length,
                                   callback, userData);
     }
 }
@@ -314,13 +493,14 @@ int lwm2m_dm_execute(lwm2m_context_t * contextP,
     }
 
     return prv_make_operation(contextP, clientID, uriP,
-                              COAP_POST, buffer, length,
+                              COAP_POST, LWM2M_CONTENT_TEXT, buffer, length,
                               callback, userData);
 }
 
 int lwm2m_dm_create(lwm2m_context_t * contextP,
                     uint16_t clientID,
                     lwm2m_uri_t * uriP,
+                    lwm2m_media_type_t format,
                     char * buffer,
                     int length,
                     lwm2m_result_callback_t callback,
@@ -333,7 +513,7 @@ int lwm2m_dm_create(lwm2m_context_t * contextP,
     }
 
     return prv_make_operation(contextP, clientID, uriP,
-                              COAP_POST, buffer, length,
+                              COAP_POST, format, buffer, length,
                               callback, userData);
 }
 
@@ -350,7 +530,7 @@ int lwm2m_dm_delete(lwm2m_context_t * contextP,
     }
 
     return prv_make_operation(contextP, clientID, uriP,
-                              COAP_DELETE, NULL, 0,
+                              COAP_DELETE, LWM2M_CONTENT_TEXT, NULL, 0,
                               callback, userData);
 }
 #endif
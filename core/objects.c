@@ -58,26 +58,210 @@
 #include <stdio.h>
 
 
+// instances of an object, bit i of the map set if instance i exists
+struct _lwm2m_instance_map_
+{
+    uint32_t *      bits;
+    lwm2m_list_t *  head;   // instanceList when the map was built
+    uint16_t        words;  // number of uint32_t in bits
+    bool            valid;  // false if bits could not be allocated, instanceList is then searched
+};
+
+// objectList is sorted by ID in object_buildIndex()
+static int prv_searchObject(lwm2m_context_t * contextP,
+                            uint16_t Id)
+{
+    int low;
+    int high;
+
+    low = 0;
+    high = contextP->numObject - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+
+        if (contextP->objectList[middle]->objID == Id) return middle;
+        if (contextP->objectList[middle]->objID < Id)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    return -1;
+}
+
+// objects reachable by the servers
+static int prv_findObjectIndex(lwm2m_context_t * contextP,
+                               uint16_t Id)
+{
+    if (Id == LWM2M_SECURITY_OBJECT_ID) return -1;
+
+    return prv_searchObject(contextP, Id);
+}
+
 static lwm2m_object_t * prv_find_object(lwm2m_context_t * contextP,
                                         uint16_t Id)
 {
     int i;
 
-    if (Id == LWM2M_SECURITY_OBJECT_ID) return NULL;
+    i = prv_findObjectIndex(contextP, Id);
+    if (i < 0) return NULL;
 
-    for (i = 0 ; i < contextP->numObject ; i++)
+    return contextP->objectList[i];
+}
+
+static void prv_buildMap(lwm2m_instance_map_t * mapP,
+                         lwm2m_object_t * objectP)
+{
+    lwm2m_list_t * instanceP;
+    uint16_t words;
+
+    // sized on the highest ID, instanceList may not be sorted
+    words = 0;
+    for (instanceP = objectP->instanceList ; instanceP != NULL ; instanceP = instanceP->next)
+    {
+        if (instanceP->id / 32 + 1 > words) words = instanceP->id / 32 + 1;
+    }
+
+    mapP->head = objectP->instanceList;
+
+    // the map only grows
+    if (words > mapP->words)
     {
-        if (contextP->objectList[i]->objID == Id)
+        uint32_t * bitsP;
+
+        bitsP = (uint32_t *)lwm2m_malloc(words * sizeof(uint32_t));
+        if (bitsP == NULL)
         {
-            return contextP->objectList[i];
+            mapP->valid = false;
+            return;
         }
+        if (mapP->bits != NULL) lwm2m_free(mapP->bits);
+        mapP->bits = bitsP;
+        mapP->words = words;
     }
+    mapP->valid = true;
 
-    return NULL;
+    if (mapP->words == 0) return;
+    memset(mapP->bits, 0, mapP->words * sizeof(uint32_t));
+    for (instanceP = objectP->instanceList ; instanceP != NULL ; instanceP = instanceP->next)
+    {
+        mapP->bits[instanceP->id / 32] |= (uint32_t)1 << (instanceP->id % 32);
+    }
+}
+
+// the map of the object at index, rebuilt if the application changed the head of instanceList
+static lwm2m_instance_map_t * prv_getMap(lwm2m_context_t * contextP,
+                                         int index)
+{
+    lwm2m_instance_map_t * mapP = contextP->instanceMaps + index;
+
+    if (mapP->head != contextP->objectList[index]->instanceList)
+    {
+        prv_buildMap(mapP, contextP->objectList[index]);
+    }
+
+    return mapP;
+}
+
+static bool prv_hasInstance(lwm2m_context_t * contextP,
+                            int index,
+                            uint16_t instanceId)
+{
+    lwm2m_instance_map_t * mapP = prv_getMap(contextP, index);
+
+    if (!mapP->valid)
+    {
+        return NULL != lwm2m_list_find(contextP->objectList[index]->instanceList, instanceId);
+    }
+    if (instanceId / 32 >= mapP->words) return false;
+
+    return (mapP->bits[instanceId / 32] & ((uint32_t)1 << (instanceId % 32))) != 0;
+}
+
+// lowest free instance ID, as lwm2m_list_newId(), or LWM2M_MAX_ID if all are used
+static uint16_t prv_newInstanceId(lwm2m_context_t * contextP,
+                                  int index)
+{
+    lwm2m_instance_map_t * mapP = prv_getMap(contextP, index);
+    uint32_t i;
+    uint32_t bit;
+
+    if (!mapP->valid) return lwm2m_list_newId(contextP->objectList[index]->instanceList);
+
+    i = 0;
+    while (i < mapP->words && mapP->bits[i] == 0xFFFFFFFF) i++;
+    bit = 0;
+    if (i < mapP->words)
+    {
+        while ((mapP->bits[i] & ((uint32_t)1 << bit)) != 0) bit++;
+    }
+    if (i * 32 + bit >= LWM2M_MAX_ID) return LWM2M_MAX_ID;
+
+    return (uint16_t)(i * 32 + bit);
+}
+
+int object_buildIndex(lwm2m_context_t * contextP)
+{
+    int i;
+
+    // insertion sort, objects are few and usually given in order
+    for (i = 1 ; i < contextP->numObject ; i++)
+    {
+        lwm2m_object_t * objectP = contextP->objectList[i];
+        int j;
+
+        for (j = i ; j > 0 && contextP->objectList[j - 1]->objID > objectP->objID ; j--)
+        {
+            contextP->objectList[j] = contextP->objectList[j - 1];
+        }
+        contextP->objectList[j] = objectP;
+    }
+
+    contextP->instanceMaps = (lwm2m_instance_map_t *)lwm2m_malloc(contextP->numObject * sizeof(lwm2m_instance_map_t));
+    if (contextP->instanceMaps == NULL) return -1;
+    memset(contextP->instanceMaps, 0, contextP->numObject * sizeof(lwm2m_instance_map_t));
+
+    for (i = 0 ; i < contextP->numObject ; i++)
+    {
+        prv_buildMap(contextP->instanceMaps + i, contextP->objectList[i]);
+    }
+
+    return 0;
+}
+
+void object_freeIndex(lwm2m_context_t * contextP)
+{
+    int i;
+
+    if (contextP->instanceMaps == NULL) return;
+
+    for (i = 0 ; i < contextP->numObject ; i++)
+    {
+        if (contextP->instanceMaps[i].bits != NULL) lwm2m_free(contextP->instanceMaps[i].bits);
+    }
+    lwm2m_free(contextP->instanceMaps);
+    contextP->instanceMaps = NULL;
+}
+
+void lwm2m_object_instances_changed(lwm2m_context_t * contextP,
+                                    uint16_t objectId)
+{
+    int i;
+
+    i = prv_searchObject(contextP, objectId);
+    if (i < 0 || contextP->instanceMaps == NULL) return;
+
+    prv_buildMap(contextP->instanceMaps + i, contextP->objectList[i]);
 }
 
 coap_status_t object_read(lwm2m_context_t * contextP,
                           lwm2m_uri_t * uriP,
+                          lwm2m_media_type_t * formatP,
                           char ** bufferP,
                           int * lengthP)
 {
@@ -85,9 +269,13 @@ coap_status_t object_read(lwm2m_context_t * contextP,
     lwm2m_object_t * targetP;
     lwm2m_tlv_t * tlvP = NULL;
     int size = 0;
+    int index;
 
-    targetP = prv_find_object(contextP, uriP->objectId);
-    if (NULL == targetP) return NOT_FOUND_4_04;
+    if (!data_isFormatSupported(*formatP)) return NOT_ACCEPTABLE_4_06;
+
+    index = prv_findObjectIndex(contextP, uriP->objectId);
+    if (index < 0) return NOT_FOUND_4_04;
+    targetP = contextP->objectList[index];
     if (NULL == targetP->readFunc) return METHOD_NOT_ALLOWED_4_05;
     if (targetP->instanceList == NULL)
     {
@@ -101,7 +289,7 @@ coap_status_t object_read(lwm2m_context_t * contextP,
     {
         if (LWM2M_URI_IS_SET_INSTANCE(uriP))
         {
-            if (NULL == lwm2m_list_find(targetP->instanceList, uriP->instanceId))
+            if (!prv_hasInstance(contextP, index, uriP->instanceId))
             {
                 return COAP_404_NOT_FOUND;
             }
@@ -112,6 +300,9 @@ coap_status_t object_read(lwm2m_context_t * contextP,
             lwm2m_list_t * instanceP;
             int i;
 
+            if (*formatP == LWM2M_CONTENT_OPAQUE) return NOT_ACCEPTABLE_4_06;
+            if (*formatP == LWM2M_CONTENT_TEXT) *formatP = LWM2M_CONTENT_TLV;
+
             size = 0;
             for (instanceP = targetP->instanceList; instanceP != NULL ; instanceP = instanceP->next)
             {
@@ -135,8 +326,8 @@ coap_status_t object_read(lwm2m_context_t * contextP,
 
             if (result == COAP_205_CONTENT)
             {
-                *lengthP = lwm2m_tlv_serialize(size, tlvP, bufferP);
-                if (*lengthP == 0) result = COAP_500_INTERNAL_SERVER_ERROR;
+                *lengthP = lwm2m_data_serialize(uriP, size, tlvP, *formatP, bufferP);
+                if (*lengthP < 0) result = COAP_500_INTERNAL_SERVER_ERROR;
             }
             lwm2m_tlv_free(size, tlvP);
 
@@ -152,32 +343,45 @@ coap_status_t object_read(lwm2m_context_t * contextP,
         if (tlvP == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
 
         tlvP->type = LWM2M_TYPE_RESSOURCE;
-        tlvP->flags = LWM2M_TLV_FLAG_TEXT_FORMAT;
+        if (*formatP == LWM2M_CONTENT_TEXT)
+        {
+            tlvP->flags = LWM2M_TLV_FLAG_TEXT_FORMAT;
+        }
         tlvP->id = uriP->resourceId;
     }
+    else if (*formatP == LWM2M_CONTENT_TEXT || *formatP == LWM2M_CONTENT_OPAQUE)
+    {
+        if (*formatP == LWM2M_CONTENT_OPAQUE) return NOT_ACCEPTABLE_4_06;
+        *formatP = LWM2M_CONTENT_TLV;
+    }
     result = targetP->readFunc(uriP->instanceId, &size, &tlvP, targetP);
     if (result == COAP_205_CONTENT)
     {
-        if (size == 1
-         && tlvP->type == LWM2M_TYPE_RESSOURCE
-         && (tlvP->flags && LWM2M_TLV_FLAG_TEXT_FORMAT) != 0 )
+        if (*formatP == LWM2M_CONTENT_TEXT)
         {
-            *bufferP = (char *)malloc(tlvP->length);
-            if (*bufferP == NULL)
+            if (size == 1
+             && tlvP->type == LWM2M_TYPE_RESSOURCE
+             && (tlvP->flags && LWM2M_TLV_FLAG_TEXT_FORMAT) != 0 )
             {
-                result = COAP_500_INTERNAL_SERVER_ERROR;
+                if ((tlvP->flags & LWM2M_TLV_FLAG_STATIC_DATA) == 0)
+                {
+                    // take ownership of the value instead of copying it
+                    *bufferP = (char *)tlvP->value;
+                    *lengthP = tlvP->length;
+                    tlvP->value = NULL;
+                    tlvP->length = 0;
+                    lwm2m_tlv_free(size, tlvP);
+
+                    return result;
+                }
             }
             else
             {
-                memcpy(*bufferP, tlvP->value, tlvP->length);
-                *lengthP = tlvP->length;
+                *formatP = LWM2M_CONTENT_TLV;
             }
         }
-        else
-        {
-            *lengthP = lwm2m_tlv_serialize(size, tlvP, bufferP);
-            if (*lengthP == 0) result = COAP_500_INTERNAL_SERVER_ERROR;
-        }
+        *lengthP = lwm2m_data_serialize(uriP, size, tlvP, *formatP, bufferP);
+        if (*lengthP < 0) result = COAP_500_INTERNAL_SERVER_ERROR;
     }
     lwm2m_tlv_free(size, tlvP);
 
@@ -186,35 +390,30 @@ coap_status_t object_read(lwm2m_context_t * contextP,
 
 coap_status_t object_write(lwm2m_context_t * contextP,
                            lwm2m_uri_t * uriP,
-                           char * buffer,
-                           int length)
+                           lwm2m_media_type_t format,
+                           uint8_t * buffer,
+                           size_t length)
 {
     coap_status_t result;
     lwm2m_object_t * targetP;
     lwm2m_tlv_t * tlvP = NULL;
     int size = 0;
 
+    if (!data_isFormatSupported(format)) return UNSUPPORTED_MEDIA_TYPE_4_15;
+
     targetP = prv_find_object(contextP, uriP->objectId);
     if (NULL == targetP) return NOT_FOUND_4_04;
     if (NULL == targetP->writeFunc) return METHOD_NOT_ALLOWED_4_05;
 
-    if (LWM2M_URI_IS_SET_RESOURCE(uriP))
+    // TLV payloads are not always tagged
+    if (format == LWM2M_CONTENT_TEXT && !LWM2M_URI_IS_SET_RESOURCE(uriP))
     {
-        size = 1;
-        tlvP = lwm2m_tlv_new(size);
-        if (tlvP == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
-
-        tlvP->flags = LWM2M_TLV_FLAG_TEXT_FORMAT | LWM2M_TLV_FLAG_STATIC_DATA;
-        tlvP->type = LWM2M_TYPE_RESSOURCE;
-        tlvP->id = uriP->resourceId;
-        tlvP->length = length;
-        tlvP->value = buffer;
-    }
-    else
-    {
-        size = lwm2m_tlv_parse(buffer, length, &tlvP);
-        if (size == 0) return COAP_500_INTERNAL_SERVER_ERROR;
+        format = LWM2M_CONTENT_TLV;
     }
+
+    size = lwm2m_data_parse(uriP, (char *)buffer, length, format, &tlvP);
+    if (size == 0) return COAP_500_INTERNAL_SERVER_ERROR;
+
     result = targetP->writeFunc(uriP->instanceId, size, tlvP, targetP);
     lwm2m_tlv_free(size, tlvP);
 
@@ -223,8 +422,8 @@ coap_status_t object_write(lwm2m_context_t * contextP,
 
 coap_status_t object_execute(lwm2m_context_t * contextP,
                              lwm2m_uri_t * uriP,
-                             char * buffer,
-                             int length)
+                             uint8_t * buffer,
+                             size_t length)
 {
     lwm2m_object_t * targetP;
 
@@ -232,51 +431,92 @@ coap_status_t object_execute(lwm2m_context_t * contextP,
     if (NULL == targetP) return NOT_FOUND_4_04;
     if (NULL == targetP->executeFunc) return METHOD_NOT_ALLOWED_4_05;
 
-    return targetP->executeFunc(uriP->instanceId, uriP->resourceId, buffer, length, targetP);
+    return targetP->executeFunc(uriP->instanceId, uriP->resourceId, (char *)buffer, (int)length, targetP);
 }
 
 coap_status_t object_create(lwm2m_context_t * contextP,
                             lwm2m_uri_t * uriP,
-                            char * buffer,
-                            int length)
+                            lwm2m_media_type_t format,
+                            uint8_t * buffer,
+                            size_t length)
 {
     lwm2m_object_t * targetP;
     lwm2m_tlv_t * tlvP = NULL;
+    lwm2m_tlv_t * dataP;
     int size = 0;
+    int index;
     uint8_t result;
 
     if (length == 0 || buffer == 0)
     {
         return BAD_REQUEST_4_00;
     }
+    if (!data_isFormatSupported(format)) return UNSUPPORTED_MEDIA_TYPE_4_15;
+    if (format == LWM2M_CONTENT_TEXT || format == LWM2M_CONTENT_OPAQUE)
+    {
+        // TLV payloads are not always tagged
+        format = LWM2M_CONTENT_TLV;
+    }
 
-    targetP = prv_find_object(contextP, uriP->objectId);
-    if (NULL == targetP) return NOT_FOUND_4_04;
+    index = prv_findObjectIndex(contextP, uriP->objectId);
+    if (index < 0) return NOT_FOUND_4_04;
+    targetP = contextP->objectList[index];
     if (NULL == targetP->createFunc) return METHOD_NOT_ALLOWED_4_05;
+    if (NULL == targetP->writeFunc) return METHOD_NOT_ALLOWED_4_05;
+
+    size = lwm2m_data_parse(uriP, (char *)buffer, length, format, &tlvP);
+    if (size == 0) return COAP_500_INTERNAL_SERVER_ERROR;
+
+    dataP = tlvP;
+    if (tlvP->type == LWM2M_TYPE_OBJECT_INSTANCE)
+    {
+        // the payload names the new instance
+        if (size != 1
+         || (LWM2M_URI_IS_SET_INSTANCE(uriP) && uriP->instanceId != tlvP->id))
+        {
+            lwm2m_tlv_free(size, tlvP);
+            return BAD_REQUEST_4_00;
+        }
+        uriP->instanceId = tlvP->id;
+        uriP->flag |= LWM2M_URI_FLAG_INSTANCE_ID;
+        dataP = (lwm2m_tlv_t *)tlvP->value;
+        size = tlvP->length;
+    }
 
     if (LWM2M_URI_IS_SET_INSTANCE(uriP))
     {
-        if (NULL != lwm2m_list_find(targetP->instanceList, uriP->instanceId))
+        if (prv_hasInstance(contextP, index, uriP->instanceId))
         {
             // Instance already exists
-            return COAP_406_NOT_ACCEPTABLE;
+            result = COAP_406_NOT_ACCEPTABLE;
+            goto exit;
         }
     }
     else
     {
-        uriP->instanceId = lwm2m_list_newId(targetP->instanceList);
+        uriP->instanceId = prv_newInstanceId(contextP, index);
+        if (uriP->instanceId == LWM2M_MAX_ID)
+        {
+            // no instance ID left
+            result = COAP_500_INTERNAL_SERVER_ERROR;
+            goto exit;
+        }
         uriP->flag |= LWM2M_URI_FLAG_INSTANCE_ID;
     }
 
-    targetP = prv_find_object(contextP, uriP->objectId);
-    if (NULL == targetP) return NOT_FOUND_4_04;
-    if (NULL == targetP->writeFunc) return METHOD_NOT_ALLOWED_4_05;
-
-    size = lwm2m_tlv_parse(buffer, length, &tlvP);
-    if (size == 0) return COAP_500_INTERNAL_SERVER_ERROR;
+    // the callback may change instanceList even when it fails
+    result = targetP->createFunc(uriP->instanceId, size, dataP, targetP);
+    prv_buildMap(contextP->instanceMaps + index, targetP);
 
-    result = targetP->createFunc(uriP->instanceId, size, tlvP, targetP);
-    lwm2m_tlv_free(size, tlvP);
+exit:
+    if (dataP != tlvP)
+    {
+        lwm2m_tlv_free(1, tlvP);
+    }
+    else
+    {
+        lwm2m_tlv_free(size, tlvP);
+    }
 
     return result;
 }
@@ -285,27 +525,30 @@ coap_status_t object_delete(lwm2m_context_t * contextP,
                             lwm2m_uri_t * uriP)
 {
     lwm2m_object_t * targetP;
+    coap_status_t result;
+    int index;
 
-    targetP = prv_find_object(contextP, uriP->objectId);
-    if (NULL == targetP) return NOT_FOUND_4_04;
+    index = prv_findObjectIndex(contextP, uriP->objectId);
+    if (index < 0) return NOT_FOUND_4_04;
+    targetP = contextP->objectList[index];
     if (NULL == targetP->deleteFunc) return METHOD_NOT_ALLOWED_4_05;
 
-    return targetP->deleteFunc(uriP->instanceId, targetP);
+    result = targetP->deleteFunc(uriP->instanceId, targetP);
+    prv_buildMap(contextP->instanceMaps + index, targetP);
+
+    return result;
 }
 
 bool object_isInstanceNew(lwm2m_context_t * contextP,
                           uint16_t objectId,
                           uint16_t instanceId)
 {
-    lwm2m_object_t * targetP;
+    int index;
 
-    targetP = prv_find_object(contextP, objectId);
-    if (targetP != NULL)
+    index = prv_findObjectIndex(contextP, objectId);
+    if (index >= 0 && prv_hasInstance(contextP, index, instanceId))
     {
-        if (NULL != lwm2m_list_find(targetP->instanceList, instanceId))
-        {
-            return false;
-        }
+        return false;
     }
 
     return true;
@@ -328,7 +571,7 @@ int prv_getRegisterPayload(lwm2m_context_t * contextP,
         if (contextP->objectList[i]->instanceList == NULL)
         {
             result = snprintf(buffer + index, length - index, "</%hu>,", contextP->objectList[i]->objID);
-            if (result > 0 && result <= length - index)
+            if (result > 0 && (size_t)result <= length - index)
             {
                 index += result;
             }
@@ -345,7 +588,7 @@ int prv_getRegisterPayload(lwm2m_context_t * contextP,
                 int result;
 
                 result = snprintf(buffer + index, length - index, "</%hu/%hu>,", contextP->objectList[i]->objID, targetP->id);
-                if (result > 0 && result <= length - index)
+                if (result > 0 && (size_t)result <= length - index)
                 {
                     index += result;
                 }
@@ -200,6 +200,7 @@ coap_status_t handle_observe_request(lwm2m_context_t * contextP,
         watcherP->server = serverP;
         watcherP->tokenLen = message->token_len;
         memcpy(watcherP->token, message->token, message->token_len);
+        watcherP->format = data_getFormat(message, true);
         watcherP->next = observedP->watcherList;
         observedP->watcherList = watcherP;
     }
@@ -259,44 +260,108 @@ void cancel_observe(lwm2m_context_t * contextP,
     }
 }
 
-void lwm2m_resource_value_changed(lwm2m_context_t * contextP,
-                                  lwm2m_uri_t * uriP)
+// notify the watchers of observedP, only the ones held in queue mode if pendingOnly is true
+static void prv_notify(lwm2m_context_t * contextP,
+                       lwm2m_observed_t * observedP,
+                       bool pendingOnly)
 {
     int result;
-    obs_list_t * listP;
     lwm2m_watcher_t * watcherP;
+    char * buffer = NULL;
+    int length = 0;
+    lwm2m_media_type_t requestedFormat = LWM2M_CONTENT_TEXT;
+    lwm2m_media_type_t format = LWM2M_CONTENT_TEXT;
+    uint16_t blockSize;
 
-    listP = prv_getObservedList(contextP, uriP);
-    while (listP != NULL)
+    result = COAP_404_NOT_FOUND;
+
+    for (watcherP = observedP->watcherList ; watcherP != NULL ; watcherP = watcherP->next)
     {
-        obs_list_t * targetP;
-        char * buffer = NULL;
-        int length = 0;
+        coap_packet_t message[1];
+
+        if (pendingOnly && !watcherP->pending) continue;
+        if (queue_isSleeping(contextP, watcherP->server))
+        {
+            // the current value is sent at the next wake-up
+            watcherP->pending = true;
+            queue_holdNotification(contextP);
+            continue;
+        }
+        watcherP->pending = false;
 
-        result = object_read(contextP, &listP->item->uri, &buffer, &length);
-        if (result == COAP_205_CONTENT)
+        // read the value once per requested content format
+        if (buffer == NULL || watcherP->format != requestedFormat)
         {
-            coap_packet_t message[1];
+            if (buffer != NULL) lwm2m_free(buffer);
+            buffer = NULL;
+            requestedFormat = watcherP->format;
+            format = requestedFormat;
+            result = object_read(contextP, &observedP->uri, &format, &buffer, &length);
+        }
+        if (result != COAP_205_CONTENT) continue;
 
-            coap_init_message(message, COAP_TYPE_NON, COAP_204_CHANGED, 0);
+        coap_init_message(message, COAP_TYPE_NON, COAP_204_CHANGED, 0);
+        if (format != LWM2M_CONTENT_TEXT)
+        {
+            coap_set_header_content_type(message, format);
+        }
+        packet_get_sizes(contextP, watcherP->server->sessionH, NULL, &blockSize);
+        if (length <= blockSize)
+        {
             coap_set_payload(message, buffer, length);
+        }
+        else
+        {
+            uint8_t * copyP;
 
-            for (watcherP = listP->item->watcherList ; watcherP != NULL ; watcherP = watcherP->next)
+            // the server reads the next blocks, buffer is also sent to the other watchers
+            copyP = (uint8_t *)lwm2m_malloc(length);
+            if (copyP == NULL) continue;
+            memcpy(copyP, buffer, length);
+            if (!block2_keep_blocks(contextP, watcherP->server->sessionH, &observedP->uri, requestedFormat, message, copyP, length, blockSize))
             {
-                watcherP->lastMid = contextP->nextMID++;
-                message->mid = watcherP->lastMid;
-                coap_set_header_token(message, watcherP->token, watcherP->tokenLen);
-                coap_set_header_observe(message, watcherP->counter++);
-                (void)message_send(contextP, message, watcherP->server->sessionH);
+                lwm2m_free(copyP);
+                continue;
             }
         }
 
+        watcherP->lastMid = contextP->nextMID++;
+        message->mid = watcherP->lastMid;
+        coap_set_header_token(message, watcherP->token, watcherP->tokenLen);
+        coap_set_header_observe(message, watcherP->counter++);
+        (void)message_send(contextP, message, watcherP->server->sessionH);
+    }
+    if (buffer != NULL) lwm2m_free(buffer);
+}
+
+void lwm2m_resource_value_changed(lwm2m_context_t * contextP,
+                                  lwm2m_uri_t * uriP)
+{
+    obs_list_t * listP;
+
+    listP = prv_getObservedList(contextP, uriP);
+    while (listP != NULL)
+    {
+        obs_list_t * targetP;
+
+        prv_notify(contextP, listP->item, false);
+
         targetP = listP;
         listP = listP->next;
         lwm2m_free(targetP);
     }
 
 }
+
+void observe_flush(lwm2m_context_t * contextP)
+{
+    lwm2m_observed_t * observedP;
+
+    for (observedP = contextP->observedList ; observedP != NULL ; observedP = observedP->next)
+    {
+        prv_notify(contextP, observedP, true);
+    }
+}
 #endif
 
 #ifdef LWM2M_SERVER_MODE
@@ -375,7 +440,7 @@ static void prv_obsRequestCallback(lwm2m_transaction_t * transacP,
         observationP->callback(((lwm2m_client_t*)transacP->peerP)->internalID,
                                &observationP->uri,
                                code,
-                               NULL, 0,
+                               LWM2M_CONTENT_TEXT, NULL, 0,
                                observationP->userData);
         observation_remove(((lwm2m_client_t*)transacP->peerP), observationP);
     }
@@ -385,6 +450,7 @@ static void prv_obsRequestCallback(lwm2m_transaction_t * transacP,
         observationP->callback(((lwm2m_client_t*)transacP->peerP)->internalID,
                                &observationP->uri,
                                0,
+                               data_getFormat(packet, false),
                                packet->payload, packet->payload_len,
                                observationP->userData);
     }
@@ -403,7 +469,7 @@ int lwm2m_observe(lwm2m_context_t * contextP,
 
     if (!LWM2M_URI_IS_SET_INSTANCE(uriP) && LWM2M_URI_IS_SET_RESOURCE(uriP)) return COAP_400_BAD_REQUEST;
 
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = clients_find(contextP, clientID);
     if (clientP == NULL) return COAP_404_NOT_FOUND;
 
     observationP = (lwm2m_observation_t *)lwm2m_malloc(sizeof(lwm2m_observation_t));
@@ -430,13 +496,15 @@ int lwm2m_observe(lwm2m_context_t * contextP,
 
     coap_set_header_observe(transactionP->message, 0);
     coap_set_header_token(transactionP->message, token, sizeof(token));
+    if (clientP->format != LWM2M_CONTENT_TEXT)
+    {
+        coap_set_header_accept(transactionP->message, clientP->format);
+    }
 
     transactionP->callback = prv_obsRequestCallback;
     transactionP->userData = (void *)observationP;
 
-    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transactionP);
-
-    return transaction_send(contextP, transactionP);
+    return queue_send(contextP, transactionP);
 }
 
 int lwm2m_observe_cancel(lwm2m_context_t * contextP,
@@ -448,7 +516,7 @@ int lwm2m_observe_cancel(lwm2m_context_t * contextP,
     lwm2m_client_t * clientP;
     lwm2m_observation_t * observationP;
 
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = clients_find(contextP, clientID);
     if (clientP == NULL) return COAP_404_NOT_FOUND;
 
     observationP = prv_findObservationByURI(clientP, uriP);
@@ -459,6 +527,72 @@ int lwm2m_observe_cancel(lwm2m_context_t * contextP,
     return 0;
 }
 
+typedef struct
+{
+    lwm2m_context_t *   contextP;
+    uint16_t            obsID;
+    uint32_t            count;
+} prv_notify_read_t;
+
+static void prv_notifyReadCallback(lwm2m_transaction_t * transacP,
+                                   void * message)
+{
+    prv_notify_read_t * dataP = (prv_notify_read_t *)transacP->userData;
+    lwm2m_client_t * clientP = (lwm2m_client_t *)transacP->peerP;
+    coap_packet_t * packet = (coap_packet_t *)message;
+    lwm2m_observation_t * observationP;
+
+    // the observation may have been cancelled in the meantime
+    observationP = (lwm2m_observation_t *)lwm2m_list_find((lwm2m_list_t *)clientP->observationList, dataP->obsID);
+    if (observationP != NULL && packet != NULL && packet->code == COAP_205_CONTENT)
+    {
+        cache_update(dataP->contextP, clientP, &observationP->uri, data_getFormat(packet, false), packet->payload, packet->payload_len);
+        observationP->callback(clientP->internalID,
+                               &observationP->uri,
+                               (int)dataP->count,
+                               data_getFormat(packet, false),
+                               packet->payload, packet->payload_len,
+                               observationP->userData);
+    }
+    else
+    {
+        LOG("Notification %u of observation %u could not be read\n", dataP->count, dataP->obsID);
+    }
+    lwm2m_free(dataP);
+}
+
+// The notification holds the first block of the value, read the whole value
+static void prv_readNotification(lwm2m_context_t * contextP,
+                                 lwm2m_client_t * clientP,
+                                 lwm2m_observation_t * observationP,
+                                 uint32_t count)
+{
+    lwm2m_transaction_t * transactionP;
+    prv_notify_read_t * dataP;
+
+    dataP = (prv_notify_read_t *)lwm2m_malloc(sizeof(prv_notify_read_t));
+    if (dataP == NULL) return;
+    dataP->contextP = contextP;
+    dataP->obsID = observationP->id;
+    dataP->count = count;
+
+    transactionP = transaction_new(COAP_GET, &observationP->uri, contextP->nextMID++, ENDPOINT_CLIENT, (void *)clientP);
+    if (transactionP == NULL)
+    {
+        lwm2m_free(dataP);
+        return;
+    }
+    if (clientP->format != LWM2M_CONTENT_TEXT)
+    {
+        coap_set_header_accept(transactionP->message, clientP->format);
+    }
+    transactionP->callback = prv_notifyReadCallback;
+    transactionP->userData = (void *)dataP;
+
+    // the next blocks are received by block2.c
+    (void)queue_send(contextP, transactionP);
+}
+
 void handle_observe_notify(lwm2m_context_t * contextP,
                            void * fromSessionH,
                            coap_packet_t * message)
@@ -479,7 +613,7 @@ void handle_observe_notify(lwm2m_context_t * contextP,
     clientID = (tokenP[0] << 8) | tokenP[1];
     obsID = (tokenP[2] << 8) | tokenP[3];
 
-    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, clientID);
+    clientP = clients_find(contextP, clientID);
     if (clientP == NULL) return;
 
     observationP = (lwm2m_observation_t *)lwm2m_list_find((lwm2m_list_t *)clientP->observationList, obsID);
@@ -491,11 +625,17 @@ void handle_observe_notify(lwm2m_context_t * contextP,
 
         message_send(contextP, &resetMsg, fromSessionH);
     }
+    else if (IS_OPTION(message, COAP_OPTION_BLOCK2) && message->block2_more)
+    {
+        prv_readNotification(contextP, clientP, observationP, count);
+    }
     else
     {
+        cache_update(contextP, clientP, &observationP->uri, data_getFormat(message, false), message->payload, message->payload_len);
         observationP->callback(clientID,
                                &observationP->uri,
                                (int)count,
+                               data_getFormat(message, false),
                                message->payload, message->payload_len,
                                observationP->userData);
     }
@@ -155,21 +155,47 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
                         void * fromSessionH)
 {
     coap_status_t coap_error_code = NO_ERROR;
-    static coap_packet_t message[1];
-    static coap_packet_t response[1];
+    coap_packet_t message[1];
+    coap_packet_t response[1];
+
+    if (contextP->captureCallback != NULL)
+    {
+        contextP->captureCallback(fromSessionH, false, buffer, length, contextP->captureUserData);
+    }
 
     coap_error_code = coap_parse_message(message, buffer, (uint16_t)length);
     if (coap_error_code==NO_ERROR)
     {
+        stats_received(contextP, message);
+        TRACE(contextP, LWM2M_TRACE_RECEIVED, message->type, message->code, message->mid, 0);
         LOG("  Parsed: ver %u, type %u, tkl %u, code %u, mid %u\r\n", message->version, message->type, message->token_len, message->code, message->mid);
         LOG("  Payload: %.*s\r\n\n", message->payload_len, message->payload);
 
         if (message->code >= COAP_GET && message->code <= COAP_DELETE)
         {
             uint32_t block_num = 0;
-            uint16_t block_size = REST_MAX_CHUNK_SIZE;
+            uint16_t block_size;
+            uint16_t preferred_size;
             uint32_t block_offset = 0;
             int32_t new_offset = 0;
+            lwm2m_block2_data_t * block2P = NULL;
+
+            /* the acknowledgement was lost, do not handle the request twice */
+            if (message->type == COAP_TYPE_CON && dedup_replay(contextP, fromSessionH, message->mid))
+            {
+                coap_free_header(message);
+                return;
+            }
+#ifdef LWM2M_CLIENT_MODE
+            /* the empty acknowledgement of a request answered separately was lost */
+            if (message->type == COAP_TYPE_CON && deferred_isPending(contextP, fromSessionH, message->mid))
+            {
+                coap_init_message(response, COAP_TYPE_ACK, 0, message->mid);
+                message_send(contextP, response, fromSessionH);
+                coap_free_header(message);
+                return;
+            }
+#endif
 
             /* prepare response */
             if (message->type==COAP_TYPE_CON)
@@ -189,27 +215,87 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
                 coap_set_header_token(response, message->token, message->token_len);
             }
 
+            packet_get_sizes(contextP, fromSessionH, NULL, &preferred_size);
+            block_size = preferred_size;
+
             /* get offset for blockwise transfers */
             if (coap_get_header_block2(message, &block_num, NULL, &block_size, &block_offset))
             {
-                LOG("Blockwise: block request %u (%u/%u) @ %u bytes\n", block_num, block_size, REST_MAX_CHUNK_SIZE, block_offset);
-                block_size = MIN(block_size, REST_MAX_CHUNK_SIZE);
+                LOG("Blockwise: block request %u (%u/%u) @ %u bytes\n", block_num, block_size, preferred_size, block_offset);
+                if (block_size > preferred_size)
+                {
+                    /* answer with smaller blocks, numbered accordingly */
+                    block_size = preferred_size;
+                    block_num = block_offset / block_size;
+                }
                 new_offset = block_offset;
             }
 
-            coap_error_code = handle_request(contextP, fromSessionH, message, response);
-            if (coap_error_code==NO_ERROR)
+            /* reassemble request payloads sent blockwise */
+            if (IS_OPTION(message, COAP_OPTION_BLOCK1))
+            {
+                uint8_t * block1_buffer;
+                size_t block1_length;
+
+                coap_error_code = block1_handle_request(contextP, fromSessionH, message, &block1_buffer, &block1_length);
+                if (coap_error_code == COAP_NO_ERROR)
+                {
+                    LOG("Block1: %u bytes reassembled\n", (unsigned int)block1_length);
+
+                    coap_set_header_block1(response, message->block1_num, 0, message->block1_size);
+                    // coap_set_payload() would truncate it to REST_MAX_CHUNK_SIZE
+                    message->payload = block1_buffer;
+                    message->payload_len = (uint16_t)block1_length;
+                    coap_error_code = handle_request(contextP, fromSessionH, message, response);
+                    lwm2m_free(block1_buffer);
+                }
+                else
+                {
+                    if (coap_error_code == COAP_231_CONTINUE)
+                    {
+                        /* the peer may be asked for smaller blocks */
+                        coap_set_header_block1(response, message->block1_num, 1, MIN(message->block1_size, preferred_size));
+                    }
+                    coap_set_status_code(response, coap_error_code);
+                    coap_error_code = message_send(contextP, response, fromSessionH);
+                    coap_free_header(message);
+                    return;
+                }
+            }
+            else if (message->code == COAP_GET && block_num > 0
+                  && NULL != (block2P = block2_read_response(contextP, fromSessionH, message, response)))
+            {
+                /* next block of a response kept when its first block was sent */
+                LOG("Blockwise: block %u sliced from kept response\n", block_num);
+                coap_error_code = NO_ERROR;
+            }
+            else
             {
-                /* Apply blockwise transfers. */
-                if ( IS_OPTION(message, COAP_OPTION_BLOCK1) && response->code<BAD_REQUEST_4_00 && !IS_OPTION(response, COAP_OPTION_BLOCK1) )
+                coap_error_code = handle_request(contextP, fromSessionH, message, response);
+                if (coap_error_code == NO_ERROR
+                 && message->code == COAP_GET
+                 && response->code == COAP_205_CONTENT
+                 && block_offset == 0
+                 && response->payload_len > block_size)
                 {
-                    LOG("Block1 NOT IMPLEMENTED\n");
+                    /* keep it to slice the next blocks */
+                    block2P = block2_keep_response(contextP, fromSessionH, message, response);
+                }
+            }
+            if (coap_error_code==NO_ERROR)
+            {
+                /* slicing below moves response->payload */
+                uint8_t * payload = response->payload;
 
-                    coap_error_code = NOT_IMPLEMENTED_5_01;
-                    coap_error_message = "NoBlock1Support";
+                /* Apply blockwise transfers, a 2.03 Valid response has no payload. */
+                if (response->code == COAP_203_VALID)
+                {
+                    LOG("Validated ETag, no payload sent\n");
                 }
                 else if ( IS_OPTION(message, COAP_OPTION_BLOCK2) )
                 {
+                    if (response->payload_len > 0) coap_set_header_size(response, response->payload_len);
+
                     /* unchanged new_offset indicates that resource is unaware of blockwise transfer */
                     if (new_offset==block_offset)
                     {
@@ -237,18 +323,44 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
                 }
                 else if (new_offset!=0)
                 {
-                    LOG("Blockwise: no block option for blockwise resource, using block size %u\n", REST_MAX_CHUNK_SIZE);
+                    LOG("Blockwise: no block option for blockwise resource, using block size %u\n", block_size);
+
+                    coap_set_header_block2(response, 0, new_offset!=-1, block_size);
+                    coap_set_payload(response, response->payload, MIN(response->payload_len, block_size));
+                }
+                else if (response->payload_len > block_size)
+                {
+                    LOG("Blockwise: payload length %u, sending first block\n", response->payload_len);
 
-                    coap_set_header_block2(response, 0, new_offset!=-1, REST_MAX_CHUNK_SIZE);
-                    coap_set_payload(response, response->payload, MIN(response->payload_len, REST_MAX_CHUNK_SIZE));
+                    coap_set_header_size(response, response->payload_len);
+                    coap_set_header_block2(response, 0, 1, block_size);
+                    coap_set_payload(response, response->payload, block_size);
                 } /* if (blockwise request) */
 
                 coap_error_code = message_send(contextP, response, fromSessionH);
 
-                lwm2m_free(response->payload);
+                if (block2P == NULL)
+                {
+                    lwm2m_free(payload);
+                }
+                else if (!IS_OPTION(response, COAP_OPTION_BLOCK2) || !response->block2_more)
+                {
+                    /* last block sent */
+                    block2_remove_response(contextP, block2P);
+                }
                 response->payload = NULL;
                 response->payload_len = 0;
             }
+            else if (coap_error_code == COAP_PENDING)
+            {
+                /* the response will be sent separately */
+                if (message->type == COAP_TYPE_CON)
+                {
+                    coap_init_message(response, COAP_TYPE_ACK, 0, message->mid);
+                    message_send(contextP, response, fromSessionH);
+                }
+                coap_error_code = NO_ERROR;
+            }
             else
             {
             	coap_error_code = message_send(contextP, response, fromSessionH);
@@ -263,6 +375,12 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
             {
                 LOG("Received ACK\n");
             }
+            else if (message->type==COAP_TYPE_CON)
+            {
+                /* separate response or notification, also acknowledged when duplicated */
+                coap_init_message(response, COAP_TYPE_ACK, 0, message->mid);
+                message_send(contextP, response, fromSessionH);
+            }
             else if (message->type==COAP_TYPE_RST)
             {
                 LOG("Received RST\n");
@@ -271,8 +389,10 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
             }
 
 #ifdef LWM2M_SERVER_MODE
+            /* the piggybacked response to the observe request completes its transaction */
             if ( (message->code == COAP_204_CHANGED || message->code == COAP_205_CONTENT)
-             && IS_OPTION(message, COAP_OPTION_OBSERVE))
+             && IS_OPTION(message, COAP_OPTION_OBSERVE)
+             && message->type != COAP_TYPE_ACK)
             {
                 handle_observe_notify(contextP, fromSessionH, message);
             }
@@ -283,12 +403,19 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
             }
         } /* Request or Response */
 
+#ifdef LWM2M_SERVER_MODE
+        /* a client in queue mode listens for a while after sending */
+        queue_wakeup(contextP, fromSessionH);
+#endif
+
         coap_free_header(message);
 
     } /* if (parsed correctly) */
     else
     {
         LOG("Message parsing failed %d\r\n", coap_error_code);
+        contextP->stats.parseFailures++;
+        TRACE(contextP, LWM2M_TRACE_PARSE_FAILED, 0, 0, length >= 4 ? (buffer[2] << 8) | buffer[3] : 0, 0);
     }
 
     if (coap_error_code != NO_ERROR)
@@ -308,19 +435,112 @@ void lwm2m_handle_packet(lwm2m_context_t * contextP,
 }
 
 
+void packet_get_sizes(lwm2m_context_t * contextP,
+                      void * sessionH,
+                      uint16_t * packetSizeP,
+                      uint16_t * blockSizeP)
+{
+    uint16_t packetSize = 0;
+    uint16_t blockSize = 0;
+
+#ifdef LWM2M_CLIENT_MODE
+    {
+        lwm2m_server_t * serverP;
+
+        serverP = contextP->serverList;
+        while (serverP != NULL && serverP->sessionH != sessionH) serverP = serverP->next;
+        if (serverP == NULL)
+        {
+            serverP = contextP->bootstrapServerList;
+            while (serverP != NULL && serverP->sessionH != sessionH) serverP = serverP->next;
+        }
+        if (serverP != NULL)
+        {
+            packetSize = serverP->packetSize;
+            blockSize = serverP->blockSize;
+        }
+    }
+#endif
+#ifdef LWM2M_SERVER_MODE
+    {
+        lwm2m_client_t * clientP;
+
+        clientP = clients_findBySession(contextP, sessionH, NULL);
+        if (clientP != NULL)
+        {
+            packetSize = clientP->packetSize;
+            blockSize = clientP->blockSize;
+        }
+    }
+#endif
+
+    if (packetSize == 0) packetSize = contextP->packetSize;
+    if (blockSize == 0) blockSize = contextP->blockSize;
+
+    // per-peer values are not checked by lwm2m_set_packet_size()
+    if (packetSize < COAP_MAX_HEADER_SIZE + LWM2M_MIN_BLOCK_SIZE) packetSize = COAP_MAX_HEADER_SIZE + LWM2M_MIN_BLOCK_SIZE;
+    if (packetSizeP != NULL) *packetSizeP = packetSize;
+
+    if (blockSizeP != NULL)
+    {
+        // largest power of two not above blockSize and fitting in a datagram
+        *blockSizeP = LWM2M_MIN_BLOCK_SIZE;
+        while (*blockSizeP * 2 <= blockSize
+            && *blockSizeP * 2 <= REST_MAX_CHUNK_SIZE
+            && COAP_MAX_HEADER_SIZE + *blockSizeP * 2 <= packetSize)
+        {
+            *blockSizeP *= 2;
+        }
+    }
+}
+
+uint8_t packet_send(lwm2m_context_t * contextP,
+                    void * sessionH,
+                    uint8_t * buffer,
+                    size_t length)
+{
+    if (contextP->captureCallback != NULL)
+    {
+        contextP->captureCallback(sessionH, true, buffer, length, contextP->captureUserData);
+    }
+    stats_sent(contextP, buffer, length);
+
+    return contextP->bufferSendCallback(sessionH, buffer, length, contextP->userData);
+}
+
 coap_status_t message_send(lwm2m_context_t * contextP,
                            coap_packet_t * message,
                            void * sessionH)
 {
     coap_status_t result = INTERNAL_SERVER_ERROR_5_00;
-    uint8_t pktBuffer[COAP_MAX_PACKET_SIZE+1];
+    uint8_t * pktBuffer;
     size_t pktBufferLen = 0;
+    uint16_t packetSize;
+
+    packet_get_sizes(contextP, sessionH, &packetSize, NULL);
+
+    // larger payloads must be sliced in blocks by the callers, do not send a truncated one
+    if (message->payload_len > packetSize - COAP_MAX_HEADER_SIZE)
+    {
+        LOG("Payload of %u bytes does not fit in a %u bytes datagram\n", message->payload_len, packetSize);
+        return result;
+    }
+
+    pktBuffer = (uint8_t *)lwm2m_malloc(packetSize);
+    if (pktBuffer == NULL) return result;
 
     pktBufferLen = coap_serialize_message(message, pktBuffer);
     if (0 != pktBufferLen)
     {
-        result = contextP->bufferSendCallback(sessionH, pktBuffer, pktBufferLen, contextP->userData);
+        result = packet_send(contextP, sessionH, pktBuffer, pktBufferLen);
+        TRACE(contextP, LWM2M_TRACE_SENT, message->type, message->code, message->mid, 0);
+        // piggybacked responses answer confirmable requests, keep them for duplicates
+        if (message->type == COAP_TYPE_ACK && message->code != 0)
+        {
+            dedup_store(contextP, sessionH, message->mid, pktBuffer, pktBufferLen);
+        }
     }
+    lwm2m_free(pktBuffer);
 
     return result;
 }
@@ -0,0 +1,246 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Queue mode (UQ, SQ and UQS bindings).
+ *
+ * A client in queue mode only listens for a while after sending a message.
+ *
+ * On the server, requests made while the client sleeps are queued on the
+ * client, in order, and all sent as soon as a message is received from
+ * it, typically a registration update. The client is considered asleep
+ * LWM2M_QUEUE_AWAKE_TIME seconds after its last message.
+ *
+ * On the client, notifications to servers in queue mode are held while
+ * sleeping. The client wakes up when a notification has been held for
+ * lwm2m_context_t::queueMaxDelay seconds or when a registration update is
+ * due. It then sends the registration updates due before the next wake-up
+ * and all held notifications, and listens for
+ * lwm2m_context_t::queueListenTime seconds.
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool queue_isQueueMode(lwm2m_binding_t binding)
+{
+    switch (binding)
+    {
+    case BINDING_UQ:
+    case BINDING_SQ:
+    case BINDING_UQS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+#ifdef LWM2M_CLIENT_MODE
+
+// date at which the registration to a server in queue mode must be updated
+static time_t prv_updateTime(lwm2m_server_t * serverP)
+{
+    return registration_updateTime(serverP, LWM2M_QUEUE_AWAKE_TIME);
+}
+
+bool queue_isSleeping(lwm2m_context_t * contextP,
+                      lwm2m_server_t * serverP)
+{
+    struct timeval tv;
+
+    if (!queue_isQueueMode(serverP->binding)) return false;
+    if (0 != utils_gettimeofday(contextP, &tv)) return false;
+
+    return contextP->queueAwakeUntil <= tv.tv_sec;
+}
+
+void queue_holdNotification(lwm2m_context_t * contextP)
+{
+    struct timeval tv;
+
+    if (contextP->queueNotifyTime != 0) return;
+    if (0 != utils_gettimeofday(contextP, &tv)) return;
+
+    contextP->queueNotifyTime = tv.tv_sec + contextP->queueMaxDelay;
+}
+
+void queue_listen(lwm2m_context_t * contextP)
+{
+    struct timeval tv;
+
+    if (0 != utils_gettimeofday(contextP, &tv)) return;
+
+    contextP->queueAwakeUntil = tv.tv_sec + contextP->queueListenTime;
+}
+
+int queue_step(lwm2m_context_t * contextP,
+               time_t currentTime)
+{
+    lwm2m_server_t * serverP;
+    time_t nextTime;
+    bool wakeUp;
+
+    if (contextP->queueAwakeUntil > currentTime)
+    {
+        for (serverP = contextP->serverList ; serverP != NULL ; serverP = serverP->next)
+        {
+            if (serverP->status == STATE_REGISTERED
+             && queue_isQueueMode(serverP->binding)
+             && prv_updateTime(serverP) <= currentTime)
+            {
+                registration_update(contextP, serverP);
+            }
+        }
+        // notifications held before an update sent by the application
+        if (contextP->queueNotifyTime != 0)
+        {
+            contextP->queueNotifyTime = 0;
+            observe_flush(contextP);
+        }
+        return (int)(contextP->queueAwakeUntil - currentTime);
+    }
+
+    wakeUp = contextP->queueNotifyTime != 0 && contextP->queueNotifyTime <= currentTime;
+    nextTime = contextP->queueNotifyTime;
+    for (serverP = contextP->serverList ; serverP != NULL ; serverP = serverP->next)
+    {
+        time_t updateTime;
+
+        if (serverP->status != STATE_REGISTERED || !queue_isQueueMode(serverP->binding)) continue;
+
+        updateTime = prv_updateTime(serverP);
+        if (updateTime <= currentTime)
+        {
+            wakeUp = true;
+        }
+        else if (nextTime == 0 || updateTime < nextTime)
+        {
+            nextTime = updateTime;
+        }
+    }
+
+    if (!wakeUp)
+    {
+        if (nextTime == 0) return -1;
+        return (int)(nextTime - currentTime);
+    }
+
+    // send all the uplinks due before the next wake-up in this window
+    contextP->queueAwakeUntil = currentTime + contextP->queueListenTime;
+    for (serverP = contextP->serverList ; serverP != NULL ; serverP = serverP->next)
+    {
+        if (serverP->status == STATE_REGISTERED
+         && queue_isQueueMode(serverP->binding)
+         && prv_updateTime(serverP) <= currentTime + (time_t)contextP->queueMaxDelay)
+        {
+            registration_update(contextP, serverP);
+        }
+    }
+    contextP->queueNotifyTime = 0;
+    observe_flush(contextP);
+
+    return (int)contextP->queueListenTime;
+}
+
+void lwm2m_set_queue_times(lwm2m_context_t * contextP,
+                           uint32_t listenTime,
+                           uint32_t maxDelay)
+{
+    contextP->queueListenTime = listenTime;
+    contextP->queueMaxDelay = maxDelay;
+}
+
+#endif
+
+#ifdef LWM2M_SERVER_MODE
+
+int queue_send(lwm2m_context_t * contextP,
+               lwm2m_transaction_t * transacP)
+{
+    if (transacP->peerType == ENDPOINT_CLIENT)
+    {
+        lwm2m_client_t * clientP = (lwm2m_client_t *)transacP->peerP;
+        struct timeval tv;
+
+        if (queue_isQueueMode(clientP->binding)
+         && 0 == utils_gettimeofday(contextP, &tv)
+         && clientP->lastSeen + LWM2M_QUEUE_AWAKE_TIME <= tv.tv_sec)
+        {
+            lwm2m_transaction_t ** lastP;
+
+            // sent when the client wakes up
+            transacP->next = NULL;
+            lastP = &clientP->queueList;
+            while (*lastP != NULL) lastP = &(*lastP)->next;
+            *lastP = transacP;
+
+            return 0;
+        }
+    }
+
+    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transacP);
+
+    return transaction_send(contextP, transacP);
+}
+
+void queue_wakeup(lwm2m_context_t * contextP,
+                  void * fromSessionH)
+{
+    lwm2m_client_t * clientP;
+    struct timeval tv;
+
+    if (0 != utils_gettimeofday(contextP, &tv)) return;
+
+    for (clientP = clients_findBySession(contextP, fromSessionH, NULL) ;
+         clientP != NULL ;
+         clientP = clients_findBySession(contextP, fromSessionH, clientP))
+    {
+        clientP->lastSeen = tv.tv_sec;
+        while (clientP->queueList != NULL)
+        {
+            lwm2m_transaction_t * transacP;
+
+            transacP = clientP->queueList;
+            clientP->queueList = transacP->next;
+            transacP->next = NULL;
+
+            contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transacP);
+            transaction_send(contextP, transacP);
+        }
+    }
+}
+
+void queue_free(lwm2m_client_t * clientP)
+{
+    while (clientP->queueList != NULL)
+    {
+        lwm2m_transaction_t * transacP;
+
+        transacP = clientP->queueList;
+        clientP->queueList = transacP->next;
+
+        // the client left without waking up
+        if (transacP->callback != NULL)
+        {
+            transacP->callback(transacP, NULL);
+        }
+        transaction_free(transacP);
+    }
+}
+
+#endif
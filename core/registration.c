@@ -124,6 +124,7 @@ static int prv_getRegistrationQuery(lwm2m_context_t * contextP, lwm2m_server_t *
 static void prv_handleRegistrationReply(lwm2m_transaction_t * transacP,
                                         void * message)
 {
+    lwm2m_context_t * contextP = (lwm2m_context_t *)transacP->userData;
     lwm2m_server_t * targetP;
     coap_packet_t * packet = (coap_packet_t *)message;
 
@@ -139,7 +140,8 @@ static void prv_handleRegistrationReply(lwm2m_transaction_t * transacP,
             targetP->status = STATE_DEREGISTERED;
             targetP->mid = 0;
         }
-        else if (packet->mid == targetP->mid
+        // each Block1 block of the registration has its own message ID
+        else if (packet->mid == transacP->mID
               && packet->type == COAP_TYPE_ACK
               && packet->location_path != NULL)
         {
@@ -148,7 +150,7 @@ static void prv_handleRegistrationReply(lwm2m_transaction_t * transacP,
                 targetP->status = STATE_REGISTERED;
                 targetP->location = coap_get_multi_option_as_string(packet->location_path);
 
-                if (0 == lwm2m_gettimeofday(&tv, NULL)) 
+                if (0 == utils_gettimeofday(contextP, &tv)) 
                 {
                     targetP->registration = tv.tv_sec;
                 }
@@ -201,25 +203,32 @@ static int prv_register(lwm2m_context_t * contextP, lwm2m_server_t * server)
         server->sessionH = contextP->connectCallback(server->shortID, contextP->userData);
     }
 
-    if (server->sessionH != NULL)
+    if (server->sessionH == NULL) return SERVICE_UNAVAILABLE_5_03;
+
+    transaction = transaction_new(COAP_POST, NULL, contextP->nextMID++, ENDPOINT_SERVER, (void *)server);
+    if (transaction == NULL) return INTERNAL_SERVER_ERROR_5_00;
+
+    coap_set_header_uri_path(transaction->message, "/"URI_REGISTRATION_SEGMENT);
+    coap_set_header_uri_query(transaction->message, query);
+    if (!transaction_set_payload(contextP, transaction, (uint8_t *)payload, payload_length))
     {
-        transaction = transaction_new(COAP_POST, NULL, contextP->nextMID++, ENDPOINT_SERVER, (void *)server);
-        if (transaction == NULL) return INTERNAL_SERVER_ERROR_5_00;
+        transaction_free(transaction);
+        return INTERNAL_SERVER_ERROR_5_00;
+    }
 
-        coap_set_header_uri_path(transaction->message, "/"URI_REGISTRATION_SEGMENT);
-        coap_set_header_uri_query(transaction->message, query);
-        coap_set_payload(transaction->message, payload, payload_length);
+    transaction->callback = prv_handleRegistrationReply;
+    transaction->userData = (void *) contextP;
 
-        transaction->callback = prv_handleRegistrationReply;
-        transaction->userData = (void *) server;
+    contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
+    if (transaction_send(contextP, transaction) != 0) return INTERNAL_SERVER_ERROR_5_00;
 
-        contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
-        if (transaction_send(contextP, transaction) == 0)
-        {
-            server->status = STATE_REG_PENDING;
-            server->mid = transaction->mID;
-        }
-    }
+    server->status = STATE_REG_PENDING;
+    server->mid = transaction->mID;
+    contextP->stats.registrations++;
+    TRACE(contextP, LWM2M_TRACE_REGISTERED, COAP_TYPE_CON, COAP_POST, transaction->mID, server->shortID);
+    if (queue_isQueueMode(server->binding)) queue_listen(contextP);
+
+    return 0;
 }
 
 int lwm2m_start(lwm2m_context_t * contextP)
@@ -234,6 +243,7 @@ int lwm2m_start(lwm2m_context_t * contextP)
 static void prv_handleRegistrationUpdateReply(lwm2m_transaction_t * transacP,
                                         void * message)
 {
+    lwm2m_context_t * contextP = (lwm2m_context_t *)transacP->userData;
     lwm2m_server_t * targetP;
     coap_packet_t * packet = (coap_packet_t *)message;
     struct timeval tv;
@@ -254,7 +264,7 @@ static void prv_handleRegistrationUpdateReply(lwm2m_transaction_t * transacP,
         {
             if (packet->code == CHANGED_2_04)
             {
-                if (0 == lwm2m_gettimeofday(&tv, NULL)) 
+                if (0 == utils_gettimeofday(contextP, &tv)) 
                 {
                     targetP->registration = tv.tv_sec;
                 }
@@ -274,7 +284,7 @@ static void prv_handleRegistrationUpdateReply(lwm2m_transaction_t * transacP,
     }
 }
 
-static int prv_update_registration(lwm2m_context_t * contextP, lwm2m_server_t * server) {
+int registration_update(lwm2m_context_t * contextP, lwm2m_server_t * server) {
     lwm2m_transaction_t * transaction;
 
     transaction = transaction_new(COAP_PUT, NULL, contextP->nextMID++, ENDPOINT_SERVER, (void *)server);
@@ -283,15 +293,19 @@ static int prv_update_registration(lwm2m_context_t * contextP, lwm2m_server_t *
     coap_set_header_uri_path(transaction->message, server->location);
 
     transaction->callback = prv_handleRegistrationUpdateReply;
-    transaction->userData = (void *) server;
+    transaction->userData = (void *) contextP;
 
     contextP->transactionList = (lwm2m_transaction_t *)LWM2M_LIST_ADD(contextP->transactionList, transaction);
 
-    if (transaction_send(contextP, transaction) == 0)
-    {
-        server->status = STATE_REG_UPDATE_PENDING;
-        server->mid = transaction->mID;
-    }
+    if (transaction_send(contextP, transaction) != 0) return INTERNAL_SERVER_ERROR_5_00;
+
+    server->status = STATE_REG_UPDATE_PENDING;
+    server->mid = transaction->mID;
+    contextP->stats.updates++;
+    TRACE(contextP, LWM2M_TRACE_UPDATED, COAP_TYPE_CON, COAP_PUT, transaction->mID, server->shortID);
+    // the server sends its queued requests now
+    if (queue_isQueueMode(server->binding)) queue_listen(contextP);
+
     return 0;
 }
 
@@ -306,7 +320,7 @@ int lwm2m_update_registration(lwm2m_context_t * contextP, uint16_t shortServerID
         if (targetP->shortID == shortServerID)
         {
             // found the server, trigger the update transaction
-            return prv_update_registration(contextP, targetP);
+            return registration_update(contextP, targetP);
         } else {
             // try next server
             targetP = targetP->next;
@@ -317,6 +331,31 @@ int lwm2m_update_registration(lwm2m_context_t * contextP, uint16_t shortServerID
     return NOT_FOUND_4_04;
 }
 
+// date at which the registration must be updated, margin seconds before it expires
+time_t registration_updateTime(lwm2m_server_t * serverP,
+                               uint32_t margin)
+{
+    uint32_t lifetime;
+
+    lifetime = serverP->lifetime != 0 ? serverP->lifetime : LWM2M_DEFAULT_LIFETIME;
+    if (lifetime > 2 * margin)
+    {
+        return serverP->registration + lifetime - margin;
+    }
+    return serverP->registration + lifetime / 2;
+}
+
+// lower timeoutP to interval seconds
+static void prv_setTimeout(struct timeval * timeoutP,
+                           time_t interval)
+{
+    if (timeoutP->tv_sec > interval)
+    {
+        timeoutP->tv_sec = interval;
+        timeoutP->tv_usec = 0;
+    }
+}
+
 // for each server update the registration if needed
 int lwm2m_update_registrations(lwm2m_context_t * contextP, uint32_t currentTime, struct timeval * timeoutP)
 {
@@ -324,16 +363,29 @@ int lwm2m_update_registrations(lwm2m_context_t * contextP, uint32_t currentTime,
     targetP = contextP->serverList;
     while (targetP != NULL)
     {
+        time_t updateTime;
+
         switch (targetP->status) {
             case STATE_REGISTERED:
-                if (targetP->registration + targetP->lifetime - timeoutP->tv_sec <= currentTime)
+                // servers in queue mode are updated in the wake-up windows
+                if (queue_isQueueMode(targetP->binding)) break;
+                updateTime = registration_updateTime(targetP, LWM2M_UPDATE_MARGIN);
+                if (updateTime > currentTime)
                 {
-                    prv_update_registration(contextP, targetP);
+                    prv_setTimeout(timeoutP, updateTime - currentTime);
+                }
+                else if (registration_update(contextP, targetP) == 0)
+                {
+                    // the transaction was sent after lwm2m_step() computed its retransmission time
+                    prv_setTimeout(timeoutP, COAP_RESPONSE_TIMEOUT);
                 }
                 break;
             case STATE_DEREGISTERED:
                 // TODO: is it disabled?
-                prv_register(contextP, targetP);
+                if (prv_register(contextP, targetP) == 0)
+                {
+                    prv_setTimeout(timeoutP, COAP_RESPONSE_TIMEOUT);
+                }
                 break;
             case STATE_REG_PENDING:
                 break;
@@ -388,10 +440,6 @@ static void prv_handleDeregistrationReply(lwm2m_transaction_t * transacP,
 void registration_deregister(lwm2m_context_t * contextP,
                              lwm2m_server_t * serverP)
 {
-    coap_packet_t message[1];
-    uint8_t pktBuffer[COAP_MAX_PACKET_SIZE+1];
-    size_t pktBufferLen = 0;
-
     if (serverP->status == STATE_DEREGISTERED
      || serverP->status == STATE_REG_PENDING
      || serverP->status == STATE_DEREG_PENDING)
@@ -413,6 +461,8 @@ void registration_deregister(lwm2m_context_t * contextP,
     {
         serverP->status = STATE_REG_PENDING;
         serverP->mid = transaction->mID;
+        contextP->stats.deregistrations++;
+        TRACE(contextP, LWM2M_TRACE_DEREGISTERED, COAP_TYPE_CON, COAP_DELETE, transaction->mID, serverP->shortID);
     }
 }
 #endif
@@ -498,151 +548,14 @@ error:
     return -1;
 }
 
-static int prv_getId(uint8_t * data,
-                     uint16_t length,
-                     uint16_t * objId,
-                     uint16_t * instanceId)
-{
-    int value;
-    uint16_t limit;
-    uint16_t end;
-
-    // Expecting application/link-format (RFC6690)
-    // strip open and close tags
-    if (length >= 1 && data[0] == '<' && data[length-1] == '>')
-    {
-        data++;
-        length-=2;
-    } 
-    else
-    {
-        return 0;
-    }
-
-    // If there is a preceding /, remove it
-    if (length >= 1 && data[0] == '/')
-    {
-        data++;
-        length-=1;
-    }
-
-    limit = 0;
-    while (limit < length && data[limit] != '/' && data[limit] != ' ') limit++;
-    value = prv_get_number(data, limit);
-    if (value < 0 || value >= LWM2M_MAX_ID) return 0;
-    *objId = value;
-
-    if (limit != length)
-    {
-        limit += 1;
-        end = limit;
-        while (end < length && data[end] != ' ') end++;
-        if (end != limit)
-        {
-            value = prv_get_number(data + limit, end - limit);
-            if (value >= 0 && value < LWM2M_MAX_ID)
-            {
-                *instanceId = value;
-                return 2;
-            }
-        }
-    }
-
-    return 1;
-}
-
-static lwm2m_client_object_t * prv_decodeRegisterPayload(uint8_t * payload,
-                                                         uint16_t payloadLength)
-{
-    lwm2m_client_object_t * objList;
-    uint16_t id;
-    uint16_t instance;
-    uint16_t start;
-    uint16_t end;
-    int result;
-
-    objList = NULL;
-    start = 0;
-    while (start < payloadLength)
-    {
-        while (start < payloadLength && payload[start] == ' ') start++;
-        if (start == payloadLength) return objList;
-        end = start;
-        while (end < payloadLength && payload[end] != ',') end++;
-        result = prv_getId(payload + start, end - start, &id, &instance);
-        if (result != 0)
-        {
-            lwm2m_client_object_t * objectP;
-
-            objectP = (lwm2m_client_object_t *)lwm2m_list_find((lwm2m_list_t *)objList, id);
-            if (objectP == NULL)
-            {
-                objectP = (lwm2m_client_object_t *)lwm2m_malloc(sizeof(lwm2m_client_object_t));
-                memset(objectP, 0, sizeof(lwm2m_client_object_t));
-                if (objectP == NULL) return objList;
-                objectP->id = id;
-                objList = (lwm2m_client_object_t *)LWM2M_LIST_ADD(objList, objectP);
-            }
-            if (result == 2)
-            {
-                lwm2m_list_t * instanceP;
-
-                instanceP = lwm2m_list_find(objectP->instanceList, instance);
-                if (instanceP == NULL)
-                {
-                    instanceP = (lwm2m_list_t *)lwm2m_malloc(sizeof(lwm2m_list_t));
-                    memset(instanceP, 0, sizeof(lwm2m_list_t));
-                    instanceP->id = instance;
-                    objectP->instanceList = LWM2M_LIST_ADD(objectP->instanceList, instanceP);
-                }
-            }
-        }
-        start = end + 1;
-    }
-
-    return objList;
-}
-
-static lwm2m_client_t * prv_getClientByName(lwm2m_context_t * contextP,
-                                            char * name)
-{
-    lwm2m_client_t * targetP;
-
-    targetP = contextP->clientList;
-    while (targetP != NULL && strcmp(name, targetP->name) != 0)
-    {
-        targetP = targetP->next;
-    }
-
-    return targetP;
-}
-
-static void prv_freeClientObjectList(lwm2m_client_object_t * objects)
-{
-    while (objects != NULL)
-    {
-        lwm2m_client_object_t * objP;
-
-        while (objects->instanceList != NULL)
-        {
-            lwm2m_list_t * target;
-
-            target = objects->instanceList;
-            objects->instanceList = objects->instanceList->next;
-            lwm2m_free(target);
-        }
-
-        objP = objects;
-        objects = objects->next;
-        lwm2m_free(objP);
-    }
-}
-
-void prv_freeClient(lwm2m_client_t * clientP)
+void prv_freeClient(lwm2m_context_t * contextP,
+                    lwm2m_client_t * clientP)
 {
     if (clientP->name != NULL) lwm2m_free(clientP->name);
     if (clientP->msisdn != NULL) lwm2m_free(clientP->msisdn);
-    prv_freeClientObjectList(clientP->objectList);
+    layout_release(contextP, clientP->layout);
+    queue_free(clientP);
+    cache_free(clientP);
     while(clientP->observationList != NULL)
     {
         lwm2m_observation_t * targetP;
@@ -679,7 +592,7 @@ coap_status_t handle_registration_request(lwm2m_context_t * contextP,
     coap_status_t result;
     struct timeval tv;
 
-    if (lwm2m_gettimeofday(&tv, NULL) != 0)
+    if (utils_gettimeofday(contextP, &tv) != 0)
     {
         return COAP_500_INTERNAL_SERVER_ERROR;
     }
@@ -692,7 +605,7 @@ coap_status_t handle_registration_request(lwm2m_context_t * contextP,
         uint32_t lifetime;
         char * msisdn;
         lwm2m_binding_t binding;
-        lwm2m_client_object_t * objects;
+        lwm2m_client_layout_t * layoutP;
         lwm2m_client_t * clientP;
         char location[MAX_LOCATION_LENGTH];
 
@@ -701,8 +614,8 @@ coap_status_t handle_registration_request(lwm2m_context_t * contextP,
         {
             return COAP_400_BAD_REQUEST;
         }
-        objects = prv_decodeRegisterPayload(message->payload, message->payload_len);
-        if (objects == NULL)
+        layoutP = layout_acquire(contextP, message->payload, message->payload_len);
+        if (layoutP == NULL)
         {
             lwm2m_free(name);
             if (msisdn != NULL) lwm2m_free(msisdn);
@@ -712,6 +625,7 @@ coap_status_t handle_registration_request(lwm2m_context_t * contextP,
         if (name == NULL)
         {
             if (msisdn != NULL) lwm2m_free(msisdn);
+            layout_release(contextP, layoutP);
             return COAP_400_BAD_REQUEST;
         }
         if (lifetime == 0)
@@ -719,14 +633,13 @@ coap_status_t handle_registration_request(lwm2m_context_t * contextP,
             lifetime = LWM2M_DEFAULT_LIFETIME;
         }
 
-        clientP = prv_getClientByName(contextP, name);
+        clientP = clients_findByName(contextP, name);
         if (clientP != NULL)
         {
             // we reset this registration
             lwm2m_free(clientP->name);
             if (clientP->msisdn != NULL) lwm2m_free(clientP->msisdn);
-            prv_freeClientObjectList(clientP->objectList);
-            clientP->objectList = NULL;
+            layout_release(contextP, clientP->layout);
         }
         else
         {
@@ -735,36 +648,43 @@ coap_status_t handle_registration_request(lwm2m_context_t * contextP,
             {
                 lwm2m_free(name);
                 if (msisdn != NULL) lwm2m_free(msisdn);
-                prv_freeClientObjectList(objects);
+                layout_release(contextP, layoutP);
                 return COAP_500_INTERNAL_SERVER_ERROR;
             }
             memset(clientP, 0, sizeof(lwm2m_client_t));
-            clientP->internalID = lwm2m_list_newId((lwm2m_list_t *)contextP->clientList);
-            contextP->clientList = (lwm2m_client_t *)LWM2M_LIST_ADD(contextP->clientList, clientP);
+            clientP->name = name;
+            if (clients_add(contextP, clientP) != 0)
+            {
+                lwm2m_free(clientP);
+                lwm2m_free(name);
+                if (msisdn != NULL) lwm2m_free(msisdn);
+                layout_release(contextP, layoutP);
+                return COAP_500_INTERNAL_SERVER_ERROR;
+            }
         }
         clientP->name = name;
         clientP->binding = binding;
         clientP->msisdn = msisdn;
         clientP->lifetime = lifetime;
-        clientP->endOfLife = tv.tv_sec + lifetime;
-        clientP->objectList = objects;
-        clientP->sessionH = fromSessionH;
+        clientP->layout = layoutP;
+        clientP->objectList = layout_getObjects(layoutP);
+        clients_setEndOfLife(contextP, clientP, tv.tv_sec + lifetime);
+        clients_setSession(contextP, clientP, fromSessionH);
 
-        if (prv_getLocationString(clientP->internalID, location) == 0)
+        if (prv_getLocationString(clientP->internalID, location) == 0
+         || coap_set_header_location_path(response, location) == 0)
         {
-            prv_freeClient(clientP);
-            return COAP_500_INTERNAL_SERVER_ERROR;
-        }
-        if (coap_set_header_location_path(response, location) == 0)
-        {
-            prv_freeClient(clientP);
+            clients_remove(contextP, clientP);
+            prv_freeClient(contextP, clientP);
             return COAP_500_INTERNAL_SERVER_ERROR;
         }
 
         if (contextP->monitorCallback != NULL)
         {
-            contextP->monitorCallback(clientP->internalID, NULL, CREATED_2_01, NULL, 0, contextP->monitorUserData);
+            contextP->monitorCallback(clientP->internalID, NULL, CREATED_2_01, LWM2M_CONTENT_TEXT, NULL, 0, contextP->monitorUserData);
         }
+        contextP->stats.registrations++;
+        TRACE(contextP, LWM2M_TRACE_REGISTERED, message->type, message->code, message->mid, clientP->internalID);
         result = COAP_201_CREATED;
     }
     break;
@@ -775,19 +695,18 @@ coap_status_t handle_registration_request(lwm2m_context_t * contextP,
         uint32_t lifetime;
         char * msisdn;
         lwm2m_binding_t binding;
-        lwm2m_client_object_t * objects;
+        lwm2m_client_layout_t * layoutP;
         lwm2m_client_t * clientP;
 
         if ((uriP->flag & LWM2M_URI_MASK_ID) != LWM2M_URI_FLAG_OBJECT_ID) return COAP_400_BAD_REQUEST;
 
-        clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)contextP->clientList, uriP->objectId);
+        clientP = clients_find(contextP, uriP->objectId);
         if (clientP == NULL) return COAP_404_NOT_FOUND;
 
         if (0 != prv_getParameters(message->uri_query, &name, &lifetime, &msisdn, &binding))
         {
             return COAP_400_BAD_REQUEST;
         }
-        objects = prv_decodeRegisterPayload(message->payload, message->payload_len);
 
         // Endpoint client name MUST NOT be present
         if (name != NULL)
@@ -797,6 +716,14 @@ coap_status_t handle_registration_request(lwm2m_context_t * contextP,
             return COAP_400_BAD_REQUEST;
         }
 
+        // an unchanged list of objects keeps the current layout
+        layoutP = NULL;
+        if (message->payload_len != 0
+         && !layout_isSame(clientP->layout, message->payload, message->payload_len))
+        {
+            layoutP = layout_acquire(contextP, message->payload, message->payload_len);
+        }
+
         if (binding != BINDING_UNKNOWN)
         {
             clientP->binding = binding;
@@ -811,60 +738,47 @@ coap_status_t handle_registration_request(lwm2m_context_t * contextP,
             clientP->lifetime = lifetime;
         }
         // client IP address, port or MSISDN may have changed
-        clientP->sessionH = fromSessionH;
+        clients_setSession(contextP, clientP, fromSessionH);
 
-        if (objects != NULL)
+        if (layoutP != NULL)
         {
             lwm2m_observation_t * observationP;
 
-            // remove observations on object/instance no longer existing
+            // remove observations on object/instance no longer existing, only objects which changed are checked
             observationP = clientP->observationList;
             while (observationP != NULL)
             {
-                lwm2m_client_object_t * objP;
                 lwm2m_observation_t * nextP;
 
                 nextP = observationP->next;
 
-                objP = (lwm2m_client_object_t *)lwm2m_list_find((lwm2m_list_t *)objects, observationP->uri.objectId);
-                if (objP == NULL)
+                if (layout_hasChanged(clientP->layout, layoutP, observationP->uri.objectId)
+                 && !layout_contains(layoutP, &observationP->uri))
                 {
                     observationP->callback(clientP->internalID,
                                            &observationP->uri,
                                            COAP_202_DELETED,
-                                           NULL, 0,
+                                           LWM2M_CONTENT_TEXT, NULL, 0,
                                            observationP->userData);
                     observation_remove(clientP, observationP);
                 }
-                else
-                {
-                    if ((observationP->uri.flag & LWM2M_URI_FLAG_INSTANCE_ID) != 0)
-                    {
-                        if (lwm2m_list_find((lwm2m_list_t *)objP->instanceList, observationP->uri.instanceId) == NULL)
-                        {
-                            observationP->callback(clientP->internalID,
-                                                   &observationP->uri,
-                                                   COAP_202_DELETED,
-                                                   NULL, 0,
-                                                   observationP->userData);
-                            observation_remove(clientP, observationP);
-                        }
-                    }
-                }
 
                 observationP = nextP;
             }
 
-            prv_freeClientObjectList(clientP->objectList);
-            clientP->objectList = objects;
+            layout_release(contextP, clientP->layout);
+            clientP->layout = layoutP;
+            clientP->objectList = layout_getObjects(layoutP);
         }
 
-        clientP->endOfLife = tv.tv_sec + clientP->lifetime;
+        clients_setEndOfLife(contextP, clientP, tv.tv_sec + clientP->lifetime);
 
         if (contextP->monitorCallback != NULL)
         {
-            contextP->monitorCallback(clientP->internalID, NULL, COAP_204_CHANGED, NULL, 0, contextP->monitorUserData);
+            contextP->monitorCallback(clientP->internalID, NULL, COAP_204_CHANGED, LWM2M_CONTENT_TEXT, NULL, 0, contextP->monitorUserData);
         }
+        contextP->stats.updates++;
+        TRACE(contextP, LWM2M_TRACE_UPDATED, message->type, message->code, message->mid, clientP->internalID);
         result = COAP_204_CHANGED;
     }
     break;
@@ -875,13 +789,16 @@ coap_status_t handle_registration_request(lwm2m_context_t * contextP,
 
         if ((uriP->flag & LWM2M_URI_MASK_ID) != LWM2M_URI_FLAG_OBJECT_ID) return COAP_400_BAD_REQUEST;
 
-        contextP->clientList = (lwm2m_client_t *)LWM2M_LIST_RM(contextP->clientList, uriP->objectId, &clientP);
+        clientP = clients_find(contextP, uriP->objectId);
         if (clientP == NULL) return COAP_400_BAD_REQUEST;
+        clients_remove(contextP, clientP);
         if (contextP->monitorCallback != NULL)
         {
-            contextP->monitorCallback(clientP->internalID, NULL, DELETED_2_02, NULL, 0, contextP->monitorUserData);
+            contextP->monitorCallback(clientP->internalID, NULL, DELETED_2_02, LWM2M_CONTENT_TEXT, NULL, 0, contextP->monitorUserData);
         }
-        prv_freeClient(clientP);
+        TRACE(contextP, LWM2M_TRACE_DEREGISTERED, message->type, message->code, message->mid, clientP->internalID);
+        prv_freeClient(contextP, clientP);
+        contextP->stats.deregistrations++;
         result = COAP_202_DELETED;
     }
     break;
@@ -0,0 +1,475 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Content format independent part of the SenML encoders and decoders:
+ * conversion between lwm2m_tlv_t trees and flat lists of records and
+ * handling of the record names.
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+int senml_nameToRecord(uint8_t * name,
+                       size_t length,
+                       lwm2m_senml_record_t * recordP)
+{
+    uint16_t ids[4];
+    int num;
+    size_t i;
+
+    if (length == 0 || name[0] != '/') return 0;
+
+    num = 0;
+    i = 1;
+    while (i < length)
+    {
+        uint32_t value;
+        size_t start;
+
+        if (num == 4) return 0;
+
+        start = i;
+        value = 0;
+        while (i < length && name[i] >= '0' && name[i] <= '9')
+        {
+            value = value * 10 + (name[i] - '0');
+            if (value >= LWM2M_MAX_ID) return 0;
+            i++;
+        }
+        // empty segment or trailing '/'
+        if (i == start) return 0;
+        if (i < length)
+        {
+            if (name[i] != '/' || i + 1 == length) return 0;
+            i++;
+        }
+        ids[num++] = (uint16_t)value;
+    }
+    if (num == 0) return 0;
+
+    memset(&recordP->uri, 0, sizeof(lwm2m_uri_t));
+    recordP->uri.flag = LWM2M_URI_FLAG_OBJECT_ID;
+    recordP->uri.objectId = ids[0];
+    recordP->uri.instanceId = LWM2M_MAX_ID;
+    recordP->uri.resourceId = LWM2M_MAX_ID;
+    recordP->resourceInstanceId = LWM2M_MAX_ID;
+    if (num > 1)
+    {
+        recordP->uri.flag |= LWM2M_URI_FLAG_INSTANCE_ID;
+        recordP->uri.instanceId = ids[1];
+    }
+    if (num > 2)
+    {
+        recordP->uri.flag |= LWM2M_URI_FLAG_RESOURCE_ID;
+        recordP->uri.resourceId = ids[2];
+    }
+    if (num > 3)
+    {
+        recordP->resourceInstanceId = ids[3];
+    }
+
+    return 1;
+}
+
+static int prv_writeId(uint16_t id,
+                       char * buffer)
+{
+    buffer[0] = '/';
+    return 1 + lwm2m_int64ToPlainTextBuffer(id, buffer + 1, SENML_NAME_MAX_LEN);
+}
+
+int senml_recordName(lwm2m_senml_record_t * recordP,
+                     char * buffer)
+{
+    lwm2m_uri_t * uriP = &recordP->uri;
+    int length;
+
+    length = prv_writeId(uriP->objectId, buffer);
+    if (LWM2M_URI_IS_SET_INSTANCE(uriP))
+    {
+        length += prv_writeId(uriP->instanceId, buffer + length);
+        if (LWM2M_URI_IS_SET_RESOURCE(uriP))
+        {
+            length += prv_writeId(uriP->resourceId, buffer + length);
+            if (recordP->resourceInstanceId != LWM2M_MAX_ID)
+            {
+                length += prv_writeId(recordP->resourceInstanceId, buffer + length);
+            }
+        }
+    }
+
+    return length;
+}
+
+int senml_baseName(int count,
+                   lwm2m_senml_record_t * recordArray,
+                   char * buffer)
+{
+    char name[SENML_NAME_MAX_LEN];
+    int fullLength;
+    int length;
+    bool isSameName;
+    int i;
+
+    if (count == 0) return 0;
+
+    fullLength = senml_recordName(recordArray, buffer);
+    length = fullLength;
+    isSameName = true;
+
+    for (i = 1 ; i < count && length > 0 ; i++)
+    {
+        int nameLength;
+        int j;
+
+        nameLength = senml_recordName(recordArray + i, name);
+        j = 0;
+        while (j < length && j < nameLength && buffer[j] == name[j])
+        {
+            j++;
+        }
+        if (j != fullLength || nameLength != fullLength) isSameName = false;
+        length = j;
+    }
+
+    // all the records have the same name (e.g. time series)
+    if (isSameName) return fullLength;
+
+    // only cut names at segment boundaries
+    while (length > 0 && buffer[length - 1] != '/')
+    {
+        length--;
+    }
+
+    return length;
+}
+
+// Add the base value to a numeric value.
+void senml_applyBaseValue(senml_base_t * baseP,
+                          lwm2m_senml_record_t * recordP)
+{
+    if (baseP->valueType == LWM2M_DATA_UNDEFINED) return;
+
+    if (baseP->valueType == LWM2M_DATA_INTEGER
+     && recordP->type == LWM2M_DATA_INTEGER)
+    {
+        int64_t base = baseP->integerValue;
+        int64_t value = recordP->value.asInteger;
+
+        if ((base >= 0 && value <= INT64_MAX - base)
+         || (base < 0 && value >= INT64_MIN - base))
+        {
+            recordP->value.asInteger = base + value;
+            return;
+        }
+    }
+
+    if (recordP->type == LWM2M_DATA_INTEGER)
+    {
+        recordP->value.asFloat = (double)recordP->value.asInteger;
+        recordP->type = LWM2M_DATA_FLOAT;
+    }
+    if (baseP->valueType == LWM2M_DATA_INTEGER)
+    {
+        recordP->value.asFloat += (double)baseP->integerValue;
+    }
+    else
+    {
+        recordP->value.asFloat += baseP->floatValue;
+    }
+}
+
+// Set the URI and time of a decoded record from its name and time and the base fields.
+int senml_resolveRecord(senml_base_t * baseP,
+                        uint8_t * name,
+                        size_t nameLength,
+                        double time,
+                        lwm2m_senml_record_t * recordP)
+{
+    uint8_t fullName[SENML_NAME_MAX_LEN];
+
+    if (baseP->nameLength + nameLength > SENML_NAME_MAX_LEN) return 0;
+    if (baseP->nameLength > 0) memcpy(fullName, baseP->name, baseP->nameLength);
+    if (nameLength > 0) memcpy(fullName + baseP->nameLength, name, nameLength);
+    if (0 == senml_nameToRecord(fullName, baseP->nameLength + nameLength, recordP)) return 0;
+
+    recordP->time = baseP->time + time;
+
+    return 1;
+}
+
+static int prv_countRecords(int size,
+                            lwm2m_tlv_t * tlvP)
+{
+    int count;
+    int i;
+
+    count = 0;
+    for (i = 0 ; i < size ; i++)
+    {
+        switch (tlvP[i].type)
+        {
+        case LWM2M_TYPE_OBJECT_INSTANCE:
+        case LWM2M_TYPE_MULTIPLE_RESSOURCE:
+            count += prv_countRecords(tlvP[i].length, (lwm2m_tlv_t *)tlvP[i].value);
+            break;
+        default:
+            count++;
+            break;
+        }
+    }
+
+    return count;
+}
+
+static int prv_setRecordValue(lwm2m_tlv_t * tlvP,
+                              lwm2m_senml_record_t * recordP)
+{
+    switch (tlvP->dataType)
+    {
+    case LWM2M_DATA_INTEGER:
+        recordP->type = LWM2M_DATA_INTEGER;
+        return lwm2m_tlv_decode_int(tlvP, &recordP->value.asInteger);
+
+    case LWM2M_DATA_FLOAT:
+        recordP->type = LWM2M_DATA_FLOAT;
+        return lwm2m_tlv_decode_float(tlvP, &recordP->value.asFloat);
+
+    case LWM2M_DATA_BOOLEAN:
+        recordP->type = LWM2M_DATA_BOOLEAN;
+        return lwm2m_tlv_decode_bool(tlvP, &recordP->value.asBoolean);
+
+    case LWM2M_DATA_OPAQUE:
+        recordP->type = LWM2M_DATA_OPAQUE;
+        break;
+
+    default:
+        recordP->type = LWM2M_DATA_STRING;
+        break;
+    }
+    recordP->value.asBuffer.length = tlvP->length;
+    recordP->value.asBuffer.buffer = tlvP->value;
+
+    return 1;
+}
+
+static int prv_fillRecords(lwm2m_senml_record_t * baseP,
+                           int size,
+                           lwm2m_tlv_t * tlvP,
+                           lwm2m_senml_record_t * recordArray)
+{
+    int index;
+    int i;
+
+    index = 0;
+    for (i = 0 ; i < size ; i++)
+    {
+        lwm2m_senml_record_t record;
+        int result;
+
+        memcpy(&record, baseP, sizeof(lwm2m_senml_record_t));
+
+        switch (tlvP[i].type)
+        {
+        case LWM2M_TYPE_OBJECT_INSTANCE:
+            record.uri.instanceId = tlvP[i].id;
+            record.uri.flag |= LWM2M_URI_FLAG_INSTANCE_ID;
+            result = prv_fillRecords(&record, tlvP[i].length, (lwm2m_tlv_t *)tlvP[i].value, recordArray + index);
+            if (result < 0) return -1;
+            index += result;
+            break;
+
+        case LWM2M_TYPE_MULTIPLE_RESSOURCE:
+        case LWM2M_TYPE_RESSOURCE:
+            if (!LWM2M_URI_IS_SET_INSTANCE((&record.uri)))
+            {
+                // single instance object
+                record.uri.instanceId = 0;
+                record.uri.flag |= LWM2M_URI_FLAG_INSTANCE_ID;
+            }
+            record.uri.resourceId = tlvP[i].id;
+            record.uri.flag |= LWM2M_URI_FLAG_RESOURCE_ID;
+            if (tlvP[i].type == LWM2M_TYPE_MULTIPLE_RESSOURCE)
+            {
+                result = prv_fillRecords(&record, tlvP[i].length, (lwm2m_tlv_t *)tlvP[i].value, recordArray + index);
+                if (result < 0) return -1;
+                index += result;
+            }
+            else
+            {
+                if (0 == prv_setRecordValue(tlvP + i, &record)) return -1;
+                memcpy(recordArray + index, &record, sizeof(lwm2m_senml_record_t));
+                index++;
+            }
+            break;
+
+        case LWM2M_TYPE_RESSOURCE_INSTANCE:
+            if (!LWM2M_URI_IS_SET_RESOURCE((&record.uri))) return -1;
+            record.resourceInstanceId = tlvP[i].id;
+            if (0 == prv_setRecordValue(tlvP + i, &record)) return -1;
+            memcpy(recordArray + index, &record, sizeof(lwm2m_senml_record_t));
+            index++;
+            break;
+
+        default:
+            return -1;
+        }
+    }
+
+    return index;
+}
+
+int senml_recordsFromTlv(lwm2m_uri_t * uriP,
+                         int size,
+                         lwm2m_tlv_t * tlvP,
+                         lwm2m_senml_record_t ** recordArrayP)
+{
+    lwm2m_senml_record_t base;
+    int count;
+
+    *recordArrayP = NULL;
+
+    count = prv_countRecords(size, tlvP);
+    if (count == 0) return 0;
+
+    *recordArrayP = (lwm2m_senml_record_t *)lwm2m_malloc(count * sizeof(lwm2m_senml_record_t));
+    if (*recordArrayP == NULL) return -1;
+
+    memset(&base, 0, sizeof(lwm2m_senml_record_t));
+    base.uri.flag = LWM2M_URI_FLAG_OBJECT_ID;
+    base.uri.objectId = uriP->objectId;
+    base.uri.instanceId = LWM2M_MAX_ID;
+    base.uri.resourceId = LWM2M_MAX_ID;
+    base.resourceInstanceId = LWM2M_MAX_ID;
+    if (LWM2M_URI_IS_SET_INSTANCE(uriP))
+    {
+        base.uri.instanceId = uriP->instanceId;
+        base.uri.flag |= LWM2M_URI_FLAG_INSTANCE_ID;
+    }
+
+    if (count != prv_fillRecords(&base, size, tlvP, *recordArrayP))
+    {
+        lwm2m_free(*recordArrayP);
+        *recordArrayP = NULL;
+        return -1;
+    }
+
+    return count;
+}
+
+// Return the lwm2m_tlv_t with the given ID in the array, adding it if needed.
+static lwm2m_tlv_t * prv_getTlv(lwm2m_tlv_t ** arrayP,
+                                size_t * sizeP,
+                                uint8_t type,
+                                uint16_t id)
+{
+    lwm2m_tlv_t * newArray;
+    size_t i;
+
+    for (i = 0 ; i < *sizeP ; i++)
+    {
+        if ((*arrayP)[i].id == id)
+        {
+            if ((*arrayP)[i].type != type) return NULL;
+            return *arrayP + i;
+        }
+    }
+
+    newArray = lwm2m_tlv_new(*sizeP + 1);
+    if (newArray == NULL) return NULL;
+    if (*sizeP > 0)
+    {
+        memcpy(newArray, *arrayP, *sizeP * sizeof(lwm2m_tlv_t));
+        lwm2m_free(*arrayP);
+    }
+    *arrayP = newArray;
+    newArray[*sizeP].type = type;
+    newArray[*sizeP].id = id;
+    *sizeP += 1;
+
+    return newArray + *sizeP - 1;
+}
+
+int senml_tlvBuilderCallback(lwm2m_senml_record_t * recordP,
+                             void * userData)
+{
+    senml_tlv_builder_t * builderP = (senml_tlv_builder_t *)userData;
+    lwm2m_uri_t * uriP = builderP->uriP;
+    lwm2m_tlv_t ** arrayP;
+    size_t * sizeP;
+    lwm2m_tlv_t * tlvP;
+
+    // the record must target a resource below the request URI
+    if (!LWM2M_URI_IS_SET_RESOURCE((&recordP->uri))) return -1;
+    if (recordP->uri.objectId != uriP->objectId) return -1;
+    if (LWM2M_URI_IS_SET_INSTANCE(uriP) && recordP->uri.instanceId != uriP->instanceId) return -1;
+    if (LWM2M_URI_IS_SET_RESOURCE(uriP) && recordP->uri.resourceId != uriP->resourceId) return -1;
+
+    arrayP = &builderP->tlvP;
+    sizeP = &builderP->size;
+
+    if (!LWM2M_URI_IS_SET_INSTANCE(uriP))
+    {
+        tlvP = prv_getTlv(arrayP, sizeP, LWM2M_TYPE_OBJECT_INSTANCE, recordP->uri.instanceId);
+        if (tlvP == NULL) return -1;
+        arrayP = (lwm2m_tlv_t **)&tlvP->value;
+        sizeP = &tlvP->length;
+    }
+
+    if (recordP->resourceInstanceId != LWM2M_MAX_ID)
+    {
+        tlvP = prv_getTlv(arrayP, sizeP, LWM2M_TYPE_MULTIPLE_RESSOURCE, recordP->uri.resourceId);
+        if (tlvP == NULL) return -1;
+        arrayP = (lwm2m_tlv_t **)&tlvP->value;
+        sizeP = &tlvP->length;
+
+        tlvP = prv_getTlv(arrayP, sizeP, LWM2M_TYPE_RESSOURCE_INSTANCE, recordP->resourceInstanceId);
+    }
+    else
+    {
+        tlvP = prv_getTlv(arrayP, sizeP, LWM2M_TYPE_RESSOURCE, recordP->uri.resourceId);
+    }
+    if (tlvP == NULL) return -1;
+    // duplicated record
+    if (tlvP->value != NULL) return -1;
+
+    switch (recordP->type)
+    {
+    case LWM2M_DATA_INTEGER:
+        lwm2m_tlv_encode_int(recordP->value.asInteger, tlvP);
+        break;
+    case LWM2M_DATA_FLOAT:
+        lwm2m_tlv_encode_float(recordP->value.asFloat, tlvP);
+        break;
+    case LWM2M_DATA_BOOLEAN:
+        lwm2m_tlv_encode_bool(recordP->value.asBoolean, tlvP);
+        break;
+    default:
+        // points inside the payload
+        tlvP->flags = LWM2M_TLV_FLAG_STATIC_DATA;
+        tlvP->dataType = recordP->type;
+        tlvP->length = recordP->value.asBuffer.length;
+        tlvP->value = recordP->value.asBuffer.buffer;
+        return 0;
+    }
+    if (tlvP->value == NULL) return -1;
+
+    return 0;
+}
@@ -0,0 +1,793 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * SenML-CBOR (RFC 8428) encoder and decoder.
+ *
+ * The encoder factors the common prefix of the record names in the base
+ * name and the time of the first record in the base time. Numbers are
+ * written in their shortest exact CBOR form.
+ * The decoder does not allocate memory: records are resolved one at a time
+ * and handed to the caller's callback.
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#define CBOR_TYPE_UNSIGNED  0
+#define CBOR_TYPE_NEGATIVE  1
+#define CBOR_TYPE_BYTES     2
+#define CBOR_TYPE_TEXT      3
+#define CBOR_TYPE_ARRAY     4
+#define CBOR_TYPE_MAP       5
+#define CBOR_TYPE_TAG       6
+#define CBOR_TYPE_SIMPLE    7
+
+#define CBOR_INFO_INDEFINITE    31
+#define CBOR_BREAK              0xFF
+
+#define CBOR_SIMPLE_FALSE   20
+#define CBOR_SIMPLE_TRUE    21
+#define CBOR_FLOAT16        25
+#define CBOR_FLOAT32        26
+#define CBOR_FLOAT64        27
+
+#define CBOR_MAX_DEPTH      8
+
+// SenML labels
+#define SENML_LABEL_BVER    -1
+#define SENML_LABEL_BN      -2
+#define SENML_LABEL_BT      -3
+#define SENML_LABEL_BU      -4
+#define SENML_LABEL_BV      -5
+#define SENML_LABEL_N       0
+#define SENML_LABEL_U       1
+#define SENML_LABEL_V       2
+#define SENML_LABEL_VS      3
+#define SENML_LABEL_VB      4
+#define SENML_LABEL_S       5
+#define SENML_LABEL_T       6
+#define SENML_LABEL_UT      7
+#define SENML_LABEL_VD      8
+
+
+/*
+ * Encoder
+ *
+ * All prv_write*() functions return the number of bytes of the encoded item
+ * and only compute it when buffer is NULL.
+ */
+
+static size_t prv_writeHead(uint8_t * buffer,
+                            uint8_t type,
+                            uint64_t value)
+{
+    size_t length;
+    size_t i;
+
+    if (value < 24) length = 0;
+    else if (value <= 0xFF) length = 1;
+    else if (value <= 0xFFFF) length = 2;
+    else if (value <= 0xFFFFFFFF) length = 4;
+    else length = 8;
+
+    if (buffer != NULL)
+    {
+        switch (length)
+        {
+        case 0:
+            buffer[0] = (type << 5) | (uint8_t)value;
+            break;
+        case 1:
+            buffer[0] = (type << 5) | 24;
+            break;
+        case 2:
+            buffer[0] = (type << 5) | 25;
+            break;
+        case 4:
+            buffer[0] = (type << 5) | 26;
+            break;
+        default:
+            buffer[0] = (type << 5) | 27;
+            break;
+        }
+        for (i = 0 ; i < length ; i++)
+        {
+            buffer[1 + i] = (value >> (8 * (length - 1 - i))) & 0xFF;
+        }
+    }
+
+    return 1 + length;
+}
+
+static size_t prv_writeInteger(uint8_t * buffer,
+                               int64_t value)
+{
+    if (value < 0)
+    {
+        // -1 - value can not overflow
+        return prv_writeHead(buffer, CBOR_TYPE_NEGATIVE, (uint64_t)(-(value + 1)));
+    }
+
+    return prv_writeHead(buffer, CBOR_TYPE_UNSIGNED, (uint64_t)value);
+}
+
+static size_t prv_writeString(uint8_t * buffer,
+                              uint8_t type,
+                              uint8_t * data,
+                              size_t length)
+{
+    size_t headLength;
+
+    headLength = prv_writeHead(buffer, type, length);
+    if (buffer != NULL && length > 0)
+    {
+        memcpy(buffer + headLength, data, length);
+    }
+
+    return headLength + length;
+}
+
+static size_t prv_writeFloat(uint8_t * buffer,
+                             double value)
+{
+    uint64_t bits;
+    uint8_t info;
+    size_t length;
+    size_t i;
+
+    if (value >= -FLT_MAX && value <= FLT_MAX
+     && (double)(float)value == value)
+    {
+        float shortValue = (float)value;
+        uint32_t shortBits;
+        uint32_t exponent;
+        uint32_t mantissa;
+
+        memcpy(&shortBits, &shortValue, sizeof(shortBits));
+        exponent = (shortBits >> 23) & 0xFF;
+        mantissa = shortBits & 0x7FFFFF;
+
+        if ((exponent == 0 && mantissa == 0)
+         || (exponent >= 113 && exponent <= 142 && (mantissa & 0x1FFF) == 0))
+        {
+            // exact as an half precision float
+            bits = (shortBits >> 16) & 0x8000;
+            if (exponent != 0)
+            {
+                bits |= ((exponent - 112) << 10) | (mantissa >> 13);
+            }
+            info = CBOR_FLOAT16;
+            length = 2;
+        }
+        else
+        {
+            bits = shortBits;
+            info = CBOR_FLOAT32;
+            length = 4;
+        }
+    }
+    else
+    {
+        memcpy(&bits, &value, sizeof(bits));
+        info = CBOR_FLOAT64;
+        length = 8;
+    }
+
+    if (buffer != NULL)
+    {
+        buffer[0] = (CBOR_TYPE_SIMPLE << 5) | info;
+        for (i = 0 ; i < length ; i++)
+        {
+            buffer[1 + i] = (bits >> (8 * (length - 1 - i))) & 0xFF;
+        }
+    }
+
+    return 1 + length;
+}
+
+static size_t prv_writeNumber(uint8_t * buffer,
+                              double value)
+{
+    // integral values are shorter as CBOR integers
+    if (value > -9223372036854775808.0 && value < 9223372036854775808.0
+     && (double)(int64_t)value == value)
+    {
+        return prv_writeInteger(buffer, (int64_t)value);
+    }
+
+    return prv_writeFloat(buffer, value);
+}
+
+static size_t prv_writeRecord(uint8_t * buffer,
+                              lwm2m_senml_record_t * recordP,
+                              char * baseName,
+                              int baseLength,
+                              double baseTime,
+                              bool isFirst)
+{
+    char name[SENML_NAME_MAX_LEN];
+    int nameLength;
+    uint64_t fieldCount;
+    size_t length;
+
+    nameLength = senml_recordName(recordP, name);
+
+    fieldCount = 1;
+    if (isFirst && baseLength > 0) fieldCount++;
+    if (isFirst && baseTime != 0) fieldCount++;
+    if (nameLength > baseLength) fieldCount++;
+    if (recordP->time != baseTime) fieldCount++;
+
+    // prv_write*() do not write anything when buffer is NULL
+#define CURRENT (buffer == NULL ? NULL : buffer + length)
+
+    length = prv_writeHead(buffer, CBOR_TYPE_MAP, fieldCount);
+
+    if (isFirst && baseLength > 0)
+    {
+        length += prv_writeInteger(CURRENT, SENML_LABEL_BN);
+        length += prv_writeString(CURRENT, CBOR_TYPE_TEXT, (uint8_t *)baseName, baseLength);
+    }
+    if (isFirst && baseTime != 0)
+    {
+        length += prv_writeInteger(CURRENT, SENML_LABEL_BT);
+        length += prv_writeNumber(CURRENT, baseTime);
+    }
+    if (nameLength > baseLength)
+    {
+        length += prv_writeInteger(CURRENT, SENML_LABEL_N);
+        length += prv_writeString(CURRENT, CBOR_TYPE_TEXT, (uint8_t *)name + baseLength, nameLength - baseLength);
+    }
+    if (recordP->time != baseTime)
+    {
+        length += prv_writeInteger(CURRENT, SENML_LABEL_T);
+        length += prv_writeNumber(CURRENT, recordP->time - baseTime);
+    }
+
+    switch (recordP->type)
+    {
+    case LWM2M_DATA_INTEGER:
+        length += prv_writeInteger(CURRENT, SENML_LABEL_V);
+        length += prv_writeInteger(CURRENT, recordP->value.asInteger);
+        break;
+
+    case LWM2M_DATA_FLOAT:
+        length += prv_writeInteger(CURRENT, SENML_LABEL_V);
+        length += prv_writeFloat(CURRENT, recordP->value.asFloat);
+        break;
+
+    case LWM2M_DATA_BOOLEAN:
+        length += prv_writeInteger(CURRENT, SENML_LABEL_VB);
+        if (buffer != NULL)
+        {
+            buffer[length] = (CBOR_TYPE_SIMPLE << 5) | (recordP->value.asBoolean ? CBOR_SIMPLE_TRUE : CBOR_SIMPLE_FALSE);
+        }
+        length += 1;
+        break;
+
+    case LWM2M_DATA_OPAQUE:
+        length += prv_writeInteger(CURRENT, SENML_LABEL_VD);
+        length += prv_writeString(CURRENT, CBOR_TYPE_BYTES, recordP->value.asBuffer.buffer, recordP->value.asBuffer.length);
+        break;
+
+    default:
+        length += prv_writeInteger(CURRENT, SENML_LABEL_VS);
+        length += prv_writeString(CURRENT, CBOR_TYPE_TEXT, recordP->value.asBuffer.buffer, recordP->value.asBuffer.length);
+        break;
+    }
+
+#undef CURRENT
+
+    return length;
+}
+
+static size_t prv_serialize(uint8_t * buffer,
+                            int count,
+                            lwm2m_senml_record_t * recordArray,
+                            char * baseName,
+                            int baseLength)
+{
+    size_t length;
+    int i;
+
+    length = prv_writeHead(buffer, CBOR_TYPE_ARRAY, count);
+    for (i = 0 ; i < count ; i++)
+    {
+        length += prv_writeRecord(buffer == NULL ? NULL : buffer + length,
+                                  recordArray + i,
+                                  baseName, baseLength,
+                                  recordArray[0].time,
+                                  i == 0);
+    }
+
+    return length;
+}
+
+int lwm2m_senml_cbor_serialize(int count,
+                               lwm2m_senml_record_t * recordArray,
+                               uint8_t ** bufferP)
+{
+    char baseName[SENML_NAME_MAX_LEN];
+    int baseLength;
+    size_t length;
+
+    *bufferP = NULL;
+    if (count < 0) return -1;
+
+    baseLength = senml_baseName(count, recordArray, baseName);
+
+    length = prv_serialize(NULL, count, recordArray, baseName, baseLength);
+    *bufferP = (uint8_t *)lwm2m_malloc(length);
+    if (*bufferP == NULL) return -1;
+
+    prv_serialize(*bufferP, count, recordArray, baseName, baseLength);
+
+    return (int)length;
+}
+
+
+/*
+ * Decoder
+ *
+ * All prv_read*() functions return the number of bytes read or 0 in case
+ * of error.
+ */
+
+static size_t prv_readHead(uint8_t * buffer,
+                           size_t length,
+                           uint8_t * typeP,
+                           uint8_t * infoP,
+                           uint64_t * valueP)
+{
+    size_t headLength;
+    size_t i;
+
+    if (length < 1) return 0;
+
+    *typeP = buffer[0] >> 5;
+    *infoP = buffer[0] & 0x1F;
+
+    if (*infoP < 24)
+    {
+        *valueP = *infoP;
+        return 1;
+    }
+
+    switch (*infoP)
+    {
+    case 24:
+        headLength = 1;
+        break;
+    case 25:
+        headLength = 2;
+        break;
+    case 26:
+        headLength = 4;
+        break;
+    case 27:
+        headLength = 8;
+        break;
+    case CBOR_INFO_INDEFINITE:
+        // only supported for arrays and maps
+        if (*typeP != CBOR_TYPE_ARRAY && *typeP != CBOR_TYPE_MAP) return 0;
+        *valueP = 0;
+        return 1;
+    default:
+        return 0;
+    }
+
+    if (length < 1 + headLength) return 0;
+
+    *valueP = 0;
+    for (i = 1 ; i <= headLength ; i++)
+    {
+        *valueP = (*valueP << 8) | buffer[i];
+    }
+
+    return 1 + headLength;
+}
+
+static size_t prv_skipItem(uint8_t * buffer,
+                           size_t length,
+                           int depth)
+{
+    uint8_t type;
+    uint8_t info;
+    uint64_t value;
+    size_t index;
+    uint64_t i;
+
+    if (depth > CBOR_MAX_DEPTH) return 0;
+
+    index = prv_readHead(buffer, length, &type, &info, &value);
+    if (index == 0) return 0;
+
+    switch (type)
+    {
+    case CBOR_TYPE_BYTES:
+    case CBOR_TYPE_TEXT:
+        if (value > length - index) return 0;
+        index += (size_t)value;
+        break;
+
+    case CBOR_TYPE_ARRAY:
+    case CBOR_TYPE_MAP:
+        if (type == CBOR_TYPE_MAP) value *= 2;
+        for (i = 0 ; info == CBOR_INFO_INDEFINITE || i < value ; i++)
+        {
+            size_t itemLength;
+
+            if (info == CBOR_INFO_INDEFINITE)
+            {
+                if (index >= length) return 0;
+                if (buffer[index] == CBOR_BREAK)
+                {
+                    index++;
+                    break;
+                }
+            }
+            itemLength = prv_skipItem(buffer + index, length - index, depth + 1);
+            if (itemLength == 0) return 0;
+            index += itemLength;
+        }
+        break;
+
+    case CBOR_TYPE_TAG:
+        {
+            size_t itemLength;
+
+            itemLength = prv_skipItem(buffer + index, length - index, depth + 1);
+            if (itemLength == 0) return 0;
+            index += itemLength;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return index;
+}
+
+static double prv_halfToDouble(uint16_t half)
+{
+    uint64_t exponent = (half >> 10) & 0x1F;
+    uint64_t mantissa = half & 0x3FF;
+    uint64_t bits;
+    double value;
+
+    if (exponent == 0)
+    {
+        value = (double)mantissa / 16777216.0;
+        return (half & 0x8000) ? -value : value;
+    }
+
+    bits = (uint64_t)(half & 0x8000) << 48;
+    if (exponent == 0x1F)
+    {
+        bits |= ((uint64_t)0x7FF << 52) | (mantissa << 42);
+    }
+    else
+    {
+        bits |= ((exponent - 15 + 1023) << 52) | (mantissa << 42);
+    }
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+// Read a number as an integer if possible or as a float.
+static size_t prv_readNumber(uint8_t * buffer,
+                             size_t length,
+                             lwm2m_data_type_t * typeP,
+                             int64_t * integerP,
+                             double * floatP)
+{
+    uint8_t type;
+    uint8_t info;
+    uint64_t value;
+    size_t headLength;
+
+    headLength = prv_readHead(buffer, length, &type, &info, &value);
+    if (headLength == 0) return 0;
+
+    switch (type)
+    {
+    case CBOR_TYPE_UNSIGNED:
+        if (value <= INT64_MAX)
+        {
+            *typeP = LWM2M_DATA_INTEGER;
+            *integerP = (int64_t)value;
+        }
+        else
+        {
+            *typeP = LWM2M_DATA_FLOAT;
+            *floatP = (double)value;
+        }
+        break;
+
+    case CBOR_TYPE_NEGATIVE:
+        if (value <= INT64_MAX)
+        {
+            *typeP = LWM2M_DATA_INTEGER;
+            *integerP = -1 - (int64_t)value;
+        }
+        else
+        {
+            *typeP = LWM2M_DATA_FLOAT;
+            *floatP = -1.0 - (double)value;
+        }
+        break;
+
+    case CBOR_TYPE_SIMPLE:
+        *typeP = LWM2M_DATA_FLOAT;
+        switch (info)
+        {
+        case CBOR_FLOAT16:
+            *floatP = prv_halfToDouble((uint16_t)value);
+            break;
+        case CBOR_FLOAT32:
+            {
+                uint32_t shortBits = (uint32_t)value;
+                float shortValue;
+
+                memcpy(&shortValue, &shortBits, sizeof(shortValue));
+                *floatP = shortValue;
+            }
+            break;
+        case CBOR_FLOAT64:
+            memcpy(floatP, &value, sizeof(*floatP));
+            break;
+        default:
+            return 0;
+        }
+        break;
+
+    default:
+        return 0;
+    }
+
+    return headLength;
+}
+
+static size_t prv_readDouble(uint8_t * buffer,
+                             size_t length,
+                             double * valueP)
+{
+    lwm2m_data_type_t type;
+    int64_t integer;
+    size_t result;
+
+    result = prv_readNumber(buffer, length, &type, &integer, valueP);
+    if (result != 0 && type == LWM2M_DATA_INTEGER)
+    {
+        *valueP = (double)integer;
+    }
+
+    return result;
+}
+
+static size_t prv_readString(uint8_t * buffer,
+                             size_t length,
+                             uint8_t expectedType,
+                             uint8_t ** dataP,
+                             size_t * dataLengthP)
+{
+    uint8_t type;
+    uint8_t info;
+    uint64_t value;
+    size_t headLength;
+
+    headLength = prv_readHead(buffer, length, &type, &info, &value);
+    if (headLength == 0 || type != expectedType) return 0;
+    if (value > length - headLength) return 0;
+
+    *dataP = buffer + headLength;
+    *dataLengthP = (size_t)value;
+
+    return headLength + (size_t)value;
+}
+
+// Decode one record map. *hasValueP is set to false for records holding only base fields.
+static size_t prv_readRecord(uint8_t * buffer,
+                             size_t length,
+                             senml_base_t * baseP,
+                             lwm2m_senml_record_t * recordP,
+                             bool * hasValueP)
+{
+    uint8_t type;
+    uint8_t info;
+    uint64_t fieldCount;
+    uint8_t * name;
+    size_t nameLength;
+    double time;
+    size_t index;
+    uint64_t i;
+
+    index = prv_readHead(buffer, length, &type, &info, &fieldCount);
+    if (index == 0 || type != CBOR_TYPE_MAP) return 0;
+
+    name = NULL;
+    nameLength = 0;
+    time = 0;
+    *hasValueP = false;
+
+    for (i = 0 ; info == CBOR_INFO_INDEFINITE || i < fieldCount ; i++)
+    {
+        uint8_t labelType;
+        uint8_t labelInfo;
+        uint64_t labelValue;
+        int64_t label;
+        size_t result;
+
+        if (index >= length) return 0;
+        if (info == CBOR_INFO_INDEFINITE && buffer[index] == CBOR_BREAK)
+        {
+            index++;
+            break;
+        }
+
+        result = prv_readHead(buffer + index, length - index, &labelType, &labelInfo, &labelValue);
+        if (result == 0) return 0;
+        if (labelType == CBOR_TYPE_UNSIGNED && labelValue <= INT64_MAX)
+        {
+            label = (int64_t)labelValue;
+        }
+        else if (labelType == CBOR_TYPE_NEGATIVE && labelValue <= INT64_MAX)
+        {
+            label = -1 - (int64_t)labelValue;
+        }
+        else
+        {
+            // not a SenML-CBOR label, skip the key and its value
+            result = prv_skipItem(buffer + index, length - index, 0);
+            if (result == 0) return 0;
+            index += result;
+            result = prv_skipItem(buffer + index, length - index, 0);
+            if (result == 0) return 0;
+            index += result;
+            continue;
+        }
+        index += result;
+        if (index >= length) return 0;
+
+        switch (label)
+        {
+        case SENML_LABEL_BN:
+            result = prv_readString(buffer + index, length - index, CBOR_TYPE_TEXT, &baseP->name, &baseP->nameLength);
+            break;
+
+        case SENML_LABEL_BT:
+            result = prv_readDouble(buffer + index, length - index, &baseP->time);
+            break;
+
+        case SENML_LABEL_BV:
+            result = prv_readNumber(buffer + index, length - index, &baseP->valueType, &baseP->integerValue, &baseP->floatValue);
+            break;
+
+        case SENML_LABEL_N:
+            result = prv_readString(buffer + index, length - index, CBOR_TYPE_TEXT, &name, &nameLength);
+            break;
+
+        case SENML_LABEL_T:
+            result = prv_readDouble(buffer + index, length - index, &time);
+            break;
+
+        case SENML_LABEL_V:
+            result = prv_readNumber(buffer + index, length - index, &recordP->type, &recordP->value.asInteger, &recordP->value.asFloat);
+            if (result != 0) senml_applyBaseValue(baseP, recordP);
+            *hasValueP = true;
+            break;
+
+        case SENML_LABEL_VS:
+            recordP->type = LWM2M_DATA_STRING;
+            result = prv_readString(buffer + index, length - index, CBOR_TYPE_TEXT, &recordP->value.asBuffer.buffer, &recordP->value.asBuffer.length);
+            *hasValueP = true;
+            break;
+
+        case SENML_LABEL_VD:
+            recordP->type = LWM2M_DATA_OPAQUE;
+            result = prv_readString(buffer + index, length - index, CBOR_TYPE_BYTES, &recordP->value.asBuffer.buffer, &recordP->value.asBuffer.length);
+            *hasValueP = true;
+            break;
+
+        case SENML_LABEL_VB:
+            if (buffer[index] == ((CBOR_TYPE_SIMPLE << 5) | CBOR_SIMPLE_TRUE))
+            {
+                recordP->value.asBoolean = true;
+            }
+            else if (buffer[index] == ((CBOR_TYPE_SIMPLE << 5) | CBOR_SIMPLE_FALSE))
+            {
+                recordP->value.asBoolean = false;
+            }
+            else
+            {
+                return 0;
+            }
+            recordP->type = LWM2M_DATA_BOOLEAN;
+            result = 1;
+            *hasValueP = true;
+            break;
+
+        default:
+            // bver, units, sum and update time are ignored
+            result = prv_skipItem(buffer + index, length - index, 0);
+            break;
+        }
+        if (result == 0) return 0;
+        index += result;
+    }
+
+    if (*hasValueP)
+    {
+        if (0 == senml_resolveRecord(baseP, name, nameLength, time, recordP)) return 0;
+    }
+
+    return index;
+}
+
+int lwm2m_senml_cbor_parse(uint8_t * buffer,
+                           size_t length,
+                           lwm2m_senml_callback_t callback,
+                           void * userData)
+{
+    senml_base_t base;
+    uint8_t type;
+    uint8_t info;
+    uint64_t recordCount;
+    size_t index;
+    uint64_t i;
+    int count;
+
+    index = prv_readHead(buffer, length, &type, &info, &recordCount);
+    if (index == 0 || type != CBOR_TYPE_ARRAY) return -1;
+
+    memset(&base, 0, sizeof(base));
+    count = 0;
+
+    for (i = 0 ; info == CBOR_INFO_INDEFINITE || i < recordCount ; i++)
+    {
+        lwm2m_senml_record_t record;
+        bool hasValue;
+        size_t result;
+
+        if (index >= length) return -1;
+        if (info == CBOR_INFO_INDEFINITE && buffer[index] == CBOR_BREAK)
+        {
+            index++;
+            break;
+        }
+
+        memset(&record, 0, sizeof(record));
+        result = prv_readRecord(buffer + index, length - index, &base, &record, &hasValue);
+        if (result == 0) return -1;
+        index += result;
+
+        if (hasValue)
+        {
+            if (0 != callback(&record, userData)) return -1;
+            count++;
+        }
+    }
+
+    if (index != length) return -1;
+
+    return count;
+}
@@ -0,0 +1,873 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * SenML-JSON (RFC 8428) encoder and decoder.
+ *
+ * The encoder allocates its output from an upper bound of the encoded length
+ * and writes the records in a single pass, using the same base name and base
+ * time compression as the SenML-CBOR encoder.
+ * The decoder is a tokenizer working on the payload itself: strings without
+ * escape sequences are handed to the callback as pointers inside the payload,
+ * escaped strings and base64 opaque values are decoded in place.
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+// Longest output of lwm2m_float64ToPlainTextBuffer()
+#define PRV_NUMBER_MAX_LENGTH   32
+// Keys, quotes and separators plus base name, name, base time, time and a numeric value
+#define PRV_RECORD_MAX_LENGTH   (48 + 2 * SENML_NAME_MAX_LEN + 3 * PRV_NUMBER_MAX_LENGTH)
+
+#define PRV_JSON_MAX_DEPTH      8
+
+static const char prv_hexDigits[] = "0123456789ABCDEF";
+static const char prv_base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+
+/*
+ * Encoder
+ *
+ * All prv_write*() functions return the number of bytes written. The buffer
+ * is known to be large enough.
+ */
+
+static size_t prv_writeText(char * buffer,
+                            const char * text)
+{
+    size_t length;
+
+    length = strlen(text);
+    memcpy(buffer, text, length);
+
+    return length;
+}
+
+static size_t prv_writeString(char * buffer,
+                              uint8_t * string,
+                              size_t stringLength)
+{
+    size_t length;
+    size_t i;
+
+    length = 0;
+    buffer[length++] = '"';
+    for (i = 0 ; i < stringLength ; i++)
+    {
+        switch (string[i])
+        {
+        case '"':
+        case '\\':
+            buffer[length++] = '\\';
+            buffer[length++] = string[i];
+            break;
+
+        default:
+            if (string[i] < 0x20)
+            {
+                buffer[length++] = '\\';
+                buffer[length++] = 'u';
+                buffer[length++] = '0';
+                buffer[length++] = '0';
+                buffer[length++] = prv_hexDigits[string[i] >> 4];
+                buffer[length++] = prv_hexDigits[string[i] & 0x0F];
+            }
+            else
+            {
+                buffer[length++] = string[i];
+            }
+            break;
+        }
+    }
+    buffer[length++] = '"';
+
+    return length;
+}
+
+// base64url without padding as RFC 8428 requires
+static size_t prv_writeBase64(char * buffer,
+                              uint8_t * data,
+                              size_t dataLength)
+{
+    size_t length;
+    size_t i;
+
+    length = 0;
+    buffer[length++] = '"';
+    for (i = 0 ; i + 2 < dataLength ; i += 3)
+    {
+        buffer[length++] = prv_base64Alphabet[data[i] >> 2];
+        buffer[length++] = prv_base64Alphabet[((data[i] & 0x03) << 4) | (data[i + 1] >> 4)];
+        buffer[length++] = prv_base64Alphabet[((data[i + 1] & 0x0F) << 2) | (data[i + 2] >> 6)];
+        buffer[length++] = prv_base64Alphabet[data[i + 2] & 0x3F];
+    }
+    if (i < dataLength)
+    {
+        buffer[length++] = prv_base64Alphabet[data[i] >> 2];
+        if (i + 1 < dataLength)
+        {
+            buffer[length++] = prv_base64Alphabet[((data[i] & 0x03) << 4) | (data[i + 1] >> 4)];
+            buffer[length++] = prv_base64Alphabet[(data[i + 1] & 0x0F) << 2];
+        }
+        else
+        {
+            buffer[length++] = prv_base64Alphabet[(data[i] & 0x03) << 4];
+        }
+    }
+    buffer[length++] = '"';
+
+    return length;
+}
+
+// Return 0 for values without JSON representation (NaN and infinites).
+static size_t prv_writeNumber(char * buffer,
+                              double value)
+{
+    if (value > -9223372036854775808.0 && value < 9223372036854775808.0
+     && (double)(int64_t)value == value)
+    {
+        return lwm2m_int64ToPlainTextBuffer((int64_t)value, buffer, PRV_NUMBER_MAX_LENGTH);
+    }
+
+    return lwm2m_float64ToPlainTextBuffer(value, buffer, PRV_NUMBER_MAX_LENGTH);
+}
+
+static size_t prv_valueMaxLength(lwm2m_senml_record_t * recordP)
+{
+    switch (recordP->type)
+    {
+    case LWM2M_DATA_INTEGER:
+    case LWM2M_DATA_FLOAT:
+    case LWM2M_DATA_BOOLEAN:
+        return 0;
+
+    case LWM2M_DATA_OPAQUE:
+        return (recordP->value.asBuffer.length + 2) / 3 * 4;
+
+    default:
+        // every character may be escaped as \u00XX
+        return recordP->value.asBuffer.length * 6;
+    }
+}
+
+// Return 0 in case of error.
+static size_t prv_writeRecord(char * buffer,
+                              lwm2m_senml_record_t * recordP,
+                              char * baseName,
+                              int baseLength,
+                              double baseTime,
+                              bool isFirst)
+{
+    char name[SENML_NAME_MAX_LEN];
+    int nameLength;
+    size_t length;
+    size_t result;
+
+    nameLength = senml_recordName(recordP, name);
+
+    length = prv_writeText(buffer, "{");
+
+    if (isFirst && baseLength > 0)
+    {
+        length += prv_writeText(buffer + length, "\"bn\":");
+        length += prv_writeString(buffer + length, (uint8_t *)baseName, baseLength);
+        buffer[length++] = ',';
+    }
+    if (isFirst && baseTime != 0)
+    {
+        length += prv_writeText(buffer + length, "\"bt\":");
+        result = prv_writeNumber(buffer + length, baseTime);
+        if (result == 0) return 0;
+        length += result;
+        buffer[length++] = ',';
+    }
+    if (nameLength > baseLength)
+    {
+        length += prv_writeText(buffer + length, "\"n\":");
+        length += prv_writeString(buffer + length, (uint8_t *)name + baseLength, nameLength - baseLength);
+        buffer[length++] = ',';
+    }
+    if (recordP->time != baseTime)
+    {
+        length += prv_writeText(buffer + length, "\"t\":");
+        result = prv_writeNumber(buffer + length, recordP->time - baseTime);
+        if (result == 0) return 0;
+        length += result;
+        buffer[length++] = ',';
+    }
+
+    switch (recordP->type)
+    {
+    case LWM2M_DATA_INTEGER:
+        length += prv_writeText(buffer + length, "\"v\":");
+        length += lwm2m_int64ToPlainTextBuffer(recordP->value.asInteger, buffer + length, PRV_NUMBER_MAX_LENGTH);
+        break;
+
+    case LWM2M_DATA_FLOAT:
+        length += prv_writeText(buffer + length, "\"v\":");
+        // keep the fractional part so that the value is decoded as a float
+        result = lwm2m_float64ToPlainTextBuffer(recordP->value.asFloat, buffer + length, PRV_NUMBER_MAX_LENGTH);
+        if (result == 0) return 0;
+        length += result;
+        break;
+
+    case LWM2M_DATA_BOOLEAN:
+        length += prv_writeText(buffer + length, recordP->value.asBoolean ? "\"vb\":true" : "\"vb\":false");
+        break;
+
+    case LWM2M_DATA_OPAQUE:
+        length += prv_writeText(buffer + length, "\"vd\":");
+        length += prv_writeBase64(buffer + length, recordP->value.asBuffer.buffer, recordP->value.asBuffer.length);
+        break;
+
+    default:
+        length += prv_writeText(buffer + length, "\"vs\":");
+        length += prv_writeString(buffer + length, recordP->value.asBuffer.buffer, recordP->value.asBuffer.length);
+        break;
+    }
+
+    buffer[length++] = '}';
+
+    return length;
+}
+
+int lwm2m_senml_json_serialize(int count,
+                               lwm2m_senml_record_t * recordArray,
+                               uint8_t ** bufferP)
+{
+    char baseName[SENML_NAME_MAX_LEN];
+    int baseLength;
+    char * buffer;
+    size_t maxLength;
+    size_t length;
+    int i;
+
+    *bufferP = NULL;
+    if (count < 0) return -1;
+
+    baseLength = senml_baseName(count, recordArray, baseName);
+
+    maxLength = 2;
+    for (i = 0 ; i < count ; i++)
+    {
+        maxLength += PRV_RECORD_MAX_LENGTH + prv_valueMaxLength(recordArray + i);
+    }
+
+    buffer = (char *)lwm2m_malloc(maxLength);
+    if (buffer == NULL) return -1;
+
+    length = prv_writeText(buffer, "[");
+    for (i = 0 ; i < count ; i++)
+    {
+        size_t result;
+
+        if (i != 0) buffer[length++] = ',';
+        result = prv_writeRecord(buffer + length,
+                                 recordArray + i,
+                                 baseName, baseLength,
+                                 recordArray[0].time,
+                                 i == 0);
+        if (result == 0)
+        {
+            lwm2m_free(buffer);
+            return -1;
+        }
+        length += result;
+    }
+    buffer[length++] = ']';
+
+    *bufferP = (uint8_t *)buffer;
+
+    return (int)length;
+}
+
+
+/*
+ * Decoder
+ *
+ * All prv_read*() and prv_skip*() functions except prv_skipSpace() return
+ * the number of bytes read or 0 in case of error.
+ */
+
+static size_t prv_skipSpace(uint8_t * buffer,
+                            size_t length)
+{
+    size_t i;
+
+    i = 0;
+    while (i < length
+        && (buffer[i] == ' ' || buffer[i] == '\t' || buffer[i] == '\r' || buffer[i] == '\n'))
+    {
+        i++;
+    }
+
+    return i;
+}
+
+static int prv_hexValue(uint8_t c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static bool prv_readHex4(uint8_t * buffer,
+                         size_t length,
+                         uint32_t * valueP)
+{
+    size_t i;
+
+    if (length < 4) return false;
+
+    *valueP = 0;
+    for (i = 0 ; i < 4 ; i++)
+    {
+        int digit;
+
+        digit = prv_hexValue(buffer[i]);
+        if (digit < 0) return false;
+        *valueP = (*valueP << 4) | (uint32_t)digit;
+    }
+
+    return true;
+}
+
+// Decode the \uXXXX escape sequence at buffer and write its UTF-8 encoding at outputP.
+// Return the number of bytes read or 0 in case of error. *outLengthP is never larger.
+static size_t prv_readUnicodeEscape(uint8_t * buffer,
+                                    size_t length,
+                                    uint8_t * outputP,
+                                    size_t * outLengthP)
+{
+    uint32_t code;
+    size_t result;
+
+    if (!prv_readHex4(buffer + 2, length - 2, &code)) return 0;
+    result = 6;
+
+    if (code >= 0xDC00 && code <= 0xDFFF) return 0;
+    if (code >= 0xD800 && code <= 0xDBFF)
+    {
+        uint32_t low;
+
+        // surrogate pair
+        if (length < 12 || buffer[6] != '\\' || buffer[7] != 'u') return 0;
+        if (!prv_readHex4(buffer + 8, length - 8, &low)) return 0;
+        if (low < 0xDC00 || low > 0xDFFF) return 0;
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        result = 12;
+    }
+
+    if (code < 0x80)
+    {
+        outputP[0] = (uint8_t)code;
+        *outLengthP = 1;
+    }
+    else if (code < 0x800)
+    {
+        outputP[0] = (uint8_t)(0xC0 | (code >> 6));
+        outputP[1] = (uint8_t)(0x80 | (code & 0x3F));
+        *outLengthP = 2;
+    }
+    else if (code < 0x10000)
+    {
+        outputP[0] = (uint8_t)(0xE0 | (code >> 12));
+        outputP[1] = (uint8_t)(0x80 | ((code >> 6) & 0x3F));
+        outputP[2] = (uint8_t)(0x80 | (code & 0x3F));
+        *outLengthP = 3;
+    }
+    else
+    {
+        outputP[0] = (uint8_t)(0xF0 | (code >> 18));
+        outputP[1] = (uint8_t)(0x80 | ((code >> 12) & 0x3F));
+        outputP[2] = (uint8_t)(0x80 | ((code >> 6) & 0x3F));
+        outputP[3] = (uint8_t)(0x80 | (code & 0x3F));
+        *outLengthP = 4;
+    }
+
+    return result;
+}
+
+// Strings are unescaped in place. *stringP points inside buffer.
+static size_t prv_readString(uint8_t * buffer,
+                             size_t length,
+                             uint8_t ** stringP,
+                             size_t * stringLengthP)
+{
+    size_t readIndex;
+    size_t writeIndex;
+
+    if (length == 0 || buffer[0] != '"') return 0;
+
+    readIndex = 1;
+    writeIndex = 1;
+    while (readIndex < length && buffer[readIndex] != '"')
+    {
+        if (buffer[readIndex] < 0x20) return 0;
+
+        if (buffer[readIndex] != '\\')
+        {
+            buffer[writeIndex++] = buffer[readIndex++];
+            continue;
+        }
+
+        if (readIndex + 1 >= length) return 0;
+        switch (buffer[readIndex + 1])
+        {
+        case '"':
+        case '\\':
+        case '/':
+            buffer[writeIndex++] = buffer[readIndex + 1];
+            break;
+        case 'b':
+            buffer[writeIndex++] = '\b';
+            break;
+        case 'f':
+            buffer[writeIndex++] = '\f';
+            break;
+        case 'n':
+            buffer[writeIndex++] = '\n';
+            break;
+        case 'r':
+            buffer[writeIndex++] = '\r';
+            break;
+        case 't':
+            buffer[writeIndex++] = '\t';
+            break;
+        case 'u':
+            {
+                size_t result;
+                size_t outLength;
+
+                result = prv_readUnicodeEscape(buffer + readIndex, length - readIndex, buffer + writeIndex, &outLength);
+                if (result == 0) return 0;
+                writeIndex += outLength;
+                readIndex += result;
+            }
+            continue;
+        default:
+            return 0;
+        }
+        readIndex += 2;
+    }
+    if (readIndex >= length) return 0;
+
+    *stringP = buffer + 1;
+    *stringLengthP = writeIndex - 1;
+
+    return readIndex + 1;
+}
+
+// Same as prv_readString() without modifying the buffer.
+static size_t prv_skipString(uint8_t * buffer,
+                             size_t length)
+{
+    size_t i;
+
+    if (length == 0 || buffer[0] != '"') return 0;
+
+    i = 1;
+    while (i < length && buffer[i] != '"')
+    {
+        if (buffer[i] == '\\') i++;
+        i++;
+    }
+    if (i >= length) return 0;
+
+    return i + 1;
+}
+
+static size_t prv_numberLength(uint8_t * buffer,
+                               size_t length,
+                               bool * isFloatP)
+{
+    size_t i;
+
+    *isFloatP = false;
+    i = 0;
+    while (i < length)
+    {
+        switch (buffer[i])
+        {
+        case '.':
+        case 'e':
+        case 'E':
+            *isFloatP = true;
+            break;
+        case '-':
+        case '+':
+            break;
+        default:
+            if (buffer[i] < '0' || buffer[i] > '9') return i;
+            break;
+        }
+        i++;
+    }
+
+    return i;
+}
+
+static size_t prv_readNumber(uint8_t * buffer,
+                             size_t length,
+                             lwm2m_data_type_t * typeP,
+                             int64_t * integerP,
+                             double * floatP)
+{
+    size_t result;
+    bool isFloat;
+
+    result = prv_numberLength(buffer, length, &isFloat);
+    if (result == 0) return 0;
+
+    if (!isFloat && 0 != lwm2m_PlainTextToInt64((char *)buffer, (int)result, integerP))
+    {
+        *typeP = LWM2M_DATA_INTEGER;
+        return result;
+    }
+
+    // also integers out of int64_t range
+    if (0 == lwm2m_PlainTextToFloat64((char *)buffer, (int)result, floatP)) return 0;
+    *typeP = LWM2M_DATA_FLOAT;
+
+    return result;
+}
+
+static size_t prv_readDouble(uint8_t * buffer,
+                             size_t length,
+                             double * valueP)
+{
+    lwm2m_data_type_t type;
+    int64_t integer;
+    size_t result;
+
+    result = prv_readNumber(buffer, length, &type, &integer, valueP);
+    if (result != 0 && type == LWM2M_DATA_INTEGER) *valueP = (double)integer;
+
+    return result;
+}
+
+static size_t prv_readLiteral(uint8_t * buffer,
+                              size_t length,
+                              const char * literal)
+{
+    size_t literalLength;
+
+    literalLength = strlen(literal);
+    if (length < literalLength) return 0;
+    if (0 != memcmp(buffer, literal, literalLength)) return 0;
+
+    return literalLength;
+}
+
+// Decode a base64 string in place, accepting both the base64 and base64url alphabets.
+static bool prv_decodeBase64(uint8_t * data,
+                             size_t length,
+                             size_t * dataLengthP)
+{
+    uint32_t bits;
+    int bitCount;
+    size_t outIndex;
+    size_t i;
+
+    while (length > 0 && data[length - 1] == '=')
+    {
+        length--;
+    }
+    if (length % 4 == 1) return false;
+
+    bits = 0;
+    bitCount = 0;
+    outIndex = 0;
+    for (i = 0 ; i < length ; i++)
+    {
+        uint8_t c = data[i];
+        uint32_t value;
+
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '-' || c == '+') value = 62;
+        else if (c == '_' || c == '/') value = 63;
+        else return false;
+
+        bits = (bits << 6) | value;
+        bitCount += 6;
+        if (bitCount >= 8)
+        {
+            bitCount -= 8;
+            data[outIndex++] = (uint8_t)(bits >> bitCount);
+        }
+    }
+
+    *dataLengthP = outIndex;
+
+    return true;
+}
+
+static size_t prv_skipValue(uint8_t * buffer,
+                            size_t length,
+                            int depth)
+{
+    uint8_t closing;
+    size_t index;
+    bool isFloat;
+
+    if (length == 0) return 0;
+
+    switch (buffer[0])
+    {
+    case '"':
+        return prv_skipString(buffer, length);
+    case 't':
+        return prv_readLiteral(buffer, length, "true");
+    case 'f':
+        return prv_readLiteral(buffer, length, "false");
+    case 'n':
+        return prv_readLiteral(buffer, length, "null");
+    case '{':
+        closing = '}';
+        break;
+    case '[':
+        closing = ']';
+        break;
+    default:
+        return prv_numberLength(buffer, length, &isFloat);
+    }
+
+    if (depth >= PRV_JSON_MAX_DEPTH) return 0;
+
+    index = 1;
+    index += prv_skipSpace(buffer + index, length - index);
+    if (index < length && buffer[index] == closing) return index + 1;
+
+    while (index < length)
+    {
+        size_t result;
+
+        if (closing == '}')
+        {
+            result = prv_skipString(buffer + index, length - index);
+            if (result == 0) return 0;
+            index += result;
+            index += prv_skipSpace(buffer + index, length - index);
+            if (index >= length || buffer[index] != ':') return 0;
+            index++;
+            index += prv_skipSpace(buffer + index, length - index);
+        }
+
+        result = prv_skipValue(buffer + index, length - index, depth + 1);
+        if (result == 0) return 0;
+        index += result;
+        index += prv_skipSpace(buffer + index, length - index);
+
+        if (index >= length) return 0;
+        if (buffer[index] == closing) return index + 1;
+        if (buffer[index] != ',') return 0;
+        index++;
+        index += prv_skipSpace(buffer + index, length - index);
+    }
+
+    return 0;
+}
+
+static bool prv_isKey(uint8_t * key,
+                      size_t keyLength,
+                      const char * label)
+{
+    return keyLength == strlen(label) && 0 == memcmp(key, label, keyLength);
+}
+
+// Decode one record object. *hasValueP is set to false for records holding only base fields.
+static size_t prv_readRecord(uint8_t * buffer,
+                             size_t length,
+                             senml_base_t * baseP,
+                             lwm2m_senml_record_t * recordP,
+                             bool * hasValueP)
+{
+    uint8_t * name;
+    size_t nameLength;
+    double time;
+    size_t index;
+
+    if (length == 0 || buffer[0] != '{') return 0;
+
+    name = NULL;
+    nameLength = 0;
+    time = 0;
+    *hasValueP = false;
+
+    index = 1;
+    index += prv_skipSpace(buffer + index, length - index);
+    if (index < length && buffer[index] == '}') return index + 1;
+
+    // prv_readString() fails on truncated records
+    while (true)
+    {
+        uint8_t * key;
+        size_t keyLength;
+        size_t result;
+
+        result = prv_readString(buffer + index, length - index, &key, &keyLength);
+        if (result == 0) return 0;
+        index += result;
+        index += prv_skipSpace(buffer + index, length - index);
+        if (index >= length || buffer[index] != ':') return 0;
+        index++;
+        index += prv_skipSpace(buffer + index, length - index);
+        if (index >= length) return 0;
+
+        if (prv_isKey(key, keyLength, "bn"))
+        {
+            result = prv_readString(buffer + index, length - index, &baseP->name, &baseP->nameLength);
+        }
+        else if (prv_isKey(key, keyLength, "bt"))
+        {
+            result = prv_readDouble(buffer + index, length - index, &baseP->time);
+        }
+        else if (prv_isKey(key, keyLength, "bv"))
+        {
+            result = prv_readNumber(buffer + index, length - index, &baseP->valueType, &baseP->integerValue, &baseP->floatValue);
+        }
+        else if (prv_isKey(key, keyLength, "n"))
+        {
+            result = prv_readString(buffer + index, length - index, &name, &nameLength);
+        }
+        else if (prv_isKey(key, keyLength, "t"))
+        {
+            result = prv_readDouble(buffer + index, length - index, &time);
+        }
+        else if (prv_isKey(key, keyLength, "v"))
+        {
+            result = prv_readNumber(buffer + index, length - index, &recordP->type, &recordP->value.asInteger, &recordP->value.asFloat);
+            if (result != 0) senml_applyBaseValue(baseP, recordP);
+            *hasValueP = true;
+        }
+        else if (prv_isKey(key, keyLength, "vs"))
+        {
+            recordP->type = LWM2M_DATA_STRING;
+            result = prv_readString(buffer + index, length - index, &recordP->value.asBuffer.buffer, &recordP->value.asBuffer.length);
+            *hasValueP = true;
+        }
+        else if (prv_isKey(key, keyLength, "vd"))
+        {
+            recordP->type = LWM2M_DATA_OPAQUE;
+            result = prv_readString(buffer + index, length - index, &recordP->value.asBuffer.buffer, &recordP->value.asBuffer.length);
+            if (result != 0
+             && !prv_decodeBase64(recordP->value.asBuffer.buffer, recordP->value.asBuffer.length, &recordP->value.asBuffer.length))
+            {
+                return 0;
+            }
+            *hasValueP = true;
+        }
+        else if (prv_isKey(key, keyLength, "vb"))
+        {
+            recordP->type = LWM2M_DATA_BOOLEAN;
+            recordP->value.asBoolean = (buffer[index] == 't');
+            result = prv_readLiteral(buffer + index, length - index, recordP->value.asBoolean ? "true" : "false");
+            *hasValueP = true;
+        }
+        else
+        {
+            // bver, units, sum and update time are ignored
+            result = prv_skipValue(buffer + index, length - index, 0);
+        }
+        if (result == 0) return 0;
+        index += result;
+        index += prv_skipSpace(buffer + index, length - index);
+
+        if (index >= length) return 0;
+        if (buffer[index] == '}')
+        {
+            index++;
+            break;
+        }
+        if (buffer[index] != ',') return 0;
+        index++;
+        index += prv_skipSpace(buffer + index, length - index);
+    }
+
+    if (*hasValueP)
+    {
+        if (0 == senml_resolveRecord(baseP, name, nameLength, time, recordP)) return 0;
+    }
+
+    return index;
+}
+
+int lwm2m_senml_json_parse(uint8_t * buffer,
+                           size_t length,
+                           lwm2m_senml_callback_t callback,
+                           void * userData)
+{
+    senml_base_t base;
+    size_t index;
+    int count;
+
+    index = prv_skipSpace(buffer, length);
+    if (index >= length || buffer[index] != '[') return -1;
+    index++;
+    index += prv_skipSpace(buffer + index, length - index);
+
+    memset(&base, 0, sizeof(base));
+    count = 0;
+
+    if (index < length && buffer[index] == ']')
+    {
+        index++;
+    }
+    else
+    {
+        // prv_readRecord() fails on truncated payloads
+        while (true)
+        {
+            lwm2m_senml_record_t record;
+            bool hasValue;
+            size_t result;
+
+            memset(&record, 0, sizeof(record));
+            result = prv_readRecord(buffer + index, length - index, &base, &record, &hasValue);
+            if (result == 0) return -1;
+            index += result;
+
+            if (hasValue)
+            {
+                if (0 != callback(&record, userData)) return -1;
+                count++;
+            }
+
+            index += prv_skipSpace(buffer + index, length - index);
+            if (index >= length) return -1;
+            if (buffer[index] == ']')
+            {
+                index++;
+                break;
+            }
+            if (buffer[index] != ',') return -1;
+            index++;
+            index += prv_skipSpace(buffer + index, length - index);
+        }
+    }
+
+    index += prv_skipSpace(buffer + index, length - index);
+    if (index != length) return -1;
+
+    return count;
+}
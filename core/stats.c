@@ -0,0 +1,134 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Engine statistics.
+ *
+ * Counters are updated where packets are sent and received and kept in
+ * lwm2m_context_t::stats. The number of transactions, observations and
+ * clients is not maintained, it is counted when taking a snapshot with
+ * lwm2m_get_stats().
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+static void prv_count(uint32_t * types,
+                      uint32_t * codes,
+                      uint8_t type,
+                      uint8_t code)
+{
+    types[type & 0x03]++;
+    codes[code >> 5]++;
+}
+
+void stats_received(lwm2m_context_t * contextP,
+                    coap_packet_t * message)
+{
+    prv_count(contextP->stats.packetsReceived, contextP->stats.codesReceived, message->type, message->code);
+}
+
+void stats_sent(lwm2m_context_t * contextP,
+                uint8_t * buffer,
+                size_t length)
+{
+    // type and code are in the fixed header
+    if (length < 4) return;
+
+    prv_count(contextP->stats.packetsSent, contextP->stats.codesSent, (buffer[0] >> 4) & 0x03, buffer[1]);
+}
+
+void stats_rtt(lwm2m_context_t * contextP,
+               lwm2m_transaction_t * transacP)
+{
+    uint8_t method;
+    uint64_t rtt;
+    int bucket;
+
+    method = ((coap_packet_t *)transacP->message)->code;
+    if (method < COAP_GET || method > COAP_DELETE) return;
+
+    rtt = utils_gettime_ms(contextP) - transacP->send_time;
+    bucket = 0;
+    while (rtt >= 2 && bucket < LWM2M_STATS_RTT_BUCKETS - 1)
+    {
+        rtt >>= 1;
+        bucket++;
+    }
+
+    contextP->stats.rtt[method - COAP_GET][bucket]++;
+}
+
+void lwm2m_get_stats(lwm2m_context_t * contextP,
+                     lwm2m_stats_t * statsP)
+{
+    lwm2m_transaction_t * transacP;
+
+    memcpy(statsP, &contextP->stats, sizeof(lwm2m_stats_t));
+
+    statsP->transactions = 0;
+    statsP->observations = 0;
+    statsP->clients = 0;
+
+    for (transacP = contextP->transactionList ; transacP != NULL ; transacP = transacP->next)
+    {
+        statsP->transactions++;
+    }
+
+#ifdef LWM2M_CLIENT_MODE
+    {
+        lwm2m_observed_t * observedP;
+        lwm2m_watcher_t * watcherP;
+
+        for (observedP = contextP->observedList ; observedP != NULL ; observedP = observedP->next)
+        {
+            for (watcherP = observedP->watcherList ; watcherP != NULL ; watcherP = watcherP->next)
+            {
+                statsP->observations++;
+            }
+        }
+    }
+#endif
+
+#ifdef LWM2M_SERVER_MODE
+    {
+        lwm2m_client_t * clientP;
+        lwm2m_observation_t * observationP;
+
+        for (clientP = contextP->clientList ; clientP != NULL ; clientP = clientP->next)
+        {
+            statsP->clients++;
+            for (observationP = clientP->observationList ; observationP != NULL ; observationP = observationP->next)
+            {
+                statsP->observations++;
+            }
+            // requests queued for a sleeping client are transactions too
+            for (transacP = clientP->queueList ; transacP != NULL ; transacP = transacP->next)
+            {
+                statsP->transactions++;
+            }
+        }
+    }
+#endif
+}
+
+void lwm2m_reset_stats(lwm2m_context_t * contextP)
+{
+    memset(&contextP->stats, 0, sizeof(lwm2m_stats_t));
+}
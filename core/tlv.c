@@ -22,6 +22,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <float.h>
 
 #define _PRV_64BIT_BUFFER_SIZE 8
 
@@ -525,71 +526,91 @@ void lwm2m_tlv_free(int size,
     lwm2m_free(tlvP);
 }
 
-void lwm2m_tlv_encode_int(int64_t data,
-                          lwm2m_tlv_t * tlvP)
+// Write the value of data in buffer, in plain text or as a TLV integer.
+// Return the length of the value or 0 if buffer is too small.
+static size_t prv_encodeInt(int64_t data,
+                            bool text,
+                            uint8_t * buffer,
+                            size_t bufferLen)
 {
-    tlvP->length = 0;
+    uint8_t bytes[_PRV_64BIT_BUFFER_SIZE];
+    size_t length = 0;
+    uint64_t value;
+    int negative = 0;
 
-    if ((tlvP->flags & LWM2M_TLV_FLAG_TEXT_FORMAT) != 0)
+    if (text)
     {
-        char string[32];
-        int length;
+        return (size_t)lwm2m_int64ToPlainTextBuffer(data, (char *)buffer, bufferLen);
+    }
 
-        length = snprintf(string, 32, "%" PRId64, data);
-        if (length > 0)
-        {
-            tlvP->value = (uint8_t *)lwm2m_malloc(length);
-            if (tlvP->value != NULL)
-            {
-                strncpy(tlvP->value, string, length);
-                tlvP->flags &= ~LWM2M_TLV_FLAG_STATIC_DATA;
-                tlvP->length = length;
-            }
-        }
+    memset(bytes, 0, _PRV_64BIT_BUFFER_SIZE);
+
+    if (data < 0)
+    {
+        negative = 1;
+        value = 0 - data;
     }
     else
     {
-        uint8_t buffer[_PRV_64BIT_BUFFER_SIZE];
-        size_t length = 0;
-        uint64_t value;
-        int negative = 0;
+        value = data;
+    }
 
-        memset(buffer, 0, _PRV_64BIT_BUFFER_SIZE);
+    do
+    {
+        length++;
+        bytes[_PRV_64BIT_BUFFER_SIZE - length] = (value >> (8*(length-1))) & 0xFF;
+    } while (value > (((uint64_t)1 << ((8 * length)-1)) - 1));
 
-        if (data < 0)
-        {
-            negative = 1;
-            value = 0 - data;
-        }
-        else
-        {
-            value = data;
-        }
 
-        do
-        {
-            length++;
-            buffer[_PRV_64BIT_BUFFER_SIZE - length] = (value >> (8*(length-1))) & 0xFF;
-        } while (value > (((uint64_t)1 << ((8 * length)-1)) - 1));
+    if (1 == negative)
+    {
+        bytes[_PRV_64BIT_BUFFER_SIZE - length] |= 0x80;
+    }
 
+    if (bufferLen < length) return 0;
+    memcpy(buffer, bytes + (_PRV_64BIT_BUFFER_SIZE - length), length);
 
-        if (1 == negative)
-        {
-            buffer[_PRV_64BIT_BUFFER_SIZE - length] |= 0x80;
-        }
+    return length;
+}
 
-        tlvP->value = (uint8_t *)lwm2m_malloc(length);
-        if (tlvP->value != NULL)
-        {
-            memcpy(tlvP->value,
-                   buffer + (_PRV_64BIT_BUFFER_SIZE - length),
-                   length);
-            tlvP->flags &= ~LWM2M_TLV_FLAG_STATIC_DATA;
-            tlvP->length = length;
-        }
+// Point tlvP to a copy of the length bytes of buffer.
+static void prv_setCopy(lwm2m_tlv_t * tlvP,
+                        uint8_t * buffer,
+                        size_t length)
+{
+    if (length == 0) return;
+
+    tlvP->value = (uint8_t *)lwm2m_malloc(length);
+    if (tlvP->value != NULL)
+    {
+        memcpy(tlvP->value, buffer, length);
+        tlvP->flags &= ~LWM2M_TLV_FLAG_STATIC_DATA;
+        tlvP->length = length;
     }
 }
 
+void lwm2m_tlv_encode_int(int64_t data,
+                          lwm2m_tlv_t * tlvP)
+{
+    uint8_t buffer[LWM2M_TLV_NUMBER_MAX_LENGTH];
+
+    tlvP->length = 0;
+    tlvP->dataType = LWM2M_DATA_INTEGER;
+
+    prv_setCopy(tlvP, buffer, prv_encodeInt(data, (tlvP->flags & LWM2M_TLV_FLAG_TEXT_FORMAT) != 0, buffer, sizeof(buffer)));
+}
+
+void lwm2m_tlv_encode_int_buffer(int64_t data,
+                                 lwm2m_tlv_t * tlvP,
+                                 uint8_t * buffer,
+                                 size_t bufferLen)
+{
+    tlvP->dataType = LWM2M_DATA_INTEGER;
+    tlvP->length = prv_encodeInt(data, (tlvP->flags & LWM2M_TLV_FLAG_TEXT_FORMAT) != 0, buffer, bufferLen);
+    tlvP->value = buffer;
+    tlvP->flags |= LWM2M_TLV_FLAG_STATIC_DATA;
+}
+
 int lwm2m_tlv_decode_int(lwm2m_tlv_t * tlvP,
                          int64_t * dataP)
 {
@@ -597,18 +618,22 @@ int lwm2m_tlv_decode_int(lwm2m_tlv_t * tlvP,
 
     if (tlvP->length == 0) return 0;
 
-    if ((tlvP->flags & LWM2M_TLV_FLAG_TEXT_FORMAT) != 0)
+    if (tlvP->dataType == LWM2M_DATA_FLOAT)
     {
-        char string[32];
-        int result;
+        double value;
 
-        // int64 is 20 digit max
-        if (tlvP->length > 32) return 0;
+        if (0 == lwm2m_tlv_decode_float(tlvP, &value)) return 0;
+        if (value < -9223372036854775808.0 || value >= 9223372036854775808.0) return 0;
+        *dataP = (int64_t)value;
+        if ((double)*dataP != value) return 0;
 
-        memcpy(string, tlvP->value, tlvP->length);
-        string[tlvP->length] = 0;
-        result = sscanf(string, "%" PRId64, dataP);
-        if (result != 1) return 0;
+        return 1;
+    }
+
+    if ((tlvP->flags & LWM2M_TLV_FLAG_TEXT_FORMAT) != 0)
+    {
+        // parsed in place, no need for a null-terminated copy
+        if (0 == lwm2m_PlainTextToInt64((char *)tlvP->value, tlvP->length, dataP)) return 0;
     }
     else
     {
@@ -636,6 +661,7 @@ void lwm2m_tlv_encode_bool(bool data,
                           lwm2m_tlv_t * tlvP)
 {
     tlvP->length = 0;
+    tlvP->dataType = LWM2M_DATA_BOOLEAN;
 
     tlvP->value = (uint8_t *)lwm2m_malloc(1);
     if (tlvP->value != NULL)
@@ -703,3 +729,115 @@ int lwm2m_tlv_decode_bool(lwm2m_tlv_t * tlvP,
 
     return 1;
 }
+
+// Write the value of data in buffer, in plain text or as a TLV float.
+// Return the length of the value or 0 if buffer is too small.
+static size_t prv_encodeFloat(double data,
+                              bool text,
+                              uint8_t * buffer,
+                              size_t bufferLen)
+{
+    uint64_t bits;
+    size_t length;
+    size_t i;
+
+    if (text)
+    {
+        return (size_t)lwm2m_float64ToPlainTextBuffer(data, (char *)buffer, bufferLen);
+    }
+
+    // use the 32-bit representation when it is exact
+    if (data >= -FLT_MAX && data <= FLT_MAX
+     && (double)(float)data == data)
+    {
+        float shortData = (float)data;
+        uint32_t shortBits;
+
+        memcpy(&shortBits, &shortData, sizeof(shortBits));
+        bits = shortBits;
+        length = 4;
+    }
+    else
+    {
+        memcpy(&bits, &data, sizeof(bits));
+        length = 8;
+    }
+
+    if (bufferLen < length) return 0;
+    // network byte order
+    for (i = 0 ; i < length ; i++)
+    {
+        buffer[i] = (bits >> (8 * (length - 1 - i))) & 0xFF;
+    }
+
+    return length;
+}
+
+void lwm2m_tlv_encode_float(double data,
+                            lwm2m_tlv_t * tlvP)
+{
+    uint8_t buffer[LWM2M_TLV_NUMBER_MAX_LENGTH];
+
+    tlvP->length = 0;
+    tlvP->dataType = LWM2M_DATA_FLOAT;
+
+    prv_setCopy(tlvP, buffer, prv_encodeFloat(data, (tlvP->flags & LWM2M_TLV_FLAG_TEXT_FORMAT) != 0, buffer, sizeof(buffer)));
+}
+
+void lwm2m_tlv_encode_float_buffer(double data,
+                                   lwm2m_tlv_t * tlvP,
+                                   uint8_t * buffer,
+                                   size_t bufferLen)
+{
+    tlvP->dataType = LWM2M_DATA_FLOAT;
+    tlvP->length = prv_encodeFloat(data, (tlvP->flags & LWM2M_TLV_FLAG_TEXT_FORMAT) != 0, buffer, bufferLen);
+    tlvP->value = buffer;
+    tlvP->flags |= LWM2M_TLV_FLAG_STATIC_DATA;
+}
+
+int lwm2m_tlv_decode_float(lwm2m_tlv_t * tlvP,
+                           double * dataP)
+{
+    uint64_t bits;
+    size_t i;
+
+    if (tlvP->length == 0) return 0;
+
+    if (tlvP->dataType == LWM2M_DATA_INTEGER)
+    {
+        int64_t value;
+
+        if (0 == lwm2m_tlv_decode_int(tlvP, &value)) return 0;
+        *dataP = (double)value;
+
+        return 1;
+    }
+
+    if ((tlvP->flags & LWM2M_TLV_FLAG_TEXT_FORMAT) != 0)
+    {
+        return lwm2m_PlainTextToFloat64((char *)tlvP->value, tlvP->length, dataP);
+    }
+
+    if (tlvP->length != 4 && tlvP->length != 8) return 0;
+
+    bits = 0;
+    for (i = 0 ; i < tlvP->length ; i++)
+    {
+        bits = (bits << 8) | tlvP->value[i];
+    }
+
+    if (tlvP->length == 4)
+    {
+        uint32_t shortBits = (uint32_t)bits;
+        float shortData;
+
+        memcpy(&shortData, &shortBits, sizeof(shortData));
+        *dataP = shortData;
+    }
+    else
+    {
+        memcpy(dataP, &bits, sizeof(*dataP));
+    }
+
+    return 1;
+}
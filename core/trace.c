@@ -0,0 +1,136 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Trace of the engine events.
+ *
+ * Events are written as fixed-size lwm2m_trace_record_t in a ring buffer
+ * allocated by lwm2m_trace_start(), the oldest records being overwritten.
+ * Recording an event is a copy of a few bytes, without formatting nor
+ * locking: like the rest of the engine, the ring is only accessed from the
+ * thread calling lwm2m_step() and lwm2m_handle_packet().
+ */
+
+#include "internals.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+struct _lwm2m_trace_
+{
+    uint32_t                size;   // number of records in the ring
+    uint32_t                next;   // index of the next record written
+    bool                    full;   // the ring wrapped around
+    lwm2m_trace_record_t    records[];
+};
+
+void trace_add(lwm2m_context_t * contextP,
+               lwm2m_trace_event_t event,
+               uint8_t type,
+               uint8_t code,
+               uint16_t mid,
+               uint16_t id)
+{
+    lwm2m_trace_t * traceP = contextP->trace;
+    lwm2m_trace_record_t * recordP;
+
+    recordP = traceP->records + traceP->next;
+    recordP->time = utils_gettime_ms(contextP);
+    recordP->event = (uint8_t)event;
+    recordP->type = type;
+    recordP->code = code;
+    recordP->reserved = 0;
+    recordP->mid = mid;
+    recordP->id = id;
+
+    traceP->next++;
+    if (traceP->next == traceP->size)
+    {
+        traceP->next = 0;
+        traceP->full = true;
+    }
+}
+
+int lwm2m_trace_start(lwm2m_context_t * contextP,
+                      uint32_t count)
+{
+    lwm2m_trace_t * traceP;
+
+    lwm2m_trace_stop(contextP);
+    if (count == 0) return COAP_NO_ERROR;
+
+    traceP = (lwm2m_trace_t *)lwm2m_malloc(sizeof(lwm2m_trace_t) + count * sizeof(lwm2m_trace_record_t));
+    if (traceP == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+    memset(traceP, 0, sizeof(lwm2m_trace_t));
+    traceP->size = count;
+
+    contextP->trace = traceP;
+
+    return COAP_NO_ERROR;
+}
+
+void lwm2m_trace_stop(lwm2m_context_t * contextP)
+{
+    if (contextP->trace != NULL)
+    {
+        lwm2m_free(contextP->trace);
+        contextP->trace = NULL;
+    }
+}
+
+uint32_t lwm2m_trace_dump(lwm2m_context_t * contextP,
+                          uint32_t duration,
+                          lwm2m_trace_record_t * bufferP,
+                          uint32_t count)
+{
+    lwm2m_trace_t * traceP = contextP->trace;
+    uint32_t available;
+    uint32_t first;
+    uint32_t i;
+
+    if (traceP == NULL) return 0;
+
+    available = traceP->full ? traceP->size : traceP->next;
+    if (count > available) count = available;
+
+    // the newest records are at the end
+    if (duration != 0)
+    {
+        uint64_t now;
+        uint64_t since;
+        uint32_t recent;
+
+        // a duration longer than the clock reading covers all the records
+        now = utils_gettime_ms(contextP);
+        since = now > (uint64_t)duration * 1000 ? now - (uint64_t)duration * 1000 : 0;
+        recent = 0;
+        while (recent < count
+            && traceP->records[(traceP->next + traceP->size - recent - 1) % traceP->size].time >= since)
+        {
+            recent++;
+        }
+        count = recent;
+    }
+
+    first = (traceP->next + traceP->size - count) % traceP->size;
+    for (i = 0 ; i < count ; i++)
+    {
+        bufferP[i] = traceP->records[(first + i) % traceP->size];
+    }
+
+    return count;
+}
@@ -84,11 +84,11 @@ Contains code snippets which are:
 
 
 /*
- * Modulo mask (+1 and +0.5 for rounding) for a random number to get the tick number for the random
- * retransmission time between COAP_RESPONSE_TIMEOUT and COAP_RESPONSE_TIMEOUT*COAP_RESPONSE_RANDOM_FACTOR.
+ * RFC 7252 4.8: the first timeout is picked at random between ACK_TIMEOUT (COAP_RESPONSE_TIMEOUT)
+ * and ACK_TIMEOUT * ACK_RANDOM_FACTOR (1.5), then doubles at each retransmission.
  */
-#define COAP_RESPONSE_TIMEOUT_TICKS         (CLOCK_SECOND * COAP_RESPONSE_TIMEOUT)
-#define COAP_RESPONSE_TIMEOUT_BACKOFF_MASK  ((CLOCK_SECOND * COAP_RESPONSE_TIMEOUT * (COAP_RESPONSE_RANDOM_FACTOR - 1)) + 1.5)
+#define COAP_RESPONSE_TIMEOUT_MS            (COAP_RESPONSE_TIMEOUT * 1000)
+#define COAP_RESPONSE_RANDOM_RANGE_MS       (COAP_RESPONSE_TIMEOUT_MS / 2)
 
 static int prv_check_addr(void * leftSessionH,
                           void * rightSessionH)
@@ -103,6 +103,45 @@ static int prv_check_addr(void * leftSessionH,
     return 1;
 }
 
+static void * prv_getSessionH(lwm2m_context_t * contextP,
+                              lwm2m_transaction_t * transacP)
+{
+    switch (transacP->peerType)
+    {
+#ifdef LWM2M_SERVER_MODE
+    case ENDPOINT_CLIENT:
+        return clients_getSession(contextP, (lwm2m_client_t *)transacP->peerP);
+#endif
+
+#ifdef LWM2M_CLIENT_MODE
+    case ENDPOINT_SERVER:
+        return ((lwm2m_server_t *)transacP->peerP)->sessionH;
+#endif
+
+    default:
+        return NULL;
+    }
+}
+
+static uint16_t prv_getPeerId(lwm2m_transaction_t * transacP)
+{
+    switch (transacP->peerType)
+    {
+#ifdef LWM2M_SERVER_MODE
+    case ENDPOINT_CLIENT:
+        return ((lwm2m_client_t *)transacP->peerP)->internalID;
+#endif
+
+#ifdef LWM2M_CLIENT_MODE
+    case ENDPOINT_SERVER:
+        return ((lwm2m_server_t *)transacP->peerP)->shortID;
+#endif
+
+    default:
+        return 0;
+    }
+}
+
 lwm2m_transaction_t * transaction_new(coap_method_t method,
                                       lwm2m_uri_t * uriP,
                                       uint16_t mID,
@@ -121,6 +160,8 @@ lwm2m_transaction_t * transaction_new(coap_method_t method,
     if (transacP->message == NULL) goto error;
 
     coap_init_message(transacP->message, COAP_TYPE_CON, method, mID);
+    // identifies a separate response, callers may set another token
+    transaction_set_token(transacP, mID);
 
     transacP->mID = mID;
     transacP->peerType = peerType;
@@ -161,14 +202,117 @@ error:
     return NULL;
 }
 
+// A confirmable separate response: code is a response code and the caller sets the token of the request.
+lwm2m_transaction_t * transaction_new_response(coap_status_t code,
+                                               uint16_t mID,
+                                               lwm2m_endpoint_type_t peerType,
+                                               void * peerP)
+{
+    lwm2m_transaction_t * transacP;
+
+    transacP = transaction_new(COAP_GET, NULL, mID, peerType, peerP);
+    if (transacP == NULL) return NULL;
+    coap_set_status_code(transacP->message, code);
+
+    return transacP;
+}
+
+void transaction_set_token(lwm2m_transaction_t * transacP,
+                           uint16_t value)
+{
+    uint8_t token[2];
+
+    token[0] = value >> 8;
+    token[1] = value & 0xFF;
+    coap_set_header_token(transacP->message, token, sizeof(token));
+}
+
 void transaction_free(lwm2m_transaction_t * transacP)
 {
     if (transacP->message) lwm2m_free(transacP->message);
     if (transacP->buffer) lwm2m_free(transacP->buffer);
+    if (transacP->payload) lwm2m_free(transacP->payload);
     lwm2m_free(transacP);
 }
 
-void transaction_remove(lwm2m_context_t * contextP,
+int transaction_set_payload(lwm2m_context_t * contextP,
+                            lwm2m_transaction_t * transacP,
+                            uint8_t * buffer,
+                            int length)
+{
+    uint16_t blockSize;
+
+    packet_get_sizes(contextP, prv_getSessionH(contextP, transacP), NULL, &blockSize);
+    if (length <= blockSize)
+    {
+        coap_set_payload(transacP->message, buffer, length);
+        return 1;
+    }
+
+    // keep a copy to send the next blocks
+    transacP->payload = (uint8_t *)lwm2m_malloc(length);
+    if (transacP->payload == NULL) return 0;
+    memcpy(transacP->payload, buffer, length);
+    transacP->payload_len = length;
+
+    coap_set_header_block1(transacP->message, 0, 1, blockSize);
+    coap_set_payload(transacP->message, transacP->payload, blockSize);
+
+    return 1;
+}
+
+// Send the block following the one acknowledged by message. Return 0 if the transfer is over.
+static int prv_send_next_block(lwm2m_context_t * contextP,
+                               lwm2m_transaction_t * transacP,
+                               coap_packet_t * message)
+{
+    coap_packet_t * requestP = (coap_packet_t *)transacP->message;
+    uint8_t * previousBuffer;
+    uint32_t num;
+    uint16_t size;
+    size_t offset;
+    size_t length;
+
+    if (transacP->payload == NULL
+     || transacP->buffer == NULL
+     || message->code != COAP_231_CONTINUE
+     || !IS_OPTION(requestP, COAP_OPTION_BLOCK1))
+    {
+        return 0;
+    }
+
+    offset = (size_t)(requestP->block1_num + 1) * requestP->block1_size;
+    if (offset >= transacP->payload_len) return 0;
+
+    // the peer may ask for smaller blocks
+    size = requestP->block1_size;
+    if (IS_OPTION(message, COAP_OPTION_BLOCK1) && message->block1_size < size)
+    {
+        size = message->block1_size;
+    }
+    num = offset / size;
+    length = MIN(transacP->payload_len - offset, size);
+
+    // coap_serialize_message() released the options of the previous block, get them back from the sent datagram
+    previousBuffer = transacP->buffer;
+    if (NO_ERROR != coap_parse_message(requestP, previousBuffer, transacP->buffer_len)) return 0;
+
+    requestP->mid = contextP->nextMID++;
+    transacP->mID = requestP->mid;
+    coap_set_header_block1(requestP, num, offset + length < transacP->payload_len, size);
+    coap_set_payload(requestP, transacP->payload + offset, length);
+
+    transacP->buffer = NULL;
+    transacP->retrans_counter = 0;
+    transaction_send(contextP, transacP);
+
+    // the parsed options pointed inside the previous datagram
+    lwm2m_free(previousBuffer);
+
+    return 1;
+}
+
+void transaction_unlink(lwm2m_context_t * contextP,
                         lwm2m_transaction_t * transacP)
 {
     if (NULL != contextP->transactionList)
@@ -190,10 +334,33 @@ void transaction_remove(lwm2m_context_t * contextP,
             }
         }
     }
+}
+
+void transaction_remove(lwm2m_context_t * contextP,
+                        lwm2m_transaction_t * transacP)
+{
+    transaction_unlink(contextP, transacP);
     transaction_free(transacP);
 }
 
 
+static bool prv_match(lwm2m_transaction_t * transacP,
+                      coap_packet_t * message)
+{
+    coap_packet_t * requestP = (coap_packet_t *)transacP->message;
+
+    // piggybacked responses share the Message ID of the request
+    if (message->type == COAP_TYPE_ACK || message->type == COAP_TYPE_RST)
+    {
+        return transacP->mID == message->mid;
+    }
+
+    // separate responses only share the token
+    return requestP->code <= COAP_DELETE
+        && requestP->token_len == message->token_len
+        && 0 == memcmp(requestP->token, message->token, message->token_len);
+}
+
 void transaction_handle_response(lwm2m_context_t * contextP,
                                  void * fromSessionH,
                                  coap_packet_t * message)
@@ -204,36 +371,37 @@ void transaction_handle_response(lwm2m_context_t * contextP,
 
     while (transacP != NULL)
     {
-        void * targetSessionH;
-
-        targetSessionH = NULL;
-        switch (transacP->peerType)
-        {
-    #ifdef LWM2M_SERVER_MODE
-        case ENDPOINT_CLIENT:
-            targetSessionH = ((lwm2m_client_t *)transacP->peerP)->sessionH;
-            break;
-    #endif
-
-    #ifdef LWM2M_CLIENT_MODE
-        case ENDPOINT_SERVER:
-            targetSessionH = ((lwm2m_server_t *)transacP->peerP)->sessionH;
-            break;
-    #endif
-
-        default:
-            break;
-        }
-
-        if (prv_check_addr(fromSessionH, targetSessionH))
+        if (prv_check_addr(fromSessionH, prv_getSessionH(contextP, transacP)))
         {
-            if (transacP->mID == message->mid)
+            if (prv_match(transacP, message))
             {
+                if (message->type == COAP_TYPE_ACK
+                 && message->code == 0
+                 && ((coap_packet_t *)transacP->message)->code <= COAP_DELETE)
+                {
+                    // the request is acknowledged, the response is sent separately
+                    if (!transacP->ack_received)
+                    {
+                        transacP->ack_received = true;
+                        transacP->retrans_counter = COAP_MAX_RETRANSMIT + 1;
+                        transacP->retrans_time = utils_gettime_ms(contextP) + COAP_EXCHANGE_LIFETIME * 1000;
+                    }
+                    return;
+                }
+
                 // HACK: If a message is sent from the monitor callback,
                 // it will arrive before the registration ACK.
                 // So we resend transaction that were denied for authentication reason.
                 if (message->code != COAP_401_UNAUTHORIZED || transacP->retrans_counter >= COAP_MAX_RETRANSMIT)
                 {
+                    stats_rtt(contextP, transacP);
+                    TRACE(contextP, LWM2M_TRACE_RESPONSE, message->type, message->code, message->mid, prv_getPeerId(transacP));
+
+                    // Block1 transfer in progress
+                    if (prv_send_next_block(contextP, transacP, message)) return;
+                    // response sent in several blocks, answered later
+                    if (block2_handle_response(contextP, transacP, message)) return;
+
                     if (transacP->callback != NULL)
                     {
                         transacP->callback(transacP, message);
@@ -252,18 +420,47 @@ void transaction_handle_response(lwm2m_context_t * contextP,
 int transaction_send(lwm2m_context_t * contextP,
                      lwm2m_transaction_t * transacP)
 {
+    if (transacP->retrans_counter > COAP_MAX_RETRANSMIT)
+    {
+        // no answer within the timeout of the last retransmission
+        contextP->stats.timeouts++;
+        TRACE(contextP, LWM2M_TRACE_TIMEOUT, 0, ((coap_packet_t *)transacP->message)->code, transacP->mID, prv_getPeerId(transacP));
+        if (transacP->callback)
+        {
+            transacP->callback(transacP, NULL);
+        }
+        transaction_remove(contextP, transacP);
+        return -1;
+    }
+
     if (transacP->buffer == NULL)
     {
-        uint8_t tempBuffer[LWM2M_MAX_PACKET_SIZE];
+        coap_packet_t * messageP = (coap_packet_t *)transacP->message;
+        uint16_t packetSize;
         int length;
 
-        length = coap_serialize_message(transacP->message, tempBuffer);
-        if (length <= 0) return COAP_500_INTERNAL_SERVER_ERROR;
+        packet_get_sizes(contextP, prv_getSessionH(contextP, transacP), &packetSize, NULL);
+
+        // larger payloads are sent with Block1 rather than truncated
+        if (messageP->payload_len > packetSize - COAP_MAX_HEADER_SIZE)
+        {
+            if (transacP->payload != NULL
+             || !transaction_set_payload(contextP, transacP, messageP->payload, messageP->payload_len))
+            {
+                return COAP_500_INTERNAL_SERVER_ERROR;
+            }
+        }
 
-        transacP->buffer = (uint8_t*)lwm2m_malloc(length);
+        transacP->buffer = (uint8_t*)lwm2m_malloc(packetSize);
         if (transacP->buffer == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
 
-        memcpy(transacP->buffer, tempBuffer, length);
+        length = coap_serialize_message(messageP, transacP->buffer);
+        if (length <= 0)
+        {
+            lwm2m_free(transacP->buffer);
+            transacP->buffer = NULL;
+            return COAP_500_INTERNAL_SERVER_ERROR;
+        }
         transacP->buffer_len = length;
     }
 
@@ -271,51 +468,36 @@ int transaction_send(lwm2m_context_t * contextP,
     {
     case ENDPOINT_CLIENT:
         LOG("Sending %d bytes\r\n", transacP->buffer_len);
-        contextP->bufferSendCallback(((lwm2m_client_t*)transacP->peerP)->sessionH,
-                                     transacP->buffer, transacP->buffer_len, contextP->userData);
+        packet_send(contextP, prv_getSessionH(contextP, transacP),
+                    transacP->buffer, transacP->buffer_len);
 
         break;
 
     case ENDPOINT_SERVER:
         LOG("Sending %d bytes\r\n", transacP->buffer_len);
-        contextP->bufferSendCallback(((lwm2m_server_t*)transacP->peerP)->sessionH,
-                                     transacP->buffer, transacP->buffer_len, contextP->userData);
+        packet_send(contextP, ((lwm2m_server_t*)transacP->peerP)->sessionH,
+                    transacP->buffer, transacP->buffer_len);
         break;
 
     default:
         return 0;
     }
+    TRACE(contextP, transacP->retrans_counter == 0 ? LWM2M_TRACE_SENT : LWM2M_TRACE_RETRANSMITTED,
+          COAP_TYPE_CON, ((coap_packet_t *)transacP->message)->code, transacP->mID, prv_getPeerId(transacP));
 
     if (transacP->retrans_counter == 0)
     {
-        struct timeval tv;
-
-        if (0 == lwm2m_gettimeofday(&tv, NULL))
-        {
-            transacP->retrans_time = tv.tv_sec;
-            transacP->retrans_counter = 1;
-        }
-        else
-        {
-            // crude error handling
-            transacP->retrans_counter = COAP_MAX_RETRANSMIT;
-        }
-    }
-
-    if (transacP->retrans_counter < COAP_MAX_RETRANSMIT)
-    {
-        transacP->retrans_time += COAP_RESPONSE_TIMEOUT * transacP->retrans_counter;
-        transacP->retrans_counter++;
+        // randomized so that transactions started together do not retransmit together
+        transacP->retrans_timeout = COAP_RESPONSE_TIMEOUT_MS + rand() % (COAP_RESPONSE_RANDOM_RANGE_MS + 1);
+        transacP->send_time = utils_gettime_ms(contextP);
     }
     else
     {
-        if (transacP->callback)
-        {
-            transacP->callback(transacP, NULL);
-        }
-        transaction_remove(contextP, transacP);
-        return -1;
+        transacP->retrans_timeout *= 2;
+        contextP->stats.retransmissions++;
     }
+    transacP->retrans_time = utils_gettime_ms(contextP) + transacP->retrans_timeout;
+    transacP->retrans_counter++;
 
     return 0;
 }
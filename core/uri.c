@@ -218,3 +218,36 @@ int lwm2m_stringToUri(char * buffer,
     return head;
 }
 
+bool uri_matchPath(char * path,
+                   multi_option_t * optionP)
+{
+    size_t index;
+
+    index = 0;
+    while (optionP != NULL)
+    {
+        if (path[index] != '/') return false;
+        index++;
+        if (0 != strncmp(path + index, optionP->data, optionP->len)) return false;
+        index += optionP->len;
+        optionP = optionP->next;
+    }
+
+    return path[index] == 0;
+}
+
+bool uri_isSame(lwm2m_uri_t * uri1P,
+                lwm2m_uri_t * uri2P)
+{
+    // the object ID is always there but lwm2m_stringToUri() does not flag it
+    if ((uri1P->flag & (LWM2M_URI_FLAG_INSTANCE_ID | LWM2M_URI_FLAG_RESOURCE_ID))
+     != (uri2P->flag & (LWM2M_URI_FLAG_INSTANCE_ID | LWM2M_URI_FLAG_RESOURCE_ID)))
+    {
+        return false;
+    }
+    if (uri1P->objectId != uri2P->objectId) return false;
+    if (LWM2M_URI_IS_SET_INSTANCE(uri1P) && uri1P->instanceId != uri2P->instanceId) return false;
+    if (LWM2M_URI_IS_SET_RESOURCE(uri1P) && uri1P->resourceId != uri2P->resourceId) return false;
+
+    return true;
+}
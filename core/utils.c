@@ -51,50 +51,698 @@
 #include <string.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <math.h>
+#ifndef LWM2M_EMBEDDED_MODE
+#include <time.h>
+#endif
 
 
+#define PRV_INT64_MAX_DIGITS    20
+#define PRV_FLOAT64_MAX_LENGTH  32
+#define PRV_FLOAT64_MAX_DIGITS  19
+
+static const char prv_digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const double prv_exactPow10[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const uint64_t prv_uint64Pow10[] =
+{
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+// Write the decimal digits of value at the end of buffer which must hold
+// PRV_INT64_MAX_DIGITS bytes. Return the index of the first digit.
+static int prv_uint64ToDigits(uint64_t value,
+                              char * buffer)
+{
+    int index = PRV_INT64_MAX_DIGITS;
+
+    while (value >= 100)
+    {
+        int pair = (int)(value % 100) * 2;
+
+        value /= 100;
+        buffer[--index] = prv_digitPairs[pair + 1];
+        buffer[--index] = prv_digitPairs[pair];
+    }
+    if (value >= 10)
+    {
+        int pair = (int)value * 2;
+
+        buffer[--index] = prv_digitPairs[pair + 1];
+        buffer[--index] = prv_digitPairs[pair];
+    }
+    else
+    {
+        buffer[--index] = (char)('0' + value);
+    }
+
+    return index;
+}
+
+/*
+ * Shortest round-trip double to decimal conversion.
+ * This is an implementation of the Grisu2 algorithm from Florian Loitsch's
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers".
+ */
+
+typedef struct
+{
+    uint64_t f;
+    int      e;
+} prv_diy_fp_t;
+
+#define PRV_DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define PRV_DP_EXPONENT_MASK    0x7FF0000000000000ULL
+#define PRV_DP_HIDDEN_BIT       0x0010000000000000ULL
+#define PRV_DP_EXPONENT_BIAS    1075
+
+static const uint64_t prv_cachedPowersF[] =
+{
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t prv_cachedPowersE[] =
+{
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static prv_diy_fp_t prv_fpMultiply(prv_diy_fp_t x,
+                                   prv_diy_fp_t y)
+{
+    prv_diy_fp_t r;
+    uint64_t a = x.f >> 32;
+    uint64_t b = x.f & 0xFFFFFFFF;
+    uint64_t c = y.f >> 32;
+    uint64_t d = y.f & 0xFFFFFFFF;
+    uint64_t ac = a * c;
+    uint64_t bc = b * c;
+    uint64_t ad = a * d;
+    uint64_t bd = b * d;
+    uint64_t tmp;
+
+    tmp = (bd >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF);
+    tmp += 1U << 31;    // round
+
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    r.e = x.e + y.e + 64;
+
+    return r;
+}
+
+static prv_diy_fp_t prv_fpNormalize(prv_diy_fp_t x)
+{
+    while ((x.f & (1ULL << 63)) == 0)
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+
+    return x;
+}
+
+static void prv_grisuRound(char * buffer,
+                           int length,
+                           uint64_t delta,
+                           uint64_t rest,
+                           uint64_t tenKappa,
+                           uint64_t wpW)
+{
+    while (rest < wpW
+        && delta - rest >= tenKappa
+        && (rest + tenKappa < wpW || wpW - rest > rest + tenKappa - wpW))
+    {
+        buffer[length - 1]--;
+        rest += tenKappa;
+    }
+}
+
+static void prv_digitGen(prv_diy_fp_t w,
+                         prv_diy_fp_t mp,
+                         uint64_t delta,
+                         char * buffer,
+                         int * lengthP,
+                         int * kP)
+{
+    prv_diy_fp_t one;
+    uint64_t wpW;
+    uint32_t p1;
+    uint64_t p2;
+    int kappa;
+
+    one.f = 1ULL << -mp.e;
+    one.e = mp.e;
+    wpW = mp.f - w.f;
+    p1 = (uint32_t)(mp.f >> -one.e);
+    p2 = mp.f & (one.f - 1);
+
+    kappa = 1;
+    while (kappa < 10 && p1 >= prv_uint64Pow10[kappa]) kappa++;
+
+    *lengthP = 0;
+    while (kappa > 0)
+    {
+        uint32_t d;
+        uint64_t tmp;
+
+        kappa--;
+        d = p1 / (uint32_t)prv_uint64Pow10[kappa];
+        p1 %= (uint32_t)prv_uint64Pow10[kappa];
+        if (d != 0 || *lengthP != 0)
+        {
+            buffer[(*lengthP)++] = (char)('0' + d);
+        }
+        tmp = ((uint64_t)p1 << -one.e) + p2;
+        if (tmp <= delta)
+        {
+            *kP += kappa;
+            prv_grisuRound(buffer, *lengthP, delta, tmp, prv_uint64Pow10[kappa] << -one.e, wpW);
+            return;
+        }
+    }
+
+    while (1)
+    {
+        char d;
+
+        p2 *= 10;
+        delta *= 10;
+        d = (char)(p2 >> -one.e);
+        if (d != 0 || *lengthP != 0)
+        {
+            buffer[(*lengthP)++] = (char)('0' + d);
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta)
+        {
+            *kP += kappa;
+            prv_grisuRound(buffer, *lengthP, delta, p2, one.f, wpW * (-kappa < 20 ? prv_uint64Pow10[-kappa] : 0));
+            return;
+        }
+    }
+}
+
+// value must be finite and strictly positive.
+// On return, buffer contains *lengthP digits and value ~= digits * 10^(*kP)
+static void prv_grisu2(double value,
+                       char * buffer,
+                       int * lengthP,
+                       int * kP)
+{
+    union { double d; uint64_t u; } bits;
+    prv_diy_fp_t v;
+    prv_diy_fp_t mMinus;
+    prv_diy_fp_t mPlus;
+    prv_diy_fp_t cMk;
+    prv_diy_fp_t w;
+    prv_diy_fp_t wPlus;
+    prv_diy_fp_t wMinus;
+    int biasedE;
+    double dk;
+    int k;
+    int index;
+
+    bits.d = value;
+    biasedE = (int)((bits.u & PRV_DP_EXPONENT_MASK) >> 52);
+    if (biasedE != 0)
+    {
+        v.f = (bits.u & PRV_DP_SIGNIFICAND_MASK) + PRV_DP_HIDDEN_BIT;
+        v.e = biasedE - PRV_DP_EXPONENT_BIAS;
+    }
+    else
+    {
+        v.f = bits.u & PRV_DP_SIGNIFICAND_MASK;
+        v.e = 1 - PRV_DP_EXPONENT_BIAS;
+    }
+
+    // boundaries of the rounding interval
+    mPlus.f = (v.f << 1) + 1;
+    mPlus.e = v.e - 1;
+    while ((mPlus.f & (PRV_DP_HIDDEN_BIT << 1)) == 0)
+    {
+        mPlus.f <<= 1;
+        mPlus.e--;
+    }
+    mPlus.f <<= 10;
+    mPlus.e -= 10;
+    if (v.f == PRV_DP_HIDDEN_BIT)
+    {
+        mMinus.f = (v.f << 2) - 1;
+        mMinus.e = v.e - 2;
+    }
+    else
+    {
+        mMinus.f = (v.f << 1) - 1;
+        mMinus.e = v.e - 1;
+    }
+    mMinus.f <<= mMinus.e - mPlus.e;
+    mMinus.e = mPlus.e;
+
+    // cached power of ten bringing the exponent in the [-60, -32] range
+    dk = (-61 - mPlus.e) * 0.30102999566398114 + 347;
+    k = (int)dk;
+    if (dk - k > 0.0) k++;
+    index = (k >> 3) + 1;
+    *kP = -(-348 + index * 8);
+    cMk.f = prv_cachedPowersF[index];
+    cMk.e = prv_cachedPowersE[index];
+
+    w = prv_fpMultiply(prv_fpNormalize(v), cMk);
+    wPlus = prv_fpMultiply(mPlus, cMk);
+    wMinus = prv_fpMultiply(mMinus, cMk);
+    wMinus.f++;
+    wPlus.f--;
+
+    prv_digitGen(w, wPlus, wPlus.f - wMinus.f, buffer, lengthP, kP);
+}
+
+// Format the digits returned by prv_grisu2(). buffer must hold PRV_FLOAT64_MAX_LENGTH bytes.
+static int prv_prettifyFloat(char * buffer,
+                             int length,
+                             int k)
+{
+    int kk = length + k;    // 10^(kk-1) <= v < 10^kk
+
+    if (length <= kk && kk <= 21)
+    {
+        // 1234e7 -> 12340000000.0
+        memset(buffer + length, '0', kk - length);
+        buffer[kk] = '.';
+        buffer[kk + 1] = '0';
+        return kk + 2;
+    }
+    else if (0 < kk && kk <= 21)
+    {
+        // 1234e-2 -> 12.34
+        memmove(buffer + kk + 1, buffer + kk, length - kk);
+        buffer[kk] = '.';
+        return length + 1;
+    }
+    else if (-6 < kk && kk <= 0)
+    {
+        // 1234e-6 -> 0.001234
+        int offset = 2 - kk;
+
+        memmove(buffer + offset, buffer, length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        memset(buffer + 2, '0', offset - 2);
+        return length + offset;
+    }
+    else
+    {
+        // 1234e30 -> 1.234e33
+        char digits[PRV_INT64_MAX_DIGITS];
+        int exponent = kk - 1;
+        int index;
+
+        if (length == 1)
+        {
+            index = 1;
+        }
+        else
+        {
+            memmove(buffer + 2, buffer + 1, length - 1);
+            buffer[1] = '.';
+            index = length + 1;
+        }
+        buffer[index++] = 'e';
+        if (exponent < 0)
+        {
+            buffer[index++] = '-';
+            exponent = -exponent;
+        }
+        k = prv_uint64ToDigits((uint64_t)exponent, digits);
+        memcpy(buffer + index, digits + k, PRV_INT64_MAX_DIGITS - k);
+        return index + PRV_INT64_MAX_DIGITS - k;
+    }
+}
+
 int lwm2m_PlainTextToInt64(char * buffer,
                            int length,
                            int64_t * dataP)
 {
     uint64_t result = 0;
-    int sign = 1;
-    int mul = 0;
+    uint64_t limit = INT64_MAX;
+    bool negative = false;
     int i = 0;
 
-    if (0 == length) return 0;
+    if (0 >= length) return 0;
 
     if (buffer[0] == '-')
     {
-        sign = -1;
+        negative = true;
+        limit = (uint64_t)INT64_MAX + 1;
         i = 1;
+        if (length == 1) return 0;
     }
 
     while (i < length)
     {
-        if ('0' <= buffer[i] && buffer[i] <= '9')
+        unsigned int digit;
+
+        digit = (unsigned int)(buffer[i] - '0');
+        if (digit > 9) return 0;
+
+        // check for overflow before accumulating
+        if (result > (limit - digit) / 10) return 0;
+        result = result * 10 + digit;
+        i++;
+    }
+
+    if (negative)
+    {
+        *dataP = (int64_t)(0 - result);
+    }
+    else
+    {
+        *dataP = (int64_t)result;
+    }
+    return 1;
+}
+
+int lwm2m_PlainTextToFloat64(char * buffer,
+                             int length,
+                             double * dataP)
+{
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool negative = false;
+    bool truncated = false;
+    bool found = false;
+    int i = 0;
+
+    if (0 >= length) return 0;
+
+    if (buffer[i] == '-' || buffer[i] == '+')
+    {
+        negative = (buffer[i] == '-');
+        i++;
+    }
+
+    // integer part
+    while (i < length && '0' <= buffer[i] && buffer[i] <= '9')
+    {
+        found = true;
+        if (digits < PRV_FLOAT64_MAX_DIGITS)
+        {
+            mantissa = mantissa * 10 + (buffer[i] - '0');
+            if (mantissa != 0) digits++;
+        }
+        else
         {
-            if (0 == mul)
+            if (buffer[i] != '0') truncated = true;
+            exponent++;
+        }
+        i++;
+    }
+
+    // fractional part
+    if (i < length && buffer[i] == '.')
+    {
+        i++;
+        while (i < length && '0' <= buffer[i] && buffer[i] <= '9')
+        {
+            found = true;
+            if (digits < PRV_FLOAT64_MAX_DIGITS)
+            {
+                mantissa = mantissa * 10 + (buffer[i] - '0');
+                if (mantissa != 0) digits++;
+                exponent--;
+            }
+            else if (buffer[i] != '0')
+            {
+                truncated = true;
+            }
+            i++;
+        }
+    }
+    if (!found) return 0;
+
+    // exponent part
+    if (i < length && (buffer[i] == 'e' || buffer[i] == 'E'))
+    {
+        bool negativeExponent = false;
+        int value = 0;
+        int start;
+
+        i++;
+        if (i < length && (buffer[i] == '-' || buffer[i] == '+'))
+        {
+            negativeExponent = (buffer[i] == '-');
+            i++;
+        }
+        start = i;
+        while (i < length && '0' <= buffer[i] && buffer[i] <= '9')
+        {
+            if (value <= 1000) value = value * 10 + (buffer[i] - '0');
+            i++;
+        }
+        if (i == start) return 0;
+
+        if (value > 1000)
+        {
+            // far beyond double range, let the slow path saturate
+            truncated = true;
+        }
+        else
+        {
+            exponent += negativeExponent ? -value : value;
+        }
+    }
+    if (i != length) return 0;
+
+    if (mantissa == 0 && !truncated)
+    {
+        *dataP = negative ? -0.0 : 0.0;
+        return 1;
+    }
+
+    // Clinger's fast path: both the mantissa and the power of ten are exact doubles
+    if (!truncated && mantissa <= (1ULL << 53))
+    {
+        double value = (double)mantissa;
+        bool exact = true;
+
+        if (exponent < 0)
+        {
+            if (exponent >= -22)
             {
-                mul = 10;
+                value /= prv_exactPow10[-exponent];
             }
             else
             {
-                result *= mul;
+                exact = false;
+            }
+        }
+        else if (exponent > 22)
+        {
+            // 1e25 can still be exactly computed as 1000 * 1e22
+            if (exponent <= 22 + 15
+             && mantissa <= (1ULL << 53) / prv_uint64Pow10[exponent - 22])
+            {
+                value = (double)(mantissa * prv_uint64Pow10[exponent - 22]) * prv_exactPow10[22];
+            }
+            else
+            {
+                exact = false;
             }
-            result += buffer[i] - '0';
         }
         else
         {
-            return 0;
+            value *= prv_exactPow10[exponent];
+        }
+
+        if (exact)
+        {
+            *dataP = negative ? -value : value;
+            return 1;
         }
-        i++;
     }
 
-    *dataP = result * sign;
+    // slow path requires a null-terminated string
+    {
+        char string[PRV_FLOAT64_MAX_LENGTH * 2];
+        char * stringP = string;
+        double value;
+
+        if (length >= (int)sizeof(string))
+        {
+            stringP = (char *)lwm2m_malloc(length + 1);
+            if (stringP == NULL) return 0;
+        }
+        memcpy(stringP, buffer, length);
+        stringP[length] = 0;
+
+        // the syntax was checked above
+        value = strtod(stringP, NULL);
+        if (stringP != string) lwm2m_free(stringP);
+
+        // out of double range
+        if (value - value != 0.0) return 0;
+        *dataP = value;
+    }
+
     return 1;
 }
 
+int lwm2m_int64ToPlainTextBuffer(int64_t data,
+                                 char * buffer,
+                                 size_t length)
+{
+    char digits[PRV_INT64_MAX_DIGITS];
+    uint64_t value;
+    int index;
+    int result;
+
+    if (data < 0)
+    {
+        value = 0 - (uint64_t)data;
+    }
+    else
+    {
+        value = (uint64_t)data;
+    }
+
+    index = prv_uint64ToDigits(value, digits);
+    result = PRV_INT64_MAX_DIGITS - index;
+    if (data < 0) result++;
+
+    if (length < (size_t)result) return 0;
+
+    if (data < 0) *buffer++ = '-';
+    memcpy(buffer, digits + index, PRV_INT64_MAX_DIGITS - index);
+
+    return result;
+}
+
+int lwm2m_float64ToPlainTextBuffer(double data,
+                                   char * buffer,
+                                   size_t length)
+{
+    char string[PRV_FLOAT64_MAX_LENGTH];
+    int index;
+    int result;
+
+    // NaN and infinites have no plain text representation
+    if (data != data || data - data != 0.0) return 0;
+
+    index = 0;
+    // keeps the sign of -0.0
+    if (signbit(data))
+    {
+        string[index++] = '-';
+        data = -data;
+    }
+
+    if (data == 0.0)
+    {
+        string[index++] = '0';
+        string[index++] = '.';
+        string[index++] = '0';
+        result = index;
+    }
+    else
+    {
+        int digitsLen;
+        int k;
+
+        prv_grisu2(data, string + index, &digitsLen, &k);
+        result = index + prv_prettifyFloat(string + index, digitsLen, k);
+    }
+
+    if (length < (size_t)result) return 0;
+    memcpy(buffer, string, result);
+
+    return result;
+}
+
+int lwm2m_boolToPlainTextBuffer(bool data,
+                                char * buffer,
+                                size_t length)
+{
+    if (length < 1) return 0;
+
+    buffer[0] = data ? '1' : '0';
+
+    return 1;
+}
+
+static int prv_copyPlainText(char * string,
+                             int length,
+                             char ** bufferP)
+{
+    if (length > 0)
+    {
+        *bufferP = (char *)lwm2m_malloc(length);
+        if (NULL != *bufferP)
+        {
+            memcpy(*bufferP, string, length);
+        }
+        else
+        {
+            length = 0;
+        }
+    }
+
+    return length;
+}
+
 int lwm2m_int8ToPlainText(int8_t data,
                           char ** bufferP)
 {
@@ -116,25 +764,12 @@ int lwm2m_int32ToPlainText(int32_t data,
 int lwm2m_int64ToPlainText(int64_t data,
                            char ** bufferP)
 {
-    char string[32];
+    char string[PRV_INT64_MAX_DIGITS + 1];
     int len;
 
-    len = snprintf(string, 32, "%" PRId64, data);
-    if (len > 0)
-    {
-        *bufferP = (char *)lwm2m_malloc(len);
+    len = lwm2m_int64ToPlainTextBuffer(data, string, sizeof(string));
 
-        if (NULL != *bufferP)
-        {
-            strncpy(*bufferP, string, len);
-        }
-        else
-        {
-            len = 0;
-        }
-    }
-
-    return len;
+    return prv_copyPlainText(string, len, bufferP);
 }
 
 
@@ -148,25 +783,12 @@ int lwm2m_float32ToPlainText(float data,
 int lwm2m_float64ToPlainText(double data,
                              char ** bufferP)
 {
-    char string[64];
+    char string[PRV_FLOAT64_MAX_LENGTH];
     int len;
 
-    len = snprintf(string, 64, "%lf", data);
-    if (len > 0)
-    {
-        *bufferP = (char *)lwm2m_malloc(len);
-
-        if (NULL != *bufferP)
-        {
-            strncpy(*bufferP, string, len);
-        }
-        else
-        {
-            len = 0;
-        }
-    }
+    len = lwm2m_float64ToPlainTextBuffer(data, string, sizeof(string));
 
-    return len;
+    return prv_copyPlainText(string, len, bufferP);
 }
 
 
@@ -180,30 +802,63 @@ lwm2m_binding_t lwm2m_stringToBinding(uint8_t *buffer,
                                       size_t length)
 {
     // test order is important
-    if (strncmp(buffer, "U", length) == 0)
+    if (strncmp((char *)buffer, "U", length) == 0)
     {
         return BINDING_U;
     }
-    if (strncmp(buffer, "S", length) == 0)
+    if (strncmp((char *)buffer, "S", length) == 0)
     {
         return BINDING_S;
     }
-    if (strncmp(buffer, "UQ", length) == 0)
+    if (strncmp((char *)buffer, "UQ", length) == 0)
     {
         return BINDING_UQ;
     }
-    if (strncmp(buffer, "SQ", length) == 0)
+    if (strncmp((char *)buffer, "SQ", length) == 0)
     {
         return BINDING_SQ;
     }
-    if (strncmp(buffer, "US", length) == 0)
+    if (strncmp((char *)buffer, "US", length) == 0)
     {
         return BINDING_UQ;
     }
-    if (strncmp(buffer, "UQS", length) == 0)
+    if (strncmp((char *)buffer, "UQS", length) == 0)
     {
         return BINDING_UQ;
     }
 
     return BINDING_UNKNOWN;
 }
+
+int utils_gettimeofday(lwm2m_context_t * contextP,
+                       struct timeval * tv)
+{
+    uint64_t now;
+
+    if (contextP->clockCallback == NULL) return lwm2m_gettimeofday(tv, NULL);
+
+    // dates and timers run on the same clock
+    now = contextP->clockCallback(contextP->clockUserData);
+    tv->tv_sec = (time_t)(now / 1000);
+    tv->tv_usec = (suseconds_t)((now % 1000) * 1000);
+
+    return 0;
+}
+
+uint64_t utils_gettime_ms(lwm2m_context_t * contextP)
+{
+    if (contextP->clockCallback == NULL) return lwm2m_gettime_ms();
+
+    return contextP->clockCallback(contextP->clockUserData);
+}
+
+#ifndef LWM2M_EMBEDDED_MODE
+uint64_t lwm2m_gettime_ms(void)
+{
+    struct timespec ts;
+
+    if (0 != clock_gettime(CLOCK_MONOTONIC, &ts)) return 0;
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+#endif
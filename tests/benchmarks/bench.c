@@ -0,0 +1,461 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Micro-benchmarks of the CoAP, TLV, URI, plain text and list primitives,
+ * and of the dispatch of requests to the objects of a client.
+ *
+ * Each benchmark runs for at least the time given as argument in
+ * milliseconds (100 by default). Results are printed as CSV lines:
+ * benchmark,iterations,ns_per_op,allocs_per_op
+ */
+
+#include "internals.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef void (*bench_func_t)(void * arg);
+
+typedef struct
+{
+    lwm2m_list_t *  head;
+    lwm2m_list_t *  nodes;
+    uint16_t        size;
+    uint16_t        next;
+} list_arg_t;
+
+typedef struct
+{
+    lwm2m_context_t *   contextP;
+    lwm2m_list_t *      instances;  // shared by all the objects
+    uint16_t            numInstance;
+    uint16_t            next;
+} object_arg_t;
+
+static uint64_t g_allocs = 0;
+static uint64_t g_minTime = 100000000;
+
+// keeps results alive so that the compiler does not drop the benchmarked calls
+static volatile int g_sink;
+
+int lwm2m_gettimeofday(struct timeval * tv,
+                       void * p)
+{
+    return gettimeofday(tv, NULL);
+}
+
+uint64_t lwm2m_gettime_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void * lwm2m_malloc(size_t s)
+{
+    g_allocs++;
+    return malloc(s);
+}
+
+void lwm2m_free(void * p)
+{
+    free(p);
+}
+
+static uint64_t prv_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void prv_run(const char * name,
+                    bench_func_t func,
+                    void * arg)
+{
+    uint64_t iterations;
+    uint64_t elapsed;
+    uint64_t allocs;
+
+    iterations = 1;
+    while (1)
+    {
+        uint64_t start;
+        uint64_t i;
+
+        g_allocs = 0;
+        start = prv_now_ns();
+        for (i = 0 ; i < iterations ; i++)
+        {
+            func(arg);
+        }
+        elapsed = prv_now_ns() - start;
+        allocs = g_allocs;
+
+        if (elapsed >= g_minTime || iterations >= ((uint64_t)1 << 32)) break;
+        iterations *= 2;
+    }
+
+    fprintf(stdout, "%s,%llu,%.1f,%.2f\n", name, (unsigned long long)iterations,
+            (double)elapsed / iterations, (double)allocs / iterations);
+    fflush(stdout);
+}
+
+/*
+ * CoAP
+ */
+
+static uint8_t g_request[64];
+static uint16_t g_requestLength;
+
+static void prv_build_request(coap_packet_t * messageP)
+{
+    uint8_t token[2] = {0x12, 0x34};
+
+    coap_init_message(messageP, COAP_TYPE_CON, COAP_GET, 0x4321);
+    coap_set_header_token(messageP, token, sizeof(token));
+    coap_set_header_uri_path(messageP, "/3/0/13");
+    coap_set_header_accept(messageP, LWM2M_CONTENT_TLV);
+}
+
+static void prv_coap_parse(void * arg)
+{
+    coap_packet_t message;
+
+    g_sink = coap_parse_message(&message, g_request, g_requestLength);
+    coap_free_header(&message);
+}
+
+static void prv_coap_serialize(void * arg)
+{
+    coap_packet_t message;
+    uint8_t buffer[64];
+
+    prv_build_request(&message);
+    // also releases the options
+    g_sink = coap_serialize_message(&message, buffer);
+}
+
+/*
+ * TLV
+ */
+
+// Device object instance
+static char g_tlv[] = {0xC8, 0x00, 0x14, 0x4F, 0x70, 0x65, 0x6E, 0x20, 0x4D, 0x6F, 0x62, 0x69, 0x6C, 0x65, 0x20,
+                       0x41, 0x6C, 0x6C, 0x69, 0x61, 0x6E, 0x63, 0x65, 0xC8, 0x01, 0x16, 0x4C, 0x69, 0x67, 0x68,
+                       0x74, 0x77, 0x65, 0x69, 0x67, 0x68, 0x74, 0x20, 0x4D, 0x32, 0x4D, 0x20, 0x43, 0x6C, 0x69,
+                       0x65, 0x6E, 0x74, 0xC8, 0x02, 0x09, 0x33, 0x34, 0x35, 0x30, 0x30, 0x30, 0x31, 0x32, 0x33,
+                       0xC3, 0x03, 0x31, 0x2E, 0x30, 0x86, 0x06, 0x41, 0x00, 0x01, 0x41, 0x01, 0x05, 0x88, 0x07,
+                       0x08, 0x42, 0x00, 0x0E, 0xD8, 0x42, 0x01, 0x13, 0x88, 0x87, 0x08, 0x41, 0x00, 0x7D, 0x42,
+                       0x01, 0x03, 0x84, 0xC1, 0x09, 0x64, 0xC1, 0x0A, 0x0F, 0x83, 0x0B, 0x41, 0x00, 0x00, 0xC4,
+                       0x0D, 0x51, 0x82, 0x42, 0x8F, 0xC6, 0x0E, 0x2B, 0x30, 0x32, 0x3A, 0x30, 0x30, 0xC1, 0x0F, 0x55};
+
+static lwm2m_tlv_t * g_tlvP;
+static int g_tlvSize;
+
+static void prv_tlv_parse(void * arg)
+{
+    lwm2m_tlv_t * tlvP;
+    int size;
+
+    size = lwm2m_tlv_parse(g_tlv, sizeof(g_tlv), &tlvP);
+    g_sink = size;
+    lwm2m_tlv_free(size, tlvP);
+}
+
+static void prv_tlv_serialize(void * arg)
+{
+    char * buffer;
+    int length;
+
+    length = lwm2m_tlv_serialize(g_tlvSize, g_tlvP, &buffer);
+    g_sink = length;
+    if (length > 0) lwm2m_free(buffer);
+}
+
+/*
+ * URI
+ */
+
+static multi_option_t * g_uriPath;
+
+static void prv_decode_uri(void * arg)
+{
+    lwm2m_uri_t * uriP;
+
+    uriP = lwm2m_decode_uri(g_uriPath);
+    g_sink = uriP != NULL;
+    lwm2m_free(uriP);
+}
+
+static void prv_string_to_uri(void * arg)
+{
+    lwm2m_uri_t uri;
+
+    g_sink = lwm2m_stringToUri("/1024/10/1", 10, &uri);
+}
+
+static void prv_tlv_encode_int(void * arg)
+{
+    lwm2m_tlv_t tlv;
+
+    memset(&tlv, 0, sizeof(tlv));
+    tlv.flags = LWM2M_TLV_FLAG_TEXT_FORMAT;
+    lwm2m_tlv_encode_int(-1234567890, &tlv);
+    g_sink = (int)tlv.length;
+    lwm2m_free(tlv.value);
+}
+
+static void prv_tlv_encode_int_buffer(void * arg)
+{
+    uint8_t buffer[LWM2M_TLV_NUMBER_MAX_LENGTH];
+    lwm2m_tlv_t tlv;
+
+    memset(&tlv, 0, sizeof(tlv));
+    tlv.flags = LWM2M_TLV_FLAG_TEXT_FORMAT;
+    lwm2m_tlv_encode_int_buffer(-1234567890, &tlv, buffer, sizeof(buffer));
+    g_sink = (int)tlv.length;
+}
+
+/*
+ * Plain text
+ */
+
+static void prv_plaintext_to_int(void * arg)
+{
+    int64_t value;
+
+    g_sink = lwm2m_PlainTextToInt64("-1234567890", 11, &value);
+}
+
+static void prv_int_to_plaintext(void * arg)
+{
+    char buffer[32];
+
+    g_sink = lwm2m_int64ToPlainTextBuffer(-1234567890, buffer, sizeof(buffer));
+}
+
+static void prv_plaintext_to_float(void * arg)
+{
+    double value;
+
+    g_sink = lwm2m_PlainTextToFloat64("-12345.678", 10, &value);
+}
+
+static void prv_float_to_plaintext(void * arg)
+{
+    char buffer[32];
+
+    g_sink = lwm2m_float64ToPlainTextBuffer(-12345.678, buffer, sizeof(buffer));
+}
+
+/*
+ * Lists
+ */
+
+static int prv_list_init(list_arg_t * listP,
+                         uint16_t size)
+{
+    uint16_t i;
+
+    memset(listP, 0, sizeof(list_arg_t));
+    listP->nodes = (lwm2m_list_t *)malloc(size * sizeof(lwm2m_list_t));
+    if (listP->nodes == NULL) return -1;
+    memset(listP->nodes, 0, size * sizeof(lwm2m_list_t));
+
+    for (i = size ; i > 0 ; i--)
+    {
+        listP->nodes[i - 1].id = i - 1;
+        listP->nodes[i - 1].next = listP->head;
+        listP->head = listP->nodes + i - 1;
+    }
+    listP->size = size;
+
+    return 0;
+}
+
+static void prv_list_find(void * arg)
+{
+    list_arg_t * listP = (list_arg_t *)arg;
+
+    g_sink = lwm2m_list_find(listP->head, listP->next) != NULL;
+    listP->next = (listP->next + 1) % listP->size;
+}
+
+static void prv_list_add_remove(void * arg)
+{
+    list_arg_t * listP = (list_arg_t *)arg;
+    lwm2m_list_t * nodeP;
+
+    // in the middle of the list
+    listP->head = lwm2m_list_remove(listP->head, listP->size / 2, &nodeP);
+    listP->head = lwm2m_list_add(listP->head, nodeP);
+}
+
+static void prv_list_new_id(void * arg)
+{
+    list_arg_t * listP = (list_arg_t *)arg;
+
+    g_sink = lwm2m_list_newId(listP->head);
+}
+
+/*
+ * Objects of a client
+ */
+
+#define BENCH_OBJECT_COUNT  32
+
+static void * prv_connect(uint16_t serverID,
+                          void * userData)
+{
+    return NULL;
+}
+
+static uint8_t prv_send(void * sessionH,
+                        uint8_t * buffer,
+                        size_t length,
+                        void * userData)
+{
+    return COAP_NO_ERROR;
+}
+
+static int prv_objects_init(object_arg_t * objectsP,
+                            uint16_t numInstance)
+{
+    lwm2m_object_t * objectArray[BENCH_OBJECT_COUNT];
+    uint16_t i;
+
+    memset(objectsP, 0, sizeof(object_arg_t));
+    objectsP->instances = (lwm2m_list_t *)malloc(numInstance * sizeof(lwm2m_list_t));
+    if (objectsP->instances == NULL) return -1;
+    for (i = 0 ; i < numInstance ; i++)
+    {
+        objectsP->instances[i].id = i;
+        objectsP->instances[i].next = i + 1 < numInstance ? objectsP->instances + i + 1 : NULL;
+    }
+    objectsP->numInstance = numInstance;
+
+    objectsP->contextP = lwm2m_init(prv_connect, prv_send, NULL);
+    if (objectsP->contextP == NULL) return -1;
+
+    // IDs 0 to BENCH_OBJECT_COUNT - 1 include the mandatory Security, Server and Device Objects
+    for (i = 0 ; i < BENCH_OBJECT_COUNT ; i++)
+    {
+        objectArray[i] = (lwm2m_object_t *)lwm2m_malloc(sizeof(lwm2m_object_t));
+        if (objectArray[i] == NULL) return -1;
+        memset(objectArray[i], 0, sizeof(lwm2m_object_t));
+        objectArray[i]->objID = BENCH_OBJECT_COUNT - 1 - i;
+        objectArray[i]->instanceList = objectsP->instances;
+    }
+
+    if (lwm2m_configure(objectsP->contextP, "bench", NULL, BENCH_OBJECT_COUNT, objectArray) != COAP_NO_ERROR) return -1;
+
+    return 0;
+}
+
+static void prv_objects_close(object_arg_t * objectsP)
+{
+    lwm2m_close(objectsP->contextP);
+    free(objectsP->instances);
+}
+
+static void prv_object_instance_lookup(void * arg)
+{
+    object_arg_t * objectsP = (object_arg_t *)arg;
+    uint16_t objectId;
+    uint16_t instanceId;
+
+    // spread over the objects and the instances
+    objectId = 1 + objectsP->next % (BENCH_OBJECT_COUNT - 1);
+    instanceId = (uint16_t)(((uint32_t)objectsP->next * 7919) % objectsP->numInstance);
+    g_sink = object_isInstanceNew(objectsP->contextP, objectId, instanceId);
+    objectsP->next++;
+}
+
+int main(int argc, char *argv[])
+{
+    coap_packet_t message;
+    uint16_t sizes[] = {10, 100, 1000};
+    char name[64];
+    unsigned int i;
+
+    if (argc > 1)
+    {
+        g_minTime = (uint64_t)atoi(argv[1]) * 1000000;
+    }
+
+    prv_build_request(&message);
+    g_requestLength = coap_serialize_message(&message, g_request);
+
+    coap_parse_message(&message, g_request, g_requestLength);
+    g_uriPath = message.uri_path;
+
+    g_tlvSize = lwm2m_tlv_parse(g_tlv, sizeof(g_tlv), &g_tlvP);
+
+    fprintf(stdout, "benchmark,iterations,ns_per_op,allocs_per_op\n");
+
+    prv_run("coap_parse_message", prv_coap_parse, NULL);
+    prv_run("coap_serialize_message", prv_coap_serialize, NULL);
+    prv_run("lwm2m_tlv_parse", prv_tlv_parse, NULL);
+    prv_run("lwm2m_tlv_serialize", prv_tlv_serialize, NULL);
+    prv_run("lwm2m_tlv_encode_int", prv_tlv_encode_int, NULL);
+    prv_run("lwm2m_tlv_encode_int_buffer", prv_tlv_encode_int_buffer, NULL);
+    prv_run("lwm2m_decode_uri", prv_decode_uri, NULL);
+    prv_run("lwm2m_stringToUri", prv_string_to_uri, NULL);
+    prv_run("lwm2m_PlainTextToInt64", prv_plaintext_to_int, NULL);
+    prv_run("lwm2m_int64ToPlainTextBuffer", prv_int_to_plaintext, NULL);
+    prv_run("lwm2m_PlainTextToFloat64", prv_plaintext_to_float, NULL);
+    prv_run("lwm2m_float64ToPlainTextBuffer", prv_float_to_plaintext, NULL);
+
+    for (i = 0 ; i < sizeof(sizes) / sizeof(sizes[0]) ; i++)
+    {
+        list_arg_t list;
+
+        if (prv_list_init(&list, sizes[i]) != 0) return 1;
+
+        snprintf(name, sizeof(name), "lwm2m_list_find/%u", sizes[i]);
+        prv_run(name, prv_list_find, &list);
+        snprintf(name, sizeof(name), "lwm2m_list_add_remove/%u", sizes[i]);
+        prv_run(name, prv_list_add_remove, &list);
+        snprintf(name, sizeof(name), "lwm2m_list_newId/%u", sizes[i]);
+        prv_run(name, prv_list_new_id, &list);
+
+        free(list.nodes);
+    }
+
+    for (i = 0 ; i < sizeof(sizes) / sizeof(sizes[0]) ; i++)
+    {
+        object_arg_t objects;
+
+        if (prv_objects_init(&objects, sizes[i]) != 0) return 1;
+
+        snprintf(name, sizeof(name), "object_isInstanceNew/%u", sizes[i]);
+        prv_run(name, prv_object_instance_lookup, &objects);
+
+        prv_objects_close(&objects);
+    }
+
+    lwm2m_tlv_free(g_tlvSize, g_tlvP);
+    coap_free_header(&message);
+
+    return 0;
+}
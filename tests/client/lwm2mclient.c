@@ -72,7 +72,8 @@
 #include <errno.h>
 #include <signal.h>
 
-#define MAX_PACKET_SIZE 128 //ensure sync with: er_coap_13.h REST_MAX_CHUNK_SIZE!
+// large enough for a full CoAP message carrying a REST_MAX_CHUNK_SIZE block
+#define MAX_PACKET_SIZE 2048
 
 static int g_quit = 0;
 
@@ -0,0 +1,670 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Load generator running a server context and many client contexts in the
+ * same process.
+ *
+ * The clients are spread over worker threads, each thread owning its client
+ * contexts. The server context runs in the main thread. Datagrams are passed
+ * between threads through in-memory mailboxes, the session handle of a
+ * client being the same on both sides.
+ *
+ * All the clients register at once. The server then observes the current
+ * time of the Device object of each client. During the load phase, the
+ * workers trigger notifications and registration updates and the server
+ * reads the Device object of random clients, at the given rates.
+ */
+
+#include "liblwm2m.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#define SERVER_ID       123
+#define MAX_WORKERS     64
+// period of lwm2m_step() calls
+#define STEP_PERIOD_US  10000
+// time left to the server to observe all the clients before the load phase
+#define OBSERVE_DELAY_US    1000000
+// malloc() alignment, the block size being stored before the block
+#define ALLOC_HEADER    16
+
+extern lwm2m_object_t * get_object_device();
+extern lwm2m_object_t * get_server_object();
+extern lwm2m_object_t * get_security_object();
+
+typedef struct _datagram_
+{
+    struct _datagram_ * next;
+    struct _link_ *     linkP;
+    size_t              length;
+    uint8_t             data[];
+} datagram_t;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    datagram_t *    head;
+    datagram_t *    tail;
+} mailbox_t;
+
+typedef struct _worker_ worker_t;
+
+// a client and its session with the server
+typedef struct _link_
+{
+    lwm2m_context_t *   contextP;
+    worker_t *          workerP;
+    uint64_t            nextStep;
+} link_t;
+
+struct _worker_
+{
+    pthread_t       thread;
+    mailbox_t       mailbox;
+    link_t *        links;
+    uint32_t        count;
+    unsigned int    seed;
+    uint64_t        notifications;
+    uint64_t        updates;
+    int64_t         memory;     // allocated by the clients once registered
+    volatile int    ready;
+};
+
+typedef struct
+{
+    uint32_t    clients;
+    uint32_t    workers;
+    uint32_t    duration;       // of the load phase in seconds
+    uint32_t    notifyRate;     // per second, for all the clients
+    uint32_t    updateRate;
+    uint32_t    readRate;
+    uint32_t    lifetime;
+} options_t;
+
+static options_t g_options = {1000, 4, 10, 1000, 10, 100, 300};
+
+static mailbox_t g_serverMailbox;
+static worker_t g_workers[MAX_WORKERS];
+
+// set by the main thread
+static volatile int g_loadStarted = 0;
+static volatile int g_quit = 0;
+static uint64_t g_loadStart;
+
+// updated by the main thread only
+static uint32_t g_registered = 0;
+static uint64_t g_updatesReceived = 0;
+static uint64_t g_notificationsReceived = 0;
+static uint32_t g_readsFailed = 0;
+static uint32_t * g_latencies = NULL;
+static uint32_t g_latencyCount = 0;
+static uint32_t g_latencySize = 0;
+// clients registered but not observed yet
+static uint16_t * g_pending = NULL;
+static uint32_t g_pendingCount = 0;
+
+// bytes allocated by the engine in the current thread
+static __thread int64_t t_memory = 0;
+
+static uint64_t prv_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int lwm2m_gettimeofday(struct timeval * tv,
+                       void * p)
+{
+    return gettimeofday(tv, NULL);
+}
+
+uint64_t lwm2m_gettime_ms(void)
+{
+    return prv_now_us() / 1000;
+}
+
+void * lwm2m_malloc(size_t s)
+{
+    uint8_t * blockP;
+
+    blockP = (uint8_t *)malloc(s + ALLOC_HEADER);
+    if (blockP == NULL) return NULL;
+
+    *(size_t *)blockP = s;
+    t_memory += s;
+
+    return blockP + ALLOC_HEADER;
+}
+
+void lwm2m_free(void * p)
+{
+    uint8_t * blockP;
+
+    if (p == NULL) return;
+
+    blockP = (uint8_t *)p - ALLOC_HEADER;
+    t_memory -= *(size_t *)blockP;
+    free(blockP);
+}
+
+static void prv_mailbox_init(mailbox_t * mailboxP)
+{
+    pthread_mutex_init(&mailboxP->mutex, NULL);
+    pthread_cond_init(&mailboxP->cond, NULL);
+    mailboxP->head = NULL;
+    mailboxP->tail = NULL;
+}
+
+static void prv_mailbox_post(mailbox_t * mailboxP,
+                             link_t * linkP,
+                             uint8_t * buffer,
+                             size_t length)
+{
+    datagram_t * datagramP;
+
+    datagramP = (datagram_t *)malloc(sizeof(datagram_t) + length);
+    if (datagramP == NULL) return;
+    datagramP->next = NULL;
+    datagramP->linkP = linkP;
+    datagramP->length = length;
+    memcpy(datagramP->data, buffer, length);
+
+    pthread_mutex_lock(&mailboxP->mutex);
+    if (mailboxP->tail == NULL)
+    {
+        mailboxP->head = datagramP;
+    }
+    else
+    {
+        mailboxP->tail->next = datagramP;
+    }
+    mailboxP->tail = datagramP;
+    pthread_cond_signal(&mailboxP->cond);
+    pthread_mutex_unlock(&mailboxP->mutex);
+}
+
+// take all the datagrams, waiting at most timeout microseconds for one
+static datagram_t * prv_mailbox_take(mailbox_t * mailboxP,
+                                     uint64_t timeout)
+{
+    datagram_t * datagramP;
+
+    pthread_mutex_lock(&mailboxP->mutex);
+    if (mailboxP->head == NULL && timeout > 0)
+    {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (timeout % 1000000) * 1000;
+        ts.tv_sec += timeout / 1000000 + ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&mailboxP->cond, &mailboxP->mutex, &ts);
+    }
+    datagramP = mailboxP->head;
+    mailboxP->head = NULL;
+    mailboxP->tail = NULL;
+    pthread_mutex_unlock(&mailboxP->mutex);
+
+    return datagramP;
+}
+
+/*
+ * Clients
+ */
+
+static void * prv_connect_server(uint16_t serverID,
+                                 void * userData)
+{
+    // the link is the session with the server
+    return userData;
+}
+
+static uint8_t prv_client_send(void * sessionH,
+                               uint8_t * buffer,
+                               size_t length,
+                               void * userData)
+{
+    prv_mailbox_post(&g_serverMailbox, (link_t *)sessionH, buffer, length);
+    return COAP_NO_ERROR;
+}
+
+static int prv_client_init(link_t * linkP,
+                           uint32_t index)
+{
+    lwm2m_object_t * objArray[3];
+    char name[32];
+
+    objArray[0] = get_security_object(SERVER_ID, "coap://localhost:5683", false);
+    objArray[1] = get_server_object(SERVER_ID, "U", g_options.lifetime, false);
+    objArray[2] = get_object_device();
+    if (objArray[0] == NULL || objArray[1] == NULL || objArray[2] == NULL) return -1;
+
+    linkP->contextP = lwm2m_init(prv_connect_server, prv_client_send, linkP);
+    if (linkP->contextP == NULL) return -1;
+
+    snprintf(name, sizeof(name), "loadgen%06u", index);
+    if (lwm2m_configure(linkP->contextP, name, NULL, 3, objArray) != 0) return -1;
+    if (lwm2m_start(linkP->contextP) != 0) return -1;
+
+    return 0;
+}
+
+static void * prv_worker(void * arg)
+{
+    worker_t * workerP = (worker_t *)arg;
+    lwm2m_uri_t uri;
+    uint64_t nextStep;
+    uint32_t i;
+
+    lwm2m_stringToUri("/3/0/13", 7, &uri);
+
+    for (i = 0 ; i < workerP->count ; i++)
+    {
+        uint32_t index = (uint32_t)(workerP - g_workers) + i * g_options.workers;
+
+        workerP->links[i].workerP = workerP;
+        if (prv_client_init(workerP->links + i, index) != 0)
+        {
+            fprintf(stderr, "Failed to create client %u\r\n", index);
+            exit(1);
+        }
+    }
+    workerP->ready = 1;
+
+    nextStep = 0;
+    while (!g_quit)
+    {
+        datagram_t * datagramP;
+        uint64_t now;
+
+        datagramP = prv_mailbox_take(&workerP->mailbox, 1000);
+        while (datagramP != NULL)
+        {
+            datagram_t * nextP = datagramP->next;
+
+            lwm2m_handle_packet(datagramP->linkP->contextP, datagramP->data, datagramP->length, datagramP->linkP);
+            datagramP->linkP->nextStep = 0;
+            free(datagramP);
+            datagramP = nextP;
+        }
+
+        now = prv_now_us();
+        if (now >= nextStep)
+        {
+            for (i = 0 ; i < workerP->count ; i++)
+            {
+                link_t * linkP = workerP->links + i;
+
+                if (linkP->nextStep <= now)
+                {
+                    struct timeval tv = {60, 0};
+
+                    lwm2m_step(linkP->contextP, &tv);
+                    linkP->nextStep = now + (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+                }
+            }
+            nextStep = now + STEP_PERIOD_US;
+        }
+
+        if (g_loadStarted)
+        {
+            uint64_t elapsed = now > g_loadStart ? now - g_loadStart : 0;
+            uint64_t due;
+
+            if (workerP->memory == 0) workerP->memory = t_memory;
+
+            // this worker's share of the rates
+            due = elapsed * g_options.notifyRate / g_options.workers / 1000000;
+            while (workerP->notifications < due)
+            {
+                link_t * linkP = workerP->links + rand_r(&workerP->seed) % workerP->count;
+
+                lwm2m_resource_value_changed(linkP->contextP, &uri);
+                // the notification is sent by the next lwm2m_step()
+                linkP->nextStep = 0;
+                workerP->notifications++;
+            }
+            due = elapsed * g_options.updateRate / g_options.workers / 1000000;
+            while (workerP->updates < due)
+            {
+                link_t * linkP = workerP->links + rand_r(&workerP->seed) % workerP->count;
+
+                lwm2m_update_registration(linkP->contextP, SERVER_ID);
+                linkP->nextStep = 0;
+                workerP->updates++;
+            }
+        }
+    }
+
+    for (i = 0 ; i < workerP->count ; i++)
+    {
+        lwm2m_close(workerP->links[i].contextP);
+    }
+
+    return NULL;
+}
+
+/*
+ * Server
+ */
+
+static uint8_t prv_server_send(void * sessionH,
+                               uint8_t * buffer,
+                               size_t length,
+                               void * userData)
+{
+    link_t * linkP = (link_t *)sessionH;
+
+    prv_mailbox_post(&linkP->workerP->mailbox, linkP, buffer, length);
+    return COAP_NO_ERROR;
+}
+
+static void * prv_server_connect(uint16_t serverID,
+                                 void * userData)
+{
+    return NULL;
+}
+
+static void prv_notify_callback(uint16_t clientID,
+                                lwm2m_uri_t * uriP,
+                                int status,
+                                lwm2m_media_type_t format,
+                                uint8_t * data,
+                                int dataLength,
+                                void * userData)
+{
+    // status is the observe counter, 0 for the first response
+    if (g_loadStarted && data != NULL && status > 0) g_notificationsReceived++;
+}
+
+static void prv_read_callback(uint16_t clientID,
+                              lwm2m_uri_t * uriP,
+                              int status,
+                              lwm2m_media_type_t format,
+                              uint8_t * data,
+                              int dataLength,
+                              void * userData)
+{
+    uint64_t start = (uint64_t)(uintptr_t)userData;
+
+    if (status != COAP_205_CONTENT)
+    {
+        g_readsFailed++;
+        return;
+    }
+
+    if (g_latencyCount == g_latencySize)
+    {
+        uint32_t * latencies;
+
+        latencies = (uint32_t *)realloc(g_latencies, (g_latencySize + 1024) * 2 * sizeof(uint32_t));
+        if (latencies == NULL) return;
+        g_latencies = latencies;
+        g_latencySize = (g_latencySize + 1024) * 2;
+    }
+    g_latencies[g_latencyCount++] = (uint32_t)(prv_now_us() - start);
+}
+
+static void prv_monitor_callback(uint16_t clientID,
+                                 lwm2m_uri_t * uriP,
+                                 int status,
+                                 lwm2m_media_type_t format,
+                                 uint8_t * data,
+                                 int dataLength,
+                                 void * userData)
+{
+    switch (status)
+    {
+    case COAP_201_CREATED:
+        // the client rejects requests until it receives the registration response
+        g_pending[g_pendingCount++] = clientID;
+        g_registered++;
+        break;
+
+    case COAP_204_CHANGED:
+        if (g_loadStarted) g_updatesReceived++;
+        break;
+
+    default:
+        break;
+    }
+}
+
+static int prv_compare(const void * left,
+                       const void * right)
+{
+    uint32_t l = *(const uint32_t *)left;
+    uint32_t r = *(const uint32_t *)right;
+
+    return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+static uint32_t prv_percentile(uint32_t percent)
+{
+    if (g_latencyCount == 0) return 0;
+    return g_latencies[(uint64_t)(g_latencyCount - 1) * percent / 100];
+}
+
+void print_usage(void)
+{
+    fprintf(stderr, "Usage: lwm2mloadgen [OPTIONS]\r\n");
+    fprintf(stderr, "Run a LWM2M server and many clients in the same process.\r\n");
+    fprintf(stderr, "  -c CLIENTS\tnumber of clients (default %u)\r\n", g_options.clients);
+    fprintf(stderr, "  -t THREADS\tnumber of client threads (default %u)\r\n", g_options.workers);
+    fprintf(stderr, "  -d SECONDS\tduration of the load phase (default %u)\r\n", g_options.duration);
+    fprintf(stderr, "  -n RATE\tnotifications per second (default %u)\r\n", g_options.notifyRate);
+    fprintf(stderr, "  -u RATE\tregistration updates per second (default %u)\r\n", g_options.updateRate);
+    fprintf(stderr, "  -r RATE\treads per second (default %u)\r\n", g_options.readRate);
+    fprintf(stderr, "  -l SECONDS\tregistration lifetime (default %u)\r\n\n", g_options.lifetime);
+}
+
+int main(int argc, char *argv[])
+{
+    lwm2m_context_t * lwm2mH;
+    lwm2m_stats_t stats;
+    uint64_t start;
+    uint64_t registeredTime = 0;
+    uint64_t nextStep;
+    uint64_t readsSent = 0;
+    uint64_t notifications = 0;
+    int64_t clientMemory = 0;
+    int64_t serverMemory = 0;
+    uint32_t clientIDs;
+    uint32_t i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:t:d:n:u:r:l:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            g_options.clients = atoi(optarg);
+            break;
+        case 't':
+            g_options.workers = atoi(optarg);
+            break;
+        case 'd':
+            g_options.duration = atoi(optarg);
+            break;
+        case 'n':
+            g_options.notifyRate = atoi(optarg);
+            break;
+        case 'u':
+            g_options.updateRate = atoi(optarg);
+            break;
+        case 'r':
+            g_options.readRate = atoi(optarg);
+            break;
+        case 'l':
+            g_options.lifetime = atoi(optarg);
+            break;
+        default:
+            print_usage();
+            return 1;
+        }
+    }
+    if (g_options.clients == 0 || g_options.clients > LWM2M_MAX_ID
+     || g_options.workers == 0 || g_options.workers > MAX_WORKERS)
+    {
+        print_usage();
+        return 1;
+    }
+    if (g_options.workers > g_options.clients) g_options.workers = g_options.clients;
+
+    prv_mailbox_init(&g_serverMailbox);
+    lwm2mH = lwm2m_init(prv_server_connect, prv_server_send, NULL);
+    if (NULL == lwm2mH)
+    {
+        fprintf(stderr, "lwm2m_init() failed\r\n");
+        return 1;
+    }
+    lwm2m_set_monitoring_callback(lwm2mH, prv_monitor_callback, NULL);
+    g_pending = (uint16_t *)malloc(g_options.clients * sizeof(uint16_t));
+    if (g_pending == NULL) return 1;
+
+    start = prv_now_us();
+    for (i = 0 ; i < g_options.workers ; i++)
+    {
+        worker_t * workerP = g_workers + i;
+
+        prv_mailbox_init(&workerP->mailbox);
+        // clients are dealt to the workers in turn
+        workerP->count = g_options.clients / g_options.workers + (i < g_options.clients % g_options.workers ? 1 : 0);
+        workerP->links = (link_t *)calloc(workerP->count, sizeof(link_t));
+        workerP->seed = i + 1;
+        if (workerP->links == NULL
+         || 0 != pthread_create(&workerP->thread, NULL, prv_worker, workerP))
+        {
+            fprintf(stderr, "Failed to start worker %u\r\n", i);
+            return 1;
+        }
+    }
+
+    nextStep = 0;
+    while (1)
+    {
+        datagram_t * datagramP;
+        uint64_t now;
+
+        datagramP = prv_mailbox_take(&g_serverMailbox, 1000);
+        while (datagramP != NULL)
+        {
+            datagram_t * nextP = datagramP->next;
+
+            lwm2m_handle_packet(lwm2mH, datagramP->data, datagramP->length, datagramP->linkP);
+            free(datagramP);
+            datagramP = nextP;
+        }
+
+        for (i = 0 ; i < g_pendingCount ; i++)
+        {
+            lwm2m_uri_t uri;
+
+            lwm2m_stringToUri("/3/0/13", 7, &uri);
+            lwm2m_observe(lwm2mH, g_pending[i], &uri, prv_notify_callback, NULL);
+        }
+        g_pendingCount = 0;
+
+        now = prv_now_us();
+        if (now >= nextStep)
+        {
+            struct timeval tv = {60, 0};
+
+            lwm2m_step(lwm2mH, &tv);
+            nextStep = now + STEP_PERIOD_US;
+        }
+
+        if (registeredTime == 0)
+        {
+            if (g_registered == g_options.clients)
+            {
+                registeredTime = now;
+                fprintf(stdout, "%u clients registered in %.3f s\r\n", g_registered, (now - start) / 1000000.0);
+            }
+        }
+        else if (!g_loadStarted)
+        {
+            if (now >= registeredTime + OBSERVE_DELAY_US)
+            {
+                serverMemory = t_memory;
+                g_loadStart = now;
+                g_loadStarted = 1;
+            }
+        }
+        else
+        {
+            uint64_t elapsed = now - g_loadStart;
+            uint64_t due;
+
+            if (elapsed >= (uint64_t)g_options.duration * 1000000) break;
+
+            due = elapsed * g_options.readRate / 1000000;
+            while (readsSent < due)
+            {
+                lwm2m_uri_t uri;
+
+                lwm2m_stringToUri("/3/0", 4, &uri);
+                clientIDs = rand() % g_options.clients;
+                if (0 != lwm2m_dm_read(lwm2mH, (uint16_t)clientIDs, &uri, prv_read_callback, (void *)(uintptr_t)prv_now_us()))
+                {
+                    g_readsFailed++;
+                }
+                readsSent++;
+            }
+        }
+    }
+
+    g_quit = 1;
+    for (i = 0 ; i < g_options.workers ; i++)
+    {
+        pthread_join(g_workers[i].thread, NULL);
+        notifications += g_workers[i].notifications;
+        clientMemory += g_workers[i].memory;
+    }
+
+    lwm2m_get_stats(lwm2mH, &stats);
+    qsort(g_latencies, g_latencyCount, sizeof(uint32_t), prv_compare);
+
+    fprintf(stdout, "registrations/s: %.1f\r\n", g_registered * 1000000.0 / (registeredTime - start));
+    fprintf(stdout, "notifications: %llu triggered, %llu received, %.1f/s\r\n",
+            (unsigned long long)notifications, (unsigned long long)g_notificationsReceived,
+            g_notificationsReceived / (double)g_options.duration);
+    fprintf(stdout, "updates: %llu received, %.1f/s\r\n",
+            (unsigned long long)g_updatesReceived, g_updatesReceived / (double)g_options.duration);
+    fprintf(stdout, "reads: %llu sent, %u answered, %u failed\r\n",
+            (unsigned long long)readsSent, g_latencyCount, g_readsFailed);
+    fprintf(stdout, "read latency: p50 %u us, p99 %u us\r\n", prv_percentile(50), prv_percentile(99));
+    fprintf(stdout, "memory per client: %lld bytes in the server, %lld bytes in the client\r\n",
+            (long long)(serverMemory / g_options.clients), (long long)(clientMemory / g_options.clients));
+    fprintf(stdout, "server: %u retransmissions, %u timeouts, %u parse failures\r\n",
+            stats.retransmissions, stats.timeouts, stats.parseFailures);
+
+    lwm2m_close(lwm2mH);
+    free(g_latencies);
+    free(g_pending);
+
+    return 0;
+}
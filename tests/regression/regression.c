@@ -0,0 +1,633 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Regression checks of the core.
+ *
+ * A server context and a client context exchange datagrams through an
+ * in-memory queue on a virtual clock. Each check prints its name followed
+ * by OK or failed. The exit status is the number of failed checks.
+ */
+
+#include "internals.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define SERVER_ID       123
+#define TEST_OBJECT_ID  31024
+#define PENDING_INSTANCE_ID 7
+// virtual date of the start of the checks in milliseconds
+#define START_DATE      1000000000000ULL
+
+extern lwm2m_object_t * get_object_device();
+extern lwm2m_object_t * get_server_object();
+extern lwm2m_object_t * get_security_object();
+
+typedef struct _datagram_
+{
+    struct _datagram_ * next;
+    bool                toServer;
+    size_t              length;
+    uint8_t             data[];
+} datagram_t;
+
+typedef struct
+{
+    lwm2m_list_t *  next;
+    uint16_t        id;
+} prv_instance_t;
+
+typedef struct
+{
+    int         status;
+    uint8_t *   data;
+    int         length;
+} result_t;
+
+static uint64_t g_now = START_DATE;
+static datagram_t * g_firstP = NULL;
+static datagram_t ** g_lastP = &g_firstP;
+
+static lwm2m_context_t * g_serverP;
+static lwm2m_context_t * g_clientP;
+static uint16_t g_clientID;
+static int g_session;
+
+// payload of the last 2.05 response sent by the client
+static uint8_t g_sent[1024];
+static size_t g_sentLength;
+// 2.03 responses sent by the client
+static int g_validCount = 0;
+// responses with this code sent by the client are lost, 0 for none
+static uint8_t g_dropCode = 0;
+
+static int g_failures = 0;
+
+static void prv_check(const char * name,
+                      bool success)
+{
+    fprintf(stdout, "%s %s\n", name, success ? "OK" : "failed");
+    if (!success) g_failures++;
+}
+
+static uint64_t prv_clock(void * userData)
+{
+    return g_now;
+}
+
+/*
+ * Network
+ */
+
+static void prv_push(bool toServer,
+                     uint8_t * buffer,
+                     size_t length)
+{
+    datagram_t * datagramP;
+
+    datagramP = (datagram_t *)malloc(sizeof(datagram_t) + length);
+    if (datagramP == NULL) return;
+    datagramP->next = NULL;
+    datagramP->toServer = toServer;
+    datagramP->length = length;
+    memcpy(datagramP->data, buffer, length);
+
+    *g_lastP = datagramP;
+    g_lastP = &datagramP->next;
+}
+
+static uint8_t prv_client_send(void * sessionH,
+                               uint8_t * buffer,
+                               size_t length,
+                               void * userData)
+{
+    coap_packet_t message[1];
+
+    if (COAP_NO_ERROR == coap_parse_message(message, buffer, (uint16_t)length))
+    {
+        if (message->code == COAP_205_CONTENT
+         && message->payload_len <= sizeof(g_sent))
+        {
+            memcpy(g_sent, message->payload, message->payload_len);
+            g_sentLength = message->payload_len;
+        }
+        else if (message->code == COAP_203_VALID)
+        {
+            g_validCount++;
+        }
+        if (g_dropCode != 0 && message->code == g_dropCode)
+        {
+            coap_free_header(message);
+            return COAP_NO_ERROR;
+        }
+    }
+    coap_free_header(message);
+
+    prv_push(true, buffer, length);
+    return COAP_NO_ERROR;
+}
+
+static uint8_t prv_server_send(void * sessionH,
+                               uint8_t * buffer,
+                               size_t length,
+                               void * userData)
+{
+    prv_push(false, buffer, length);
+    return COAP_NO_ERROR;
+}
+
+static void * prv_connect_server(uint16_t serverID,
+                                 void * userData)
+{
+    return &g_session;
+}
+
+// deliver the datagrams until both contexts are idle
+static void prv_run(void)
+{
+    struct timeval tv;
+
+    do
+    {
+        while (g_firstP != NULL)
+        {
+            datagram_t * datagramP = g_firstP;
+
+            g_firstP = datagramP->next;
+            if (g_firstP == NULL) g_lastP = &g_firstP;
+            lwm2m_handle_packet(datagramP->toServer ? g_serverP : g_clientP, datagramP->data, (int)datagramP->length, &g_session);
+            free(datagramP);
+        }
+        tv.tv_sec = 60;
+        tv.tv_usec = 0;
+        lwm2m_step(g_clientP, &tv);
+        tv.tv_sec = 60;
+        tv.tv_usec = 0;
+        lwm2m_step(g_serverP, &tv);
+    } while (g_firstP != NULL);
+}
+
+/*
+ * Test object: a string with characters escaped in JSON and an opaque value
+ */
+
+// lwm2m_list_find() stops at the first higher ID
+static bool prv_has_instance(lwm2m_object_t * objectP,
+                             uint16_t instanceId)
+{
+    lwm2m_list_t * instanceP;
+
+    for (instanceP = objectP->instanceList ; instanceP != NULL ; instanceP = instanceP->next)
+    {
+        if (instanceP->id == instanceId) return true;
+    }
+
+    return false;
+}
+
+static uint8_t prv_read(uint16_t instanceId,
+                        int * numDataP,
+                        lwm2m_tlv_t ** dataArrayP,
+                        lwm2m_object_t * objectP)
+{
+    static uint8_t opaque[] = {0x00, 0xFF, 0x10, 0x20};
+    int i;
+
+    if (!prv_has_instance(objectP, instanceId)) return COAP_404_NOT_FOUND;
+    // answered later with lwm2m_complete_request()
+    if (instanceId == PENDING_INSTANCE_ID) return COAP_PENDING;
+
+    if (*numDataP == 0)
+    {
+        *dataArrayP = lwm2m_tlv_new(2);
+        if (*dataArrayP == NULL) return COAP_500_INTERNAL_SERVER_ERROR;
+        *numDataP = 2;
+        (*dataArrayP)[0].id = 0;
+        (*dataArrayP)[1].id = 1;
+    }
+
+    for (i = 0 ; i < *numDataP ; i++)
+    {
+        lwm2m_tlv_t * tlvP = *dataArrayP + i;
+
+        tlvP->type = LWM2M_TYPE_RESSOURCE;
+        tlvP->flags |= LWM2M_TLV_FLAG_STATIC_DATA;
+        switch (tlvP->id)
+        {
+        case 0:
+            tlvP->dataType = LWM2M_DATA_STRING;
+            tlvP->value = (uint8_t *)"a\"b\\c";
+            tlvP->length = 5;
+            break;
+        case 1:
+            tlvP->dataType = LWM2M_DATA_OPAQUE;
+            tlvP->value = opaque;
+            tlvP->length = sizeof(opaque);
+            break;
+        default:
+            return COAP_404_NOT_FOUND;
+        }
+    }
+
+    return COAP_205_CONTENT;
+}
+
+static lwm2m_object_t * prv_get_test_object(uint16_t * idArray,
+                                            int count)
+{
+    lwm2m_object_t * objectP;
+    int i;
+
+    objectP = (lwm2m_object_t *)malloc(sizeof(lwm2m_object_t));
+    if (objectP == NULL) return NULL;
+    memset(objectP, 0, sizeof(lwm2m_object_t));
+    objectP->objID = TEST_OBJECT_ID;
+    objectP->readFunc = prv_read;
+
+    // appended in the given order, which may not be sorted
+    for (i = count - 1 ; i >= 0 ; i--)
+    {
+        prv_instance_t * instanceP;
+
+        instanceP = (prv_instance_t *)malloc(sizeof(prv_instance_t));
+        if (instanceP == NULL) return NULL;
+        instanceP->id = idArray[i];
+        instanceP->next = objectP->instanceList;
+        objectP->instanceList = (lwm2m_list_t *)instanceP;
+    }
+
+    return objectP;
+}
+
+/*
+ * Server side
+ */
+
+static void prv_monitor_callback(uint16_t clientID,
+                                 lwm2m_uri_t * uriP,
+                                 int status,
+                                 lwm2m_media_type_t format,
+                                 uint8_t * data,
+                                 int dataLength,
+                                 void * userData)
+{
+    if (status == COAP_201_CREATED) g_clientID = clientID;
+}
+
+static void prv_result_callback(uint16_t clientID,
+                                lwm2m_uri_t * uriP,
+                                int status,
+                                lwm2m_media_type_t format,
+                                uint8_t * data,
+                                int dataLength,
+                                void * userData)
+{
+    result_t * resultP = (result_t *)userData;
+
+    resultP->status = status;
+    resultP->length = dataLength;
+    free(resultP->data);
+    resultP->data = (uint8_t *)malloc(dataLength > 0 ? dataLength : 1);
+    if (resultP->data != NULL) memcpy(resultP->data, data, dataLength);
+}
+
+static void prv_read_uri(const char * uriString,
+                         result_t * resultP)
+{
+    lwm2m_uri_t uri;
+
+    resultP->status = 0;
+    lwm2m_stringToUri((char *)uriString, strlen(uriString), &uri);
+    lwm2m_dm_read(g_serverP, g_clientID, &uri, prv_result_callback, resultP);
+    prv_run();
+}
+
+/*
+ * Checks
+ */
+
+// the registration payload is sent with Block1 when it does not fit in a datagram
+static void prv_check_registration_blocks(void)
+{
+    lwm2m_client_object_t * objectP;
+    lwm2m_list_t * instanceP = NULL;
+
+    for (objectP = g_serverP->clientList->objectList ; objectP != NULL ; objectP = objectP->next)
+    {
+        if (objectP->id == TEST_OBJECT_ID) break;
+    }
+    if (objectP != NULL)
+    {
+        for (instanceP = objectP->instanceList ; instanceP != NULL ; instanceP = instanceP->next)
+        {
+            if (instanceP->id == 2) break;
+        }
+    }
+    prv_check("registration_blocks", instanceP != NULL);
+}
+
+// the value cache must not alter the payload given to the callbacks
+static void prv_check_cache_payload(void)
+{
+    lwm2m_client_t * clientP;
+    result_t result;
+
+    memset(&result, 0, sizeof(result));
+    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)g_serverP->clientList, g_clientID);
+    if (clientP == NULL)
+    {
+        prv_check("cache_payload", false);
+        return;
+    }
+    clientP->format = LWM2M_CONTENT_SENML_JSON;
+
+    prv_read_uri("/31024/2", &result);
+    prv_check("cache_payload_read",
+              result.status == COAP_205_CONTENT
+              && result.length == (int)g_sentLength
+              && 0 == memcmp(result.data, g_sent, g_sentLength));
+
+    // answered 2.03 and replaced by the kept response
+    prv_read_uri("/31024/2", &result);
+    prv_check("cache_payload_validated",
+              result.status == COAP_205_CONTENT
+              && result.length > 0
+              && result.length == (int)g_sentLength
+              && 0 == memcmp(result.data, g_sent, g_sentLength));
+
+    clientP->format = LWM2M_CONTENT_TEXT;
+    free(result.data);
+}
+
+// reads are validated with their ETag when the value cache is disabled
+static void prv_check_etag_without_cache(void)
+{
+    result_t first;
+    result_t second;
+    int validCount;
+
+    memset(&first, 0, sizeof(first));
+    memset(&second, 0, sizeof(second));
+    lwm2m_set_cache_max_age(g_serverP, 0);
+
+    prv_read_uri("/31024/40", &first);
+    validCount = g_validCount;
+    prv_read_uri("/31024/40", &second);
+    prv_check("etag_without_cache",
+              first.status == COAP_205_CONTENT
+              && second.status == COAP_205_CONTENT
+              && g_validCount == validCount + 1
+              && second.length == first.length
+              && 0 == memcmp(second.data, first.data, first.length));
+
+    lwm2m_set_cache_max_age(g_serverP, 60);
+    free(first.data);
+    free(second.data);
+}
+
+// a notification larger than a block reaches the observe callback whole
+static void prv_check_notify_blocks(void)
+{
+    lwm2m_client_t * clientP;
+    lwm2m_uri_t uri;
+    result_t read;
+    result_t notify;
+
+    memset(&read, 0, sizeof(read));
+    memset(&notify, 0, sizeof(notify));
+    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)g_serverP->clientList, g_clientID);
+    if (clientP == NULL)
+    {
+        prv_check("notify_blocks", false);
+        return;
+    }
+    clientP->format = LWM2M_CONTENT_SENML_JSON;
+
+    prv_read_uri("/31024/40", &read);
+    lwm2m_stringToUri("/31024/40", strlen("/31024/40"), &uri);
+    lwm2m_observe(g_serverP, g_clientID, &uri, prv_result_callback, &notify);
+    prv_run();
+
+    lwm2m_set_packet_size(g_clientP, COAP_MAX_HEADER_SIZE + 16, 16);
+    notify.status = -1;
+    lwm2m_resource_value_changed(g_clientP, &uri);
+    prv_run();
+    prv_check("notify_blocks",
+              notify.status >= 0
+              && read.length > 16
+              && notify.length == read.length
+              && 0 == memcmp(notify.data, read.data, read.length));
+
+    lwm2m_set_packet_size(g_clientP, LWM2M_DEFAULT_PACKET_SIZE, LWM2M_DEFAULT_BLOCK_SIZE);
+    lwm2m_observe_cancel(g_serverP, g_clientID, &uri, prv_result_callback, &notify);
+    clientP->format = LWM2M_CONTENT_TEXT;
+    free(read.data);
+    free(notify.data);
+}
+
+// cached values and kept responses expire while the lists are not walked at every step
+static void prv_check_cache_expiry(void)
+{
+    lwm2m_client_t * clientP;
+    result_t result;
+
+    memset(&result, 0, sizeof(result));
+    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)g_serverP->clientList, g_clientID);
+    if (clientP == NULL)
+    {
+        prv_check("cache_expiry", false);
+        return;
+    }
+
+    prv_read_uri("/31024/2", &result);
+    prv_check("cache_expiry_kept",
+              clientP->cacheList != NULL
+              && clientP->responseList != NULL
+              && g_serverP->cacheExpiry > (time_t)(g_now / 1000));
+
+    g_now += 61000;
+    prv_run();
+    prv_check("cache_expiry",
+              clientP->cacheList == NULL
+              && clientP->responseList == NULL
+              && g_serverP->cacheExpiry == 0);
+
+    free(result.data);
+}
+
+// layouts are found again after their hash table grows
+static void prv_check_layout_table(void)
+{
+    lwm2m_client_layout_t * layoutArray[100];
+    char payload[16];
+    bool success = true;
+    int length;
+    int i;
+
+    for (i = 0 ; i < 100 ; i++)
+    {
+        length = snprintf(payload, sizeof(payload), "</%d/0>", 1000 + i);
+        layoutArray[i] = layout_acquire(g_serverP, (uint8_t *)payload, (uint16_t)length);
+        if (layoutArray[i] == NULL) success = false;
+    }
+    for (i = 0 ; i < 100 && success ; i++)
+    {
+        length = snprintf(payload, sizeof(payload), "</%d/0>", 1000 + i);
+        if (layout_acquire(g_serverP, (uint8_t *)payload, (uint16_t)length) != layoutArray[i]) success = false;
+        layout_release(g_serverP, layoutArray[i]);
+    }
+    for (i = 0 ; i < 100 ; i++)
+    {
+        layout_release(g_serverP, layoutArray[i]);
+    }
+    prv_check("layout_table", success);
+}
+
+// a duration longer than the clock reading dumps the whole trace
+static void prv_check_trace_duration(void)
+{
+    lwm2m_trace_record_t records[16];
+    uint32_t count;
+
+    count = lwm2m_trace_dump(g_serverP, 0, records, 16);
+    prv_check("trace_duration",
+              count > 0
+              && lwm2m_trace_dump(g_serverP, 0xFFFFFFFF, records, 16) == count);
+}
+
+// a separate response never acknowledged is counted
+static void prv_check_lost_response(void)
+{
+    lwm2m_stats_t stats;
+    lwm2m_uri_t uri;
+    result_t result;
+    int i;
+
+    memset(&result, 0, sizeof(result));
+    // acknowledged with an empty ACK
+    prv_read_uri("/31024/7", &result);
+
+    g_dropCode = COAP_404_NOT_FOUND;
+    lwm2m_stringToUri("/31024/7", strlen("/31024/7"), &uri);
+    lwm2m_complete_request(g_clientP, &uri, COAP_404_NOT_FOUND, 0, NULL);
+    // until the server gives up waiting for the response
+    for (i = 0 ; i < 30 && result.status == 0 ; i++)
+    {
+        g_now += 15000;
+        prv_run();
+    }
+    g_dropCode = 0;
+
+    lwm2m_get_stats(g_clientP, &stats);
+    prv_check("lost_response", stats.lostResponses == 1 && result.status != 0);
+
+    free(result.data);
+}
+
+// plain text floats keep their sign through a round trip
+static void prv_check_float_round_trip(void)
+{
+    double values[] = {-0.0, 0.0, -1.5, 1e-300, -2.5e300, 0.1};
+    char buffer[64];
+    bool success = true;
+    size_t i;
+
+    for (i = 0 ; i < sizeof(values) / sizeof(values[0]) ; i++)
+    {
+        double value;
+        int length;
+
+        length = lwm2m_float64ToPlainTextBuffer(values[i], buffer, sizeof(buffer));
+        if (length <= 0
+         || 1 != lwm2m_PlainTextToFloat64(buffer, length, &value)
+         || value != values[i]
+         || signbit(value) != signbit(values[i]))
+        {
+            fprintf(stdout, "  %.*s\n", length > 0 ? length : 0, buffer);
+            success = false;
+        }
+    }
+    prv_check("float_round_trip", success);
+}
+
+// the instance map of an object whose instanceList is not sorted
+static void prv_check_unsorted_instances(void)
+{
+    result_t result;
+
+    memset(&result, 0, sizeof(result));
+
+    prv_read_uri("/31024/40", &result);
+    prv_check("unsorted_instances_last", result.status == COAP_205_CONTENT);
+    prv_read_uri("/31024/2", &result);
+    prv_check("unsorted_instances_first", result.status == COAP_205_CONTENT);
+    prv_read_uri("/31024/3", &result);
+    prv_check("unsorted_instances_missing", result.status == COAP_404_NOT_FOUND);
+
+    free(result.data);
+}
+
+int main(int argc, char *argv[])
+{
+    lwm2m_object_t * objArray[4];
+    uint16_t instances[] = {40, 2, PENDING_INSTANCE_ID};
+
+    // both modes are built in, the server context also needs a connect callback
+    g_serverP = lwm2m_init(prv_connect_server, prv_server_send, NULL);
+    if (g_serverP == NULL) return 1;
+    lwm2m_set_clock_callback(g_serverP, prv_clock, NULL);
+    lwm2m_set_monitoring_callback(g_serverP, prv_monitor_callback, NULL);
+    lwm2m_set_cache_max_age(g_serverP, 60);
+    lwm2m_trace_start(g_serverP, 16);
+
+    objArray[0] = get_security_object(SERVER_ID, "coap://localhost:5683", false);
+    objArray[1] = get_server_object(SERVER_ID, "U", 300, false);
+    objArray[2] = get_object_device();
+    objArray[3] = prv_get_test_object(instances, sizeof(instances) / sizeof(instances[0]));
+    if (objArray[0] == NULL || objArray[1] == NULL || objArray[2] == NULL || objArray[3] == NULL) return 1;
+
+    g_clientP = lwm2m_init(prv_connect_server, prv_client_send, NULL);
+    if (g_clientP == NULL) return 1;
+    lwm2m_set_clock_callback(g_clientP, prv_clock, NULL);
+    if (lwm2m_configure(g_clientP, "regression", NULL, 4, objArray) != 0) return 1;
+    // small enough for the registration payload to be sent in several blocks
+    lwm2m_set_packet_size(g_clientP, COAP_MAX_HEADER_SIZE + 16, 16);
+    lwm2m_start(g_clientP);
+    prv_run();
+    prv_check("registration", g_serverP->clientList != NULL);
+    if (g_serverP->clientList == NULL) return 1;
+    lwm2m_set_packet_size(g_clientP, LWM2M_DEFAULT_PACKET_SIZE, LWM2M_DEFAULT_BLOCK_SIZE);
+    prv_check_registration_blocks();
+
+    prv_check_float_round_trip();
+    prv_check_trace_duration();
+    prv_check_layout_table();
+    prv_check_unsorted_instances();
+    prv_check_cache_payload();
+    prv_check_etag_without_cache();
+    prv_check_notify_blocks();
+    prv_check_cache_expiry();
+    prv_check_lost_response();
+
+    lwm2m_close(g_clientP);
+    lwm2m_close(g_serverP);
+
+    return g_failures;
+}
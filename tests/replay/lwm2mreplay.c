@@ -0,0 +1,217 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Replays the datagrams received in a capture file written by the 'capture'
+ * command of lwm2mserver into a fresh server context.
+ *
+ * The engine runs on a virtual clock set to the time of each datagram, so
+ * that lifetimes and retransmissions expire as they did when capturing.
+ * By default, datagrams are fed as fast as possible. With -p, they are fed
+ * at the recorded pace.
+ */
+
+#include "liblwm2m.h"
+#include "capture.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+// virtual clock in milliseconds, starting at the date the replay starts
+static uint64_t g_start;
+static uint64_t g_now;
+
+static uint32_t g_sent = 0;
+
+int lwm2m_gettimeofday(struct timeval * tv,
+                       void * p)
+{
+    tv->tv_sec = (g_start + g_now) / 1000;
+    tv->tv_usec = ((g_start + g_now) % 1000) * 1000;
+    return 0;
+}
+
+uint64_t lwm2m_gettime_ms(void)
+{
+    return g_start + g_now;
+}
+
+void * lwm2m_malloc(size_t s)
+{
+    return malloc(s);
+}
+
+void lwm2m_free(void * p)
+{
+    free(p);
+}
+
+static uint8_t prv_buffer_send(void * sessionH,
+                               uint8_t * buffer,
+                               size_t length,
+                               void * userdata)
+{
+    g_sent++;
+    return COAP_NO_ERROR;
+}
+
+static uint64_t prv_real_time_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void prv_wait_until(uint64_t realStart,
+                           uint32_t time)
+{
+    uint64_t now;
+
+    now = prv_real_time_ms();
+    if (now < realStart + time)
+    {
+        struct timespec ts;
+        uint64_t delay = realStart + time - now;
+
+        ts.tv_sec = delay / 1000;
+        ts.tv_nsec = (delay % 1000) * 1000000;
+        nanosleep(&ts, NULL);
+    }
+}
+
+void print_usage(void)
+{
+    fprintf(stderr, "Usage: lwm2mreplay [-p] FILE\r\n");
+    fprintf(stderr, "Replay the datagrams received in FILE, captured with the 'capture' command of lwm2mserver.\r\n");
+    fprintf(stderr, "  -p: replay at the recorded pace instead of as fast as possible.\r\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    lwm2m_context_t * lwm2mH;
+    capture_record_t record;
+    lwm2m_stats_t stats;
+    static uint8_t buffer[CAPTURE_MAX_DATAGRAM];
+    char * path = NULL;
+    bool paced = false;
+    FILE * fileP;
+    uint64_t realStart;
+    uint64_t elapsed;
+    uint64_t nextStep;
+    uint32_t received = 0;
+    uint32_t recordedSent = 0;
+    int result;
+    int i;
+
+    for (i = 1 ; i < argc ; i++)
+    {
+        if (strcmp(argv[i], "-p") == 0)
+        {
+            paced = true;
+        }
+        else if (path == NULL)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+    if (path == NULL)
+    {
+        print_usage();
+        return 1;
+    }
+
+    fileP = fopen(path, "rb");
+    if (fileP == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\r\n", path);
+        return 1;
+    }
+    if (capture_read_header(fileP) != 0)
+    {
+        fprintf(stderr, "%s is not a capture file\r\n", path);
+        fclose(fileP);
+        return 1;
+    }
+
+    realStart = prv_real_time_ms();
+    g_start = (uint64_t)time(NULL) * 1000;
+    g_now = 0;
+
+    lwm2mH = lwm2m_init(NULL, prv_buffer_send, NULL);
+    if (NULL == lwm2mH)
+    {
+        fprintf(stderr, "lwm2m_init() failed\r\n");
+        fclose(fileP);
+        return 1;
+    }
+
+    nextStep = 0;
+    while (1 == (result = capture_read(fileP, &record, buffer)))
+    {
+        if (record.sent)
+        {
+            recordedSent++;
+            continue;
+        }
+
+        if (paced) prv_wait_until(realStart, record.time);
+        g_now = record.time;
+
+        // let lifetimes and retransmissions expire before this datagram
+        if (g_now >= nextStep)
+        {
+            struct timeval tv = {60, 0};
+
+            lwm2m_step(lwm2mH, &tv);
+            nextStep = g_now + (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+        }
+
+        // sessions are only compared by the engine
+        lwm2m_handle_packet(lwm2mH, buffer, record.length, (void *)(uintptr_t)(record.session + 1));
+        received++;
+    }
+    elapsed = prv_real_time_ms() - realStart;
+    fclose(fileP);
+
+    if (result < 0)
+    {
+        fprintf(stderr, "Truncated capture file after %u datagrams\r\n", received);
+    }
+
+    lwm2m_get_stats(lwm2mH, &stats);
+    fprintf(stdout, "%u datagrams replayed in %llu ms", received, (unsigned long long)elapsed);
+    if (elapsed != 0)
+    {
+        fprintf(stdout, " (%llu datagrams/s)", (unsigned long long)received * 1000 / elapsed);
+    }
+    fprintf(stdout, "\r\n");
+    fprintf(stdout, "%u datagrams sent, %u in the capture\r\n", g_sent, recordedSent);
+    fprintf(stdout, "%u parse failures, %u clients registered at the end\r\n", stats.parseFailures, stats.clients);
+
+    lwm2m_close(lwm2mH);
+
+    return result < 0 ? 1 : 0;
+}
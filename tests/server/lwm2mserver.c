@@ -66,13 +66,21 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <signal.h>
+#include <inttypes.h>
+#include <time.h>
 
 #include "commandline.h"
 #include "connection.h"
+#include "capture.h"
 
-#define MAX_PACKET_SIZE 128
+// large enough for a full CoAP message carrying a REST_MAX_CHUNK_SIZE block
+#define MAX_PACKET_SIZE 2048
+
+// events kept for the 'trace' command
+#define TRACE_SIZE  1024
 
 static int g_quit = 0;
+static capture_t * g_captureP = NULL;
 
 static uint8_t prv_buffer_send(void * sessionH,
                                uint8_t * buffer,
@@ -160,6 +168,113 @@ static void prv_output_clients(char * buffer,
     }
 }
 
+static void prv_output_stats(char * buffer,
+                             void * user_data)
+{
+    lwm2m_context_t * lwm2mH = (lwm2m_context_t *) user_data;
+    lwm2m_stats_t stats;
+    const char * methods[] = {"GET", "POST", "PUT", "DELETE"};
+    int i;
+    int j;
+
+    lwm2m_get_stats(lwm2mH, &stats);
+
+    fprintf(stdout, "Packets\t\tCON\tNON\tACK\tRST\r\n");
+    fprintf(stdout, "  received\t%u\t%u\t%u\t%u\r\n", stats.packetsReceived[0], stats.packetsReceived[1], stats.packetsReceived[2], stats.packetsReceived[3]);
+    fprintf(stdout, "  sent\t\t%u\t%u\t%u\t%u\r\n", stats.packetsSent[0], stats.packetsSent[1], stats.packetsSent[2], stats.packetsSent[3]);
+    fprintf(stdout, "Codes\t\t0.xx\t2.xx\t4.xx\t5.xx\r\n");
+    fprintf(stdout, "  received\t%u\t%u\t%u\t%u\r\n", stats.codesReceived[0], stats.codesReceived[2], stats.codesReceived[4], stats.codesReceived[5]);
+    fprintf(stdout, "  sent\t\t%u\t%u\t%u\t%u\r\n", stats.codesSent[0], stats.codesSent[2], stats.codesSent[4], stats.codesSent[5]);
+    fprintf(stdout, "Parse failures: %u, retransmissions: %u, timeouts: %u\r\n", stats.parseFailures, stats.retransmissions, stats.timeouts);
+    fprintf(stdout, "Registrations: %u, updates: %u, deregistrations: %u\r\n", stats.registrations, stats.updates, stats.deregistrations);
+    fprintf(stdout, "Clients: %u, observations: %u, transactions: %u\r\n", stats.clients, stats.observations, stats.transactions);
+
+    for (i = 0 ; i < 4 ; i++)
+    {
+        bool empty = true;
+
+        for (j = 0 ; j < LWM2M_STATS_RTT_BUCKETS ; j++)
+        {
+            if (stats.rtt[i][j] != 0) empty = false;
+        }
+        if (empty) continue;
+
+        fprintf(stdout, "%s round-trip times:\r\n", methods[i]);
+        for (j = 0 ; j < LWM2M_STATS_RTT_BUCKETS ; j++)
+        {
+            if (stats.rtt[i][j] == 0) continue;
+            if (j == 0)
+            {
+                fprintf(stdout, "  < 2 ms\t%u\r\n", stats.rtt[i][j]);
+            }
+            else if (j == LWM2M_STATS_RTT_BUCKETS - 1)
+            {
+                fprintf(stdout, "  >= %u ms\t%u\r\n", 1u << j, stats.rtt[i][j]);
+            }
+            else
+            {
+                fprintf(stdout, "  %u-%u ms\t%u\r\n", 1u << j, (2u << j) - 1, stats.rtt[i][j]);
+            }
+        }
+    }
+}
+
+static void prv_dump_trace(char * buffer,
+                           void * user_data)
+{
+    lwm2m_context_t * lwm2mH = (lwm2m_context_t *) user_data;
+    lwm2m_trace_record_t records[TRACE_SIZE];
+    char path[256];
+    unsigned int duration = 0;
+    uint32_t count;
+    FILE * fileP;
+
+    if (sscanf(buffer, "%255s %u", path, &duration) < 1) goto syntax_error;
+
+    count = lwm2m_trace_dump(lwm2mH, duration, records, TRACE_SIZE);
+
+    fileP = fopen(path, "wb");
+    if (fileP == NULL)
+    {
+        fprintf(stdout, "Cannot open %s\r\n", path);
+        return;
+    }
+    fwrite(records, sizeof(lwm2m_trace_record_t), count, fileP);
+    fclose(fileP);
+
+    fprintf(stdout, "%u events written to %s\r\n", count, path);
+    return;
+
+syntax_error:
+    fprintf(stdout, "Syntax error !");
+}
+
+static void prv_capture(char * buffer,
+                        void * user_data)
+{
+    lwm2m_context_t * lwm2mH = (lwm2m_context_t *) user_data;
+    char path[256];
+
+    if (g_captureP != NULL)
+    {
+        lwm2m_set_capture_callback(lwm2mH, NULL, NULL);
+        capture_close(g_captureP);
+        g_captureP = NULL;
+        fprintf(stdout, "Capture stopped.\r\n");
+    }
+
+    if (sscanf(buffer, "%255s", path) < 1) return;
+
+    g_captureP = capture_open(path);
+    if (g_captureP == NULL)
+    {
+        fprintf(stdout, "Cannot open %s\r\n", path);
+        return;
+    }
+    lwm2m_set_capture_callback(lwm2mH, capture_callback, g_captureP);
+    fprintf(stdout, "Capturing to %s\r\n", path);
+}
+
 static void print_indent(int num)
 {
     int i;
@@ -222,6 +337,84 @@ static void output_tlv(char * buffer,
     }
 }
 
+static int prv_print_senml_record(lwm2m_senml_record_t * recordP,
+                                  void * userData)
+{
+    int indent = *(int *)userData;
+
+    print_indent(indent);
+    fprintf(stdout, "/%d", recordP->uri.objectId);
+    if (LWM2M_URI_IS_SET_INSTANCE((&recordP->uri))) fprintf(stdout, "/%d", recordP->uri.instanceId);
+    if (LWM2M_URI_IS_SET_RESOURCE((&recordP->uri))) fprintf(stdout, "/%d", recordP->uri.resourceId);
+    if (recordP->resourceInstanceId != LWM2M_MAX_ID) fprintf(stdout, "/%d", recordP->resourceInstanceId);
+    if (recordP->time != 0) fprintf(stdout, " @%.3f", recordP->time);
+    fprintf(stdout, ": ");
+
+    switch (recordP->type)
+    {
+    case LWM2M_DATA_INTEGER:
+        fprintf(stdout, "%" PRId64 "\n", recordP->value.asInteger);
+        break;
+    case LWM2M_DATA_FLOAT:
+        fprintf(stdout, "%.17g\n", recordP->value.asFloat);
+        break;
+    case LWM2M_DATA_BOOLEAN:
+        fprintf(stdout, "%s\n", recordP->value.asBoolean ? "true" : "false");
+        break;
+    case LWM2M_DATA_STRING:
+        fprintf(stdout, "\"%.*s\"\n", (int)recordP->value.asBuffer.length, recordP->value.asBuffer.buffer);
+        break;
+    default:
+        fprintf(stdout, "%d bytes\n", (int)recordP->value.asBuffer.length);
+        output_buffer(stdout, recordP->value.asBuffer.buffer, recordP->value.asBuffer.length);
+        break;
+    }
+
+    return 0;
+}
+
+static void prv_output_data(lwm2m_uri_t * uriP,
+                            lwm2m_media_type_t format,
+                            uint8_t * data,
+                            int dataLength,
+                            int indent)
+{
+    switch (format)
+    {
+    case LWM2M_CONTENT_TLV:
+        output_tlv(data, dataLength, indent);
+        break;
+
+    case LWM2M_CONTENT_SENML_JSON:
+        // already in the format expected by consumers, pass it through
+        print_indent(indent);
+        fwrite(data, 1, dataLength, stdout);
+        fprintf(stdout, "\n");
+        break;
+
+    case LWM2M_CONTENT_SENML_CBOR:
+        if (lwm2m_senml_cbor_parse(data, dataLength, prv_print_senml_record, &indent) < 0)
+        {
+            print_indent(indent);
+            fprintf(stdout, "Invalid SenML-CBOR payload:\n");
+            output_buffer(stdout, data, dataLength);
+        }
+        break;
+
+    case LWM2M_CONTENT_TEXT:
+        // TLV payloads are not always tagged
+        if (!LWM2M_URI_IS_SET_RESOURCE(uriP))
+        {
+            output_tlv(data, dataLength, indent);
+            break;
+        }
+        // fall through
+    default:
+        output_buffer(stdout, data, dataLength);
+        break;
+    }
+}
+
 static int prv_read_id(char * buffer,
                        uint16_t * idP)
 {
@@ -247,6 +440,7 @@ static int prv_read_id(char * buffer,
 static void prv_result_callback(uint16_t clientID,
                                 lwm2m_uri_t * uriP,
                                 int status,
+                                lwm2m_media_type_t format,
                                 uint8_t * data,
                                 int dataLength,
                                 void * userData)
@@ -263,14 +457,7 @@ static void prv_result_callback(uint16_t clientID,
     if (data != NULL)
     {
         fprintf(stdout, "%d bytes received:\r\n", dataLength);
-        if (LWM2M_URI_IS_SET_RESOURCE(uriP))
-        {
-            output_buffer(stdout, data, dataLength);
-        }
-        else
-        {
-            output_tlv(data, dataLength, 2);
-        }
+        prv_output_data(uriP, format, data, dataLength, 2);
     }
 
     fprintf(stdout, "\r\n> ");
@@ -280,6 +467,7 @@ static void prv_result_callback(uint16_t clientID,
 static void prv_notify_callback(uint16_t clientID,
                                 lwm2m_uri_t * uriP,
                                 int count,
+                                lwm2m_media_type_t format,
                                 uint8_t * data,
                                 int dataLength,
                                 void * userData)
@@ -296,7 +484,7 @@ static void prv_notify_callback(uint16_t clientID,
     if (data != NULL)
     {
         fprintf(stdout, "%d bytes received:\r\n", dataLength);
-        output_buffer(stdout, data, dataLength);
+        prv_output_data(uriP, format, data, dataLength, 2);
     }
 
     fprintf(stdout, "\r\n> ");
@@ -336,6 +524,47 @@ syntax_error:
     fprintf(stdout, "Syntax error !");
 }
 
+static void prv_cache_client(char * buffer,
+                             void * user_data)
+{
+    lwm2m_context_t * lwm2mH = (lwm2m_context_t *) user_data;
+    uint16_t clientId;
+    lwm2m_uri_t uri;
+    lwm2m_tlv_t * tlvP;
+    time_t receivedTime;
+    char * tlvBuffer;
+    int result;
+
+    result = prv_read_id(buffer, &clientId);
+    if (result != 1) goto syntax_error;
+
+    buffer = get_next_arg(buffer);
+    if (buffer[0] == 0) goto syntax_error;
+
+    result = lwm2m_stringToUri(buffer, strlen(buffer), &uri);
+    if (result == 0) goto syntax_error;
+
+    result = lwm2m_cache_read(lwm2mH, clientId, &uri, &tlvP, &receivedTime);
+    if (result != COAP_205_CONTENT)
+    {
+        fprintf(stdout, "Error %d.%2d", (result&0xE0)>>5, result&0x1F);
+        return;
+    }
+
+    fprintf(stdout, "Received %ld seconds ago:\r\n", (long)(time(NULL) - receivedTime));
+    result = lwm2m_tlv_serialize(1, tlvP, &tlvBuffer);
+    if (result > 0)
+    {
+        output_tlv(tlvBuffer, result, 2);
+        lwm2m_free(tlvBuffer);
+    }
+    lwm2m_tlv_free(1, tlvP);
+    return;
+
+syntax_error:
+    fprintf(stdout, "Syntax error !");
+}
+
 static void prv_write_client(char * buffer,
                              void * user_data)
 {
@@ -364,7 +593,7 @@ static void prv_write_client(char * buffer,
     result = lwm2m_stringToUri(uriString, i, &uri);
     if (result == 0) goto syntax_error;
 
-    result = lwm2m_dm_write(lwm2mH, clientId, &uri, buffer, strlen(buffer), prv_result_callback, NULL);
+    result = lwm2m_dm_write(lwm2mH, clientId, &uri, LWM2M_CONTENT_TEXT, buffer, strlen(buffer), prv_result_callback, NULL);
 
     if (result == 0)
     {
@@ -479,7 +708,7 @@ static void prv_create_client(char * buffer,
    /* End Client dependent part*/
 
     //Create
-    result = lwm2m_dm_create(lwm2mH, clientId,&uri, temp_buffer, temp_length, prv_result_callback, NULL);
+    result = lwm2m_dm_create(lwm2mH, clientId, &uri, LWM2M_CONTENT_TLV, temp_buffer, temp_length, prv_result_callback, NULL);
 
     if (result == 0)
     {
@@ -528,6 +757,55 @@ syntax_error:
     fprintf(stdout, "Syntax error !");
 }
 
+static void prv_format_client(char * buffer,
+                              void * user_data)
+{
+    lwm2m_context_t * lwm2mH = (lwm2m_context_t *) user_data;
+    lwm2m_client_t * clientP;
+    uint16_t clientId;
+    int result;
+
+    result = prv_read_id(buffer, &clientId);
+    if (result != 1) goto syntax_error;
+
+    buffer = get_next_arg(buffer);
+    if (buffer[0] == 0) goto syntax_error;
+
+    clientP = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)lwm2mH->clientList, clientId);
+    if (clientP == NULL)
+    {
+        fprintf(stdout, "Unknown client #%d", clientId);
+        return;
+    }
+
+    if (strncmp(buffer, "default", 7) == 0)
+    {
+        clientP->format = LWM2M_CONTENT_TEXT;
+    }
+    else if (strncmp(buffer, "tlv", 3) == 0)
+    {
+        clientP->format = LWM2M_CONTENT_TLV;
+    }
+    else if (strncmp(buffer, "json", 4) == 0)
+    {
+        clientP->format = LWM2M_CONTENT_SENML_JSON;
+    }
+    else if (strncmp(buffer, "cbor", 4) == 0)
+    {
+        clientP->format = LWM2M_CONTENT_SENML_CBOR;
+    }
+    else
+    {
+        goto syntax_error;
+    }
+
+    fprintf(stdout, "OK");
+    return;
+
+syntax_error:
+    fprintf(stdout, "Syntax error !");
+}
+
 static void prv_observe_client(char * buffer,
                                void * user_data)
 {
@@ -597,6 +875,7 @@ syntax_error:
 static void prv_monitor_callback(uint16_t clientID,
                                  lwm2m_uri_t * uriP,
                                  int status,
+                                 lwm2m_media_type_t format,
                                  uint8_t * data,
                                  int dataLength,
                                  void * userData)
@@ -668,10 +947,19 @@ int main(int argc, char *argv[])
     command_desc_t commands[] =
     {
             {"list", "List registered clients.", NULL, prv_output_clients, NULL},
+            {"stats", "Show the statistics of the server.", NULL, prv_output_stats, NULL},
+            {"capture", "Capture the datagrams to a file.", " capture [FILE]\r\n"
+                                            "   FILE: file to write, to replay with lwm2mreplay. Without FILE, stops capturing.\r\n", prv_capture, NULL},
+            {"trace", "Write the last events to a file.", " trace FILE [SECONDS]\r\n"
+                                            "   FILE: file to write, to read with tracedecode\r\n"
+                                            "   SECONDS: only write the events of the last SECONDS seconds\r\n", prv_dump_trace, NULL},
             {"read", "Read from a client.", " read CLIENT# URI\r\n"
                                             "   CLIENT#: client number as returned by command 'list'\r\n"
                                             "   URI: uri to read such as /3, /3//2, /3/0/2, /1024/11, /1024//1\r\n"
                                             "Result will be displayed asynchronously.", prv_read_client, NULL},
+            {"cache", "Show the last known value of a client resource.", " cache CLIENT# URI\r\n"
+                                            "   CLIENT#: client number as returned by command 'list'\r\n"
+                                            "   URI: uri of a resource read or observed less than a minute ago such as /3/0/13\r\n", prv_cache_client, NULL},
             {"write", "Write to a client.", " write CLIENT# URI DATA\r\n"
                                             "   CLIENT#: client number as returned by command 'list'\r\n"
                                             "   URI: uri to write to such as /3, /3//2, /3/0/2, /1024/11, /1024//1\r\n"
@@ -690,6 +978,10 @@ int main(int argc, char *argv[])
                                             "   URI: uri to which create the Object Instance such as /1024, /1024/45 \r\n"
                                             "   DATA: data to initialize the new Object Instance (0-255 for object 1024) \r\n"
                                             "Result will be displayed asynchronously.", prv_create_client, NULL},
+            {"format", "Set the content format requested from a client.", " format CLIENT# FORMAT\r\n"
+                                            "   CLIENT#: client number as returned by command 'list'\r\n"
+                                            "   FORMAT: default, tlv, json (SenML-JSON) or cbor (SenML-CBOR)\r\n"
+                                            "Applies to the next reads and observations.", prv_format_client, NULL},
             {"observe", "Observe from a client.", " observe CLIENT# URI\r\n"
                                             "   CLIENT#: client number as returned by command 'list'\r\n"
                                             "   URI: uri to observe such as /3, /3/0/2, /1024/11\r\n"
@@ -720,6 +1012,10 @@ int main(int argc, char *argv[])
 
     signal(SIGINT, handle_sigint);
 
+    // answer the 'cache' command with values read or notified in the last minute
+    lwm2m_set_cache_max_age(lwm2mH, 60);
+    lwm2m_trace_start(lwm2mH, TRACE_SIZE);
+
     for (i = 0 ; commands[i].name != NULL ; i++)
     {
         commands[i].userData = (void *)lwm2mH;
@@ -824,6 +1120,7 @@ int main(int argc, char *argv[])
     lwm2m_close(lwm2mH);
     close(sock);
     connection_free(connList);
+    if (g_captureP != NULL) capture_close(g_captureP);
 
     return 0;
 }
@@ -0,0 +1,535 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Discrete-event simulation of a server and many clients.
+ *
+ * All the contexts share a virtual clock set with lwm2m_set_clock_callback().
+ * Datagrams and lwm2m_step() calls are events in a queue ordered by date.
+ * The clock jumps from one event to the next: a context is only stepped at
+ * the deadline reported by its previous lwm2m_step(), or shortly after it
+ * received a datagram, so idle periods cost nothing.
+ *
+ * Datagrams are delivered after a fixed latency and may be dropped, which
+ * exercises retransmissions, registration updates and lifetime expiries.
+ * The random generator is seeded from the command line: two runs with the
+ * same options process the same events.
+ */
+
+#include "liblwm2m.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+
+#define SERVER_ID       123
+// virtual date of the start of the simulation in milliseconds
+#define START_DATE      1000000000000ULL
+// longest time between two lwm2m_step() of a context in milliseconds
+#define MAX_STEP        86400000
+
+extern lwm2m_object_t * get_object_device();
+extern lwm2m_object_t * get_server_object();
+extern lwm2m_object_t * get_security_object();
+
+// a context of the simulation, the server or a client
+typedef struct
+{
+    lwm2m_context_t *   contextP;
+    uint64_t            stepTime;   // date of the next lwm2m_step()
+    uint64_t            stepSeq;    // sequence number of the event of the next lwm2m_step()
+    bool                started;
+} node_t;
+
+typedef struct
+{
+    node_t *    toP;        // receiving node
+    node_t *    sessionH;   // the client node on both sides
+    size_t      length;
+    uint8_t     data[];
+} datagram_t;
+
+// an lwm2m_step() of nodeP if datagramP is NULL, a delivery otherwise
+typedef struct
+{
+    uint64_t        time;
+    uint64_t        seq;
+    node_t *        nodeP;
+    datagram_t *    datagramP;
+} event_t;
+
+typedef struct
+{
+    uint32_t    clients;
+    uint32_t    duration;   // simulated seconds
+    uint32_t    lifetime;
+    uint32_t    latency;    // one-way, in milliseconds
+    uint32_t    loss;       // percentage of datagrams dropped
+    uint32_t    tick;       // delay of the lwm2m_step() following a datagram, in milliseconds
+    uint32_t    window;     // clients start within this many seconds
+    uint32_t    interval;   // reporting interval in simulated seconds
+    uint64_t    seed;
+} options_t;
+
+static options_t g_options = {10000, 7 * 86400, 86400, 50, 0, 1000, 60, 86400, 1};
+
+// virtual clock in milliseconds
+static uint64_t g_now = START_DATE;
+
+static event_t * g_events = NULL;
+static uint32_t g_eventCount = 0;
+static uint32_t g_eventSize = 0;
+static uint64_t g_eventSeq = 0;
+
+static node_t g_server;
+static node_t * g_clients = NULL;
+
+static uint64_t g_random;
+
+// counters of the current reporting interval
+static uint64_t g_processed = 0;
+static uint64_t g_serverSteps = 0;
+static uint64_t g_clientSteps = 0;
+static uint64_t g_delivered = 0;
+static uint64_t g_dropped = 0;
+static uint32_t g_registered = 0;
+static uint32_t g_removed = 0;
+
+static uint64_t prv_clock(void * userData)
+{
+    return g_now;
+}
+
+// xorshift64*
+static uint32_t prv_random(void)
+{
+    g_random ^= g_random >> 12;
+    g_random ^= g_random << 25;
+    g_random ^= g_random >> 27;
+    return (uint32_t)((g_random * 2685821657736338717ULL) >> 32);
+}
+
+static uint64_t prv_wall_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Event queue, a binary min-heap on (time, seq)
+ */
+
+static bool prv_before(event_t * leftP,
+                       event_t * rightP)
+{
+    if (leftP->time != rightP->time) return leftP->time < rightP->time;
+    return leftP->seq < rightP->seq;
+}
+
+static void prv_push(uint64_t time,
+                     node_t * nodeP,
+                     datagram_t * datagramP)
+{
+    event_t event;
+    uint32_t i;
+
+    if (g_eventCount == g_eventSize)
+    {
+        event_t * eventsP;
+
+        eventsP = (event_t *)realloc(g_events, (g_eventSize + 1024) * 2 * sizeof(event_t));
+        if (eventsP == NULL)
+        {
+            fprintf(stderr, "Out of memory\r\n");
+            exit(1);
+        }
+        g_events = eventsP;
+        g_eventSize = (g_eventSize + 1024) * 2;
+    }
+
+    event.time = time;
+    event.seq = g_eventSeq++;
+    event.nodeP = nodeP;
+    event.datagramP = datagramP;
+
+    i = g_eventCount++;
+    while (i > 0 && prv_before(&event, g_events + (i - 1) / 2))
+    {
+        g_events[i] = g_events[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    g_events[i] = event;
+}
+
+static void prv_pop(event_t * eventP)
+{
+    event_t last;
+    uint32_t i;
+
+    *eventP = g_events[0];
+    last = g_events[--g_eventCount];
+
+    i = 0;
+    while (2 * i + 1 < g_eventCount)
+    {
+        uint32_t child = 2 * i + 1;
+
+        if (child + 1 < g_eventCount && prv_before(g_events + child + 1, g_events + child)) child++;
+        if (!prv_before(g_events + child, &last)) break;
+        g_events[i] = g_events[child];
+        i = child;
+    }
+    g_events[i] = last;
+}
+
+// the previous event of nodeP, if any, becomes stale
+static void prv_schedule(node_t * nodeP,
+                         uint64_t time)
+{
+    nodeP->stepTime = time;
+    nodeP->stepSeq = g_eventSeq;
+    prv_push(time, nodeP, NULL);
+}
+
+/*
+ * Network
+ */
+
+static void prv_send(node_t * toP,
+                     node_t * sessionH,
+                     uint8_t * buffer,
+                     size_t length)
+{
+    datagram_t * datagramP;
+
+    if (prv_random() % 100 < g_options.loss)
+    {
+        g_dropped++;
+        return;
+    }
+
+    datagramP = (datagram_t *)malloc(sizeof(datagram_t) + length);
+    if (datagramP == NULL) return;
+    datagramP->toP = toP;
+    datagramP->sessionH = sessionH;
+    datagramP->length = length;
+    memcpy(datagramP->data, buffer, length);
+
+    prv_push(g_now + g_options.latency, toP, datagramP);
+}
+
+static uint8_t prv_client_send(void * sessionH,
+                               uint8_t * buffer,
+                               size_t length,
+                               void * userData)
+{
+    prv_send(&g_server, (node_t *)sessionH, buffer, length);
+    return COAP_NO_ERROR;
+}
+
+static uint8_t prv_server_send(void * sessionH,
+                               uint8_t * buffer,
+                               size_t length,
+                               void * userData)
+{
+    prv_send((node_t *)sessionH, (node_t *)sessionH, buffer, length);
+    return COAP_NO_ERROR;
+}
+
+static void * prv_connect_server(uint16_t serverID,
+                                 void * userData)
+{
+    // the client node is the session with the server
+    return userData;
+}
+
+static void prv_monitor_callback(uint16_t clientID,
+                                 lwm2m_uri_t * uriP,
+                                 int status,
+                                 lwm2m_media_type_t format,
+                                 uint8_t * data,
+                                 int dataLength,
+                                 void * userData)
+{
+    switch (status)
+    {
+    case COAP_201_CREATED:
+        g_registered++;
+        break;
+
+    case COAP_202_DELETED:
+        g_removed++;
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*
+ * Simulation
+ */
+
+static int prv_client_init(node_t * nodeP,
+                           uint32_t index)
+{
+    lwm2m_object_t * objArray[3];
+    char name[32];
+
+    objArray[0] = get_security_object(SERVER_ID, "coap://localhost:5683", false);
+    objArray[1] = get_server_object(SERVER_ID, "U", g_options.lifetime, false);
+    objArray[2] = get_object_device();
+    if (objArray[0] == NULL || objArray[1] == NULL || objArray[2] == NULL) return -1;
+
+    nodeP->contextP = lwm2m_init(prv_connect_server, prv_client_send, nodeP);
+    if (nodeP->contextP == NULL) return -1;
+    lwm2m_set_clock_callback(nodeP->contextP, prv_clock, NULL);
+
+    snprintf(name, sizeof(name), "sim%06u", index);
+    if (lwm2m_configure(nodeP->contextP, name, NULL, 3, objArray) != 0) return -1;
+
+    return 0;
+}
+
+static void prv_step(node_t * nodeP)
+{
+    struct timeval tv = {MAX_STEP / 1000, 0};
+    uint64_t interval;
+
+    if (!nodeP->started)
+    {
+        // sends the registration
+        lwm2m_start(nodeP->contextP);
+        nodeP->started = true;
+    }
+    lwm2m_step(nodeP->contextP, &tv);
+
+    interval = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    if (interval == 0) interval = 1;
+    prv_schedule(nodeP, g_now + interval);
+}
+
+static void prv_deliver(datagram_t * datagramP)
+{
+    node_t * nodeP = datagramP->toP;
+
+    lwm2m_handle_packet(nodeP->contextP, datagramP->data, datagramP->length, datagramP->sessionH);
+    g_delivered++;
+
+    // the datagram may have changed the deadlines of the node
+    if (nodeP->stepTime > g_now + g_options.tick)
+    {
+        prv_schedule(nodeP, g_now + g_options.tick);
+    }
+}
+
+static void prv_report(uint64_t wallTime)
+{
+    lwm2m_stats_t stats;
+    uint32_t clients;
+
+    lwm2m_get_stats(g_server.contextP, &stats);
+    clients = stats.clients;
+
+    fprintf(stdout, "%8.2f h %8u %10u %10u %10u %12llu %10llu %10llu %10llu %10llu %8.3f\r\n",
+            (g_now - START_DATE) / 3600000.0,
+            clients,
+            g_registered,
+            stats.updates,
+            g_removed - stats.deregistrations,
+            (unsigned long long)g_delivered,
+            (unsigned long long)g_dropped,
+            (unsigned long long)g_serverSteps,
+            (unsigned long long)g_clientSteps,
+            (unsigned long long)g_processed,
+            wallTime / 1000.0);
+    fflush(stdout);
+
+    lwm2m_reset_stats(g_server.contextP);
+    g_registered = 0;
+    g_removed = 0;
+    g_delivered = 0;
+    g_dropped = 0;
+    g_serverSteps = 0;
+    g_clientSteps = 0;
+    g_processed = 0;
+}
+
+void print_usage(void)
+{
+    fprintf(stderr, "Usage: lwm2msim [OPTIONS]\r\n");
+    fprintf(stderr, "Simulate a LWM2M server and many clients on a virtual clock.\r\n");
+    fprintf(stderr, "  -c CLIENTS\tnumber of clients (default %u)\r\n", g_options.clients);
+    fprintf(stderr, "  -d SECONDS\tsimulated duration (default %u)\r\n", g_options.duration);
+    fprintf(stderr, "  -l SECONDS\tregistration lifetime (default %u)\r\n", g_options.lifetime);
+    fprintf(stderr, "  -L MS\t\tone-way latency (default %u)\r\n", g_options.latency);
+    fprintf(stderr, "  -x PERCENT\tdatagrams dropped (default %u)\r\n", g_options.loss);
+    fprintf(stderr, "  -k MS\t\tdelay of the step following a datagram (default %u)\r\n", g_options.tick);
+    fprintf(stderr, "  -w SECONDS\tclients start within this window (default %u)\r\n", g_options.window);
+    fprintf(stderr, "  -i SECONDS\treporting interval (default %u)\r\n", g_options.interval);
+    fprintf(stderr, "  -s SEED\trandom seed (default %llu)\r\n\n", (unsigned long long)g_options.seed);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t end;
+    uint64_t nextReport;
+    uint64_t wallStart;
+    uint64_t wallReport;
+    uint32_t i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:d:l:L:x:k:w:i:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            g_options.clients = atoi(optarg);
+            break;
+        case 'd':
+            g_options.duration = atoi(optarg);
+            break;
+        case 'l':
+            g_options.lifetime = atoi(optarg);
+            break;
+        case 'L':
+            g_options.latency = atoi(optarg);
+            break;
+        case 'x':
+            g_options.loss = atoi(optarg);
+            break;
+        case 'k':
+            g_options.tick = atoi(optarg);
+            break;
+        case 'w':
+            g_options.window = atoi(optarg);
+            break;
+        case 'i':
+            g_options.interval = atoi(optarg);
+            break;
+        case 's':
+            g_options.seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            print_usage();
+            return 1;
+        }
+    }
+    if (g_options.clients == 0 || g_options.clients > LWM2M_MAX_ID
+     || g_options.interval == 0 || g_options.loss > 100)
+    {
+        print_usage();
+        return 1;
+    }
+    g_random = g_options.seed != 0 ? g_options.seed : 1;
+
+    g_server.contextP = lwm2m_init(prv_connect_server, prv_server_send, NULL);
+    if (g_server.contextP == NULL)
+    {
+        fprintf(stderr, "lwm2m_init() failed\r\n");
+        return 1;
+    }
+    lwm2m_set_clock_callback(g_server.contextP, prv_clock, NULL);
+    lwm2m_set_monitoring_callback(g_server.contextP, prv_monitor_callback, NULL);
+    g_server.started = true;
+    prv_schedule(&g_server, g_now);
+
+    g_clients = (node_t *)calloc(g_options.clients, sizeof(node_t));
+    if (g_clients == NULL) return 1;
+    for (i = 0 ; i < g_options.clients ; i++)
+    {
+        if (prv_client_init(g_clients + i, i) != 0)
+        {
+            fprintf(stderr, "Failed to create client %u\r\n", i);
+            return 1;
+        }
+        // lwm2m_init() seeds rand() with the time
+        g_clients[i].contextP->nextMID = (uint16_t)prv_random();
+        prv_schedule(g_clients + i, g_now + prv_random() % ((uint64_t)g_options.window * 1000 + 1));
+    }
+    g_server.contextP->nextMID = (uint16_t)prv_random();
+    // retransmission timeouts are drawn with rand()
+    srand((unsigned int)g_options.seed);
+
+    fprintf(stdout, "    time  clients registered    updates    expired    datagrams    dropped server steps client steps   events  wall (s)\r\n");
+
+    end = g_now + (uint64_t)g_options.duration * 1000;
+    nextReport = g_now + (uint64_t)g_options.interval * 1000;
+    wallStart = prv_wall_ms();
+    wallReport = wallStart;
+    while (g_eventCount > 0 && g_events[0].time <= end)
+    {
+        event_t event;
+
+        while (g_events[0].time > nextReport)
+        {
+            uint64_t wallNow = prv_wall_ms();
+
+            g_now = nextReport;
+            prv_report(wallNow - wallReport);
+            wallReport = wallNow;
+            nextReport += (uint64_t)g_options.interval * 1000;
+        }
+
+        prv_pop(&event);
+        g_now = event.time;
+
+        if (event.datagramP != NULL)
+        {
+            prv_deliver(event.datagramP);
+            free(event.datagramP);
+        }
+        else
+        {
+            // skip the steps rescheduled since
+            if (event.seq != event.nodeP->stepSeq) continue;
+            if (event.nodeP == &g_server)
+            {
+                g_serverSteps++;
+            }
+            else
+            {
+                g_clientSteps++;
+            }
+            prv_step(event.nodeP);
+        }
+        g_processed++;
+    }
+    g_now = end;
+    prv_report(prv_wall_ms() - wallReport);
+
+    fprintf(stdout, "%u simulated seconds in %.3f s\r\n", g_options.duration, (prv_wall_ms() - wallStart) / 1000.0);
+
+    // deregistrations are queued but never delivered
+    for (i = 0 ; i < g_options.clients ; i++)
+    {
+        lwm2m_close(g_clients[i].contextP);
+    }
+    free(g_clients);
+    lwm2m_close(g_server.contextP);
+    for (i = 0 ; i < g_eventCount ; i++)
+    {
+        free(g_events[i].datagramP);
+    }
+    free(g_events);
+
+    return 0;
+}
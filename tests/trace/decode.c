@@ -0,0 +1,118 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Renders the lwm2m_trace_record_t written by lwm2m_trace_dump() to a file,
+ * for instance by the 'trace' command of lwm2mserver. The file must be read
+ * on a host of the same endianness.
+ */
+
+#include "core/liblwm2m.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+static const char * prv_event_name(uint8_t event)
+{
+    switch (event)
+    {
+    case LWM2M_TRACE_RECEIVED:
+        return "received";
+    case LWM2M_TRACE_SENT:
+        return "sent";
+    case LWM2M_TRACE_RETRANSMITTED:
+        return "retransmitted";
+    case LWM2M_TRACE_PARSE_FAILED:
+        return "parse failed";
+    case LWM2M_TRACE_DUPLICATE:
+        return "duplicate";
+    case LWM2M_TRACE_RESPONSE:
+        return "response";
+    case LWM2M_TRACE_TIMEOUT:
+        return "timeout";
+    case LWM2M_TRACE_REGISTERED:
+        return "registered";
+    case LWM2M_TRACE_UPDATED:
+        return "updated";
+    case LWM2M_TRACE_DEREGISTERED:
+        return "deregistered";
+    case LWM2M_TRACE_EXPIRED:
+        return "expired";
+    default:
+        return "unknown";
+    }
+}
+
+static const char * prv_type_name(uint8_t type)
+{
+    switch (type)
+    {
+    case 0:
+        return "CON";
+    case 1:
+        return "NON";
+    case 2:
+        return "ACK";
+    case 3:
+        return "RST";
+    default:
+        return "???";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    FILE * fileP;
+    lwm2m_trace_record_t record;
+    uint64_t start = 0;
+    int count = 0;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: tracedecode FILE\r\n");
+        return 1;
+    }
+
+    fileP = fopen(argv[1], "rb");
+    if (fileP == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\r\n", argv[1]);
+        return 1;
+    }
+
+    printf("time (ms)\tevent\t\ttype\tcode\tmid\tid\r\n");
+    while (1 == fread(&record, sizeof(record), 1, fileP))
+    {
+        // times are relative to the first event
+        if (count == 0) start = record.time;
+
+        printf("%10llu\t%-14s\t%s\t%d.%02d\t%u\t%u\r\n",
+               (unsigned long long)(record.time - start),
+               prv_event_name(record.event),
+               prv_type_name(record.type),
+               record.code >> 5, record.code & 0x1F,
+               record.mid,
+               record.id);
+        count++;
+    }
+    fclose(fileP);
+
+    printf("%d events\r\n", count);
+
+    return 0;
+}
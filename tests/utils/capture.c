@@ -0,0 +1,166 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "liblwm2m.h"
+#include "capture.h"
+
+#define CAPTURE_MAGIC       "LWCP"
+#define CAPTURE_VERSION     1
+#define CAPTURE_HEADER_LEN  9
+
+typedef struct _capture_session_
+{
+    struct _capture_session_ * next;
+    void *      sessionH;
+    uint16_t    number;
+} capture_session_t;
+
+struct _capture_t
+{
+    FILE *              fileP;
+    uint64_t            start;
+    bool                started;
+    capture_session_t * sessionList;
+    uint16_t            sessionCount;
+};
+
+capture_t * capture_open(const char * path)
+{
+    capture_t * captureP;
+    uint8_t header[5];
+
+    captureP = (capture_t *)malloc(sizeof(capture_t));
+    if (captureP == NULL) return NULL;
+    memset(captureP, 0, sizeof(capture_t));
+
+    captureP->fileP = fopen(path, "wb");
+    if (captureP->fileP == NULL)
+    {
+        free(captureP);
+        return NULL;
+    }
+
+    memcpy(header, CAPTURE_MAGIC, 4);
+    header[4] = CAPTURE_VERSION;
+    fwrite(header, 1, sizeof(header), captureP->fileP);
+
+    return captureP;
+}
+
+void capture_close(capture_t * captureP)
+{
+    while (captureP->sessionList != NULL)
+    {
+        capture_session_t * sessionP;
+
+        sessionP = captureP->sessionList;
+        captureP->sessionList = sessionP->next;
+        free(sessionP);
+    }
+    fclose(captureP->fileP);
+    free(captureP);
+}
+
+static uint16_t prv_session_number(capture_t * captureP,
+                                   void * sessionH)
+{
+    capture_session_t * sessionP;
+
+    for (sessionP = captureP->sessionList ; sessionP != NULL ; sessionP = sessionP->next)
+    {
+        if (sessionP->sessionH == sessionH) return sessionP->number;
+    }
+
+    sessionP = (capture_session_t *)malloc(sizeof(capture_session_t));
+    if (sessionP == NULL) return 0xFFFF;
+    sessionP->sessionH = sessionH;
+    sessionP->number = captureP->sessionCount++;
+    sessionP->next = captureP->sessionList;
+    captureP->sessionList = sessionP;
+
+    return sessionP->number;
+}
+
+void capture_callback(void * sessionH,
+                      bool sent,
+                      uint8_t * buffer,
+                      size_t length,
+                      void * userData)
+{
+    capture_t * captureP = (capture_t *)userData;
+    uint8_t header[CAPTURE_HEADER_LEN];
+    uint64_t now;
+    uint32_t time;
+    uint16_t session;
+
+    if (length > CAPTURE_MAX_DATAGRAM) return;
+
+    now = lwm2m_gettime_ms();
+    if (!captureP->started)
+    {
+        captureP->start = now;
+        captureP->started = true;
+    }
+    time = (uint32_t)(now - captureP->start);
+    session = prv_session_number(captureP, sessionH);
+
+    header[0] = time & 0xFF;
+    header[1] = (time >> 8) & 0xFF;
+    header[2] = (time >> 16) & 0xFF;
+    header[3] = (time >> 24) & 0xFF;
+    header[4] = session & 0xFF;
+    header[5] = session >> 8;
+    header[6] = sent ? 1 : 0;
+    header[7] = length & 0xFF;
+    header[8] = length >> 8;
+
+    fwrite(header, 1, sizeof(header), captureP->fileP);
+    fwrite(buffer, 1, length, captureP->fileP);
+}
+
+int capture_read_header(FILE * fileP)
+{
+    uint8_t header[5];
+
+    if (fread(header, 1, sizeof(header), fileP) != sizeof(header)) return -1;
+    if (memcmp(header, CAPTURE_MAGIC, 4) != 0 || header[4] != CAPTURE_VERSION) return -1;
+
+    return 0;
+}
+
+int capture_read(FILE * fileP,
+                 capture_record_t * recordP,
+                 uint8_t * buffer)
+{
+    uint8_t header[CAPTURE_HEADER_LEN];
+    size_t result;
+
+    result = fread(header, 1, sizeof(header), fileP);
+    if (result == 0) return 0;
+    if (result != sizeof(header)) return -1;
+
+    recordP->time = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+    recordP->session = header[4] | (header[5] << 8);
+    recordP->sent = header[6] != 0;
+    recordP->length = header[7] | (header[8] << 8);
+
+    if (fread(buffer, 1, recordP->length, fileP) != recordP->length) return -1;
+
+    return 1;
+}
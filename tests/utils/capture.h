@@ -0,0 +1,58 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2014 Intel Corporation and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * The Eclipse Distribution License is available at
+ *    http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    David Navarro, Intel Corporation - Please refer to git log
+ *
+ *******************************************************************************/
+
+/*
+ * Capture files of the datagrams received and sent by a LWM2M context.
+ *
+ * A file starts with the 4 bytes "LWCP" followed by a version byte. Each
+ * datagram is then stored after a 9 bytes little-endian header: time in
+ * milliseconds since the first datagram (4 bytes), session number (2 bytes),
+ * direction (1 byte, 0 for received and 1 for sent) and length (2 bytes).
+ * Sessions are numbered in the order they appear.
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CAPTURE_MAX_DATAGRAM    0xFFFF
+
+typedef struct _capture_t capture_t;
+
+typedef struct
+{
+    uint32_t    time;       // milliseconds since the first datagram
+    uint16_t    session;
+    bool        sent;
+    uint16_t    length;
+} capture_record_t;
+
+capture_t * capture_open(const char * path);
+void capture_close(capture_t * captureP);
+// matches lwm2m_capture_callback_t, userData being the capture_t
+void capture_callback(void * sessionH, bool sent, uint8_t * buffer, size_t length, void * userData);
+
+// check the header of a capture file opened for reading
+int capture_read_header(FILE * fileP);
+// read the next datagram in buffer, of CAPTURE_MAX_DATAGRAM bytes. Return 1, 0 at the end of the file or -1 on error.
+int capture_read(FILE * fileP, capture_record_t * recordP, uint8_t * buffer);
+
+#endif
@@ -184,7 +184,7 @@ void output_buffer(FILE * stream,
     {
 
         fprintf(stream, "  ");
-        memcpy(array, buffer+i, 16);
+        memcpy(array, buffer+i, length-i < 16 ? length-i : 16);
 
         for (j = 0 ; j < 16 && i+j < length; j++)
         {